@@ -0,0 +1,96 @@
+#define _GNU_SOURCE
+
+#include "modules/battery.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "harness.h"
+#include "macros.h"
+#include "module.h"
+
+/* runs battery module against fake sysfs tree with uevents injected through a socket pair, fails when a uevent of
+   battery isn't rendered, reports latency from uevent to rendered text. Uevents of adapter and other devices,
+   capacity drift and re-added battery are checked by test/battery.c */
+
+#define BATTERY "BAT0"
+#define ADAPTER "AC"
+#define DEVPATH "/devices/platform/fake/power_supply/" BATTERY
+#define BATTERY_PATH "class/power_supply/" BATTERY
+#define ADAPTER_PATH "class/power_supply/" ADAPTER
+#define EVENTS_COUNT 2000
+#define INTERVAL "1h" /* fallback timer doesn't reread battery while latency is measured */
+#define MAX_VALUE_LENGTH 32
+
+static harness_attribute_t const attributes[] = {
+  {BATTERY_PATH, "type", "Battery"}, {BATTERY_PATH, "capacity", "80"}, {BATTERY_PATH, "status", "Discharging"},
+  {ADAPTER_PATH, "type", "Mains"},   {ADAPTER_PATH, "online", "0"},
+};
+
+/* adapter isn't configured, it's discovered by its type */
+static harness_fixture_options_t const options = {
+  .key = "battery",
+  .run = module_battery_run,
+  .config = "format = \"%capacity% %status% %ac%\"\nbattery = \"" BATTERY "\"\ninterval = \"" INTERVAL "\"",
+  .root_key = "sysfs_root",
+  .attributes = attributes,
+  .attributes_count = countof(attributes),
+  .initial_text = "80 discharging off",
+};
+
+static bool run_events(harness_fixture_t *fixture) {
+  static u64 latencies[EVENTS_COUNT];
+  char capacity[MAX_VALUE_LENGTH];
+  char expected[MAX_VALUE_LENGTH];
+
+  for (usize event_index = 0; event_index < EVENTS_COUNT; event_index++) {
+    /* every event changes rendered capacity, so rendered text proves module is done reading before next write */
+    long const percent = (long)(event_index * 37 % 101);
+
+    snprintf(capacity, sizeof(capacity), "%ld", percent);
+
+    if (!harness_write_attribute(fixture->root, BATTERY_PATH, "capacity", capacity)) {
+      fprintf(stderr, "failed to write capacity\n");
+      return false;
+    }
+
+    snprintf(expected, sizeof(expected), "%ld discharging off", percent);
+
+    u64 const start_time = bench_now();
+
+    if (!harness_send_uevent(&fixture->uevent_source, "change", DEVPATH, "power_supply")) {
+      fprintf(stderr, "failed to inject uevent\n");
+      return false;
+    }
+
+    latencies[event_index] = harness_wait_for_text(fixture->module, expected, start_time);
+
+    if (latencies[event_index] == 0) {
+      fprintf(stderr, "\"%s\" wasn't rendered after uevent %lu\n", expected, (unsigned long)event_index);
+      return false;
+    }
+  }
+
+  bench_report_latencies("battery/uevent_to_render", latencies, EVENTS_COUNT);
+
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  harness_fixture_t fixture;
+
+  if (!harness_fixture_construct(&fixture, &options)) {
+    return EXIT_FAILURE;
+  }
+
+  bool const is_passed = run_events(&fixture);
+
+  bench_report_value("battery/renders", "frames", (double)metrics_get(&fixture.module->metrics->renders));
+
+  return harness_fixture_destruct(&fixture) && is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+/* benchmark harness, included once by every benchmark executable:
+   bench_run reports median ns/op of BENCH_REPETITIONS runs and allocations/op counted
+   through malloc/calloc/realloc wrappers (linked with -Wl,--wrap), --json switches
+   output to one JSON object per line, bench_clock measures samples of a module run
+   over virtual clock, benchmarks driving the live session are opt-in */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "typedefs.h"
+#include "utils/fs.h"
+#include "utils/time.h"
+
+#define BENCH_REPETITIONS 5
+#define BENCH_LIVE_ENVIRONMENT "STATUS_LINE_BENCH_LIVE" /* "1" runs benchmarks changing live session state */
+
+/* keeps compiler from optimizing away value computed in benchmark loop */
+#define bench_keep(value) __asm__ volatile("" : : "g"(value) : "memory")
+
+typedef void (*bench_function_t)(void *context, u64 iterations);
+
+/* wraps virtual clock, a sample is time, allocations and counter between two waits */
+typedef struct bench_clock {
+  utils_time_clock_t clock;
+  utils_time_virtual_clock_t virtual_clock;
+  bool (*on_expired)(struct bench_clock *bench_clock); /* e.g rewrites fake procfs for next sample, null - none */
+  u64 (*get_counter)(void);                            /* e.g read syscalls, null - none */
+  void *context;
+  int abort_file_descriptor; /* written once end time is reached, like status line aborting module, -1 - none */
+  u64 sample_start; /* 0 - sample before next wait isn't measured, e.g first one including discovery */
+  u64 sample_time;  /* nanoseconds */
+  u64 allocations_start;
+  u64 sample_allocations;
+  u64 counter_start;
+  u64 sample_counter;
+  u64 samples_count; /* measured samples */
+  u64 waits_count;
+  bool is_failed; /* on_expired or writing abort file descriptor failed */
+} bench_clock_t;
+
+static bool bench_is_json = false;
+static u64 bench_allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  __atomic_fetch_add(&bench_allocations, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  __atomic_fetch_add(&bench_allocations, 1, __ATOMIC_RELAXED);
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+  __atomic_fetch_add(&bench_allocations, 1, __ATOMIC_RELAXED);
+  return __real_realloc(pointer, size);
+}
+
+static inline u64 bench_now(void) {
+  struct timespec current_time;
+  clock_gettime(CLOCK_MONOTONIC, &current_time);
+
+  return (u64)current_time.tv_sec * 1000000000UL + (u64)current_time.tv_nsec;
+}
+
+/* benchmarks changing state of the running session (e.g mixer volume, keyboard group) run only when asked to */
+static inline bool bench_is_live_allowed(char const *name) {
+  char const *live = getenv(BENCH_LIVE_ENVIRONMENT);
+
+  if (live != NULL && strcmp(live, "1") == 0) {
+    return true;
+  }
+
+  fprintf(stderr, "%s: changes live session state, skipped unless %s=1\n", name, BENCH_LIVE_ENVIRONMENT);
+
+  return false;
+}
+
+static inline bool bench_init(int argc, char *argv[]) {
+  for (int argument_index = 1; argument_index < argc; argument_index++) {
+    if (strcmp(argv[argument_index], "--json") == 0) {
+      bench_is_json = true;
+    } else {
+      fprintf(stderr, "usage: %s [--json]\n", argv[0]);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static inline int bench_compare(void const *first, void const *second) {
+  double const first_value = *(double const *)first;
+  double const second_value = *(double const *)second;
+
+  return (first_value > second_value) - (first_value < second_value);
+}
+
+static inline void bench_report(char const *name, u64 iterations, double ns_per_op, double allocations_per_op) {
+  if (bench_is_json) {
+    printf("{\"name\":\"%s\",\"iterations\":%lu,\"ns_per_op\":%.3f,\"allocations_per_op\":%.3f}\n", name,
+           (unsigned long)iterations, ns_per_op, allocations_per_op);
+  } else {
+    printf("%-48s %12lu ops %12.2f ns/op %8.2f allocs/op\n", name, (unsigned long)iterations, ns_per_op,
+           allocations_per_op);
+  }
+
+  fflush(stdout);
+}
+
+/* reports a single measured value (e.g counter of simulated run) instead of timed operation */
+static inline void bench_report_value(char const *name, char const *unit, double value) {
+  if (bench_is_json) {
+    printf("{\"name\":\"%s\",\"unit\":\"%s\",\"value\":%.3f}\n", name, unit, value);
+  } else {
+    printf("%-48s %12.3f %s\n", name, value, unit);
+  }
+
+  fflush(stdout);
+}
+
+static inline void bench_run(char const *name, bench_function_t function, void *context, u64 iterations) {
+  double ns_per_op[BENCH_REPETITIONS];
+  u64 allocations = 0;
+
+  /* warm up caches and branch predictors */
+  function(context, iterations / 10 + 1);
+
+  for (usize repetition = 0; repetition < BENCH_REPETITIONS; repetition++) {
+    u64 const allocations_start = __atomic_load_n(&bench_allocations, __ATOMIC_RELAXED);
+    u64 const start = bench_now();
+
+    function(context, iterations);
+
+    u64 const elapsed = bench_now() - start;
+
+    allocations = __atomic_load_n(&bench_allocations, __ATOMIC_RELAXED) - allocations_start;
+    ns_per_op[repetition] = (double)elapsed / (double)iterations;
+  }
+
+  qsort(ns_per_op, BENCH_REPETITIONS, sizeof(*ns_per_op), bench_compare);
+
+  bench_report(name, iterations, ns_per_op[BENCH_REPETITIONS / 2], (double)allocations / (double)iterations);
+}
+
+static inline int bench_compare_u64(void const *first, void const *second) {
+  u64 const first_value = *(u64 const *)first;
+  u64 const second_value = *(u64 const *)second;
+
+  return (first_value > second_value) - (first_value < second_value);
+}
+
+/* reports value of a scenario as "<scenario>/<name>" */
+static inline void bench_report_scenario(char const *scenario_name, char const *name, char const *unit, double value) {
+  char report_name[128];
+  snprintf(report_name, sizeof(report_name), "%s/%s", scenario_name, name);
+
+  bench_report_value(report_name, unit, value);
+}
+
+/* sorts latencies in nanoseconds and reports their median and 99th percentile in microseconds */
+static inline void bench_report_latencies(char const *name, u64 *latencies, usize count) {
+  qsort(latencies, count, sizeof(*latencies), bench_compare_u64);
+
+  bench_report_scenario(name, "p50", "us", (double)latencies[count / 2] / 1e3);
+  bench_report_scenario(name, "p99", "us", (double)latencies[count * 99 / 100] / 1e3);
+}
+
+/* read syscalls of process so far, from syscr in /proc/self/io */
+static inline u64 bench_get_read_syscalls(void) {
+  static char buffer[512];
+  static utils_fs_reader_t reader = {.file_descriptor = -1};
+
+  if (reader.file_descriptor == -1 && !utils_fs_reader_open(&reader, "/proc/self/io", buffer, sizeof(buffer))) {
+    return 0;
+  }
+
+  utils_fs_reader_refresh(&reader);
+
+  char const *syscr = strstr(buffer, "syscr: ");
+  i64 value = 0;
+
+  return syscr != NULL && utils_fs_parse_i64(syscr + strlen("syscr: "), &value) ? (u64)value : 0;
+}
+
+static inline u64 bench_clock_get_realtime(utils_time_clock_t *clock) {
+  bench_clock_t *bench_clock = (bench_clock_t *)clock;
+
+  return utils_time_clock_get_realtime(&bench_clock->virtual_clock.clock);
+}
+
+static inline bool bench_clock_timer_construct(utils_time_clock_t *clock, utils_time_timer_t *timer) {
+  bench_clock_t *bench_clock = (bench_clock_t *)clock;
+
+  return utils_time_clock_timer_construct(&bench_clock->virtual_clock.clock, timer);
+}
+
+static inline void bench_clock_timer_destruct(utils_time_clock_t *clock, utils_time_timer_t *timer) {
+  bench_clock_t *bench_clock = (bench_clock_t *)clock;
+
+  utils_time_clock_timer_destruct(&bench_clock->virtual_clock.clock, timer);
+}
+
+/* starts measuring sample before next wait */
+static inline void bench_clock_start_sample(bench_clock_t *bench_clock) {
+  bench_clock->counter_start = bench_clock->get_counter != NULL ? bench_clock->get_counter() : 0;
+  bench_clock->allocations_start = __atomic_load_n(&bench_allocations, __ATOMIC_RELAXED);
+  bench_clock->sample_start = bench_now();
+}
+
+static inline utils_time_wait_status_t bench_clock_wait_until(utils_time_clock_t *clock, utils_time_timer_t *timer,
+                                                              int file_descriptor, u64 deadline) {
+  bench_clock_t *bench_clock = (bench_clock_t *)clock;
+
+  if (bench_clock->sample_start != 0) {
+    bench_clock->sample_time += bench_now() - bench_clock->sample_start;
+    bench_clock->sample_allocations +=
+      __atomic_load_n(&bench_allocations, __ATOMIC_RELAXED) - bench_clock->allocations_start;
+
+    if (bench_clock->get_counter != NULL) {
+      bench_clock->sample_counter += bench_clock->get_counter() - bench_clock->counter_start;
+    }
+
+    bench_clock->samples_count += 1;
+  }
+
+  bench_clock->waits_count += 1;
+
+  utils_time_wait_status_t const status =
+    utils_time_clock_wait_until(&bench_clock->virtual_clock.clock, timer, file_descriptor, deadline);
+
+  if (status == UTILS_TIME_WAIT_EXPIRED && bench_clock->on_expired != NULL && !bench_clock->on_expired(bench_clock)) {
+    bench_clock->is_failed = true;
+    return UTILS_TIME_WAIT_FAILED;
+  }
+
+  if (status == UTILS_TIME_WAIT_READABLE && bench_clock->abort_file_descriptor != -1 &&
+      write(bench_clock->abort_file_descriptor, &(u64){1}, sizeof(u64)) != sizeof(u64)) {
+    bench_clock->is_failed = true;
+    return UTILS_TIME_WAIT_FAILED;
+  }
+
+  bench_clock_start_sample(bench_clock);
+
+  return status;
+}
+
+/* virtual clock from start to end time in nanoseconds, waits past end time end as readable */
+static inline void bench_clock_construct(bench_clock_t *bench_clock, u64 start_time, u64 end_time) {
+  *bench_clock = (bench_clock_t){
+    .clock =
+      {
+        .get_realtime = bench_clock_get_realtime,
+        .timer_construct = bench_clock_timer_construct,
+        .timer_destruct = bench_clock_timer_destruct,
+        .wait_until = bench_clock_wait_until,
+      },
+    .abort_file_descriptor = -1,
+  };
+
+  utils_time_virtual_clock_construct(&bench_clock->virtual_clock, start_time, end_time);
+}
@@ -0,0 +1,93 @@
+#define _GNU_SOURCE
+
+#include "modules/brightness.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "harness.h"
+#include "macros.h"
+#include "module.h"
+
+/* runs brightness module against fake sysfs tree with uevents injected through a socket pair, fails when a uevent
+   of the card isn't rendered, reports latency from uevent to rendered text. Skipping uevents of other devices and
+   re-adding the card are checked by test/brightness.c */
+
+#define CARD "fake_backlight"
+#define DEVPATH "/devices/platform/fake/backlight/" CARD
+#define DEVICE_PATH "class/backlight/" CARD
+#define EVENTS_COUNT 2000
+#define MAX_VALUE_LENGTH 24
+
+static harness_attribute_t const attributes[] = {
+  {DEVICE_PATH, "max_brightness", "1000"},
+  {DEVICE_PATH, "brightness", "500"},
+  {DEVICE_PATH, "actual_brightness", "500"},
+};
+
+static harness_fixture_options_t const options = {
+  .key = "brightness",
+  .run = module_brightness_run,
+  .config = "format = \"%value%\"\ncard = \"" CARD "\"",
+  .root_key = "sysfs_root",
+  .attributes = attributes,
+  .attributes_count = countof(attributes),
+  .initial_text = "50",
+};
+
+static bool run_events(harness_fixture_t *fixture) {
+  static u64 latencies[EVENTS_COUNT];
+  char brightness[MAX_VALUE_LENGTH];
+  char expected[MAX_VALUE_LENGTH];
+
+  for (usize event_index = 0; event_index < EVENTS_COUNT; event_index++) {
+    /* every event changes rendered percent, so rendered text proves module is done reading before next write */
+    long const percent = (long)(event_index * 37 % 101);
+
+    snprintf(brightness, sizeof(brightness), "%ld", percent * 10);
+
+    if (!harness_write_attribute(fixture->root, DEVICE_PATH, "actual_brightness", brightness)) {
+      fprintf(stderr, "failed to write brightness\n");
+      return false;
+    }
+
+    snprintf(expected, sizeof(expected), "%ld", percent);
+
+    u64 const start_time = bench_now();
+
+    if (!harness_send_uevent(&fixture->uevent_source, "change", DEVPATH, "backlight")) {
+      fprintf(stderr, "failed to inject uevent\n");
+      return false;
+    }
+
+    latencies[event_index] = harness_wait_for_text(fixture->module, expected, start_time);
+
+    if (latencies[event_index] == 0) {
+      fprintf(stderr, "brightness %s wasn't rendered after uevent %lu\n", expected, (unsigned long)event_index);
+      return false;
+    }
+  }
+
+  bench_report_latencies("brightness/uevent_to_render", latencies, EVENTS_COUNT);
+
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  harness_fixture_t fixture;
+
+  if (!harness_fixture_construct(&fixture, &options)) {
+    return EXIT_FAILURE;
+  }
+
+  bool const is_passed = run_events(&fixture);
+
+  bench_report_value("brightness/renders", "frames", (double)metrics_get(&fixture.module->metrics->renders));
+
+  return harness_fixture_destruct(&fixture) && is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
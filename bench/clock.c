@@ -0,0 +1,184 @@
+#define _GNU_SOURCE
+
+#include "modules/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench.h"
+#include "macros.h"
+#include "module.h"
+#include "status_line.h"
+#include "toml.h"
+#include "utils/time.h"
+
+/* runs clock module over virtual clock and reports time and allocations per wakeup, then against system clock in
+   real time and reports how late wakeups land after their deadline. Wakeup counts, boundaries and rendered text
+   are checked by test/clock.c */
+
+#define NANOSECONDS 1000000000UL
+#define HOUR 3600UL
+#define FORMAT "%Y-%m-%d %H:%M:%S"
+#define START_TIME 1767225600UL  /* 2026-01-01 00:00:00 UTC */
+#define SYSTEM_DURATION 5        /* seconds */
+#define MAX_LATENESS 100000000UL /* nanoseconds, timerfd wakeup later than that is a missed deadline */
+
+typedef struct lateness_clock {
+  utils_time_clock_t clock; /* measures how late waits of system clock expire */
+  u64 end_time;             /* nanoseconds, waits past it end as readable */
+  u64 max_lateness;         /* nanoseconds between deadline and wakeup */
+  u64 total_lateness;
+  u64 wait_count;
+} lateness_clock_t;
+
+static u64 lateness_clock_get_realtime(utils_time_clock_t *clock) {
+  (void)clock;
+
+  return utils_time_clock_get_realtime(utils_time_get_system_clock());
+}
+
+static bool lateness_clock_timer_construct(utils_time_clock_t *clock, utils_time_timer_t *timer) {
+  (void)clock;
+
+  return utils_time_clock_timer_construct(utils_time_get_system_clock(), timer);
+}
+
+static void lateness_clock_timer_destruct(utils_time_clock_t *clock, utils_time_timer_t *timer) {
+  (void)clock;
+
+  utils_time_clock_timer_destruct(utils_time_get_system_clock(), timer);
+}
+
+static utils_time_wait_status_t lateness_clock_wait_until(utils_time_clock_t *clock, utils_time_timer_t *timer,
+                                                          int file_descriptor, u64 deadline) {
+  lateness_clock_t *lateness_clock = (lateness_clock_t *)clock;
+
+  if (deadline >= lateness_clock->end_time) {
+    return UTILS_TIME_WAIT_READABLE;
+  }
+
+  utils_time_wait_status_t const status =
+    utils_time_clock_wait_until(utils_time_get_system_clock(), timer, file_descriptor, deadline);
+
+  if (status != UTILS_TIME_WAIT_EXPIRED) {
+    return status;
+  }
+
+  u64 const realtime = utils_time_clock_get_realtime(utils_time_get_system_clock());
+  u64 const lateness = realtime > deadline ? realtime - deadline : 0;
+
+  if (lateness > lateness_clock->max_lateness) {
+    lateness_clock->max_lateness = lateness;
+  }
+
+  lateness_clock->total_lateness += lateness;
+  lateness_clock->wait_count += 1;
+
+  return status;
+}
+
+static bool run_module(char const *name, utils_time_clock_t *clock) {
+  bool status = false;
+  toml_table_t *config = toml_parse((char[]){"format = \"" FORMAT "\"\ninterval = 1\n"}, NULL, 0);
+
+  if (config == NULL) {
+    fprintf(stderr, "%s: failed to parse config\n", name);
+    return false;
+  }
+
+  status_line_t status_line = {0};
+
+  if (!status_line_construct(&status_line, 1, STATUS_LINE_OUTPUT_NULL)) {
+    goto free_config;
+  }
+
+  status_line.clock = clock;
+
+  module_t *module = &status_line.modules[0];
+
+  if (!module_construct(module, &status_line, "clock", config) || module_clock_run(module) != EXIT_SUCCESS) {
+    fprintf(stderr, "%s: clock module failed\n", name);
+    goto free_status_line;
+  }
+
+  status = true;
+
+free_status_line:
+  status_line_destruct(&status_line);
+
+free_config:
+  toml_free(config);
+
+  return status;
+}
+
+/* every wakeup of a seconds format renders, formats time and updates module */
+static bool run_virtual(void) {
+  u64 const start_time = START_TIME * NANOSECONDS;
+  bench_clock_t bench_clock;
+
+  bench_clock_construct(&bench_clock, start_time, start_time + HOUR * NANOSECONDS);
+
+  if (!run_module("clock/1s/utc/1h", &bench_clock.clock)) {
+    return false;
+  }
+
+  double const samples = (double)bench_clock.samples_count;
+
+  bench_report_value("clock/1s/utc/1h/wakeup", "us/wakeup", (double)bench_clock.sample_time / 1e3 / samples);
+  bench_report_value("clock/1s/utc/1h/allocations", "allocs/wakeup",
+                     (double)bench_clock.sample_allocations / samples);
+
+  return true;
+}
+
+/* real timerfd wakeups */
+static bool run_system(void) {
+  lateness_clock_t lateness_clock = {
+    .clock =
+      {
+        .get_realtime = lateness_clock_get_realtime,
+        .timer_construct = lateness_clock_timer_construct,
+        .timer_destruct = lateness_clock_timer_destruct,
+        .wait_until = lateness_clock_wait_until,
+      },
+    .end_time = utils_time_clock_get_realtime(utils_time_get_system_clock()) + SYSTEM_DURATION * NANOSECONDS,
+  };
+
+  if (!run_module("clock/1s/system", &lateness_clock.clock)) {
+    return false;
+  }
+
+  u64 const waits = lateness_clock.wait_count;
+
+  bench_report_value("clock/1s/system/max_lateness", "us", (double)lateness_clock.max_lateness / 1e3);
+  bench_report_value("clock/1s/system/mean_lateness", "us",
+                     waits != 0 ? (double)lateness_clock.total_lateness / (double)waits / 1e3 : 0.0);
+
+  /* second boundaries strictly inside duration, the wait for the one at its end ends as readable */
+  if (waits + 1 < SYSTEM_DURATION || waits > SYSTEM_DURATION) {
+    fprintf(stderr, "clock/1s/system: %lu wakeups in %d s\n", (unsigned long)waits, SYSTEM_DURATION);
+    return false;
+  }
+
+  if (lateness_clock.max_lateness > MAX_LATENESS) {
+    fprintf(stderr, "clock/1s/system: woke up %.3f ms late\n", (double)lateness_clock.max_lateness / 1e6);
+    return false;
+  }
+
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  setenv("TZ", "UTC", 1);
+  tzset();
+
+  bool const is_passed = run_virtual() && run_system();
+
+  return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
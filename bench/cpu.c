@@ -0,0 +1,185 @@
+#include "modules/cpu.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "macros.h"
+#include "module.h"
+#include "status_line.h"
+#include "toml.h"
+#include "utils/time.h"
+
+/* runs cpu module over virtual clock against fake /proc/stat of CORES_COUNT cores, stat file is rewritten with
+   advanced counters inside every wait, so time between waits covers read, scan, deltas, render and update of one
+   sample only. Fails when rendered aggregate usage or heat string length differ from written counters */
+
+#define NANOSECONDS 1000000000UL
+#define CORES_COUNT 256
+#define SAMPLES_COUNT 2000
+#define JIFFIES_PER_INTERVAL 100 /* per core, USER_HZ of a second */
+#define START_TIME 1767225600UL  /* 2026-01-01 00:00:00 UTC */
+
+/* fake /proc/stat rewritten with advanced counters inside every wait */
+typedef struct fake_stat {
+  char const *path;
+  u64 busy[CORES_COUNT]; /* jiffies written so far */
+  u64 total[CORES_COUNT];
+  u8 usage; /* aggregate percent of last written interval */
+} fake_stat_t;
+
+/* busy share of core moves every interval, so top cores and heat string change from sample to sample */
+static bool write_stat(fake_stat_t *fake_stat, u64 interval_index) {
+  FILE *file = fopen(fake_stat->path, "w");
+
+  if (file == NULL) {
+    return false;
+  }
+
+  u64 busy_delta_sum = 0;
+
+  for (usize core_index = 0; core_index < CORES_COUNT; core_index++) {
+    u64 const busy_delta = (core_index * 37 + interval_index * 11) % (JIFFIES_PER_INTERVAL + 1);
+
+    fake_stat->busy[core_index] += busy_delta;
+    fake_stat->total[core_index] += JIFFIES_PER_INTERVAL;
+    busy_delta_sum += busy_delta;
+  }
+
+  fake_stat->usage =
+    (u8)((busy_delta_sum * 100 + CORES_COUNT * JIFFIES_PER_INTERVAL / 2) / (CORES_COUNT * JIFFIES_PER_INTERVAL));
+
+  u64 busy = 0;
+  u64 total = 0;
+
+  for (usize core_index = 0; core_index < CORES_COUNT; core_index++) {
+    busy += fake_stat->busy[core_index];
+    total += fake_stat->total[core_index];
+  }
+
+  /* user nice system idle iowait irq softirq steal guest guest_nice */
+  fprintf(file, "cpu  %lu 0 0 %lu 0 0 0 0 0 0\n", (unsigned long)busy, (unsigned long)(total - busy));
+
+  for (usize core_index = 0; core_index < CORES_COUNT; core_index++) {
+    fprintf(file, "cpu%lu %lu 0 0 %lu 0 0 0 0 0 0\n", (unsigned long)core_index,
+            (unsigned long)fake_stat->busy[core_index],
+            (unsigned long)(fake_stat->total[core_index] - fake_stat->busy[core_index]));
+  }
+
+  fprintf(file, "intr 123456 0 0 0\nctxt 654321\nbtime %lu\nprocesses 4242\n", START_TIME);
+
+  return fclose(file) == 0;
+}
+
+static bool rewrite_stat(bench_clock_t *bench_clock) {
+  return write_stat(bench_clock->context, bench_clock->virtual_clock.wait_count);
+}
+
+/* rendered text is "<usage> <top> <heat>" */
+static bool check_text(module_t *module, fake_stat_t const *fake_stat) {
+  char expected_usage[8];
+  snprintf(expected_usage, sizeof(expected_usage), "%u ", fake_stat->usage);
+
+  pthread_mutex_lock(&module->lock);
+  char const *heat = module->buffer != NULL ? strrchr(module->buffer, ' ') : NULL;
+  bool const is_valid = heat != NULL && strncmp(module->buffer, expected_usage, strlen(expected_usage)) == 0 &&
+                        strlen(heat + 1) == CORES_COUNT;
+  pthread_mutex_unlock(&module->lock);
+
+  return is_valid;
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_FAILURE;
+  char root[] = "/tmp/status_line_cpu_XXXXXX";
+
+  if (mkdtemp(root) == NULL) {
+    fprintf(stderr, "failed to create fake procfs\n");
+    return EXIT_FAILURE;
+  }
+
+  char stat_path[sizeof(root) + sizeof("/stat")];
+  snprintf(stat_path, sizeof(stat_path), "%s/stat", root);
+
+  static fake_stat_t fake_stat;
+  fake_stat.path = stat_path;
+
+  u64 const start_time = START_TIME * NANOSECONDS;
+  bench_clock_t bench_clock;
+
+  /* first sample includes opening stat and isn't measured, waits for SAMPLES_COUNT boundaries expire, the one after
+     them ends as readable */
+  bench_clock_construct(&bench_clock, start_time, start_time + (SAMPLES_COUNT + 1) * NANOSECONDS);
+  bench_clock.on_expired = rewrite_stat;
+  bench_clock.context = &fake_stat;
+
+  if (!write_stat(&fake_stat, 0)) {
+    fprintf(stderr, "failed to write fake stat\n");
+    goto remove_root;
+  }
+
+  char config_string[256];
+  snprintf(config_string, sizeof(config_string),
+           "format = \"%%usage%% %%top%% %%heat%%\"\ninterval = \"1s\"\nprocfs_root = \"%s\"\n", root);
+
+  toml_table_t *config = toml_parse(config_string, NULL, 0);
+
+  if (config == NULL) {
+    fprintf(stderr, "failed to parse config\n");
+    goto remove_root;
+  }
+
+  status_line_t status_line = {0};
+
+  if (!status_line_construct(&status_line, 1, STATUS_LINE_OUTPUT_NULL)) {
+    goto free_config;
+  }
+
+  status_line.clock = &bench_clock.clock;
+
+  module_t *module = &status_line.modules[0];
+
+  if (!module_construct(module, &status_line, "cpu", config) || module_cpu_run(module) != EXIT_SUCCESS ||
+      bench_clock.is_failed) {
+    fprintf(stderr, "cpu: module failed\n");
+    goto free_status_line;
+  }
+
+  if (bench_clock.samples_count != SAMPLES_COUNT) {
+    fprintf(stderr, "cpu: %lu samples, expected %d\n", (unsigned long)bench_clock.samples_count, SAMPLES_COUNT);
+    goto free_status_line;
+  }
+
+  if (!check_text(module, &fake_stat)) {
+    fprintf(stderr, "cpu: rendered text doesn't match last interval (usage %u)\n", fake_stat.usage);
+    goto free_status_line;
+  }
+
+  double const samples = (double)bench_clock.samples_count;
+
+  bench_report_value("cpu/256_cores/sample", "us/sample", (double)bench_clock.sample_time / 1e3 / samples);
+  bench_report_value("cpu/256_cores/allocations", "allocs/sample", (double)bench_clock.sample_allocations / samples);
+  bench_report_value("cpu/256_cores/updates", "updates",
+                     (double)metrics_get(&status_line.metrics.modules[0].updates));
+
+  status = EXIT_SUCCESS;
+
+free_status_line:
+  status_line_destruct(&status_line);
+
+free_config:
+  toml_free(config);
+
+remove_root:
+  unlink(stat_path);
+  rmdir(root);
+
+  return status;
+}
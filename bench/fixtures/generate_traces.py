@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+# Generates replay fixtures for modules configured in replay.toml (see include/trace.h for layout).
+# Payloads are records of module event sources, as defined next to replay function of each module.
+
+import struct
+import sys
+from pathlib import Path
+
+MODULES = ["clock", "brightness", "sound", "keyboard"]
+CLOCK, BRIGHTNESS, SOUND, KEYBOARD = range(len(MODULES))
+START_TIME = 1767225600  # 2026-01-01 00:00:00 UTC
+
+CAPSLOCK, NUMLOCK = 1, 2
+GROUP_STATE = 16  # XCB_XKB_STATE_PART_GROUP_STATE
+
+# record types, first byte of payload
+SOUND_ELEMENT, SOUND_UPDATE = range(2)
+KEYBOARD_KEYMAP, KEYBOARD_INDICATOR, KEYBOARD_STATE, KEYBOARD_UPDATE = range(4)
+BRIGHTNESS_BRIGHTNESS, BRIGHTNESS_REMOVE, BRIGHTNESS_UPDATE = range(3)
+
+
+class Trace:
+    def __init__(self, path):
+        self.file = open(path, "wb")
+        self.time_us = 0
+        self.file.write(b"SLTRACE2")
+        self.file.write(struct.pack("<H", len(MODULES)))
+
+        for key in MODULES:
+            self.file.write(struct.pack("<B", len(key)) + key.encode())
+
+    def event(self, time_us, module, payload):
+        self.file.write(struct.pack("<IHH", time_us - self.time_us, module, len(payload)) + payload)
+        self.time_us = time_us
+
+    def clock(self, time_us):
+        self.event(time_us, CLOCK, struct.pack("<q", START_TIME + time_us // 1000000))
+
+    def sound(self, time_us, volume, is_unmuted):
+        # element of the only control: index, is_removed, min, max, volume and switch, rendered right away
+        self.event(time_us, SOUND, struct.pack("<BHBqqqB", SOUND_ELEMENT, 0, 0, 0, 65536, volume, is_unmuted))
+        self.event(time_us, SOUND, struct.pack("<B", SOUND_UPDATE))
+
+    def keymap(self, time_us, group, indicators, names, symbols):
+        payload = struct.pack("<BBIB", KEYBOARD_KEYMAP, group, indicators, len(names))
+        payload += b"".join(name.encode() + b"\0" for name in names) + symbols.encode() + b"\0"
+        self.event(time_us, KEYBOARD, payload)
+
+    def indicators(self, time_us, state_changed, state):
+        self.event(time_us, KEYBOARD, struct.pack("<BII", KEYBOARD_INDICATOR, state_changed, state))
+
+    def group(self, time_us, group):
+        self.event(time_us, KEYBOARD, struct.pack("<BHB", KEYBOARD_STATE, GROUP_STATE, group))
+
+    def keyboard_update(self, time_us):
+        self.event(time_us, KEYBOARD, struct.pack("<B", KEYBOARD_UPDATE))
+
+    def brightness(self, time_us, value):
+        # max_brightness of 100, brightness is percent
+        self.event(time_us, BRIGHTNESS, struct.pack("<Bqq", BRIGHTNESS_BRIGHTNESS, value, 100))
+        self.event(time_us, BRIGHTNESS, struct.pack("<B", BRIGHTNESS_UPDATE))
+
+    def close(self):
+        self.file.close()
+
+
+LAYOUTS = ["English (US)", "Russian", "German"]
+SYMBOLS = "pc+us+ru:2+de:3+inet(evdev)"
+
+
+def initial_state(trace):
+    trace.clock(0)
+    trace.brightness(0, 60)
+    trace.sound(0, 32768, 1)
+    trace.keymap(0, 0, NUMLOCK, LAYOUTS, SYMBOLS)
+    trace.keyboard_update(0)
+
+
+def volume_storm(path):
+    """volume slider dragged back and forth for 10 s, reporting every 2 ms, with mute toggles"""
+    trace = Trace(path)
+    initial_state(trace)
+
+    next_clock_us = 1000000
+
+    for step in range(5000):
+        time_us = 1000 + step * 2000
+
+        while next_clock_us <= time_us:
+            trace.clock(next_clock_us)
+            next_clock_us += 1000000
+
+        position = step % 400
+        volume = (position if position < 200 else 400 - position) * 65536 // 200
+        is_unmuted = 0 if step % 1000 >= 950 else 1
+
+        trace.sound(time_us, volume, is_unmuted)
+
+    trace.close()
+
+
+def layout_switch(path):
+    """layout toggled between three groups every 5 ms for 10 s, with caps lock flicker"""
+    trace = Trace(path)
+    initial_state(trace)
+
+    next_clock_us = 1000000
+    indicators = NUMLOCK
+
+    for step in range(2000):
+        time_us = 1000 + step * 5000
+
+        while next_clock_us <= time_us:
+            trace.clock(next_clock_us)
+            next_clock_us += 1000000
+
+        next_indicators = NUMLOCK | (CAPSLOCK if step % 7 == 0 else 0)
+
+        trace.group(time_us, step % len(LAYOUTS))
+
+        if next_indicators != indicators:
+            trace.indicators(time_us, next_indicators ^ indicators, next_indicators)
+            indicators = next_indicators
+
+        trace.keyboard_update(time_us)
+
+        if step % 100 == 0:
+            trace.brightness(time_us + 500, 20 + step // 100 * 4)
+
+    trace.close()
+
+
+def main():
+    directory = Path(sys.argv[1]) if len(sys.argv) > 1 else Path(__file__).parent
+
+    volume_storm(directory / "volume_storm.trace")
+    layout_switch(directory / "layout_switch.trace")
+
+
+if __name__ == "__main__":
+    main()
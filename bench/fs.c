@@ -0,0 +1,209 @@
+#include "utils/fs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "bench.h"
+#include "macros.h"
+
+/* single-integer pseudo-files present on every linux system, standing in for sysfs attributes */
+#define FIRST_FILE_PATH "/proc/sys/kernel/pid_max"
+#define SECOND_FILE_PATH "/proc/sys/kernel/threads-max"
+#define ITERATIONS 200000UL
+#define BATCH_READS 2000000UL /* reads per batch run, split into ticks of batch size */
+
+typedef struct bench_readers {
+  utils_fs_reader_t readers[2];
+  char buffers[2][32];
+} bench_readers_t;
+
+static void bench_read_file(void *param, u64 iterations) {
+  (void)param;
+
+  for (u64 iteration = 0; iteration < iterations; iteration++) {
+    char *first = utils_fs_read_file(FIRST_FILE_PATH, 31);
+    char *second = utils_fs_read_file(SECOND_FILE_PATH, 31);
+
+    bench_keep(atol(first) + atol(second));
+
+    free(first);
+    free(second);
+  }
+}
+
+static void bench_reader_refresh(void *param, u64 iterations) {
+  bench_readers_t *context = param;
+
+  for (u64 iteration = 0; iteration < iterations; iteration++) {
+    i64 first = 0, second = 0;
+
+    utils_fs_reader_refresh(&context->readers[0]);
+    utils_fs_reader_refresh(&context->readers[1]);
+    utils_fs_reader_get_i64(&context->readers[0], &first);
+    utils_fs_reader_get_i64(&context->readers[1], &second);
+
+    bench_keep(first + second);
+  }
+}
+
+static void bench_reader_refresh_all(void *param, u64 iterations) {
+  bench_readers_t *context = param;
+
+  for (u64 iteration = 0; iteration < iterations; iteration++) {
+    i64 first = 0, second = 0;
+
+    utils_fs_reader_refresh_all(context->readers, countof(context->readers));
+    utils_fs_reader_get_i64(&context->readers[0], &first);
+    utils_fs_reader_get_i64(&context->readers[1], &second);
+
+    bench_keep(first + second);
+  }
+}
+
+/* one tick samples every file of batch */
+static void bench_batch_refresh(void *param, u64 iterations) {
+  utils_fs_batch_t *batch = param;
+
+  for (u64 iteration = 0; iteration < iterations; iteration++) {
+    i64 sum = 0;
+
+    utils_fs_batch_refresh(batch);
+
+    for (usize reader_index = 0; reader_index < batch->readers_count; reader_index++) {
+      i64 value = 0;
+      utils_fs_reader_get_i64(&batch->readers[reader_index], &value);
+      sum += value;
+    }
+
+    bench_keep(sum);
+  }
+}
+
+static void bench_parse_i64(void *param, u64 iterations) {
+  (void)param;
+
+  for (u64 iteration = 0; iteration < iterations; iteration++) {
+    i64 value = 0;
+    utils_fs_parse_i64("4194304\n", &value);
+
+    bench_keep(value);
+  }
+}
+
+/* reports read syscalls per sample of both files, subtracting syscalls of measurement itself */
+static void report_syscalls(char const *name, bench_function_t function, void *context, u64 iterations) {
+  u64 const overhead_start = bench_get_read_syscalls();
+  u64 const overhead = bench_get_read_syscalls() - overhead_start;
+
+  u64 const start = bench_get_read_syscalls();
+  function(context, iterations);
+  u64 const syscalls = bench_get_read_syscalls() - start - overhead;
+
+  bench_report_scenario(name, "read_syscalls", "syscalls/sample", (double)syscalls / (double)iterations);
+}
+
+/* samples the same file through files_count descriptors per tick, with pread per file and one io_uring batch */
+static bool run_batch(usize files_count) {
+  bool status = false;
+  utils_fs_reader_t *readers = calloc(files_count, sizeof(*readers));
+  char(*buffers)[32] = calloc(files_count, sizeof(*buffers));
+  usize opened_count = 0;
+
+  if (readers == NULL || buffers == NULL) {
+    goto free_readers;
+  }
+
+  for (; opened_count < files_count; opened_count++) {
+    if (!utils_fs_reader_open(&readers[opened_count], FIRST_FILE_PATH, buffers[opened_count], sizeof(buffers[0]))) {
+      fprintf(stderr, "failed to open %s %lu times\n", FIRST_FILE_PATH, (unsigned long)files_count);
+      goto close_readers;
+    }
+  }
+
+  u64 const iterations = BATCH_READS / files_count;
+
+  for (usize backend_index = 0; backend_index < 2; backend_index++) {
+    utils_fs_batch_t batch;
+    char name[128];
+
+    utils_fs_batch_construct(&batch, readers, files_count, backend_index != 0);
+
+    if (backend_index != 0 && batch.backend != UTILS_FS_BATCH_BACKEND_IO_URING) {
+      fprintf(stderr, "io_uring unavailable, skipping fs/batch_refresh/io_uring/%lu_files\n", (unsigned long)files_count);
+      utils_fs_batch_destruct(&batch);
+      continue;
+    }
+
+    snprintf(name, sizeof(name), "fs/batch_refresh/%s/%lu_files", utils_fs_batch_get_backend_name(&batch),
+             (unsigned long)files_count);
+
+    bench_run(name, bench_batch_refresh, &batch, iterations);
+    report_syscalls(name, bench_batch_refresh, &batch, iterations);
+
+    utils_fs_batch_destruct(&batch);
+  }
+
+  status = true;
+
+close_readers:
+  for (usize reader_index = 0; reader_index < opened_count; reader_index++) {
+    utils_fs_reader_close(&readers[reader_index]);
+  }
+
+free_readers:
+  free(readers);
+  free(buffers);
+
+  return status;
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  bench_readers_t readers;
+
+  if (!utils_fs_reader_open(&readers.readers[0], FIRST_FILE_PATH, readers.buffers[0], sizeof(readers.buffers[0])) ||
+      !utils_fs_reader_open(&readers.readers[1], SECOND_FILE_PATH, readers.buffers[1], sizeof(readers.buffers[1]))) {
+    fprintf(stderr, "failed to open %s and %s\n", FIRST_FILE_PATH, SECOND_FILE_PATH);
+    return EXIT_FAILURE;
+  }
+
+  /* fopen, read, close and two allocations per file */
+  bench_run("fs/read_file/2_files", bench_read_file, NULL, ITERATIONS);
+  report_syscalls("fs/read_file/2_files", bench_read_file, NULL, ITERATIONS);
+
+  /* one pread per file */
+  bench_run("fs/reader_refresh/2_files", bench_reader_refresh, &readers, ITERATIONS);
+  report_syscalls("fs/reader_refresh/2_files", bench_reader_refresh, &readers, ITERATIONS);
+
+  bench_run("fs/reader_refresh_all/2_files", bench_reader_refresh_all, &readers, ITERATIONS);
+  report_syscalls("fs/reader_refresh_all/2_files", bench_reader_refresh_all, &readers, ITERATIONS);
+
+  bench_run("fs/parse_i64", bench_parse_i64, NULL, ITERATIONS * 10);
+
+  utils_fs_reader_close(&readers.readers[0]);
+  utils_fs_reader_close(&readers.readers[1]);
+
+  /* 1000 files need more than default soft limit of 1024 descriptors with ring and stdio */
+  struct rlimit limit;
+
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  static usize const files_counts[] = {10, 100, 1000};
+  int status = EXIT_SUCCESS;
+
+  for (usize count_index = 0; count_index < countof(files_counts); count_index++) {
+    if (!run_batch(files_counts[count_index])) {
+      status = EXIT_FAILURE;
+    }
+  }
+
+  return status;
+}
@@ -0,0 +1,157 @@
+#include "modules/keyboard.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <xcb/xkb.h>
+
+#include "bench.h"
+#include "harness.h"
+#include "macros.h"
+#include "module.h"
+#include "status_line.h"
+#include "toml.h"
+
+/* locks keyboard groups of the X server in DISPLAY one after another and reports latency from the request to
+   module update, original group is locked again at the end. Layout of the live session switches while it runs, so
+   it's skipped unless STATUS_LINE_BENCH_LIVE=1 and without X server or with a single layout */
+
+#define SWITCHES_COUNT 1000
+#define UPDATE_TIMEOUT 1000000000UL /* nanoseconds */
+
+/* returns nanoseconds until updates counter moves past updates, 0 on timeout */
+static u64 wait_for_update(metrics_module_t *metrics, u64 updates, u64 start_time) {
+  while (metrics_get(&metrics->updates) <= updates) {
+    if (bench_now() - start_time > UPDATE_TIMEOUT) {
+      return 0;
+    }
+  }
+
+  return bench_now() - start_time;
+}
+
+static bool get_groups(xcb_connection_t *connection, u8 *groups_count, u8 *group) {
+  xcb_xkb_use_extension_reply_t *extension_reply =
+    xcb_xkb_use_extension_reply(connection, xcb_xkb_use_extension(connection, 1, 0), NULL);
+  bool const is_supported = extension_reply != NULL && extension_reply->supported;
+
+  free(extension_reply);
+
+  if (!is_supported) {
+    return false;
+  }
+
+  xcb_xkb_get_names_cookie_t const names_cookie =
+    xcb_xkb_get_names(connection, XCB_XKB_ID_USE_CORE_KBD, XCB_XKB_NAME_DETAIL_GROUP_NAMES);
+  xcb_xkb_get_state_cookie_t const state_cookie = xcb_xkb_get_state(connection, XCB_XKB_ID_USE_CORE_KBD);
+  xcb_xkb_get_names_reply_t *names_reply = xcb_xkb_get_names_reply(connection, names_cookie, NULL);
+  xcb_xkb_get_state_reply_t *state_reply = xcb_xkb_get_state_reply(connection, state_cookie, NULL);
+  bool const is_received = names_reply != NULL && state_reply != NULL;
+
+  if (is_received) {
+    *groups_count = (u8)__builtin_popcount(names_reply->groupNames);
+    *group = state_reply->lockedGroup;
+  }
+
+  free(names_reply);
+  free(state_reply);
+
+  return is_received;
+}
+
+static void lock_group(xcb_connection_t *connection, u8 group) {
+  xcb_xkb_latch_lock_state(connection, XCB_XKB_ID_USE_CORE_KBD, 0, 0, 1, group, 0, 0, 0);
+  xcb_flush(connection);
+}
+
+static bool run_switches(xcb_connection_t *connection, metrics_module_t *metrics, u8 groups_count, u8 group) {
+  static u64 latencies[SWITCHES_COUNT];
+
+  for (usize switch_index = 0; switch_index < SWITCHES_COUNT; switch_index++) {
+    u64 const updates = metrics_get(&metrics->updates);
+    u64 const start_time = bench_now();
+
+    group = (u8)((group + 1) % groups_count);
+    lock_group(connection, group);
+
+    latencies[switch_index] = wait_for_update(metrics, updates, start_time);
+
+    if (latencies[switch_index] == 0) {
+      fprintf(stderr, "keyboard: group %u wasn't rendered after switch %lu\n", group, (unsigned long)switch_index);
+      return false;
+    }
+  }
+
+  bench_report_latencies("keyboard/switch_to_update", latencies, SWITCHES_COUNT);
+
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  if (!bench_is_live_allowed("keyboard")) {
+    return EXIT_SUCCESS;
+  }
+
+  int status = EXIT_FAILURE;
+  xcb_connection_t *connection = xcb_connect(NULL, NULL);
+  u8 groups_count = 0;
+  u8 group = 0;
+
+  if (xcb_connection_has_error(connection) || !get_groups(connection, &groups_count, &group)) {
+    fprintf(stderr, "keyboard: no X server with XKB, skipped\n");
+    status = EXIT_SUCCESS;
+    goto disconnect;
+  }
+
+  if (groups_count < 2) {
+    fprintf(stderr, "keyboard: single keyboard layout, skipped\n");
+    status = EXIT_SUCCESS;
+    goto disconnect;
+  }
+
+  toml_table_t *config = toml_parse((char[]){"format = \"%symbol% %name%\"\n"}, NULL, 0);
+
+  if (config == NULL) {
+    fprintf(stderr, "failed to parse config\n");
+    goto disconnect;
+  }
+
+  status_line_t status_line = {0};
+
+  if (!status_line_construct(&status_line, 1, STATUS_LINE_OUTPUT_NULL)) {
+    goto free_config;
+  }
+
+  module_t *module = &status_line.modules[0];
+  metrics_module_t *metrics = &status_line.metrics.modules[0];
+  harness_module_thread_t module_thread;
+
+  if (!module_construct(module, &status_line, "keyboard", config) ||
+      !harness_module_thread_start(&module_thread, module, module_keyboard_run)) {
+    goto free_status_line;
+  }
+
+  /* first update is rendered once module selected xkb events */
+  bool const is_passed = wait_for_update(metrics, 0, bench_now()) != 0 &&
+                         run_switches(connection, metrics, groups_count, group);
+
+  lock_group(connection, group);
+
+  if (harness_module_thread_stop(&module_thread) == EXIT_SUCCESS && is_passed) {
+    status = EXIT_SUCCESS;
+  }
+
+free_status_line:
+  status_line_destruct(&status_line);
+
+free_config:
+  toml_free(config);
+
+disconnect:
+  xcb_disconnect(connection);
+
+  return status;
+}
@@ -0,0 +1,190 @@
+#include "modules/memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "harness.h"
+#include "macros.h"
+#include "module.h"
+#include "status_line.h"
+#include "toml.h"
+#include "utils/time.h"
+
+/* runs memory module over virtual clock and reports time and allocations per sample between waits, against real
+   /proc/meminfo with one and with all formats referenced, and against fake meminfo whose lines move half way
+   through (wider MemTotal value, then an inserted line), which fails when rendered text misses the moved fields */
+
+#define NANOSECONDS 1000000000UL
+#define SAMPLES_COUNT 20000
+#define START_TIME 1767225600UL /* 2026-01-01 00:00:00 UTC */
+#define ALL_FORMATS "%used% %available% %total% %percent% %swap% %dirty%"
+
+typedef struct scenario {
+  char const *name;
+  char const *format;
+  bool is_fake; /* fake meminfo rewritten inside every wait, real /proc otherwise */
+} scenario_t;
+
+/* MemTotal gets a 9 digit value half way through and an extra line appears before Dirty at three quarters */
+static bool write_meminfo(char const *path, u64 sample_index) {
+  FILE *file = fopen(path, "w");
+
+  if (file == NULL) {
+    return false;
+  }
+
+  unsigned long const total = sample_index < SAMPLES_COUNT / 2 ? 16777216UL : 134217728UL;
+  unsigned long const available = total / 4 + sample_index;
+
+  fprintf(file, "MemTotal:       %8lu kB\nMemFree:        %8lu kB\nMemAvailable:   %8lu kB\n", total, available / 2,
+          available);
+  fprintf(file, "Buffers:          384912 kB\nCached:           963356 kB\nSwapCached:            0 kB\n");
+  fprintf(file, "SwapTotal:       8388608 kB\nSwapFree:        %7lu kB\n", 8388608UL - 1024 * (sample_index % 100));
+
+  if (sample_index >= SAMPLES_COUNT * 3 / 4) {
+    fprintf(file, "Zswap:                 0 kB\n");
+  }
+
+  fprintf(file, "Dirty:           %7lu kB\nWriteback:             0 kB\n", 2048UL * (sample_index % 10));
+
+  return fclose(file) == 0;
+}
+
+static void expect_text(char *text, usize size, u64 sample_index) {
+  u64 const total = sample_index < SAMPLES_COUNT / 2 ? 16777216UL : 134217728UL;
+  u64 const available = total / 4 + sample_index;
+
+  snprintf(text, size, "%lu %lu %lu %lu %lu %lu", (unsigned long)((total - available) / 1024),
+           (unsigned long)(available / 1024), (unsigned long)(total / 1024),
+           (unsigned long)((total - available) * 100 / total), (unsigned long)(sample_index % 100),
+           (unsigned long)(2 * (sample_index % 10)));
+}
+
+static bool rewrite_meminfo(bench_clock_t *bench_clock) {
+  return write_meminfo(bench_clock->context, bench_clock->virtual_clock.wait_count);
+}
+
+static bool run_scenario(scenario_t const *scenario, char const *root) {
+  bool status = false;
+  char meminfo_path[256];
+  snprintf(meminfo_path, sizeof(meminfo_path), "%s/meminfo", root);
+
+  u64 const start_time = START_TIME * NANOSECONDS;
+  bench_clock_t bench_clock;
+
+  /* first sample is taken before first wait, waits for SAMPLES_COUNT - 1 boundaries expire */
+  bench_clock_construct(&bench_clock, start_time, start_time + SAMPLES_COUNT * NANOSECONDS);
+
+  if (scenario->is_fake) {
+    bench_clock.on_expired = rewrite_meminfo;
+    bench_clock.context = meminfo_path;
+  }
+
+  if (scenario->is_fake && !write_meminfo(meminfo_path, 0)) {
+    fprintf(stderr, "%s: failed to write fake meminfo\n", scenario->name);
+    return false;
+  }
+
+  char config_string[256];
+  snprintf(config_string, sizeof(config_string), "format = \"%s\"\ninterval = \"1s\"\nprocfs_root = \"%s\"\n",
+           scenario->format, scenario->is_fake ? root : "/proc");
+
+  toml_table_t *config = toml_parse(config_string, NULL, 0);
+
+  if (config == NULL) {
+    fprintf(stderr, "%s: failed to parse config\n", scenario->name);
+    return false;
+  }
+
+  status_line_t status_line = {0};
+
+  if (!status_line_construct(&status_line, 1, STATUS_LINE_OUTPUT_NULL)) {
+    goto free_config;
+  }
+
+  status_line.clock = &bench_clock.clock;
+
+  module_t *module = &status_line.modules[0];
+
+  if (!module_construct(module, &status_line, "memory", config)) {
+    goto free_status_line;
+  }
+
+  bench_clock_start_sample(&bench_clock);
+
+  if (module_memory_run(module) != EXIT_SUCCESS || bench_clock.is_failed) {
+    fprintf(stderr, "%s: memory module failed\n", scenario->name);
+    goto free_status_line;
+  }
+
+  /* every wait closes a sample, the first one was taken before first wait */
+  double const samples = (double)bench_clock.samples_count;
+
+  if (bench_clock.samples_count != SAMPLES_COUNT) {
+    fprintf(stderr, "%s: %lu samples, expected %d\n", scenario->name, (unsigned long)bench_clock.samples_count,
+            SAMPLES_COUNT);
+    goto free_status_line;
+  }
+
+  if (scenario->is_fake) {
+    char expected_text[256];
+    expect_text(expected_text, sizeof(expected_text), bench_clock.virtual_clock.wait_count);
+
+    if (!harness_has_text(module, expected_text)) {
+      fprintf(stderr, "%s: rendered \"%s\", expected \"%s\"\n", scenario->name, module->buffer, expected_text);
+      goto free_status_line;
+    }
+  }
+
+  bench_report_scenario(scenario->name, "sample", "us/sample", (double)bench_clock.sample_time / 1e3 / samples);
+  bench_report_scenario(scenario->name, "allocations", "allocs/sample",
+                        (double)bench_clock.sample_allocations / samples);
+
+  status = true;
+
+free_status_line:
+  status_line_destruct(&status_line);
+
+free_config:
+  toml_free(config);
+
+  return status;
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  static scenario_t const scenarios[] = {
+    {.name = "memory/proc/used", .format = "%used%"},
+    {.name = "memory/proc/all", .format = ALL_FORMATS},
+    {.name = "memory/fake/moved_lines", .format = ALL_FORMATS, .is_fake = true},
+  };
+
+  char root[] = "/tmp/status_line_memory_XXXXXX";
+
+  if (mkdtemp(root) == NULL) {
+    fprintf(stderr, "failed to create fake procfs\n");
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_SUCCESS;
+
+  for (usize scenario_index = 0; scenario_index < countof(scenarios); scenario_index++) {
+    if (!run_scenario(&scenarios[scenario_index], root)) {
+      status = EXIT_FAILURE;
+    }
+  }
+
+  char meminfo_path[sizeof(root) + sizeof("/meminfo")];
+  snprintf(meminfo_path, sizeof(meminfo_path), "%s/meminfo", root);
+
+  unlink(meminfo_path);
+  rmdir(root);
+
+  return status;
+}
@@ -0,0 +1,94 @@
+#include "metrics.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "macros.h"
+
+#define THREADS_COUNT 4
+#define ITERATIONS 10000000UL
+
+typedef enum bench_kind {
+  BENCH_BASELINE,
+  BENCH_PADDED,
+  BENCH_SHARED,
+} bench_kind_t;
+
+typedef struct bench_context {
+  bench_kind_t kind;
+  metrics_t *metrics;
+  u64 *shared;
+} bench_context_t;
+
+typedef struct bench_thread {
+  bench_context_t const *context;
+  usize index;
+  u64 iterations;
+} bench_thread_t;
+
+static void *bench_thread(void *param) {
+  bench_thread_t const *thread = param;
+  bench_context_t const *context = thread->context;
+  u64 local = 0;
+
+  for (u64 iteration = 0; iteration < thread->iterations; iteration++) {
+    switch (context->kind) {
+      case BENCH_BASELINE:
+        local += 1;
+        bench_keep(local);
+        break;
+      case BENCH_PADDED:
+        metrics_add(&context->metrics->modules[thread->index].updates, 1);
+        break;
+      case BENCH_SHARED:
+        /* neighbouring counters share a cache line, as without metrics_module_t padding */
+        metrics_add(&context->shared[thread->index], 1);
+        break;
+    }
+  }
+
+  return NULL;
+}
+
+static void bench_counters(void *param, u64 iterations) {
+  pthread_t thread_ids[THREADS_COUNT];
+  bench_thread_t threads[THREADS_COUNT];
+
+  for (usize thread_index = 0; thread_index < countof(threads); thread_index++) {
+    threads[thread_index] = (bench_thread_t){
+      .context = param,
+      .index = thread_index,
+      .iterations = iterations / THREADS_COUNT,
+    };
+
+    pthread_create(&thread_ids[thread_index], NULL, bench_thread, &threads[thread_index]);
+  }
+
+  for (usize thread_index = 0; thread_index < countof(threads); thread_index++) {
+    pthread_join(thread_ids[thread_index], NULL);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  metrics_t metrics = {0};
+  u64 shared[THREADS_COUNT] = {0};
+
+  if (!metrics_construct(&metrics, THREADS_COUNT)) {
+    return EXIT_FAILURE;
+  }
+
+  bench_run("metrics/baseline", bench_counters, &(bench_context_t){BENCH_BASELINE, &metrics, shared}, ITERATIONS);
+  bench_run("metrics/module_counter_padded", bench_counters, &(bench_context_t){BENCH_PADDED, &metrics, shared},
+            ITERATIONS);
+  bench_run("metrics/module_counter_shared_line", bench_counters,
+            &(bench_context_t){BENCH_SHARED, &metrics, shared}, ITERATIONS);
+
+  metrics_destruct(&metrics);
+
+  return EXIT_SUCCESS;
+}
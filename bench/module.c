@@ -0,0 +1,72 @@
+#include "module.h"
+
+#include <stdlib.h>
+
+#include "bench.h"
+#include "status_line.h"
+
+#define ITERATIONS 200000UL
+
+typedef struct bench_update {
+  module_t *module;
+  char const *format;
+  bool is_changing;
+} bench_update_t;
+
+static void bench_module_update(void *param, u64 iterations) {
+  bench_update_t const *context = param;
+
+  for (u64 iteration = 0; iteration < iterations; iteration++) {
+    bool const is_capslock = context->is_changing && (iteration & 1);
+
+    char const *formatters[][2] = {
+      {"%caps%", !is_capslock ? "c" : "C"},
+      {"%num%", "N"},
+      {"%scroll%", "s"},
+      {"%symbol%", "us"},
+      {"%name%", "English (US)"},
+      {NULL, NULL},
+    };
+
+    module_update(context->module, context->format, formatters);
+  }
+}
+
+static void bench_module_update_plain(void *param, u64 iterations) {
+  bench_update_t const *context = param;
+
+  for (u64 iteration = 0; iteration < iterations; iteration++) {
+    module_update(context->module, (iteration & 1) ? "12:00:01" : "12:00:00", NULL);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  status_line_t status_line = {0};
+
+  if (!status_line_construct(&status_line, 1, STATUS_LINE_OUTPUT_NULL)) {
+    return EXIT_FAILURE;
+  }
+
+  module_t *module = &status_line.modules[0];
+
+  if (!module_construct(module, &status_line, "keyboard", NULL)) {
+    return EXIT_FAILURE;
+  }
+
+  char const *format = " %caps%%num%%scroll% %symbol% (%name%) ";
+
+  bench_run("module_update/keyboard_formatters/changed", bench_module_update,
+            &(bench_update_t){module, format, true}, ITERATIONS);
+  bench_run("module_update/keyboard_formatters/unchanged", bench_module_update,
+            &(bench_update_t){module, format, false}, ITERATIONS);
+  bench_run("module_update/no_formatters/changed", bench_module_update_plain, &(bench_update_t){module, NULL, true},
+            ITERATIONS);
+
+  status_line_destruct(&status_line);
+
+  return EXIT_SUCCESS;
+}
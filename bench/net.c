@@ -0,0 +1,243 @@
+#define _GNU_SOURCE
+
+#include "modules/net.h"
+
+#include <errno.h>
+#include <linux/if.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/veth.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "harness.h"
+#include "macros.h"
+#include "module.h"
+#include "status_line.h"
+#include "toml.h"
+#include "utils/time.h"
+
+/* creates VETH_PAIRS_COUNT veth pairs in a fresh network namespace and runs net module over virtual clock, so time
+   between waits covers one RTM_GETSTATS dump, its parsing, rates and render. Skipped without permission to create
+   network namespace (e.g unprivileged container without user namespaces) */
+
+#define NANOSECONDS 1000000000UL
+#define VETH_PAIRS_COUNT 150
+#define SAMPLES_COUNT 2000
+#define START_TIME 1767225600UL /* 2026-01-01 00:00:00 UTC */
+#define REQUEST_SIZE 256
+
+typedef struct scenario {
+  char const *name;
+  char const *config; /* without format and interval */
+  char const *expected_text;
+} scenario_t;
+
+typedef struct request {
+  char buffer[REQUEST_SIZE];
+  usize length;
+} request_t;
+
+/* appends attribute and returns it, so nested attributes can be closed with request_end_nest */
+static struct rtattr *request_add(request_t *request, u16 type, void const *data, usize length) {
+  struct rtattr *attribute = (struct rtattr *)(request->buffer + request->length);
+
+  attribute->rta_type = type;
+  attribute->rta_len = (u16)RTA_LENGTH(length);
+
+  if (data != NULL) {
+    memcpy(RTA_DATA(attribute), data, length);
+  }
+
+  request->length += RTA_ALIGN(attribute->rta_len);
+
+  return attribute;
+}
+
+static void request_end_nest(request_t *request, struct rtattr *attribute) {
+  attribute->rta_len = (u16)(request->buffer + request->length - (char *)attribute);
+}
+
+static void request_add_header(request_t *request, usize length) {
+  memset(request->buffer + request->length, 0, NLMSG_ALIGN(length));
+  request->length += NLMSG_ALIGN(length);
+}
+
+/* "ip link add <name>a type veth peer name <name>b" */
+static bool create_veth_pair(int file_descriptor, usize pair_index) {
+  request_t request = {0};
+  char name[IFNAMSIZ];
+  char peer_name[IFNAMSIZ];
+
+  snprintf(name, sizeof(name), "veth%lua", (unsigned long)pair_index);
+  snprintf(peer_name, sizeof(peer_name), "veth%lub", (unsigned long)pair_index);
+
+  request_add_header(&request, NLMSG_HDRLEN);
+  request_add_header(&request, sizeof(struct ifinfomsg));
+  request_add(&request, IFLA_IFNAME, name, strlen(name) + 1);
+
+  struct rtattr *link_info = request_add(&request, IFLA_LINKINFO, NULL, 0);
+  request_add(&request, IFLA_INFO_KIND, "veth", strlen("veth") + 1);
+
+  struct rtattr *info_data = request_add(&request, IFLA_INFO_DATA, NULL, 0);
+  struct rtattr *peer = request_add(&request, VETH_INFO_PEER, NULL, 0);
+  request_add_header(&request, sizeof(struct ifinfomsg));
+  request_add(&request, IFLA_IFNAME, peer_name, strlen(peer_name) + 1);
+  request_end_nest(&request, peer);
+  request_end_nest(&request, info_data);
+  request_end_nest(&request, link_info);
+
+  struct nlmsghdr *header = (struct nlmsghdr *)request.buffer;
+  header->nlmsg_len = (u32)request.length;
+  header->nlmsg_type = RTM_NEWLINK;
+  header->nlmsg_flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL | NLM_F_ACK;
+  header->nlmsg_seq = (u32)pair_index + 1;
+  ((struct ifinfomsg *)NLMSG_DATA(header))->ifi_family = AF_UNSPEC;
+
+  if (send(file_descriptor, request.buffer, request.length, 0) != (isize)request.length) {
+    return false;
+  }
+
+  char response[REQUEST_SIZE * 4];
+  isize const length = recv(file_descriptor, response, sizeof(response), 0);
+  struct nlmsghdr const *response_header = (struct nlmsghdr const *)response;
+
+  if (length < (isize)NLMSG_LENGTH(sizeof(struct nlmsgerr)) || response_header->nlmsg_type != NLMSG_ERROR) {
+    return false;
+  }
+
+  struct nlmsgerr const *error = NLMSG_DATA(response_header);
+  errno = -error->error;
+
+  return error->error == 0;
+}
+
+static bool create_veth_pairs(void) {
+  int const file_descriptor = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+  if (file_descriptor == -1) {
+    return false;
+  }
+
+  bool status = true;
+
+  for (usize pair_index = 0; pair_index < VETH_PAIRS_COUNT && status; pair_index++) {
+    status = create_veth_pair(file_descriptor, pair_index);
+  }
+
+  close(file_descriptor);
+
+  return status;
+}
+
+static bool run_scenario(scenario_t const *scenario) {
+  bool status = false;
+
+  u64 const start_time = START_TIME * NANOSECONDS;
+  bench_clock_t bench_clock;
+
+  /* first sample is taken before first wait, waits for SAMPLES_COUNT - 1 boundaries expire */
+  bench_clock_construct(&bench_clock, start_time, start_time + SAMPLES_COUNT * NANOSECONDS);
+
+  char config_string[256];
+  snprintf(config_string, sizeof(config_string), "format = \"%%interface%% %%state%% %%rx%% %%tx%%\"\n%s",
+           scenario->config);
+
+  toml_table_t *config = toml_parse(config_string, NULL, 0);
+
+  if (config == NULL) {
+    fprintf(stderr, "%s: failed to parse config\n", scenario->name);
+    return false;
+  }
+
+  status_line_t status_line = {0};
+
+  if (!status_line_construct(&status_line, 1, STATUS_LINE_OUTPUT_NULL)) {
+    goto free_config;
+  }
+
+  status_line.clock = &bench_clock.clock;
+  /* module tells abort from link events by abort file descriptor, not by readable epoll */
+  bench_clock.abort_file_descriptor = status_line.abort_file_descriptor;
+
+  module_t *module = &status_line.modules[0];
+
+  if (!module_construct(module, &status_line, "net", config)) {
+    goto free_status_line;
+  }
+
+  bench_clock_start_sample(&bench_clock);
+
+  if (module_net_run(module) != EXIT_SUCCESS || bench_clock.is_failed) {
+    fprintf(stderr, "%s: net module failed\n", scenario->name);
+    goto free_status_line;
+  }
+
+  if (bench_clock.samples_count != SAMPLES_COUNT) {
+    fprintf(stderr, "%s: %lu samples, expected %d\n", scenario->name, (unsigned long)bench_clock.samples_count,
+            SAMPLES_COUNT);
+    goto free_status_line;
+  }
+
+  if (!harness_has_text(module, scenario->expected_text)) {
+    fprintf(stderr, "%s: rendered \"%s\", expected \"%s\"\n", scenario->name, module->buffer,
+            scenario->expected_text);
+    goto free_status_line;
+  }
+
+  /* every wait closes a sample, the first one was taken before first wait */
+  double const samples = (double)bench_clock.samples_count;
+
+  bench_report_scenario(scenario->name, "sample", "us/sample", (double)bench_clock.sample_time / 1e3 / samples);
+  bench_report_scenario(scenario->name, "allocations", "allocs/sample",
+                        (double)bench_clock.sample_allocations / samples);
+
+  status = true;
+
+free_status_line:
+  status_line_destruct(&status_line);
+
+free_config:
+  toml_free(config);
+
+  return status;
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  if (unshare(CLONE_NEWNET) == -1 && unshare(CLONE_NEWUSER | CLONE_NEWNET) == -1) {
+    fprintf(stderr, "net: no permission to create network namespace, skipped\n");
+    return EXIT_SUCCESS;
+  }
+
+  if (!create_veth_pairs()) {
+    fprintf(stderr, "net: failed to create veth pairs (%s), skipped\n", strerror(errno));
+    return EXIT_SUCCESS;
+  }
+
+  /* veth pairs are down and carry no traffic, new namespace has loopback only besides them */
+  static scenario_t const scenarios[] = {
+    {.name = "net/300_veth/aggregate", .config = "", .expected_text = "total down 0 0"},
+    {.name = "net/300_veth/2_interfaces",
+     .config = "interfaces = [\"veth0a\", \"veth149b\"]\nseparator = \" | \"\n",
+     .expected_text = "veth0a down 0 0 | veth149b down 0 0"},
+  };
+
+  int status = EXIT_SUCCESS;
+
+  for (usize scenario_index = 0; scenario_index < countof(scenarios); scenario_index++) {
+    if (!run_scenario(&scenarios[scenario_index])) {
+      status = EXIT_FAILURE;
+    }
+  }
+
+  return status;
+}
@@ -0,0 +1,310 @@
+#define _GNU_SOURCE
+
+#include "modules/sound.h"
+
+#include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "macros.h"
+#include "module.h"
+#include "status_line.h"
+#include "toml.h"
+#include "utils/fs.h"
+
+/* drags a playback control of the default device back and forth from a second mixer handle while the sound
+   module shows up to MAX_CONTROLS controls of the same device, reports cpu time, wakeups and read syscalls of the
+   module thread per volume change. Volume of the live mixer changes while it runs, so it's skipped unless
+   STATUS_LINE_BENCH_LIVE=1 and on machines without a mixer (e.g containers) */
+
+#define DEVICE "default"
+#define MAX_CONTROLS 3
+#define STORM_EVENTS 2000
+#define IDLE_TIME 100000000UL     /* nanoseconds without module wakeups after which storm is handled */
+#define IDLE_TIMEOUT 5000000000UL /* nanoseconds */
+
+typedef struct module_thread {
+  pthread_t thread;
+  module_t *module;
+  pid_t thread_id;
+  int status;
+} module_thread_t;
+
+typedef struct control {
+  snd_mixer_elem_t *elem;
+  long volumes[SND_MIXER_SCHN_LAST + 1]; /* restored after storm */
+  long min;
+  long max;
+} control_t;
+
+static void *run_module(void *param) {
+  module_thread_t *module_thread = param;
+  __atomic_store_n(&module_thread->thread_id, (pid_t)syscall(SYS_gettid), __ATOMIC_RELEASE);
+  module_thread->status = module_sound_run(module_thread->module);
+
+  return NULL;
+}
+
+/* cpu time of module thread so far in nanoseconds, metrics sample it at most every 100ms and may lag behind */
+static u64 get_cpu_time(module_thread_t const *module_thread) {
+  clockid_t clock_id;
+  struct timespec cpu_time;
+
+  if (pthread_getcpuclockid(module_thread->thread, &clock_id) != 0 || clock_gettime(clock_id, &cpu_time) != 0) {
+    return 0;
+  }
+
+  return (u64)cpu_time.tv_sec * 1000000000UL + (u64)cpu_time.tv_nsec;
+}
+
+/* read syscalls of module thread so far, from syscr in /proc/self/task/<tid>/io, false without task io accounting */
+static bool get_read_syscalls(pid_t thread_id, u64 *syscalls) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/task/%d/io", thread_id);
+
+  char *io = utils_fs_read_file(path, 511);
+
+  if (io == NULL) {
+    return false;
+  }
+
+  char const *syscr = strstr(io, "syscr: ");
+  i64 value = 0;
+  bool const is_parsed = syscr != NULL && utils_fs_parse_i64(syscr + strlen("syscr: "), &value);
+
+  free(io);
+  *syscalls = (u64)value;
+
+  return is_parsed;
+}
+
+/* waits until module thread didn't wake up for IDLE_TIME, false on timeout */
+static bool wait_for_idle(metrics_module_t *metrics) {
+  u64 const start_time = bench_now();
+  u64 wakeups = metrics_get(&metrics->wakeups);
+  u64 idle_start_time = start_time;
+
+  while (bench_now() - idle_start_time < IDLE_TIME) {
+    if (bench_now() - start_time > IDLE_TIMEOUT) {
+      return false;
+    }
+
+    usleep(1000);
+
+    u64 const current_wakeups = metrics_get(&metrics->wakeups);
+
+    if (current_wakeups != wakeups) {
+      wakeups = current_wakeups;
+      idle_start_time = bench_now();
+    }
+  }
+
+  return true;
+}
+
+/* first playback control with volume is stormed, others are only shown */
+static usize find_controls(snd_mixer_t *mixer, char const *names[MAX_CONTROLS], control_t *storm_control) {
+  usize controls_count = 0;
+
+  for (snd_mixer_elem_t *elem = snd_mixer_first_elem(mixer); elem != NULL && controls_count < MAX_CONTROLS;
+       elem = snd_mixer_elem_next(elem)) {
+    if (snd_mixer_selem_get_index(elem) != 0 ||
+        (!snd_mixer_selem_has_playback_channel(elem, SND_MIXER_SCHN_MONO) &&
+         !snd_mixer_selem_has_capture_channel(elem, SND_MIXER_SCHN_MONO))) {
+      continue;
+    }
+
+    if (storm_control->elem == NULL && snd_mixer_selem_has_playback_volume(elem)) {
+      storm_control->elem = elem;
+    }
+
+    names[controls_count++] = snd_mixer_selem_get_name(elem);
+  }
+
+  return storm_control->elem != NULL ? controls_count : 0;
+}
+
+static bool control_save(control_t *control) {
+  if (snd_mixer_selem_get_playback_volume_range(control->elem, &control->min, &control->max) < 0) {
+    return false;
+  }
+
+  for (int channel = 0; channel <= SND_MIXER_SCHN_LAST; channel++) {
+    snd_mixer_selem_channel_id_t const channel_id = (snd_mixer_selem_channel_id_t)channel;
+
+    if (snd_mixer_selem_has_playback_channel(control->elem, channel_id) &&
+        snd_mixer_selem_get_playback_volume(control->elem, channel_id, &control->volumes[channel]) < 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void control_restore(control_t const *control) {
+  for (int channel = 0; channel <= SND_MIXER_SCHN_LAST; channel++) {
+    snd_mixer_selem_channel_id_t const channel_id = (snd_mixer_selem_channel_id_t)channel;
+
+    if (snd_mixer_selem_has_playback_channel(control->elem, channel_id)) {
+      snd_mixer_selem_set_playback_volume(control->elem, channel_id, control->volumes[channel]);
+    }
+  }
+}
+
+/* slider moves between minimum and current volume, never louder than before */
+static bool run_storm(control_t const *control, module_thread_t *module_thread, metrics_module_t *metrics) {
+  long const range = control->volumes[SND_MIXER_SCHN_MONO] - control->min;
+
+  if (range < 2) {
+    fprintf(stderr, "sound: volume of stormed control is too low, skipped\n");
+    return true;
+  }
+
+  if (!wait_for_idle(metrics)) {
+    fprintf(stderr, "sound: module didn't settle before storm\n");
+    return false;
+  }
+
+  pid_t const thread_id = __atomic_load_n(&module_thread->thread_id, __ATOMIC_ACQUIRE);
+  u64 syscalls_start = 0;
+  bool const has_syscalls = get_read_syscalls(thread_id, &syscalls_start);
+  u64 const cpu_time_start = get_cpu_time(module_thread);
+  u64 const wakeups_start = metrics_get(&metrics->wakeups);
+  u64 const updates_start = metrics_get(&metrics->updates);
+  u64 const start_time = bench_now();
+
+  for (usize event_index = 0; event_index < STORM_EVENTS; event_index++) {
+    long const position = (long)(event_index % 100);
+    long const step = position < 50 ? position : 100 - position;
+
+    if (snd_mixer_selem_set_playback_volume_all(control->elem, control->min + range * step / 50) < 0) {
+      fprintf(stderr, "sound: failed to set volume\n");
+      return false;
+    }
+  }
+
+  control_restore(control);
+
+  if (!wait_for_idle(metrics)) {
+    fprintf(stderr, "sound: module didn't settle after storm\n");
+    return false;
+  }
+
+  u64 const elapsed = bench_now() - start_time - IDLE_TIME;
+  double const events = STORM_EVENTS + 1;
+
+  bench_report_value("sound/storm/duration", "ms", (double)elapsed / 1e6);
+  bench_report_value("sound/storm/cpu_time", "us/event",
+                     (double)(get_cpu_time(module_thread) - cpu_time_start) / 1e3 / events);
+  bench_report_value("sound/storm/wakeups", "wakeups/event",
+                     (double)(metrics_get(&metrics->wakeups) - wakeups_start) / events);
+  bench_report_value("sound/storm/updates", "updates/event",
+                     (double)(metrics_get(&metrics->updates) - updates_start) / events);
+
+  u64 syscalls = 0;
+
+  if (has_syscalls && get_read_syscalls(thread_id, &syscalls)) {
+    bench_report_value("sound/storm/read_syscalls", "syscalls/event", (double)(syscalls - syscalls_start) / events);
+  }
+
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  if (!bench_is_live_allowed("sound")) {
+    return EXIT_SUCCESS;
+  }
+
+  int status = EXIT_FAILURE;
+  snd_mixer_t *mixer = NULL;
+
+  if (snd_mixer_open(&mixer, 0) < 0 || snd_mixer_attach(mixer, DEVICE) < 0 ||
+      snd_mixer_selem_register(mixer, NULL, NULL) < 0 || snd_mixer_load(mixer) < 0) {
+    fprintf(stderr, "sound: no mixer on %s device, skipped\n", DEVICE);
+    status = EXIT_SUCCESS;
+    goto close_mixer;
+  }
+
+  char const *names[MAX_CONTROLS] = {0};
+  control_t control = {0};
+  usize const controls_count = find_controls(mixer, names, &control);
+
+  if (controls_count == 0) {
+    fprintf(stderr, "sound: no playback control with volume on %s device, skipped\n", DEVICE);
+    status = EXIT_SUCCESS;
+    goto close_mixer;
+  }
+
+  if (!control_save(&control)) {
+    fprintf(stderr, "sound: failed to read volume\n");
+    goto close_mixer;
+  }
+
+  char config_string[512];
+  int length = snprintf(config_string, sizeof(config_string),
+                        "format = \"%%control%% %%volume%%\"\ndevice = \"%s\"\ncontrols = [", DEVICE);
+
+  for (usize control_index = 0; control_index < controls_count; control_index++) {
+    length += snprintf(config_string + length, sizeof(config_string) - (usize)length, "%s\"%s\"",
+                       control_index != 0 ? ", " : "", names[control_index]);
+  }
+
+  snprintf(config_string + length, sizeof(config_string) - (usize)length, "]\n");
+
+  toml_table_t *config = toml_parse(config_string, NULL, 0);
+
+  if (config == NULL) {
+    fprintf(stderr, "failed to parse config\n");
+    goto close_mixer;
+  }
+
+  status_line_t status_line = {0};
+
+  if (!status_line_construct(&status_line, 1, STATUS_LINE_OUTPUT_NULL)) {
+    goto free_config;
+  }
+
+  module_thread_t module_thread = {.module = &status_line.modules[0]};
+
+  if (!module_construct(module_thread.module, &status_line, "sound", config) ||
+      pthread_create(&module_thread.thread, NULL, run_module, &module_thread) != 0) {
+    goto free_status_line;
+  }
+
+  bool const is_passed = run_storm(&control, &module_thread, &status_line.metrics.modules[0]);
+
+  u64 const abort = 1;
+
+  if (write(status_line.abort_file_descriptor, &abort, sizeof(abort)) != sizeof(abort)) {
+    fprintf(stderr, "failed to abort module\n");
+  }
+
+  pthread_join(module_thread.thread, NULL);
+
+  if (is_passed && module_thread.status == EXIT_SUCCESS) {
+    status = EXIT_SUCCESS;
+  }
+
+free_status_line:
+  status_line_destruct(&status_line);
+
+free_config:
+  toml_free(config);
+
+close_mixer:
+  if (mixer != NULL) {
+    snd_mixer_close(mixer);
+  }
+
+  return status;
+}
@@ -0,0 +1,73 @@
+#include "status_line.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "macros.h"
+#include "module.h"
+
+#define ITERATIONS 200000UL
+
+static void bench_status_line_update(void *param, u64 iterations) {
+  status_line_t *status_line = param;
+
+  for (u64 iteration = 0; iteration < iterations; iteration++) {
+    bool is_rendered = status_line_update(status_line);
+    bench_keep(is_rendered);
+  }
+}
+
+static bool run(usize modules_count) {
+  bool status = false;
+  status_line_t status_line = {0};
+
+  if (!status_line_construct(&status_line, modules_count, STATUS_LINE_OUTPUT_NULL)) {
+    return false;
+  }
+
+  for (usize module_index = 0; module_index < modules_count; module_index++) {
+    module_t *module = &status_line.modules[module_index];
+
+    if (!module_construct(module, &status_line, "clock", NULL)) {
+      goto done;
+    }
+
+    /* typical block length of a status line module */
+    module->buffer = malloc(25);
+
+    if (module->buffer == NULL) {
+      goto done;
+    }
+
+    strcpy(module->buffer, " 100% | Mon 01 12:00:00 ");
+  }
+
+  char name[64];
+  snprintf(name, sizeof(name), "status_line_update/modules_%lu", (unsigned long)modules_count);
+
+  bench_run(name, bench_status_line_update, &status_line, ITERATIONS);
+
+  status = true;
+
+done:
+  status_line_destruct(&status_line);
+
+  return status;
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  static usize const modules_counts[] = {1, 4, 16, 64};
+
+  for (usize count_index = 0; count_index < countof(modules_counts); count_index++) {
+    if (!run(modules_counts[count_index])) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+#include "utils/string.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define ITERATIONS 1000000UL
+#define BUFFER_SIZE 256
+
+typedef struct bench_replace {
+  char const *format;
+  char const *search;
+  char const *replace;
+} bench_replace_t;
+
+static void bench_string_replace(void *param, u64 iterations) {
+  bench_replace_t const *context = param;
+  char buffer[BUFFER_SIZE];
+
+  for (u64 iteration = 0; iteration < iterations; iteration++) {
+    strcpy(buffer, context->format);
+    utils_string_replace(buffer, sizeof(buffer), context->search, context->replace);
+    bench_keep(buffer);
+  }
+}
+
+static void bench_string_replace_count(void *param, u64 iterations) {
+  bench_replace_t const *context = param;
+
+  for (u64 iteration = 0; iteration < iterations; iteration++) {
+    size_t count = utils_string_replace_count(context->format, context->search);
+    bench_keep(count);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  bench_replace_t short_format = {"VOL %volume%%", "%volume%", "100"};
+  bench_replace_t long_format = {
+    "[%caps%%num%%scroll%] %symbol% (%name%) | %symbol% %symbol% | keyboard layout with a long padding text",
+    "%symbol%",
+    "us",
+  };
+  bench_replace_t missing_format = {"%caps%%num%%scroll% | keyboard", "%name%", "English (US)"};
+
+  bench_run("string/replace/short", bench_string_replace, &short_format, ITERATIONS);
+  bench_run("string/replace/long_3_matches", bench_string_replace, &long_format, ITERATIONS);
+  bench_run("string/replace/no_match", bench_string_replace, &missing_format, ITERATIONS);
+  bench_run("string/replace_count/short", bench_string_replace_count, &short_format, ITERATIONS);
+  bench_run("string/replace_count/long_3_matches", bench_string_replace_count, &long_format, ITERATIONS);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,328 @@
+#include "modules/temperature.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "harness.h"
+#include "macros.h"
+#include "module.h"
+#include "status_line.h"
+#include "toml.h"
+#include "utils/time.h"
+
+/* runs temperature module over virtual clock against fake hwmon tree of a dual-socket server (two coretemp devices
+   with package and 28 cores each, nvme and acpitz), rewriting every sensor inside each wait. Reports time,
+   allocations and read syscalls per sample between waits, fails when a sample reads more than one pread per shown
+   sensor, allocates for anything but rendered text or renders other than the last written temperatures */
+
+#define NANOSECONDS 1000000000UL
+#define SAMPLES_COUNT 2000
+#define START_TIME 1767225600UL /* 2026-01-01 00:00:00 UTC */
+#define CORES_COUNT 28
+#define MAX_SENSORS_COUNT 128
+#define MAX_LABEL_LENGTH 64
+#define MAX_VALUE_LENGTH 32
+
+typedef struct device {
+  char const *name;
+  char const *label_format; /* null - sensors have no label */
+  usize sensors_count;
+  usize first_channel; /* channels of coretemp start at 2 after package at 1 */
+} device_t;
+
+typedef struct sensor {
+  char input_path[HARNESS_MAX_PATH_LENGTH];
+  char label[MAX_LABEL_LENGTH]; /* label or device name */
+} sensor_t;
+
+typedef struct scenario {
+  char const *name;
+  char const *format;
+  char const *sensors; /* toml array, null - all sensors */
+  char const *labels[4]; /* named sensors rendered after %max% and %avg%, in format order */
+} scenario_t;
+
+static device_t const devices[] = {
+  {.name = "coretemp", .label_format = "Package id 0", .sensors_count = 1, .first_channel = 1},
+  {.name = "coretemp", .label_format = "Core %lu", .sensors_count = CORES_COUNT, .first_channel = 2},
+  {.name = "coretemp", .label_format = "Package id 1", .sensors_count = 1, .first_channel = 1},
+  {.name = "coretemp", .label_format = "Core %lu", .sensors_count = CORES_COUNT, .first_channel = 2},
+  {.name = "nvme", .label_format = "Composite", .sensors_count = 1, .first_channel = 1},
+  {.name = "nvme", .label_format = "Sensor %lu", .sensors_count = 2, .first_channel = 2},
+  {.name = "acpitz", .label_format = NULL, .sensors_count = 2, .first_channel = 1},
+};
+
+/* devices sharing hwmon directory, package and cores of one socket are one hwmon device */
+static usize const device_hwmons[] = {0, 0, 1, 1, 2, 2, 3};
+
+static sensor_t sensors[MAX_SENSORS_COUNT];
+static usize sensors_count = 0;
+
+/* millidegrees of sensor at sample, every sensor changes every sample and hottest one moves around */
+static inline i64 get_temperature(usize sensor_index, u64 sample_index) {
+  return 30000 + (i64)((sensor_index * 7 + sample_index) % 50) * 1000 + (i64)(sensor_index % 4) * 250;
+}
+
+static bool write_file(char const *path, char const *text) {
+  FILE *file = fopen(path, "w");
+
+  if (file == NULL) {
+    return false;
+  }
+
+  fputs(text, file);
+
+  return fclose(file) == 0;
+}
+
+static bool write_temperatures(sensor_t const *written_sensors, usize count, u64 sample_index) {
+  char value[MAX_VALUE_LENGTH];
+
+  for (usize sensor_index = 0; sensor_index < count; sensor_index++) {
+    snprintf(value, sizeof(value), "%ld\n", (long)get_temperature(sensor_index, sample_index));
+
+    if (!write_file(written_sensors[sensor_index].input_path, value)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool rewrite_temperatures(bench_clock_t *bench_clock) {
+  return write_temperatures(sensors, sensors_count, bench_clock->virtual_clock.wait_count);
+}
+
+/* writes "<text>\n" to attribute of hwmon device, channel 0 - attribute of device itself */
+static bool write_attribute(char const *root, unsigned long hwmon, unsigned long channel, char const *name,
+                            char const *text) {
+  char path[HARNESS_MAX_PATH_LENGTH];
+  char line[MAX_LABEL_LENGTH + 1];
+  int const path_length =
+    channel != 0 ? snprintf(path, sizeof(path), "class/hwmon/hwmon%lu/temp%lu_%s", hwmon, channel, name)
+                 : snprintf(path, sizeof(path), "class/hwmon/hwmon%lu/%s", hwmon, name);
+  int const line_length = snprintf(line, sizeof(line), "%s\n", text);
+
+  if (path_length < 0 || (usize)path_length >= sizeof(path) || line_length < 0 || (usize)line_length >= sizeof(line)) {
+    return false;
+  }
+
+  return harness_write_file(root, path, line);
+}
+
+static bool make_tree(char const *root) {
+  for (usize device_index = 0; device_index < countof(devices); device_index++) {
+    device_t const *device = &devices[device_index];
+    unsigned long const hwmon = (unsigned long)device_hwmons[device_index];
+
+    if (!write_attribute(root, hwmon, 0, "name", device->name)) {
+      return false;
+    }
+
+    for (usize sensor_index = 0; sensor_index < device->sensors_count; sensor_index++) {
+      unsigned long const channel = (unsigned long)(device->first_channel + sensor_index);
+      sensor_t *sensor = &sensors[sensors_count++];
+      int const length = snprintf(sensor->input_path, sizeof(sensor->input_path),
+                                  "%s/class/hwmon/hwmon%lu/temp%lu_input", root, hwmon, channel);
+
+      if (length < 0 || (usize)length >= sizeof(sensor->input_path)) {
+        return false;
+      }
+
+      snprintf(sensor->label, sizeof(sensor->label), "%s", device->name);
+
+      if (device->label_format != NULL) {
+        snprintf(sensor->label, sizeof(sensor->label), device->label_format, (unsigned long)sensor_index);
+
+        if (!write_attribute(root, hwmon, channel, "label", sensor->label)) {
+          return false;
+        }
+      }
+
+      /* attributes next to input aren't sensors */
+      if (!write_attribute(root, hwmon, channel, "crit", "100000")) {
+        return false;
+      }
+    }
+  }
+
+  /* input files are created here, rewritten in place by every sample */
+  return write_temperatures(sensors, sensors_count, 0);
+}
+
+static inline i64 round_degrees(i64 value) {
+  return value >= 0 ? (value + 500) / 1000 : (value - 500) / 1000;
+}
+
+/* "<max> <avg>" of shown sensors followed by hottest sensor of every label */
+static usize expect_text(scenario_t const *scenario, u64 sample_index, char *text, usize size) {
+  i64 max = INT64_MIN, sum = 0, count = 0;
+
+  for (usize sensor_index = 0; sensor_index < sensors_count; sensor_index++) {
+    bool is_shown = scenario->sensors == NULL;
+
+    for (usize label_index = 0; label_index < countof(scenario->labels) && scenario->labels[label_index] != NULL;
+         label_index++) {
+      is_shown |= strcmp(scenario->labels[label_index], sensors[sensor_index].label) == 0;
+    }
+
+    if (is_shown) {
+      i64 const temperature = get_temperature(sensor_index, sample_index);
+
+      max = temperature > max ? temperature : max;
+      sum += temperature;
+      count++;
+    }
+  }
+
+  int offset = snprintf(text, size, "%ld %ld", (long)round_degrees(max), (long)round_degrees(sum / count));
+
+  for (usize label_index = 0; label_index < countof(scenario->labels) && scenario->labels[label_index] != NULL;
+       label_index++) {
+    i64 label_max = INT64_MIN;
+
+    for (usize sensor_index = 0; sensor_index < sensors_count; sensor_index++) {
+      if (strcmp(scenario->labels[label_index], sensors[sensor_index].label) == 0 &&
+          get_temperature(sensor_index, sample_index) > label_max) {
+        label_max = get_temperature(sensor_index, sample_index);
+      }
+    }
+
+    offset += snprintf(text + offset, size - (usize)offset, " %ld", (long)round_degrees(label_max));
+  }
+
+  return (usize)count;
+}
+
+static bool run_scenario(scenario_t const *scenario, char const *root) {
+  bool status = false;
+
+  u64 const start_time = START_TIME * NANOSECONDS;
+  bench_clock_t bench_clock;
+
+  /* first sample includes discovery and isn't measured, waits for SAMPLES_COUNT - 1 boundaries expire */
+  bench_clock_construct(&bench_clock, start_time, start_time + SAMPLES_COUNT * NANOSECONDS);
+  bench_clock.on_expired = rewrite_temperatures;
+  bench_clock.get_counter = bench_get_read_syscalls;
+
+  if (!write_temperatures(sensors, sensors_count, 0)) {
+    fprintf(stderr, "%s: failed to write fake sensors\n", scenario->name);
+    return false;
+  }
+
+  char config_string[512];
+  snprintf(config_string, sizeof(config_string), "format = \"%s\"\ninterval = \"1s\"\nsysfs_root = \"%s\"\n%s%s%s",
+           scenario->format, root, scenario->sensors != NULL ? "sensors = " : "",
+           scenario->sensors != NULL ? scenario->sensors : "", scenario->sensors != NULL ? "\n" : "");
+
+  toml_table_t *config = toml_parse(config_string, NULL, 0);
+
+  if (config == NULL) {
+    fprintf(stderr, "%s: failed to parse config\n", scenario->name);
+    return false;
+  }
+
+  status_line_t status_line = {0};
+
+  if (!status_line_construct(&status_line, 1, STATUS_LINE_OUTPUT_NULL)) {
+    goto free_config;
+  }
+
+  status_line.clock = &bench_clock.clock;
+
+  module_t *module = &status_line.modules[0];
+
+  if (!module_construct(module, &status_line, "temperature", config)) {
+    goto free_status_line;
+  }
+
+  if (module_temperature_run(module) != EXIT_SUCCESS || bench_clock.is_failed) {
+    fprintf(stderr, "%s: temperature module failed\n", scenario->name);
+    goto free_status_line;
+  }
+
+  if (bench_clock.waits_count != SAMPLES_COUNT) {
+    fprintf(stderr, "%s: %lu samples, expected %d\n", scenario->name, (unsigned long)bench_clock.waits_count,
+            SAMPLES_COUNT);
+    goto free_status_line;
+  }
+
+  char expected_text[256];
+  usize const shown_count =
+    expect_text(scenario, bench_clock.virtual_clock.wait_count, expected_text, sizeof(expected_text));
+
+  if (!harness_has_text(module, expected_text)) {
+    fprintf(stderr, "%s: rendered \"%s\", expected \"%s\"\n", scenario->name, module->buffer, expected_text);
+    goto free_status_line;
+  }
+
+  /* every wait but the first closes a measured sample */
+  double const samples = (double)bench_clock.samples_count;
+  double const allocations = (double)bench_clock.sample_allocations / samples;
+  /* one read syscall of every sample is the one of bench_get_read_syscalls itself */
+  double const read_syscalls = (double)bench_clock.sample_counter / samples - 1.0;
+
+  bench_report_scenario(scenario->name, "sample", "us/sample", (double)bench_clock.sample_time / 1e3 / samples);
+  bench_report_scenario(scenario->name, "allocations", "allocs/sample", allocations);
+  bench_report_scenario(scenario->name, "read_syscalls", "syscalls/sample", read_syscalls);
+
+  /* one pread per shown sensor, allocations are module_update's copy of text and frame of status line if it changed */
+  if (allocations > 2.0 || read_syscalls > (double)shown_count) {
+    fprintf(stderr, "%s: expected at most 2 allocations and %lu reads per sample\n", scenario->name,
+            (unsigned long)shown_count);
+    goto free_status_line;
+  }
+
+  status = true;
+
+free_status_line:
+  status_line_destruct(&status_line);
+
+free_config:
+  toml_free(config);
+
+  return status;
+}
+
+int main(int argc, char *argv[]) {
+  if (!bench_init(argc, argv)) {
+    return EXIT_FAILURE;
+  }
+
+  static scenario_t const scenarios[] = {
+    {.name = "temperature/dual_socket/all", .format = "%max% %avg%"},
+    {.name = "temperature/dual_socket/named",
+     .format = "%max% %avg% %Package id 0% %Package id 1% %Composite% %acpitz%",
+     .sensors = "[\"Package id 0\", \"Package id 1\", \"Composite\", \"acpitz\"]",
+     .labels = {"Package id 0", "Package id 1", "Composite", "acpitz"}},
+  };
+
+  char root[] = "/tmp/status_line_hwmon_XXXXXX";
+
+  if (mkdtemp(root) == NULL) {
+    fprintf(stderr, "failed to create fake sysfs tree\n");
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_FAILURE;
+
+  if (!make_tree(root)) {
+    fprintf(stderr, "failed to create fake sysfs tree\n");
+    goto remove_tree;
+  }
+
+  status = EXIT_SUCCESS;
+
+  for (usize scenario_index = 0; scenario_index < countof(scenarios); scenario_index++) {
+    if (!run_scenario(&scenarios[scenario_index], root)) {
+      status = EXIT_FAILURE;
+    }
+  }
+
+remove_tree:
+  harness_remove_tree(root);
+
+  return status;
+}
@@ -8,13 +8,19 @@
 typedef struct config_module {
   char *key;
   toml_table_t *config;
+  toml_table_t *thread; /* optional thread profile overriding config thread defaults */
 } config_module_t;
 
 typedef struct config {
   config_module_t *modules; /* array modules */
   usize modules_count;
+  toml_table_t *thread;     /* optional thread profile defaults for all threads */
+  toml_table_t *metrics;    /* optional metrics options: socket, dump */
+  toml_table_t *supervisor; /* optional module restart options: restart_delay, max_restart_delay, stable_time */
+  char *log_level;          /* optional log verbosity (e.g "error", "warn", "info", "debug") */
   toml_table_t *_private;
 } config_t;
 
-bool config_construct(config_t *config);
+/* path - config file, NULL - status_line.toml in XDG_CONFIG_HOME or HOME/.config */
+bool config_construct(config_t *config, char const *path);
 void config_destruct(config_t *config);
@@ -3,20 +3,63 @@
 
 #include <stdbool.h>
 
+#include "typedefs.h"
+
 #define LOG_COLORS
 
 #ifndef LOG_MODULE
 #define LOG_MODULE ""
 #endif /* ifndef LOG_MODULE */
 
+/* messages allowed from one call site per rate limit window, the rest are counted as suppressed */
+#define LOG_RATE_LIMIT_BURST 10
+#define LOG_RATE_LIMIT_WINDOW_MS 1000
+
 typedef enum {
   LOG_ERROR = 0,
   LOG_WARN,
+  LOG_INFO,
+  LOG_DEBUG,
 } log_level_t;
 
-bool log_msg(log_level_t log_level, char const* module, char const* file, int line, char const* format, ...);
+/* rate limit state of a single __FILE__:__LINE__ */
+typedef struct log_site {
+  u64 window_start;
+  u32 count;
+  u32 suppressed;
+  /* filled when site first suppresses a message, writer reports its count once flood stops */
+  struct log_site *next;
+  char const *module;
+  char const *file;
+  int line;
+  log_level_t level;
+  bool is_registered;
+} log_site_t;
+
+/* starts writer thread, before it (and after log_destruct) messages are written synchronously, counts of
+   suppressed messages are written when window of their site ends and at log_destruct */
+bool log_construct(void);
+void log_destruct(void);
+void log_set_level(log_level_t log_level);
+bool log_parse_level(char const *name, log_level_t *log_level);
+
+bool log_msg(log_site_t *site, log_level_t log_level, char const *module, char const *file, int line,
+             char const *format, ...) __attribute__((format(printf, 6, 7)));
+
+#define log_at(log_level, ...)                                                \
+  do {                                                                        \
+    static log_site_t log_site;                                               \
+    log_msg(&log_site, log_level, LOG_MODULE, __FILE__, __LINE__, __VA_ARGS__); \
+  } while (0)
+
+#define log_error(...) log_at(LOG_ERROR, __VA_ARGS__)
+#define log_warn(...) log_at(LOG_WARN, __VA_ARGS__)
+#define log_info(...) log_at(LOG_INFO, __VA_ARGS__)
 
-#define log_error(...) log_msg(LOG_ERROR, LOG_MODULE, __FILE__, __LINE__, __VA_ARGS__)
-#define log_warn(...) log_msg(LOG_WARN, LOG_MODULE, __FILE__, __LINE__, __VA_ARGS__)
+#ifdef NDEBUG
+#define log_debug(...) ((void)0)
+#else
+#define log_debug(...) log_at(LOG_DEBUG, __VA_ARGS__)
+#endif /* ifdef NDEBUG */
 
 #endif /* end of include guard: LOG_H */
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "typedefs.h"
+#include "utils/histogram.h"
+
+#define METRICS_CACHE_LINE_SIZE 64
+
+/* counters of a single module, padded to not share cache lines. most are written from the module thread, but up,
+   restarts, downtime and errors of failed runs are written by the supervisor on the main thread, so every counter is
+   accessed through the atomic helpers below */
+typedef struct metrics_module {
+  u64 updates;               /* module_update calls */
+  u64 suppressed_updates;    /* updates which didn't change module text */
+  u64 renders;               /* status line renders triggered by module */
+  u64 errors;                /* failed updates and failed module runs */
+  u64 restarts;              /* module restarts */
+  u64 downtime;              /* nanoseconds between module exits and restarts */
+  u64 up;                    /* 1 if module thread is running */
+  u64 published_bytes;       /* bytes of module text published */
+  u64 wakeups;               /* module thread wakeups */
+  u64 cpu_time;              /* module thread cpu time in nanoseconds */
+  u64 voluntary_switches;    /* module thread voluntary context switches */
+  u64 involuntary_switches;  /* module thread involuntary context switches */
+  utils_histogram_t latency; /* nanoseconds from module event to flushed frame */
+} __attribute__((aligned(METRICS_CACHE_LINE_SIZE))) metrics_module_t;
+
+typedef struct metrics_global {
+  u64 frames;      /* status line frames rendered */
+  u64 flushes;     /* X connection flushes */
+  u64 line_length; /* length of last rendered status line */
+} __attribute__((aligned(METRICS_CACHE_LINE_SIZE))) metrics_global_t;
+
+typedef struct metrics {
+  metrics_global_t *global;
+  metrics_module_t *modules; /* array modules */
+  char const **module_names; /* array module names used as labels */
+  usize modules_count;
+} metrics_t;
+
+bool metrics_construct(metrics_t *metrics, usize modules_count);
+void metrics_destruct(metrics_t *metrics);
+/* prints metrics in prometheus text format */
+bool metrics_print(metrics_t const *metrics, FILE *stream);
+bool metrics_dump(metrics_t const *metrics, char const *path);
+/* samples cpu time and context switches of calling thread into module metrics */
+void metrics_account_thread(metrics_module_t *metrics);
+/* returns non-blocking listening unix socket or -1 */
+int metrics_listen(char const *path);
+/* accepts pending connections on listening socket and writes metrics to them */
+void metrics_serve(metrics_t const *metrics, int listen_file_descriptor);
+
+static inline void metrics_add(u64 *counter, u64 value) {
+  __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_set(u64 *gauge, u64 value) {
+  __atomic_store_n(gauge, value, __ATOMIC_RELAXED);
+}
+
+static inline u64 metrics_get(u64 const *counter) {
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
@@ -3,16 +3,53 @@
 #include <pthread.h>
 #include <stdbool.h>
 
+#include "metrics.h"
 #include "status_line.h"
+#include "thread_profile.h"
 #include "toml.h"
+#include "utils/time.h"
+#include "utils/uevent.h"
 
 typedef int (*module_run)(struct module *module);
 
+typedef enum module_replay_state {
+  MODULE_REPLAY_EMPTY = 0, /* waiting for trace event */
+  MODULE_REPLAY_FULL,      /* trace event delivered, not yet taken by module */
+  MODULE_REPLAY_TAKEN,     /* module handles trace event */
+} module_replay_state_t;
+
+/* synchronous handoff of trace events from replay driver to module thread */
+typedef struct module_replay {
+  void const *payload;
+  usize length;
+  module_replay_state_t state;
+  bool is_closed; /* trace ended or module thread exited */
+  pthread_cond_t condition;
+} module_replay_t;
+
+/* module thread state kept by status line supervisor */
+typedef struct module_supervisor {
+  pthread_t thread;
+  int exit_file_descriptor; /* eventfd written by module thread when run function returned */
+  bool is_running;
+  u32 failures;     /* consecutive exits, reset when module stays up long enough */
+  u64 start_time;   /* monotonic time of last start in nanoseconds */
+  u64 exit_time;    /* monotonic time of last exit in nanoseconds */
+  u64 restart_time; /* monotonic time of scheduled restart in nanoseconds, 0 - none */
+} module_supervisor_t;
+
 typedef struct module {
   struct status_line *status_line;
   char *buffer;
   toml_table_t *config;
   module_run run;
+  metrics_module_t *metrics;
+  u64 event_time;   /* monotonic time of oldest event not yet rendered, 0 - none */
+  u64 account_time; /* monotonic time module thread was last accounted in metrics */
+  thread_profile_t thread_profile;
+  usize index; /* index in status line modules */
+  module_replay_t replay;
+  module_supervisor_t supervisor;
   pthread_mutex_t lock;
 } module_t;
 
@@ -21,5 +58,25 @@ bool module_construct(module_t *module, status_line_t *status_line,
 void module_destruct(module_t *module);
 bool module_update(module_t *module, char const *format,
                    char const *formatters[][2]);
+/* drops module text, e.g when module thread exited */
+void module_clear(module_t *module);
+/* counts module thread wakeup (e.g poll return) and samples its cpu usage at most every 100ms */
+void module_wakeup(module_t *module);
+/* timestamps module event source (e.g inotify, alsa or xkb event), carried to the next rendered frame */
+void module_mark_event(module_t *module);
+void module_mark_event_at(module_t *module, u64 event_time);
+bool module_is_recording(module_t const *module);
+/* appends module state sampled from its event source to the trace being recorded, if any */
+void module_record(module_t *module, void const *payload, usize length);
+/* module thread side of replay, waits for next trace event, returns false at the end of trace */
+bool module_replay_next(module_t *module, void const **payload, usize *length);
+/* replay driver side, blocks until module handled the event (asked for next one or exited) */
+void module_replay_deliver(module_t *module, void const *payload, usize length);
+void module_replay_close(module_t *module);
 module_run module_get_run_function(char const *key);
+module_run module_get_replay_function(char const *key);
 int module_get_abort_file_descriptor(module_t const *module);
+/* returns clock modules read time and wait with, virtual clock of status line if set */
+utils_time_clock_t *module_get_clock(module_t const *module);
+/* returns source modules open uevent sockets with, injected source of status line if set */
+utils_uevent_source_t *module_get_uevent_source(module_t const *module);
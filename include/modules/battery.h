@@ -0,0 +1,20 @@
+#pragma once
+
+#include "module.h"
+#include "typedefs.h"
+
+typedef struct module_battery_config {
+  char *format;     /* formats:
+                       %capacity% - charge of battery in percent, "-" if battery is missing
+                       %status% - "charging", "discharging", "full", "not charging", "unknown" or "missing"
+                       %ac% - "on" if adapter is online, "off" if offline or missing */
+  char *battery;    /* power supply on path "/sys/class/power_supply/", "BAT0" by default */
+  char *adapter;    /* power supply of AC adapter (e.g "AC", "ADP1"), first one of "Mains" type if missing */
+  u64 interval;     /* nanoseconds without uevents before capacity is reread, some batteries don't send uevents while
+                       capacity drifts, "interval" duration (e.g "30s", "2m"), 1m by default */
+  char *sysfs_root; /* "/sys" by default, e.g fake tree in benchmarks */
+} module_battery_config_t;
+
+int module_battery_run(module_t *module);
+/* renders module states recorded in trace */
+int module_battery_replay(module_t *module);
@@ -3,9 +3,12 @@
 #include "module.h"
 
 typedef struct module_brightness_config {
-  char *format; /* formats:
-                   %value% - brightness level in percent */
-  char *card;   /* card on path "/sys/class/backlight/" (e.g "intel_backlight") */
+  char *format;     /* formats:
+                       %value% - brightness level in percent */
+  char *card;       /* card on path "/sys/class/backlight/" (e.g "intel_backlight") */
+  char *sysfs_root; /* "/sys" by default, e.g fake tree in tests */
 } module_brightness_config_t;
 
 int module_brightness_run(module_t *module);
+/* renders module states recorded in trace */
+int module_brightness_replay(module_t *module);
@@ -6,7 +6,12 @@
 typedef struct module_clock_config {
   char
     *format; /* formats defined in https://www.gnu.org/software/libc/manual/html_node/Formatting-Calendar-Time.html */
-  u16 interval; /* non-zero interval between updates in seconds */
+  u16 interval; /* interval between updates in seconds, raised to the finest unit shown by format (e.g 60 for "%H:%M") */
+  char **zones; /* tzdata names (e.g "UTC", "America/New_York") rendered with format, "local" by default */
+  usize zones_count;
+  char *separator; /* between zones */
 } module_clock_config_t;
 
 int module_clock_run(module_t *module);
+/* renders module states recorded in trace */
+int module_clock_replay(module_t *module);
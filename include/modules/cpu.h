@@ -0,0 +1,18 @@
+#pragma once
+
+#include "module.h"
+#include "typedefs.h"
+
+typedef struct module_cpu_config {
+  char *format;      /* formats:
+                        %usage% - utilisation of all cores in percent
+                        %top% - busiest cores as "core:percent" (e.g "12:98 3:87")
+                        %heat% - one character per core from "_" (idle) to "@" (busy) */
+  u64 interval;      /* nanoseconds between samples, "interval" duration (e.g "2s", "500ms"), 1s by default */
+  u16 top_count;     /* cores shown by %top% ("top" key), 3 by default */
+  char *procfs_root; /* "/proc" by default, e.g fake tree in benchmarks */
+} module_cpu_config_t;
+
+int module_cpu_run(module_t *module);
+/* renders module states recorded in trace */
+int module_cpu_replay(module_t *module);
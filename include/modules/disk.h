@@ -0,0 +1,25 @@
+#pragma once
+
+#include "module.h"
+#include "typedefs.h"
+
+typedef struct module_disk_config {
+  char *format;      /* rendered for every mounted mount point, formats:
+                        %mount% - mount point
+                        %used% - used space (e.g "840M", "12.5G")
+                        %free% - space available to unprivileged users
+                        %total% - size of filesystem
+                        %percent% - used space in percent of space available to unprivileged users and used space */
+  char **mounts;     /* mount points, "/" if missing, not rendered while unmounted */
+  usize mounts_count;
+  char *separator;   /* between mount points */
+  u64 interval;      /* nanoseconds between samples of a mount point, "interval" duration (e.g "30s", "5m"),
+                        30s by default, mount points are also sampled when mount table changes */
+  u64 timeout;       /* nanoseconds statvfs may block (e.g hung network filesystem) before mount point keeps its last
+                        sample, "timeout" duration, 1s by default */
+  char *procfs_root; /* "/proc" by default */
+} module_disk_config_t;
+
+int module_disk_run(module_t *module);
+/* renders module states recorded in trace */
+int module_disk_replay(module_t *module);
@@ -12,3 +12,5 @@ typedef struct module_keyboard_config {
 } module_keyboard_config_t;
 
 int module_keyboard_run(module_t *module);
+/* renders module states recorded in trace */
+int module_keyboard_replay(module_t *module);
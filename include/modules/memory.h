@@ -0,0 +1,20 @@
+#pragma once
+
+#include "module.h"
+#include "typedefs.h"
+
+typedef struct module_memory_config {
+  char *format;      /* formats, only fields of referenced formats are parsed:
+                        %used% - MemTotal without MemAvailable in MiB
+                        %available% - MemAvailable in MiB
+                        %total% - MemTotal in MiB
+                        %percent% - used memory in percent of MemTotal
+                        %swap% - SwapTotal without SwapFree in MiB
+                        %dirty% - Dirty in MiB */
+  u64 interval;      /* nanoseconds between samples, "interval" duration (e.g "2s", "500ms"), 1s by default */
+  char *procfs_root; /* "/proc" by default, e.g fake tree in benchmarks */
+} module_memory_config_t;
+
+int module_memory_run(module_t *module);
+/* renders module states recorded in trace */
+int module_memory_replay(module_t *module);
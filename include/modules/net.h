@@ -0,0 +1,20 @@
+#pragma once
+
+#include "module.h"
+#include "typedefs.h"
+
+typedef struct module_net_config {
+  char *format;       /* rendered for every interface, formats:
+                         %interface% - name of interface, "total" for aggregate
+                         %rx% - received bytes per second (e.g "840", "12.5K", "310M")
+                         %tx% - transmitted bytes per second
+                         %state% - "up" if interface is running (aggregate: any of them) else "down" */
+  char **interfaces;  /* interface names (e.g "eth0", "wlan0"), aggregate of all but loopback if missing */
+  usize interfaces_count;
+  char *separator;    /* between interfaces */
+  u64 interval;       /* nanoseconds between samples, "interval" duration (e.g "2s", "500ms"), 1s by default */
+} module_net_config_t;
+
+int module_net_run(module_t *module);
+/* renders module states recorded in trace */
+int module_net_replay(module_t *module);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "module.h"
+#include "typedefs.h"
+
+typedef struct module_pressure_config {
+  char *format;      /* formats, triggers are registered only for resources of referenced formats:
+                        %cpu%, %memory%, %io% - "some" avg10 of resource in percent
+                        %cpu_full%, %memory_full%, %io_full% - "full" avg10 of resource in percent */
+  char *trigger;     /* PSI trigger written to every pressure file, "<some|full> <stall us> <window us>",
+                        "some 300000 2000000" by default, unprivileged users need window of 2s multiple */
+  u64 interval;      /* nanoseconds between rereads while averages decay back to zero or trigger can't be registered,
+                        "interval" duration (e.g "2s", "500ms"), 2s by default */
+  char *procfs_root; /* "/proc" by default, e.g fake tree in benchmarks */
+} module_pressure_config_t;
+
+int module_pressure_run(module_t *module);
+/* renders module states recorded in trace */
+int module_pressure_replay(module_t *module);
@@ -3,11 +3,16 @@
 #include "module.h"
 
 typedef struct module_sound_config {
-  char *format;  /* formats:
-                    %volume% - volume level in percent
-                    %state% - if muted returns M else m */
-  char *control; /* alsa control (e.g "Master") */
-  char *device;  /* alsa device (e.g "default", "hw:0" ) */
+  char *format;    /* rendered for every control, formats:
+                      %volume% - volume level in percent
+                      %state% - if muted returns M else m
+                      %control% - name of control */
+  char **controls; /* alsa controls (e.g "Master", "Headphone", "Capture") sharing one mixer, "control" if missing */
+  usize controls_count;
+  char *separator; /* between controls */
+  char *device;    /* alsa device (e.g "default", "hw:0" ) */
 } module_sound_config_t;
 
 int module_sound_run(module_t *module);
+/* renders module states recorded in trace */
+int module_sound_replay(module_t *module);
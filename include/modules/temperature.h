@@ -0,0 +1,19 @@
+#pragma once
+
+#include "module.h"
+#include "typedefs.h"
+
+typedef struct module_temperature_config {
+  char *format;     /* formats, temperatures in degrees Celsius, "-" if no sensor could be read:
+                       %max% - hottest of sensors
+                       %avg% - average of sensors
+                       %<label>% - hottest of sensors with label from sensors (e.g %Package id 0%, %Composite%) */
+  char **sensors;   /* labels of sensors (temp*_label, or hwmon name if sensor has none), all sensors if missing */
+  usize sensors_count;
+  u64 interval;     /* nanoseconds between samples, "interval" duration (e.g "2s", "500ms"), 2s by default */
+  char *sysfs_root; /* "/sys" by default, e.g fake tree in benchmarks */
+} module_temperature_config_t;
+
+int module_temperature_run(module_t *module);
+/* renders module states recorded in trace */
+int module_temperature_replay(module_t *module);
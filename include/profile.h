@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "status_line.h"
+#include "typedefs.h"
+
+/* prints process cpu time, peak rss and module counters collected during status line run */
+void profile_print(status_line_t const *status_line, u64 elapsed_ms, FILE *stream);
@@ -4,17 +4,35 @@
 #include <xcb/xcb.h>
 
 #include "config.h"
+#include "metrics.h"
+#include "trace.h"
 #include "typedefs.h"
+#include "utils/time.h"
+#include "utils/uevent.h"
+
+typedef enum status_line_output {
+  STATUS_LINE_OUTPUT_X11 = 0, /* WM_NAME of root window */
+  STATUS_LINE_OUTPUT_NULL,    /* discards frames (e.g benchmarks) */
+} status_line_output_t;
 
 typedef struct status_line {
+  status_line_output_t output;
+  u64 duration_ms;                      /* non-zero - stop modules after duration */
+  trace_writer_t *trace_writer;         /* non-null - record module events */
+  trace_reader_t *trace_reader;         /* non-null - replay module events instead of running modules */
+  bool is_replay_fast;                  /* replay without waiting for recorded event times */
+  utils_time_clock_t *clock;            /* null - system clock */
+  utils_uevent_source_t *uevent_source; /* null - kernel netlink socket */
   int abort_file_descriptor;
   struct module *modules;
   usize modules_count;
   xcb_connection_t *connection;
+  metrics_t metrics;
   pthread_mutex_t lock;
 } status_line_t;
 
-bool status_line_construct(status_line_t *status_line, usize modules_count);
+bool status_line_construct(status_line_t *status_line, usize modules_count, status_line_output_t output);
 void status_line_destruct(status_line_t *status_line);
 bool status_line_run(status_line_t *status_line, config_t const *config);
-void status_line_update(status_line_t *status_line);
+/* returns true if a new frame was rendered */
+bool status_line_update(status_line_t *status_line);
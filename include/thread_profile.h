@@ -0,0 +1,33 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "toml.h"
+#include "typedefs.h"
+
+#define THREAD_PROFILE_MAX_CPUS 1024
+
+typedef enum thread_profile_scheduler {
+  THREAD_PROFILE_SCHEDULER_INHERIT = 0,
+  THREAD_PROFILE_SCHEDULER_OTHER,
+  THREAD_PROFILE_SCHEDULER_BATCH,
+  THREAD_PROFILE_SCHEDULER_IDLE,
+} thread_profile_scheduler_t;
+
+typedef struct thread_profile {
+  usize stack_size;                     /* stack size in bytes, 0 - default */
+  thread_profile_scheduler_t scheduler; /* scheduling class (e.g "idle", "batch", "other") */
+  int nice;                             /* nice value applied when has_nice is set */
+  bool has_nice;
+  u64 affinity[THREAD_PROFILE_MAX_CPUS / 64]; /* cpu mask applied when has_affinity is set */
+  bool has_affinity;
+} thread_profile_t;
+
+/* overlays keys present in table onto profile: stack_size, scheduler, nice, affinity (e.g "0-1,4") */
+bool thread_profile_parse(thread_profile_t *profile, toml_table_t const *table);
+bool thread_profile_set_attributes(thread_profile_t const *profile, pthread_attr_t *attributes);
+/* applies profile settings which can't be passed through pthread attributes (nice) to calling thread */
+bool thread_profile_apply_current(thread_profile_t const *profile);
+/* applies full profile to calling thread */
+bool thread_profile_apply_self(thread_profile_t const *profile);
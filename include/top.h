@@ -0,0 +1,6 @@
+#pragma once
+
+#include "typedefs.h"
+
+/* polls metrics socket of running status line and shows modules sorted by cpu usage until interrupted */
+int top_run(char const *socket_path, u32 interval_ms);
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "typedefs.h"
+
+/* trace file layout, integers are little endian regardless of host:
+   header: "SLTRACE2", u16 modules count, per module: u8 key length, key bytes
+   events: u32 microseconds since previous event, u16 module index, u16 payload length, payload bytes
+   payloads are records of module event sources (e.g an ALSA element, an XKB event) written field by field with
+   trace_put_*, each module defines its record types next to its replay function */
+#define TRACE_MAGIC "SLTRACE2"
+#define TRACE_EVENT_HEADER_SIZE 8
+#define TRACE_MAX_PAYLOAD_LENGTH UINT16_MAX
+
+typedef struct trace_event {
+  u64 time_us; /* microseconds since start of recording */
+  u16 module_index;
+  u16 length;
+  void const *payload;
+} trace_event_t;
+
+typedef struct trace_writer {
+  FILE *file;
+  u64 start_time; /* monotonic nanoseconds */
+  u64 last_time_us;
+  pthread_mutex_t lock;
+} trace_writer_t;
+
+typedef struct trace_reader {
+  u8 *buffer;
+  usize size;
+  usize offset;
+  u64 time_us;
+  u16 modules_count;
+  char **keys; /* array module keys */
+} trace_reader_t;
+
+/* writes value at cursor, returns cursor past it */
+static inline u8 *trace_put_u8(u8 *cursor, u8 value) {
+  cursor[0] = value;
+
+  return cursor + 1;
+}
+
+static inline u8 *trace_put_u16(u8 *cursor, u16 value) {
+  cursor[0] = (u8)value;
+  cursor[1] = (u8)(value >> 8);
+
+  return cursor + 2;
+}
+
+static inline u8 *trace_put_u32(u8 *cursor, u32 value) {
+  return trace_put_u16(trace_put_u16(cursor, (u16)value), (u16)(value >> 16));
+}
+
+static inline u8 *trace_put_u64(u8 *cursor, u64 value) {
+  return trace_put_u32(trace_put_u32(cursor, (u32)value), (u32)(value >> 32));
+}
+
+/* reads value at cursor, returns cursor past it */
+static inline u8 const *trace_get_u8(u8 const *cursor, u8 *value) {
+  *value = cursor[0];
+
+  return cursor + 1;
+}
+
+static inline u8 const *trace_get_u16(u8 const *cursor, u16 *value) {
+  *value = (u16)(cursor[0] | cursor[1] << 8);
+
+  return cursor + 2;
+}
+
+static inline u8 const *trace_get_u32(u8 const *cursor, u32 *value) {
+  u16 low = 0;
+  u16 high = 0;
+
+  cursor = trace_get_u16(trace_get_u16(cursor, &low), &high);
+  *value = (u32)low | (u32)high << 16;
+
+  return cursor;
+}
+
+static inline u8 const *trace_get_u64(u8 const *cursor, u64 *value) {
+  u32 low = 0;
+  u32 high = 0;
+
+  cursor = trace_get_u32(trace_get_u32(cursor, &low), &high);
+  *value = (u64)low | (u64)high << 32;
+
+  return cursor;
+}
+
+bool trace_writer_construct(trace_writer_t *writer, char const *path, char const *const *keys, usize keys_count);
+void trace_writer_destruct(trace_writer_t *writer);
+/* thread-safe, called by modules with state sampled from their event source */
+bool trace_writer_write(trace_writer_t *writer, usize module_index, void const *payload, usize length);
+
+bool trace_reader_construct(trace_reader_t *reader, char const *path);
+void trace_reader_destruct(trace_reader_t *reader);
+/* returns false at the end of trace or on truncated event */
+bool trace_reader_next(trace_reader_t *reader, trace_event_t *event);
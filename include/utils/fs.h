@@ -2,6 +2,48 @@
 
 #include <stdbool.h>
 
+#include "typedefs.h"
+
+/* pseudo-file (sysfs, procfs) opened once and reread from offset 0 into caller-provided buffer */
+typedef struct utils_fs_reader {
+  int file_descriptor;
+  char *buffer; /* null-terminated content of last refresh */
+  usize size;   /* buffer size including terminating null */
+  usize length; /* bytes read by last refresh */
+} utils_fs_reader_t;
+
+typedef enum utils_fs_batch_backend {
+  UTILS_FS_BATCH_BACKEND_PREAD = 0, /* one pread per reader */
+  UTILS_FS_BATCH_BACKEND_IO_URING,  /* all reads submitted and completed with one io_uring_enter */
+} utils_fs_batch_backend_t;
+
+/* readers refreshed together every sampling tick */
+typedef struct utils_fs_batch {
+  utils_fs_reader_t *readers; /* not owned */
+  usize readers_count;
+  utils_fs_batch_backend_t backend;
+  struct utils_fs_ring *ring; /* io_uring with readers fds and buffers registered, null for pread backend */
+} utils_fs_batch_t;
+
 bool utils_fs_has_dir(char const *path);
 bool utils_fs_has_file(char const *path);
 char *utils_fs_read_file(char const *file_path, int nbytes);
+
+bool utils_fs_reader_open(utils_fs_reader_t *reader, char const *path, char *buffer, usize size);
+void utils_fs_reader_close(utils_fs_reader_t *reader);
+bool utils_fs_reader_refresh(utils_fs_reader_t *reader);
+/* refreshes readers in one call, returns false if any of them failed */
+bool utils_fs_reader_refresh_all(utils_fs_reader_t *readers, usize readers_count);
+/* uses io_uring if allowed and supported by kernel, falls back to pread otherwise */
+bool utils_fs_batch_construct(utils_fs_batch_t *batch, utils_fs_reader_t *readers, usize readers_count,
+                              bool is_io_uring_allowed);
+void utils_fs_batch_destruct(utils_fs_batch_t *batch);
+/* returns false if any reader failed, its buffer is left empty */
+bool utils_fs_batch_refresh(utils_fs_batch_t *batch);
+char const *utils_fs_batch_get_backend_name(utils_fs_batch_t const *batch);
+/* parses integer at start of buffer (e.g "1200\n") without allocation */
+bool utils_fs_parse_i64(char const *buffer, i64 *value);
+
+static inline bool utils_fs_reader_get_i64(utils_fs_reader_t const *reader, i64 *value) {
+  return utils_fs_parse_i64(reader->buffer, value);
+}
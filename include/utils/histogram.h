@@ -0,0 +1,23 @@
+#pragma once
+
+#include "typedefs.h"
+
+/* log-linear (HDR-style) histogram: values below 2^SUB_BITS are exact, above are split into
+   2^SUB_BITS linear buckets per power of two, giving at most ~3% relative error */
+#define UTILS_HISTOGRAM_SUB_BITS 5
+#define UTILS_HISTOGRAM_SUB_COUNT (1 << UTILS_HISTOGRAM_SUB_BITS)
+#define UTILS_HISTOGRAM_MAX_EXPONENT 40 /* values above 2^41 are clamped to the last bucket */
+#define UTILS_HISTOGRAM_BUCKETS_COUNT \
+  ((UTILS_HISTOGRAM_MAX_EXPONENT - UTILS_HISTOGRAM_SUB_BITS + 2) * UTILS_HISTOGRAM_SUB_COUNT)
+
+typedef struct utils_histogram {
+  u64 count;
+  u64 max;
+  u64 buckets[UTILS_HISTOGRAM_BUCKETS_COUNT];
+} utils_histogram_t;
+
+/* safe to call concurrently with readers, buckets are updated with relaxed atomics */
+void utils_histogram_record(utils_histogram_t *histogram, u64 value);
+/* returns upper bound of the bucket containing given quantile (e.g 0.99), 0 if empty */
+u64 utils_histogram_get_percentile(utils_histogram_t const *histogram, double quantile);
+u64 utils_histogram_get_count(utils_histogram_t const *histogram);
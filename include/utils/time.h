@@ -1,7 +1,81 @@
 #ifndef UTILS_TIME_H
 #define UTILS_TIME_H
 
-/* returns milliseconds since epoch with milliseconds in current second */
-long utils_time_get_milliseconds_since_epoch(void);
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "typedefs.h"
+
+/* returns CLOCK_MONOTONIC time in nanoseconds */
+u64 utils_time_get_monotonic_nanoseconds(void);
+typedef enum utils_time_wait_status {
+  UTILS_TIME_WAIT_FAILED = -1, /* errno is set */
+  UTILS_TIME_WAIT_EXPIRED,     /* deadline is reached */
+  UTILS_TIME_WAIT_READABLE,    /* file descriptor is readable */
+  UTILS_TIME_WAIT_CLOCK_SET,   /* wall-clock time was set or stepped, or system resumed, before deadline */
+} utils_time_wait_status_t;
+
+/* absolute wall-clock timer, owned by a single thread */
+typedef struct utils_time_timer {
+  int file_descriptor; /* timerfd, -1 for virtual clock */
+} utils_time_timer_t;
+
+/* source of wall-clock time and timed waits, substituted with virtual clock to simulate time */
+typedef struct utils_time_clock {
+  /* returns CLOCK_REALTIME time in nanoseconds */
+  u64 (*get_realtime)(struct utils_time_clock *clock);
+  bool (*timer_construct)(struct utils_time_clock *clock, utils_time_timer_t *timer);
+  void (*timer_destruct)(struct utils_time_clock *clock, utils_time_timer_t *timer);
+  /* waits until file descriptor is readable or CLOCK_REALTIME reaches deadline in nanoseconds since epoch,
+     readable file descriptor takes precedence over deadline */
+  utils_time_wait_status_t (*wait_until)(struct utils_time_clock *clock, utils_time_timer_t *timer,
+                                         int file_descriptor, u64 deadline);
+} utils_time_clock_t;
+
+/* simulated clock, every wait advances time to its deadline without sleeping */
+typedef struct utils_time_virtual_clock {
+  utils_time_clock_t clock;
+  u64 realtime;   /* current simulated CLOCK_REALTIME time in nanoseconds */
+  u64 end_time;   /* waits report file descriptor readable once deadline is past end time */
+  u64 wait_count; /* waits which ended on deadline */
+  u64 step_time;  /* realtime when clock and end time are stepped by step_offset, 0 - never */
+  i64 step_offset;
+} utils_time_virtual_clock_t;
+
+#define UTILS_TIME_INFINITE UINT64_MAX
+
+utils_time_clock_t *utils_time_get_system_clock(void);
+void utils_time_virtual_clock_construct(utils_time_virtual_clock_t *clock, u64 start_time, u64 end_time);
+/* steps simulated time by offset once realtime reaches step time, like settimeofday or NTP step would */
+void utils_time_virtual_clock_step(utils_time_virtual_clock_t *clock, u64 step_time, i64 offset);
+
+static inline u64 utils_time_clock_get_realtime(utils_time_clock_t *clock) {
+  return clock->get_realtime(clock);
+}
+
+static inline bool utils_time_clock_timer_construct(utils_time_clock_t *clock, utils_time_timer_t *timer) {
+  return clock->timer_construct(clock, timer);
+}
+
+static inline void utils_time_clock_timer_destruct(utils_time_clock_t *clock, utils_time_timer_t *timer) {
+  clock->timer_destruct(clock, timer);
+}
+
+static inline utils_time_wait_status_t utils_time_clock_wait_until(utils_time_clock_t *clock,
+                                                                   utils_time_timer_t *timer, int file_descriptor,
+                                                                   u64 deadline) {
+  return clock->wait_until(clock, timer, file_descriptor, deadline);
+}
+
+/* parses duration with unit suffix "ms", "s", "m" or "h" (e.g "30s"), number without suffix is seconds,
+   rejects durations which don't fit u64 in nanoseconds */
+bool utils_time_parse_duration(char const *duration, u64 *milliseconds);
+
+/* longest module interval, poll timeouts take interval in milliseconds as int */
+#define UTILS_TIME_MAX_INTERVAL_MS INT_MAX
+
+/* parses non-zero duration of at most UTILS_TIME_MAX_INTERVAL_MS, nanoseconds is left untouched on failure */
+bool utils_time_parse_interval(char const *interval, u64 *nanoseconds);
 
 #endif /* end of include guard: UTILS_TIME_H */
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "typedefs.h"
+
+#define UTILS_TZ_MAX_ABBREVIATION_LENGTH 15
+
+/* local time type of a zone (e.g CET, CEST) */
+typedef struct utils_tz_type {
+  i32 offset; /* seconds east of UTC */
+  bool is_dst;
+  char abbreviation[UTILS_TZ_MAX_ABBREVIATION_LENGTH + 1];
+} utils_tz_type_t;
+
+/* day of a POSIX TZ rule: Jn, n or Mm.w.d */
+typedef struct utils_tz_rule_date {
+  enum {
+    UTILS_TZ_RULE_DATE_JULIAN,         /* Jn, 1-365 without February 29 */
+    UTILS_TZ_RULE_DATE_DAY,            /* n, 0-365 with February 29 */
+    UTILS_TZ_RULE_DATE_MONTH_WEEK_DAY, /* Mm.w.d, d-th weekday of w-th week of month m, week 5 - last */
+  } kind;
+  u16 day;   /* n of Jn and n, weekday of Mm.w.d (0 - Sunday) */
+  u8 month;  /* 1-12 */
+  u8 week;   /* 1-5 */
+  i32 time;  /* seconds after local midnight, may be negative or past 24 hours */
+} utils_tz_rule_date_t;
+
+/* POSIX TZ rule (e.g "CET-1CEST,M3.5.0,M10.5.0/3"), applies past last transition of TZif file */
+typedef struct utils_tz_rule {
+  utils_tz_type_t standard;
+  utils_tz_type_t daylight;
+  bool has_daylight;
+  utils_tz_rule_date_t start; /* daylight saving time start in local standard time */
+  utils_tz_rule_date_t end;   /* daylight saving time end in local daylight time */
+} utils_tz_rule_t;
+
+/* zone rules loaded once from tzdata, conversions don't touch TZ or other global state of libc */
+typedef struct utils_tz {
+  i64 *transitions; /* seconds since epoch, ascending */
+  u8 *transition_types;
+  usize transitions_count;
+  utils_tz_type_t *types;
+  usize types_count;
+  utils_tz_rule_t rule;
+  bool has_rule;
+} utils_tz_t;
+
+/* loads zone by tzdata name (e.g "Europe/Berlin") from TZDIR or /usr/share/zoneinfo, absolute TZif path or POSIX
+   TZ string, "local" follows TZ environment variable and falls back to /etc/localtime and UTC */
+bool utils_tz_construct(utils_tz_t *tz, char const *name);
+void utils_tz_destruct(utils_tz_t *tz);
+/* fills broken-down time including tm_gmtoff, tm_zone points into tz and is valid until it's destructed */
+bool utils_tz_get_local_time(utils_tz_t const *tz, i64 time, struct tm *local_time);
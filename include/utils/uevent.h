@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "typedefs.h"
+
+/* kernel uevents are below 2048 bytes of environment plus header */
+#define UTILS_UEVENT_BUFFER_SIZE 8192
+
+typedef enum utils_uevent_status {
+  UTILS_UEVENT_FAILED = -1, /* errno is set */
+  UTILS_UEVENT_NONE,        /* no uevent pending */
+  UTILS_UEVENT_RECEIVED,
+  UTILS_UEVENT_OVERFLOW, /* socket buffer overflowed and uevents were dropped, state has to be reread */
+} utils_uevent_status_t;
+
+/* kernel uevent ("change@/devices/...\0ACTION=change\0DEVPATH=...\0SUBSYSTEM=...\0"), points into receive buffer */
+typedef struct utils_uevent {
+  char const *action;    /* "add", "remove", "change", ... */
+  char const *devpath;   /* device path below sysfs root (e.g "/devices/.../backlight/intel_backlight") */
+  char const *subsystem; /* e.g "backlight", "power_supply" */
+  char const *variables; /* KEY=VALUE pairs separated by null */
+  usize variables_length;
+} utils_uevent_t;
+
+/* source of uevent sockets, substituted to inject synthetic uevents into modules */
+typedef struct utils_uevent_source {
+  /* returns non-blocking datagram socket delivering one uevent per message, -1 on error */
+  int (*open)(struct utils_uevent_source *source);
+} utils_uevent_source_t;
+
+/* NETLINK_KOBJECT_UEVENT socket subscribed to kernel uevents */
+utils_uevent_source_t *utils_uevent_get_kernel_source(void);
+/* receives next uevent of subsystem (null - any), skipping others and messages not sent by kernel */
+utils_uevent_status_t utils_uevent_receive(int file_descriptor, char const *subsystem, char *buffer, usize size,
+                                           utils_uevent_t *uevent);
+/* parses null-terminated message of length bytes */
+bool utils_uevent_parse(char const *message, usize length, utils_uevent_t *uevent);
+/* returns value of KEY=VALUE variable, null if missing */
+char const *utils_uevent_get(utils_uevent_t const *uevent, char const *key);
+/* returns last component of devpath, kernel name of device (e.g "intel_backlight", "BAT0") */
+char const *utils_uevent_get_name(utils_uevent_t const *uevent);
+
+static inline int utils_uevent_source_open(utils_uevent_source_t *source) {
+  return source->open(source);
+}
@@ -51,14 +51,20 @@ static char *get_config_path(void) {
   return NULL;
 }
 
-bool config_construct(config_t *config) {
-  char *config_file_path = get_config_path();
+bool config_construct(config_t *config, char const *path) {
+  char *config_file_path = NULL;
 
-  if (config_file_path == NULL) {
-    goto error;
+  if (path == NULL) {
+    config_file_path = get_config_path();
+
+    if (config_file_path == NULL) {
+      goto error;
+    }
+
+    path = config_file_path;
   }
 
-  FILE *config_file = fopen(config_file_path, "r");
+  FILE *config_file = fopen(path, "r");
   free(config_file_path);
 
   if (config_file == NULL) {
@@ -132,10 +138,23 @@ bool config_construct(config_t *config) {
       goto error;
     }
 
-    config->modules[module_index] = (config_module_t){.key = module_key.u.s, .config = module_config};
+    config->modules[module_index] = (config_module_t){
+      .key = module_key.u.s,
+      .config = module_config,
+      .thread = toml_table_table(module, "thread"),
+    };
   }
 
   config->modules_count = modules_count;
+  config->thread = toml_table_table(config_root, "thread");
+  config->metrics = toml_table_table(config_root, "metrics");
+  config->supervisor = toml_table_table(config_root, "supervisor");
+
+  toml_value_t log_level = toml_table_string(config_root, "log_level");
+
+  if (log_level.ok) {
+    config->log_level = log_level.u.s;
+  }
 
   return true;
 
@@ -156,5 +175,6 @@ void config_destruct(config_t *config) {
   }
 
   free(config->modules);
+  free(config->log_level);
   toml_free(config->_private);
 }
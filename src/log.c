@@ -1,37 +1,426 @@
 #include "log.h"
 
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "macros.h"
+#include "utils/time.h"
+
+/* must be a power of two */
+#define LOG_RING_SLOTS 256
+#define LOG_RING_MESSAGE_SIZE 512
+#define LOG_WRITE_BATCH 64
+
+typedef struct log_slot {
+  u64 sequence;
+  u32 length;
+  log_level_t level;
+  char message[LOG_RING_MESSAGE_SIZE];
+} log_slot_t;
+
+/* bounded multi-producer single-consumer ring, the writer thread is the only consumer */
+typedef struct log_ring {
+  log_slot_t slots[LOG_RING_SLOTS];
+  u64 head;
+  u64 tail;
+  u64 dropped;
+  int wakeup_file_descriptor;
+  bool is_running;
+  bool is_stopping;
+  pthread_t writer;
+} log_ring_t;
+
+static log_ring_t ring = {.wakeup_file_descriptor = -1};
+static log_site_t *suppressing_sites = NULL; /* sites which suppressed messages, linked by next, never removed */
+static log_level_t current_level = LOG_INFO;
 
 static char const *const messages[] = {
   [LOG_ERROR] = "ERROR",
   [LOG_WARN] = "WARN",
+  [LOG_INFO] = "INFO",
+  [LOG_DEBUG] = "DEBUG",
 };
 
 static char const *const colors[] = {
   [LOG_ERROR] = "\033[31m",
   [LOG_WARN] = "\033[33m",
+  [LOG_INFO] = "\033[32m",
+  [LOG_DEBUG] = "\033[36m",
 };
 
-bool log_msg(log_level_t log_level, char const *module, char const *file, int line, char const *format, ...) {
-  FILE *stream = stdout;
+static inline int get_stream_file_descriptor(log_level_t log_level) {
+  return log_level == LOG_ERROR ? STDERR_FILENO : STDOUT_FILENO;
+}
 
-  if (log_level == LOG_ERROR) {
-    stream = stderr;
-  }
+static u32 format_message(char *buffer, usize size, log_level_t log_level, char const *module, char const *file,
+                          int line, char const *format, va_list args) {
+  usize const capacity = size - 1; /* room for the newline */
 
 #ifdef LOG_COLORS
-  fprintf(stream, "%s[%s %s:%d]%s %s: ", colors[log_level], messages[log_level], file, line, "\033[0m", module);
+  int header_length = snprintf(buffer, capacity, "%s[%s %s:%d]%s %s: ", colors[log_level], messages[log_level], file,
+                               line, "\033[0m", module);
 #else
-  fprintf(stream, "[%s %s:%d]%s: ", messages[log_level], file, line, module);
+  int header_length = snprintf(buffer, capacity, "[%s %s:%d]%s: ", messages[log_level], file, line, module);
 #endif
 
+  usize length = header_length > 0 ? (usize)header_length : 0;
+
+  if (length < capacity - 1) {
+    int message_length = vsnprintf(buffer + length, capacity - length, format, args);
+    length += message_length > 0 ? (usize)message_length : 0;
+  }
+
+  /* truncated messages are marked with "..." */
+  if (length > capacity - 1) {
+    length = capacity - 1;
+    memcpy(buffer + length - 3, "...", 3);
+  }
+
+  buffer[length] = '\n';
+
+  return (u32)length + 1;
+}
+
+/* suppressed - count of previous window to report, is_suppressing - first message of window is suppressed */
+static bool rate_limit_allows(log_site_t *site, u32 *suppressed, bool *is_suppressing) {
+  u64 const now = utils_time_get_monotonic_nanoseconds() / 1000000;
+  u64 window_start = __atomic_load_n(&site->window_start, __ATOMIC_RELAXED);
+
+  *suppressed = 0;
+  *is_suppressing = false;
+
+  if (now - window_start >= LOG_RATE_LIMIT_WINDOW_MS &&
+      __atomic_compare_exchange_n(&site->window_start, &window_start, now, false, __ATOMIC_RELAXED,
+                                  __ATOMIC_RELAXED)) {
+    __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+    *suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+  }
+
+  if (__atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED) >= LOG_RATE_LIMIT_BURST) {
+    *is_suppressing = __atomic_fetch_add(&site->suppressed, 1, __ATOMIC_RELAXED) == 0;
+    return false;
+  }
+
+  return true;
+}
+
+static log_slot_t *ring_claim(u64 *position) {
+  *position = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+
+  while (true) {
+    log_slot_t *slot = &ring.slots[*position & (LOG_RING_SLOTS - 1)];
+    u64 sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    i64 difference = (i64)(sequence - *position);
+
+    if (difference == 0) {
+      if (__atomic_compare_exchange_n(&ring.head, position, *position + 1, true, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED)) {
+        return slot;
+      }
+    } else if (difference < 0) {
+      /* ring is full, the writer can't keep up */
+      __atomic_fetch_add(&ring.dropped, 1, __ATOMIC_RELAXED);
+      return NULL;
+    } else {
+      *position = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static void wake_writer(void) {
+  write(ring.wakeup_file_descriptor, &(u64){1}, sizeof(u64));
+}
+
+static void ring_publish(log_slot_t *slot, u64 position) {
+  __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+  wake_writer();
+}
+
+static bool write_message(log_level_t log_level, char const *module, char const *file, int line, char const *format,
+                          va_list args) {
+  if (!__atomic_load_n(&ring.is_running, __ATOMIC_ACQUIRE)) {
+    char buffer[LOG_RING_MESSAGE_SIZE];
+    u32 length = format_message(buffer, sizeof(buffer), log_level, module, file, line, format, args);
+
+    return write(get_stream_file_descriptor(log_level), buffer, length) == (isize)length;
+  }
+
+  u64 position = 0;
+  log_slot_t *slot = ring_claim(&position);
+
+  if (slot == NULL) {
+    return false;
+  }
+
+  slot->level = log_level;
+  slot->length = format_message(slot->message, sizeof(slot->message), log_level, module, file, line, format, args);
+
+  ring_publish(slot, position);
+
+  return true;
+}
+
+static bool write_formatted(log_level_t log_level, char const *module, char const *file, int line,
+                            char const *format, ...) {
   va_list args;
 
   va_start(args, format);
-  vfprintf(stream, format, args);
-  fwrite("\n", sizeof(char), 1, stream);
+  bool status = write_message(log_level, module, file, line, format, args);
   va_end(args);
 
+  return status;
+}
+
+static void register_site(log_site_t *site, log_level_t log_level, char const *module, char const *file, int line) {
+  bool is_registered = false;
+
+  if (__atomic_load_n(&site->is_registered, __ATOMIC_RELAXED) ||
+      !__atomic_compare_exchange_n(&site->is_registered, &is_registered, true, false, __ATOMIC_RELAXED,
+                                   __ATOMIC_RELAXED)) {
+    return;
+  }
+
+  site->module = module;
+  site->file = file;
+  site->line = line;
+  site->level = log_level;
+  site->next = __atomic_load_n(&suppressing_sites, __ATOMIC_RELAXED);
+
+  while (!__atomic_compare_exchange_n(&suppressing_sites, &site->next, site, true, __ATOMIC_RELEASE,
+                                      __ATOMIC_RELAXED)) {
+  }
+}
+
+/* reports suppressed messages of sites whose window ended without another message, which would have reported them,
+   returns milliseconds until the next such window ends, -1 - none */
+static int report_suppressed(bool is_final) {
+  u64 const now = utils_time_get_monotonic_nanoseconds() / 1000000;
+  int timeout = -1;
+
+  for (log_site_t *site = __atomic_load_n(&suppressing_sites, __ATOMIC_ACQUIRE); site != NULL; site = site->next) {
+    u64 const elapsed = now - __atomic_load_n(&site->window_start, __ATOMIC_RELAXED);
+
+    if (!is_final && elapsed < LOG_RATE_LIMIT_WINDOW_MS) {
+      if (__atomic_load_n(&site->suppressed, __ATOMIC_RELAXED) != 0 &&
+          (timeout == -1 || LOG_RATE_LIMIT_WINDOW_MS - elapsed < (u64)timeout)) {
+        timeout = (int)(LOG_RATE_LIMIT_WINDOW_MS - elapsed);
+      }
+
+      continue;
+    }
+
+    u32 const suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+
+    if (suppressed > 0) {
+      write_formatted(site->level, site->module, site->file, site->line, "suppressed %u messages", suppressed);
+    }
+  }
+
+  return timeout;
+}
+
+static void writer_flush(struct iovec *iovecs, int iovecs_count, log_level_t log_level) {
+  if (iovecs_count == 0) {
+    return;
+  }
+
+  /* log output is best effort, short writes are not retried */
+  writev(get_stream_file_descriptor(log_level), iovecs, iovecs_count);
+}
+
+/* drains all published slots with one writev per run of messages going to the same stream */
+static void writer_drain(void) {
+  struct iovec iovecs[LOG_WRITE_BATCH];
+
+  while (true) {
+    u64 const tail = ring.tail;
+    u64 position = tail;
+    int iovecs_count = 0;
+    log_level_t stream_level = LOG_WARN;
+
+    while (iovecs_count < (int)countof(iovecs)) {
+      log_slot_t *slot = &ring.slots[position & (LOG_RING_SLOTS - 1)];
+
+      if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != position + 1) {
+        break;
+      }
+
+      if (iovecs_count > 0 &&
+          get_stream_file_descriptor(slot->level) != get_stream_file_descriptor(stream_level)) {
+        break;
+      }
+
+      stream_level = slot->level;
+      iovecs[iovecs_count++] = (struct iovec){.iov_base = slot->message, .iov_len = slot->length};
+      position++;
+    }
+
+    if (iovecs_count == 0) {
+      break;
+    }
+
+    writer_flush(iovecs, iovecs_count, stream_level);
+
+    for (u64 released = tail; released < position; released++) {
+      log_slot_t *slot = &ring.slots[released & (LOG_RING_SLOTS - 1)];
+      __atomic_store_n(&slot->sequence, released + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+    }
+
+    ring.tail = position;
+  }
+
+  u64 dropped = __atomic_exchange_n(&ring.dropped, 0, __ATOMIC_RELAXED);
+
+  if (dropped > 0) {
+    char buffer[64];
+    int length = snprintf(buffer, sizeof(buffer), "log: dropped %lu messages\n", (unsigned long)dropped);
+    write(STDERR_FILENO, buffer, (usize)length);
+  }
+}
+
+static void *writer_thread(void *param) {
+  (void)param;
+
+  int timeout = -1;
+
+  while (true) {
+    struct pollfd pfd = {.fd = ring.wakeup_file_descriptor, .events = POLLIN};
+    int const poll_status = poll(&pfd, 1, timeout);
+    u64 value;
+
+    if (poll_status < 0 && errno != EINTR) {
+      break;
+    }
+
+    if (poll_status > 0 && read(ring.wakeup_file_descriptor, &value, sizeof(value)) < 0 && errno != EINTR) {
+      break;
+    }
+
+    timeout = report_suppressed(false);
+    writer_drain();
+
+    if (__atomic_load_n(&ring.is_stopping, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+bool log_construct(void) {
+  for (u64 slot_index = 0; slot_index < LOG_RING_SLOTS; slot_index++) {
+    ring.slots[slot_index].sequence = slot_index;
+  }
+
+  ring.head = 0;
+  ring.tail = 0;
+  ring.is_stopping = false;
+  ring.wakeup_file_descriptor = eventfd(0, EFD_CLOEXEC);
+
+  if (ring.wakeup_file_descriptor == -1) {
+    return false;
+  }
+
+  /* signals must be delivered to the status line threads, not to the writer */
+  sigset_t signals, previous_signals;
+  sigfillset(&signals);
+  pthread_sigmask(SIG_SETMASK, &signals, &previous_signals);
+
+  int create_status = pthread_create(&ring.writer, NULL, writer_thread, NULL);
+
+  pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+
+  if (create_status != 0) {
+    close(ring.wakeup_file_descriptor);
+    ring.wakeup_file_descriptor = -1;
+    return false;
+  }
+
+  __atomic_store_n(&ring.is_running, true, __ATOMIC_RELEASE);
+
   return true;
 }
+
+void log_destruct(void) {
+  if (!__atomic_load_n(&ring.is_running, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+
+  __atomic_store_n(&ring.is_stopping, true, __ATOMIC_RELEASE);
+  write(ring.wakeup_file_descriptor, &(u64){1}, sizeof(u64));
+  pthread_join(ring.writer, NULL);
+
+  __atomic_store_n(&ring.is_running, false, __ATOMIC_RELEASE);
+
+  /* messages published while the writer was exiting, then counts of floods still in their window */
+  writer_drain();
+  report_suppressed(true);
+
+  close(ring.wakeup_file_descriptor);
+  ring.wakeup_file_descriptor = -1;
+}
+
+void log_set_level(log_level_t log_level) {
+  __atomic_store_n(&current_level, log_level, __ATOMIC_RELAXED);
+}
+
+bool log_parse_level(char const *name, log_level_t *log_level) {
+  static char const *const names[] = {
+    [LOG_ERROR] = "error",
+    [LOG_WARN] = "warn",
+    [LOG_INFO] = "info",
+    [LOG_DEBUG] = "debug",
+  };
+
+  for (usize name_index = 0; name_index < countof(names); name_index++) {
+    if (strcmp(names[name_index], name) == 0) {
+      *log_level = (log_level_t)name_index;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool log_msg(log_site_t *site, log_level_t log_level, char const *module, char const *file, int line,
+             char const *format, ...) {
+  if (log_level > __atomic_load_n(&current_level, __ATOMIC_RELAXED)) {
+    return false;
+  }
+
+  u32 suppressed = 0;
+  bool is_suppressing = false;
+
+  if (!rate_limit_allows(site, &suppressed, &is_suppressing)) {
+    /* writer reports the count if no message of the site comes after the window */
+    if (is_suppressing) {
+      register_site(site, log_level, module, file, line);
+
+      if (__atomic_load_n(&ring.is_running, __ATOMIC_ACQUIRE)) {
+        wake_writer();
+      }
+    }
+
+    return false;
+  }
+
+  if (suppressed > 0) {
+    write_formatted(log_level, module, file, line, "suppressed %u messages", suppressed);
+  }
+
+  va_list args;
+
+  va_start(args, format);
+  bool status = write_message(log_level, module, file, line, format, args);
+  va_end(args);
+
+  return status;
+}
@@ -1,32 +1,208 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "config.h"
 #include "log.h"
+#include "profile.h"
 #include "status_line.h"
+#include "top.h"
+#include "trace.h"
+#include "utils/time.h"
 
-int main(void) {
+#define TOP_INTERVAL_MS 1000
+
+typedef struct arguments {
+  bool is_top;
+  u64 profile_ms;          /* non-zero - run headless for given duration and print profile */
+  char const *config_path; /* non-null - config file instead of default location */
+  char const *record_path; /* non-null - record module events into trace file */
+  char const *replay_path; /* non-null - replay trace file headless and print profile */
+  bool is_replay_fast;     /* replay without waiting for recorded event times */
+} arguments_t;
+
+static bool parse_arguments(arguments_t *arguments, int argc, char *argv[]) {
+  for (int argument_index = 1; argument_index < argc; argument_index++) {
+    char const *argument = argv[argument_index];
+
+    if (strcmp(argument, "--top") == 0) {
+      arguments->is_top = true;
+    } else if (strcmp(argument, "--profile") == 0) {
+      if (argument_index + 1 >= argc || !utils_time_parse_duration(argv[argument_index + 1], &arguments->profile_ms) ||
+          arguments->profile_ms == 0) {
+        log_error("--profile requires non-zero duration (e.g \"30s\")");
+        return false;
+      }
+
+      argument_index++;
+    } else if (strcmp(argument, "--config") == 0 || strcmp(argument, "--record") == 0 ||
+               strcmp(argument, "--replay") == 0) {
+      if (argument_index + 1 >= argc) {
+        log_error("%s requires file path", argument);
+        return false;
+      }
+
+      char const *path = argv[++argument_index];
+
+      if (strcmp(argument, "--config") == 0) {
+        arguments->config_path = path;
+      } else if (strcmp(argument, "--record") == 0) {
+        arguments->record_path = path;
+      } else {
+        arguments->replay_path = path;
+      }
+    } else if (strcmp(argument, "--fast") == 0) {
+      arguments->is_replay_fast = true;
+    } else {
+      log_error("Unknown argument \"%s\"", argument);
+      return false;
+    }
+  }
+
+  if (arguments->record_path != NULL && arguments->replay_path != NULL) {
+    log_error("--record and --replay can't be used together");
+    return false;
+  }
+
+  if (arguments->is_replay_fast && arguments->replay_path == NULL) {
+    log_error("--fast requires --replay");
+    return false;
+  }
+
+  return true;
+}
+
+static void print_usage(char const *name) {
+  fprintf(stderr,
+          "usage: %s [--config FILE] [--top | --profile DURATION | --record FILE | --replay FILE [--fast]]\n"
+          "  --config FILE        use config FILE instead of status_line.toml in config directory\n"
+          "  --top                show cpu usage and wakeups of modules of running status line\n"
+          "  --profile DURATION   run modules without X output for DURATION (e.g 30s) and print profile\n"
+          "  --record FILE        record module events into trace FILE\n"
+          "  --replay FILE        replay module events from trace FILE without X output and print profile\n"
+          "  --fast               replay as fast as possible instead of recorded event times\n",
+          name);
+}
+
+static int run_top(config_t const *config) {
+  toml_value_t socket_path = {0};
+
+  if (config->metrics != NULL) {
+    socket_path = toml_table_string(config->metrics, "socket");
+  }
+
+  if (!socket_path.ok) {
+    log_error("Metrics socket is not configured");
+    return EXIT_FAILURE;
+  }
+
+  int status = top_run(socket_path.u.s, TOP_INTERVAL_MS);
+  free(socket_path.u.s);
+
+  return status;
+}
+
+static bool construct_trace_writer(trace_writer_t *trace_writer, char const *path, config_t const *config) {
+  char const **keys = calloc(config->modules_count + 1, sizeof(*keys));
+
+  if (keys == NULL) {
+    log_error("Failed to allocate trace module keys");
+    return false;
+  }
+
+  for (usize module_index = 0; module_index < config->modules_count; module_index++) {
+    keys[module_index] = config->modules[module_index].key;
+  }
+
+  bool status = trace_writer_construct(trace_writer, path, keys, config->modules_count);
+  free(keys);
+
+  return status;
+}
+
+int main(int argc, char *argv[]) {
   int status = EXIT_FAILURE;
   config_t config = {0};
+  arguments_t arguments = {0};
 
-  if (!config_construct(&config)) {
+  if (!log_construct()) {
+    log_warn("Failed to start log writer, logging synchronously");
+  }
+
+  if (!parse_arguments(&arguments, argc, argv)) {
+    print_usage(argv[0]);
+    goto done;
+  }
+
+  if (!config_construct(&config, arguments.config_path)) {
     log_error("Failed to get config");
     goto done;
   }
 
+  if (config.log_level != NULL) {
+    log_level_t log_level;
+
+    if (!log_parse_level(config.log_level, &log_level)) {
+      log_error("Unknown log level \"%s\"", config.log_level);
+      goto free_config;
+    }
+
+    log_set_level(log_level);
+  }
+
+  if (arguments.is_top) {
+    status = run_top(&config);
+    goto free_config;
+  }
+
+  bool const is_profile = arguments.profile_ms != 0 || arguments.replay_path != NULL;
   status_line_t status_line = {0};
+  status_line_output_t const output = is_profile ? STATUS_LINE_OUTPUT_NULL : STATUS_LINE_OUTPUT_X11;
 
-  if (!status_line_construct(&status_line, config.modules_count)) {
+  if (!status_line_construct(&status_line, config.modules_count, output)) {
     log_error("Failed to initialize status line");
     goto free_config;
   }
 
+  status_line.duration_ms = arguments.profile_ms;
+
+  trace_writer_t trace_writer = {0};
+  trace_reader_t trace_reader = {0};
+
+  if (arguments.record_path != NULL) {
+    if (!construct_trace_writer(&trace_writer, arguments.record_path, &config)) {
+      goto free_status_line;
+    }
+
+    status_line.trace_writer = &trace_writer;
+  }
+
+  if (arguments.replay_path != NULL) {
+    if (!trace_reader_construct(&trace_reader, arguments.replay_path)) {
+      goto free_status_line;
+    }
+
+    status_line.trace_reader = &trace_reader;
+    status_line.is_replay_fast = arguments.is_replay_fast;
+  }
+
+  u64 const start_time = utils_time_get_monotonic_nanoseconds();
+
   if (!status_line_run(&status_line, &config)) {
     log_error("Failed to run status line");
-    goto free_status_line;
+    goto free_trace;
+  }
+
+  if (is_profile) {
+    profile_print(&status_line, (utils_time_get_monotonic_nanoseconds() - start_time) / 1000000, stdout);
   }
 
   status = EXIT_SUCCESS;
 
+free_trace:
+  trace_writer_destruct(&trace_writer);
+  trace_reader_destruct(&trace_reader);
+
 free_status_line:
   status_line_destruct(&status_line);
 
@@ -34,5 +210,7 @@ free_config:
   config_destruct(&config);
 
 done:
+  log_destruct();
+
   return status;
 }
@@ -0,0 +1,262 @@
+#define _GNU_SOURCE
+
+#include "metrics.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define LOG_MODULE "metrics"
+
+#include "log.h"
+#include "macros.h"
+
+typedef struct metrics_descriptor {
+  char const *name;
+  char const *type;
+  char const *help;
+  usize offset;
+  u64 divisor; /* non-zero divisor for values exported in other units (e.g nanoseconds as seconds) */
+} metrics_descriptor_t;
+
+static metrics_descriptor_t const module_descriptors[] = {
+  {"status_line_module_updates_total", "counter", "Module text updates.", offsetof(metrics_module_t, updates), 0},
+  {"status_line_module_suppressed_updates_total", "counter", "Module updates which didn't change module text.",
+   offsetof(metrics_module_t, suppressed_updates), 0},
+  {"status_line_module_renders_total", "counter", "Status line renders triggered by module.",
+   offsetof(metrics_module_t, renders), 0},
+  {"status_line_module_errors_total", "counter", "Module errors.", offsetof(metrics_module_t, errors), 0},
+  {"status_line_module_restarts_total", "counter", "Module restarts.", offsetof(metrics_module_t, restarts), 0},
+  {"status_line_module_downtime_seconds_total", "counter", "Time modules spent exited before restart.",
+   offsetof(metrics_module_t, downtime), 1000000000},
+  {"status_line_module_up", "gauge", "Whether module thread is running.", offsetof(metrics_module_t, up), 0},
+  {"status_line_module_published_bytes_total", "counter", "Bytes of module text published.",
+   offsetof(metrics_module_t, published_bytes), 0},
+  {"status_line_module_wakeups_total", "counter", "Module thread wakeups.", offsetof(metrics_module_t, wakeups), 0},
+  {"status_line_module_cpu_seconds_total", "counter", "Module thread cpu time.", offsetof(metrics_module_t, cpu_time),
+   1000000000},
+  {"status_line_module_voluntary_context_switches_total", "counter", "Module thread voluntary context switches.",
+   offsetof(metrics_module_t, voluntary_switches), 0},
+  {"status_line_module_involuntary_context_switches_total", "counter", "Module thread involuntary context switches.",
+   offsetof(metrics_module_t, involuntary_switches), 0},
+};
+
+static metrics_descriptor_t const global_descriptors[] = {
+  {"status_line_frames_total", "counter", "Status line frames rendered.", offsetof(metrics_global_t, frames), 0},
+  {"status_line_x_flushes_total", "counter", "X connection flushes.", offsetof(metrics_global_t, flushes), 0},
+  {"status_line_line_length_bytes", "gauge", "Length of last rendered status line.",
+   offsetof(metrics_global_t, line_length), 0},
+};
+
+static double const latency_quantiles[] = {0.5, 0.99, 0.999};
+
+static inline u64 get_counter(void const *counters, usize offset) {
+  return metrics_get((u64 const *)((char const *)counters + offset));
+}
+
+static inline void print_value(FILE *stream, metrics_descriptor_t const *descriptor, u64 value) {
+  if (descriptor->divisor == 0) {
+    fprintf(stream, " %lu\n", (unsigned long)value);
+  } else {
+    fprintf(stream, " %.9f\n", (double)value / (double)descriptor->divisor);
+  }
+}
+
+static inline void print_header(FILE *stream, metrics_descriptor_t const *descriptor) {
+  fprintf(stream, "# HELP %s %s\n# TYPE %s %s\n", descriptor->name, descriptor->help, descriptor->name,
+          descriptor->type);
+}
+
+bool metrics_construct(metrics_t *metrics, usize modules_count) {
+  void *global = NULL;
+  void *modules = NULL;
+
+  /* allocations stay non-empty for status line without modules */
+  if (posix_memalign(&global, METRICS_CACHE_LINE_SIZE, sizeof(*metrics->global)) != 0) {
+    log_error("Failed to allocate global metrics");
+    goto error;
+  }
+
+  if (posix_memalign(&modules, METRICS_CACHE_LINE_SIZE, (modules_count + 1) * sizeof(*metrics->modules)) != 0) {
+    log_error("Failed to allocate module metrics");
+    goto error;
+  }
+
+  metrics->module_names = calloc(modules_count + 1, sizeof(*metrics->module_names));
+
+  if (metrics->module_names == NULL) {
+    log_error("Failed to allocate module names");
+    goto error;
+  }
+
+  memset(global, 0, sizeof(*metrics->global));
+  memset(modules, 0, (modules_count + 1) * sizeof(*metrics->modules));
+
+  metrics->global = global;
+  metrics->modules = modules;
+  metrics->modules_count = modules_count;
+
+  return true;
+
+error:
+  free(global);
+  free(modules);
+
+  return false;
+}
+
+void metrics_destruct(metrics_t *metrics) {
+  free(metrics->global);
+  free(metrics->modules);
+  free(metrics->module_names);
+
+  *metrics = (metrics_t){0};
+}
+
+bool metrics_print(metrics_t const *metrics, FILE *stream) {
+  for (usize descriptor_index = 0; descriptor_index < countof(global_descriptors); descriptor_index++) {
+    metrics_descriptor_t const *descriptor = &global_descriptors[descriptor_index];
+
+    print_header(stream, descriptor);
+    fprintf(stream, "%s", descriptor->name);
+    print_value(stream, descriptor, get_counter(metrics->global, descriptor->offset));
+  }
+
+  for (usize descriptor_index = 0; descriptor_index < countof(module_descriptors); descriptor_index++) {
+    metrics_descriptor_t const *descriptor = &module_descriptors[descriptor_index];
+
+    print_header(stream, descriptor);
+
+    for (usize module_index = 0; module_index < metrics->modules_count; module_index++) {
+      char const *module_name = metrics->module_names[module_index];
+
+      fprintf(stream, "%s{module=\"%s\",index=\"%lu\"}", descriptor->name, module_name != NULL ? module_name : "",
+              (unsigned long)module_index);
+      print_value(stream, descriptor, get_counter(&metrics->modules[module_index], descriptor->offset));
+    }
+  }
+
+  fprintf(stream,
+          "# HELP status_line_module_event_latency_seconds Time from module event to flushed frame.\n"
+          "# TYPE status_line_module_event_latency_seconds summary\n");
+
+  for (usize module_index = 0; module_index < metrics->modules_count; module_index++) {
+    char const *module_name = metrics->module_names[module_index] != NULL ? metrics->module_names[module_index] : "";
+    utils_histogram_t const *latency = &metrics->modules[module_index].latency;
+
+    for (usize quantile_index = 0; quantile_index < countof(latency_quantiles); quantile_index++) {
+      fprintf(stream, "status_line_module_event_latency_seconds{module=\"%s\",index=\"%lu\",quantile=\"%g\"} %.9f\n",
+              module_name, (unsigned long)module_index, latency_quantiles[quantile_index],
+              (double)utils_histogram_get_percentile(latency, latency_quantiles[quantile_index]) / 1e9);
+    }
+
+    fprintf(stream, "status_line_module_event_latency_seconds_count{module=\"%s\",index=\"%lu\"} %lu\n", module_name,
+            (unsigned long)module_index, (unsigned long)utils_histogram_get_count(latency));
+  }
+
+  return ferror(stream) == 0;
+}
+
+bool metrics_dump(metrics_t const *metrics, char const *path) {
+  FILE *stream = fopen(path, "w");
+
+  if (stream == NULL) {
+    log_error("Failed to open metrics dump file \"%s\"", path);
+    return false;
+  }
+
+  bool status = metrics_print(metrics, stream);
+
+  if (fclose(stream) != 0) {
+    status = false;
+  }
+
+  return status;
+}
+
+void metrics_account_thread(metrics_module_t *metrics) {
+  struct timespec cpu_time;
+
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_time) == 0) {
+    metrics_set(&metrics->cpu_time, (u64)cpu_time.tv_sec * 1000000000UL + (u64)cpu_time.tv_nsec);
+  }
+
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+    metrics_set(&metrics->voluntary_switches, (u64)usage.ru_nvcsw);
+    metrics_set(&metrics->involuntary_switches, (u64)usage.ru_nivcsw);
+  }
+}
+
+int metrics_listen(char const *path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    log_error("Metrics socket path is too long");
+    return -1;
+  }
+
+  strcpy(address.sun_path, path);
+
+  int file_descriptor = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (file_descriptor == -1) {
+    log_error("Failed to create metrics socket");
+    return -1;
+  }
+
+  /* remove socket left from previous run */
+  unlink(path);
+
+  if (bind(file_descriptor, (struct sockaddr const *)&address, sizeof(address)) == -1 ||
+      listen(file_descriptor, 4) == -1) {
+    log_error("Failed to listen on metrics socket \"%s\": %s", path, strerror(errno));
+    close(file_descriptor);
+    return -1;
+  }
+
+  return file_descriptor;
+}
+
+void metrics_serve(metrics_t const *metrics, int listen_file_descriptor) {
+  int client_file_descriptor;
+
+  while ((client_file_descriptor = accept(listen_file_descriptor, NULL, NULL)) != -1) {
+    char *buffer = NULL;
+    size_t buffer_size = 0;
+    FILE *stream = open_memstream(&buffer, &buffer_size);
+
+    if (stream == NULL) {
+      log_error("Failed to open metrics stream");
+      close(client_file_descriptor);
+      return;
+    }
+
+    bool status = metrics_print(metrics, stream);
+
+    if (fclose(stream) != 0) {
+      status = false;
+    }
+
+    /* clients which don't read fast enough are dropped instead of blocking the status line */
+    for (usize offset = 0; status && offset < buffer_size;) {
+      isize written = send(client_file_descriptor, buffer + offset, buffer_size - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+      if (written <= 0) {
+        break;
+      }
+
+      offset += (usize)written;
+    }
+
+    free(buffer);
+    close(client_file_descriptor);
+  }
+}
@@ -2,24 +2,41 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 #define LOG_MODULE "module"
 
 #include "log.h"
 #include "macros.h"
+#include "metrics.h"
+#include "modules/battery.h"
 #include "modules/brightness.h"
 #include "modules/clock.h"
+#include "modules/cpu.h"
+#include "modules/disk.h"
 #include "modules/keyboard.h"
+#include "modules/memory.h"
+#include "modules/net.h"
+#include "modules/pressure.h"
 #include "modules/sound.h"
+#include "modules/temperature.h"
 #include "status_line.h"
 #include "toml.h"
+#include "trace.h"
+#include "utils/histogram.h"
 #include "utils/string.h"
+#include "utils/time.h"
+
+#define ACCOUNT_INTERVAL 100000000UL /* nanoseconds, minimal time between cpu usage samples of module thread */
 
 typedef struct module_get_run_item {
   char *key;
   module_run run;
+  module_run replay;
 } module_get_run_item_t;
 
+/* length is of text after formatters are replaced, copy may be shorter than that */
 static char *allocate_and_copy_buffer(char const *copy, usize length) {
   char *buffer = malloc(length + 1);
 
@@ -27,8 +44,10 @@ static char *allocate_and_copy_buffer(char const *copy, usize length) {
     return NULL;
   }
 
-  memcpy(buffer, copy, length);
-  buffer[length] = '\0';
+  usize const copy_length = strnlen(copy, length);
+
+  memcpy(buffer, copy, copy_length);
+  buffer[copy_length] = '\0';
 
   return buffer;
 }
@@ -59,50 +78,162 @@ static bool replace_formatters(char *buffer, usize length, char const *formatter
   return true;
 }
 
-bool module_update(module_t *module, char const *format, char const *formatters[][2]) {
+void module_clear(module_t *module) {
   pthread_mutex_lock(&module->lock);
-
   free(module->buffer);
   module->buffer = NULL;
+  pthread_mutex_unlock(&module->lock);
+}
 
-  if (formatters) {
-    usize length = calculate_new_length(format, formatters);
+void module_wakeup(module_t *module) {
+  metrics_add(&module->metrics->wakeups, 1);
 
-    char *buffer = allocate_and_copy_buffer(format, length);
+  /* accounting takes two syscalls, an event storm would pay them on every wakeup */
+  u64 const now = utils_time_get_monotonic_nanoseconds();
 
-    if (buffer == NULL) {
-      log_error("Failed to allocate buffer");
-      goto error;
-    }
+  if (now - module->account_time >= ACCOUNT_INTERVAL) {
+    module->account_time = now;
+    metrics_account_thread(module->metrics);
+  }
+}
 
-    if (!replace_formatters(buffer, length, formatters)) {
-      log_error("Failed to replace strings");
-      goto error;
-    }
+void module_mark_event(module_t *module) {
+  module_mark_event_at(module, utils_time_get_monotonic_nanoseconds());
+}
+
+void module_mark_event_at(module_t *module, u64 event_time) {
+  if (module->event_time == 0) {
+    module->event_time = event_time;
+  }
+}
+
+bool module_is_recording(module_t const *module) {
+  return module->status_line->trace_writer != NULL;
+}
+
+void module_record(module_t *module, void const *payload, usize length) {
+  if (!module_is_recording(module)) {
+    return;
+  }
+
+  if (!trace_writer_write(module->status_line->trace_writer, module->index, payload, length)) {
+    log_error("Failed to record module event");
+  }
+}
+
+bool module_replay_next(module_t *module, void const **payload, usize *length) {
+  module_replay_t *replay = &module->replay;
+  bool status = false;
+
+  pthread_mutex_lock(&module->lock);
 
-    module->buffer = buffer;
-  } else {
-    module->buffer = allocate_and_copy_buffer(format, strlen(format));
+  /* previous event is handled, release replay driver */
+  if (replay->state == MODULE_REPLAY_TAKEN) {
+    replay->state = MODULE_REPLAY_EMPTY;
+    pthread_cond_broadcast(&replay->condition);
+  }
+
+  while (replay->state != MODULE_REPLAY_FULL && !replay->is_closed) {
+    pthread_cond_wait(&replay->condition, &module->lock);
+  }
+
+  if (replay->state == MODULE_REPLAY_FULL) {
+    replay->state = MODULE_REPLAY_TAKEN;
+    *payload = replay->payload;
+    *length = replay->length;
+    status = true;
+  }
+
+  pthread_mutex_unlock(&module->lock);
+
+  return status;
+}
+
+void module_replay_deliver(module_t *module, void const *payload, usize length) {
+  module_replay_t *replay = &module->replay;
+
+  pthread_mutex_lock(&module->lock);
 
-    if (module->buffer == NULL) {
-      log_error("Failed to allocate buffer");
-      goto error;
+  if (!replay->is_closed) {
+    replay->payload = payload;
+    replay->length = length;
+    replay->state = MODULE_REPLAY_FULL;
+    pthread_cond_broadcast(&replay->condition);
+
+    while (replay->state != MODULE_REPLAY_EMPTY && !replay->is_closed) {
+      pthread_cond_wait(&replay->condition, &module->lock);
     }
   }
 
   pthread_mutex_unlock(&module->lock);
+}
 
-  status_line_update(module->status_line);
+void module_replay_close(module_t *module) {
+  pthread_mutex_lock(&module->lock);
 
-  return true;
+  module->replay.is_closed = true;
+  module->replay.state = MODULE_REPLAY_EMPTY;
+  pthread_cond_broadcast(&module->replay.condition);
 
-error:
+  pthread_mutex_unlock(&module->lock);
+}
+
+bool module_update(module_t *module, char const *format, char const *formatters[][2]) {
+  metrics_add(&module->metrics->updates, 1);
+
+  u64 const event_time = module->event_time;
+  module->event_time = 0;
+
+  usize length = formatters ? calculate_new_length(format, formatters) : strlen(format);
+  char *buffer = allocate_and_copy_buffer(format, length);
+
+  if (buffer == NULL) {
+    log_error("Failed to allocate buffer");
+    goto error;
+  }
+
+  if (formatters && !replace_formatters(buffer, length, formatters)) {
+    log_error("Failed to replace strings");
+    goto error;
+  }
+
+  pthread_mutex_lock(&module->lock);
+
+  /* unchanged text doesn't need a new frame */
+  if (module->buffer != NULL && strcmp(module->buffer, buffer) == 0) {
+    pthread_mutex_unlock(&module->lock);
+
+    free(buffer);
+    metrics_add(&module->metrics->suppressed_updates, 1);
+
+    return true;
+  }
 
   free(module->buffer);
-  module->buffer = NULL;
+  module->buffer = buffer;
+
+  usize const published_bytes = strlen(buffer);
 
   pthread_mutex_unlock(&module->lock);
 
+  metrics_add(&module->metrics->published_bytes, published_bytes);
+
+  if (status_line_update(module->status_line)) {
+    metrics_add(&module->metrics->renders, 1);
+
+    if (event_time != 0) {
+      utils_histogram_record(&module->metrics->latency, utils_time_get_monotonic_nanoseconds() - event_time);
+    }
+  }
+
+  return true;
+
+error:
+  free(buffer);
+  module_clear(module);
+
+  metrics_add(&module->metrics->errors, 1);
+
   return false;
 }
 
@@ -115,22 +246,47 @@ bool module_construct(module_t *module, status_line_t *status_line, char const *
 
   pthread_mutex_lock(&status_line->lock);
 
+  usize const module_index = (usize)(module - status_line->modules);
+
   module->status_line = status_line;
   module->config = config;
+  module->index = module_index;
+  module->metrics = &status_line->metrics.modules[module_index];
+  status_line->metrics.module_names[module_index] = key;
+
+  module->buffer = NULL;
+  module->event_time = 0;
+  module->account_time = 0;
+  module->replay = (module_replay_t){0};
+  module->supervisor = (module_supervisor_t){.exit_file_descriptor = -1};
 
-  module->run = module_get_run_function(key);
+  module->run = status_line->trace_reader != NULL ? module_get_replay_function(key) : module_get_run_function(key);
 
   if (module->run == NULL) {
     goto unlock;
   }
 
-  module->buffer = NULL;
+  module->supervisor.exit_file_descriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 
-  if (pthread_mutex_init(&module->lock, NULL) != 0) {
+  if (module->supervisor.exit_file_descriptor == -1) {
     goto unlock;
   }
 
+  if (pthread_mutex_init(&module->lock, NULL) != 0) {
+    goto close_exit_file_descriptor;
+  }
+
+  if (pthread_cond_init(&module->replay.condition, NULL) != 0) {
+    pthread_mutex_destroy(&module->lock);
+    goto close_exit_file_descriptor;
+  }
+
   status = true;
+  goto unlock;
+
+close_exit_file_descriptor:
+  close(module->supervisor.exit_file_descriptor);
+  module->supervisor.exit_file_descriptor = -1;
 
 unlock:
   pthread_mutex_unlock(&status_line->lock);
@@ -140,31 +296,73 @@ done:
 }
 
 void module_destruct(module_t *module) {
-  if (module == NULL) {
+  /* modules are zeroed until constructed */
+  if (module == NULL || module->status_line == NULL) {
     return;
   }
 
   free(module->buffer);
+
+  if (module->supervisor.exit_file_descriptor != -1) {
+    close(module->supervisor.exit_file_descriptor);
+  }
+
+  pthread_cond_destroy(&module->replay.condition);
   pthread_mutex_destroy(&module->lock);
 }
 
-module_run module_get_run_function(char const *key) {
+static module_get_run_item_t const *get_run_item(char const *key) {
   static module_get_run_item_t const items[] = {
-    {"clock", module_clock_run},
-    {"brightness", module_brightness_run},
-    {"sound", module_sound_run},
-    {"keyboard", module_keyboard_run},
+    {"clock", module_clock_run, module_clock_replay},
+    {"brightness", module_brightness_run, module_brightness_replay},
+    {"sound", module_sound_run, module_sound_replay},
+    {"keyboard", module_keyboard_run, module_keyboard_replay},
+    {"cpu", module_cpu_run, module_cpu_replay},
+    {"memory", module_memory_run, module_memory_replay},
+    {"pressure", module_pressure_run, module_pressure_replay},
+    {"net", module_net_run, module_net_replay},
+    {"battery", module_battery_run, module_battery_replay},
+    {"temperature", module_temperature_run, module_temperature_replay},
+    {"disk", module_disk_run, module_disk_replay},
   };
 
   for (usize item_index = 0; item_index < countof(items); item_index++) {
     if (strcmp(items[item_index].key, key) == 0) {
-      return items[item_index].run;
+      return &items[item_index];
     }
   }
 
   return NULL;
 }
 
+module_run module_get_run_function(char const *key) {
+  module_get_run_item_t const *item = get_run_item(key);
+
+  return item != NULL ? item->run : NULL;
+}
+
+module_run module_get_replay_function(char const *key) {
+  module_get_run_item_t const *item = get_run_item(key);
+
+  return item != NULL ? item->replay : NULL;
+}
+
 inline int module_get_abort_file_descriptor(module_t const *module) {
   return module->status_line != NULL ? module->status_line->abort_file_descriptor : -1;
 }
+
+utils_time_clock_t *module_get_clock(module_t const *module) {
+  if (module->status_line == NULL || module->status_line->clock == NULL) {
+    return utils_time_get_system_clock();
+  }
+
+  return module->status_line->clock;
+}
+
+utils_uevent_source_t *module_get_uevent_source(module_t const *module) {
+  if (module->status_line == NULL || module->status_line->uevent_source == NULL) {
+    return utils_uevent_get_kernel_source();
+  }
+
+  return module->status_line->uevent_source;
+}
@@ -0,0 +1,520 @@
+#include "modules/battery.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_MODULE "battery"
+
+#include "log.h"
+#include "macros.h"
+#include "module.h"
+#include "toml.h"
+#include "trace.h"
+#include "utils/fs.h"
+#include "utils/time.h"
+#include "utils/uevent.h"
+
+#define DEFAULT_BATTERY "BAT0"
+#define DEFAULT_INTERVAL 60000000000UL /* nanoseconds */
+#define DEFAULT_SYSFS_ROOT "/sys"
+#define POWER_SUPPLY_SUBSYSTEM "power_supply"
+#define ADAPTER_TYPE "Mains"
+#define MAX_ATTRIBUTE_LENGTH 32
+
+typedef enum status {
+  STATUS_MISSING = 0,
+  STATUS_UNKNOWN,
+  STATUS_CHARGING,
+  STATUS_DISCHARGING,
+  STATUS_NOT_CHARGING,
+  STATUS_FULL,
+  STATUSES_COUNT,
+} status_t;
+
+/* content of status attribute without newline and rendered text, indexed by status_t */
+static char const *const statuses[STATUSES_COUNT][2] = {
+  [STATUS_MISSING] = {"", "missing"},
+  [STATUS_UNKNOWN] = {"Unknown", "unknown"},
+  [STATUS_CHARGING] = {"Charging", "charging"},
+  [STATUS_DISCHARGING] = {"Discharging", "discharging"},
+  [STATUS_NOT_CHARGING] = {"Not charging", "not charging"},
+  [STATUS_FULL] = {"Full", "full"},
+};
+
+/* rendered and recorded state */
+typedef struct battery_state {
+  i8 capacity;  /* percent, -1 - battery missing */
+  u8 status;    /* status_t */
+  u8 is_online; /* adapter online, 0 if missing */
+} battery_state_t;
+
+#define RECORD_LENGTH 3 /* i8 capacity, u8 status, u8 is online */
+
+typedef struct private {
+  char *power_supply_path; /* <sysfs_root>/class/power_supply */
+  char const *battery;
+  char adapter[NAME_MAX + 1];       /* configured or discovered, empty - none found */
+  bool is_adapter_configured;       /* discovered adapter is looked up again when it's removed */
+  utils_fs_reader_t capacity_reader; /* readers stay open while device exists, reread on its uevents */
+  utils_fs_reader_t status_reader;
+  utils_fs_reader_t online_reader;
+  char capacity_buffer[MAX_ATTRIBUTE_LENGTH];
+  char status_buffer[MAX_ATTRIBUTE_LENGTH];
+  char online_buffer[MAX_ATTRIBUTE_LENGTH];
+  battery_state_t state;
+}
+private_t;
+
+static void config_free(module_battery_config_t *config) {
+  if (config == NULL) {
+    return;
+  }
+
+  free(config->sysfs_root);
+  free(config->adapter);
+  free(config->battery);
+  free(config->format);
+  free(config);
+}
+
+static module_battery_config_t *config_get(toml_table_t *table) {
+  module_battery_config_t *config = calloc(1, sizeof(*config));
+
+  if (config == NULL) {
+    log_error("Failed to allocate config");
+    return NULL;
+  }
+
+  toml_value_t format = toml_table_string(table, "format");
+
+  if (!format.ok) {
+    log_error("Failed to get format");
+    goto error;
+  }
+
+  config->format = format.u.s;
+
+  toml_value_t battery = toml_table_string(table, "battery");
+  config->battery = battery.ok ? battery.u.s : strdup(DEFAULT_BATTERY);
+
+  if (config->battery == NULL) {
+    log_error("Failed to allocate battery");
+    goto error;
+  }
+
+  toml_value_t adapter = toml_table_string(table, "adapter");
+  config->adapter = adapter.ok ? adapter.u.s : NULL;
+
+  if (config->adapter != NULL && strlen(config->adapter) > NAME_MAX) {
+    log_error("Invalid adapter name");
+    goto error;
+  }
+
+  config->interval = DEFAULT_INTERVAL;
+
+  toml_value_t interval = toml_table_string(table, "interval");
+
+  if (interval.ok) {
+    bool const is_parsed = utils_time_parse_interval(interval.u.s, &config->interval);
+
+    free(interval.u.s);
+
+    if (!is_parsed) {
+      log_error("Invalid battery interval");
+      goto error;
+    }
+  }
+
+  toml_value_t sysfs_root = toml_table_string(table, "sysfs_root");
+  config->sysfs_root = sysfs_root.ok ? sysfs_root.u.s : strdup(DEFAULT_SYSFS_ROOT);
+
+  if (config->sysfs_root == NULL) {
+    log_error("Failed to allocate sysfs root");
+    goto error;
+  }
+
+  return config;
+
+error:
+  config_free(config);
+  return NULL;
+}
+
+static void private_close_battery(private_t *private) {
+  utils_fs_reader_close(&private->capacity_reader);
+  utils_fs_reader_close(&private->status_reader);
+}
+
+static void private_close_adapter(private_t *private) {
+  utils_fs_reader_close(&private->online_reader);
+}
+
+static void private_destruct(private_t *private) {
+  private_close_battery(private);
+  private_close_adapter(private);
+  free(private->power_supply_path);
+}
+
+static bool private_construct(private_t *private, module_battery_config_t const *config) {
+  static char const *path_format = "%s/class/" POWER_SUPPLY_SUBSYSTEM;
+
+  *private = (private_t){
+    .battery = config->battery,
+    .is_adapter_configured = config->adapter != NULL,
+    .capacity_reader = {.file_descriptor = -1},
+    .status_reader = {.file_descriptor = -1},
+    .online_reader = {.file_descriptor = -1},
+  };
+
+  if (config->adapter != NULL) {
+    strcpy(private->adapter, config->adapter);
+  }
+
+  usize const path_size = (usize)strfsize(path_format, config->sysfs_root);
+  private->power_supply_path = malloc(path_size + 1);
+
+  if (private->power_supply_path == NULL) {
+    return false;
+  }
+
+  snprintf(private->power_supply_path, path_size + 1, path_format, config->sysfs_root);
+
+  return true;
+}
+
+static bool open_attribute(utils_fs_reader_t *reader, char const *power_supply_path, char const *name,
+                           char const *attribute, char *buffer, usize size) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s/%s", power_supply_path, name, attribute);
+
+  return utils_fs_reader_open(reader, path, buffer, size);
+}
+
+/* attribute content up to newline equals value */
+static inline bool is_attribute(char const *buffer, char const *value) {
+  usize const value_length = strlen(value);
+
+  return strncmp(buffer, value, value_length) == 0 && (buffer[value_length] == '\n' || buffer[value_length] == '\0');
+}
+
+/* sysfs attributes of re-added device are new files, so readers are reopened on add */
+static void private_open_battery(private_t *private) {
+  private_close_battery(private);
+
+  if (!open_attribute(&private->capacity_reader, private->power_supply_path, private->battery, "capacity",
+                      private->capacity_buffer, sizeof(private->capacity_buffer)) ||
+      !open_attribute(&private->status_reader, private->power_supply_path, private->battery, "status",
+                      private->status_buffer, sizeof(private->status_buffer))) {
+    private_close_battery(private);
+  }
+}
+
+/* returns whether power supply is of "Mains" type, read once per device on discovery */
+static bool is_adapter(char const *power_supply_path, char const *name) {
+  utils_fs_reader_t reader;
+  char buffer[MAX_ATTRIBUTE_LENGTH];
+
+  if (!open_attribute(&reader, power_supply_path, name, "type", buffer, sizeof(buffer))) {
+    return false;
+  }
+
+  bool const status = utils_fs_reader_refresh(&reader) && is_attribute(buffer, ADAPTER_TYPE);
+
+  utils_fs_reader_close(&reader);
+
+  return status;
+}
+
+/* configured adapter is opened by name, otherwise power supplies are walked for the first adapter */
+static void private_open_adapter(private_t *private) {
+  private_close_adapter(private);
+
+  if (!private->is_adapter_configured) {
+    private->adapter[0] = '\0';
+
+    DIR *directory = opendir(private->power_supply_path);
+
+    if (directory == NULL) {
+      return;
+    }
+
+    for (struct dirent const *entry = readdir(directory); entry != NULL; entry = readdir(directory)) {
+      if (entry->d_name[0] != '.' && is_adapter(private->power_supply_path, entry->d_name)) {
+        strcpy(private->adapter, entry->d_name);
+        break;
+      }
+    }
+
+    closedir(directory);
+
+    if (private->adapter[0] == '\0') {
+      return;
+    }
+  }
+
+  open_attribute(&private->online_reader, private->power_supply_path, private->adapter, "online",
+                 private->online_buffer, sizeof(private->online_buffer));
+}
+
+static void private_read_battery(private_t *private) {
+  battery_state_t *state = &private->state;
+  i64 capacity = 0;
+
+  state->capacity = -1;
+  state->status = STATUS_MISSING;
+
+  if (private->capacity_reader.file_descriptor == -1 || !utils_fs_reader_refresh(&private->capacity_reader) ||
+      !utils_fs_reader_get_i64(&private->capacity_reader, &capacity) ||
+      !utils_fs_reader_refresh(&private->status_reader)) {
+    return;
+  }
+
+  state->capacity = (i8)(capacity < 0 ? 0 : capacity > 100 ? 100 : capacity);
+  state->status = STATUS_UNKNOWN;
+
+  for (u8 status = STATUS_UNKNOWN; status < STATUSES_COUNT; status++) {
+    if (is_attribute(private->status_buffer, statuses[status][0])) {
+      state->status = status;
+      break;
+    }
+  }
+}
+
+static void private_read_adapter(private_t *private) {
+  i64 is_online = 0;
+
+  private->state.is_online = private->online_reader.file_descriptor != -1 &&
+                             utils_fs_reader_refresh(&private->online_reader) &&
+                             utils_fs_reader_get_i64(&private->online_reader, &is_online) && is_online != 0;
+}
+
+/* handles pending uevents of battery and adapter, returns false on error */
+static bool handle_events(int uevent_file_descriptor, private_t *private) {
+  char buffer[UTILS_UEVENT_BUFFER_SIZE];
+  utils_uevent_t uevent;
+  utils_uevent_status_t status;
+  bool is_battery_added = false, is_battery_changed = false;
+  bool is_adapter_added = false, is_adapter_changed = false;
+
+  while ((status = utils_uevent_receive(uevent_file_descriptor, POWER_SUPPLY_SUBSYSTEM, buffer, sizeof(buffer),
+                                        &uevent)) != UTILS_UEVENT_NONE) {
+    if (status == UTILS_UEVENT_FAILED) {
+      log_error("Failed to receive uevent");
+      return false;
+    }
+
+    /* dropped uevents may have been for battery or adapter */
+    if (status == UTILS_UEVENT_OVERFLOW) {
+      log_warn("Uevent socket overflowed, rereading power supplies");
+      is_battery_added = is_adapter_added = true;
+      continue;
+    }
+
+    char const *name = utils_uevent_get_name(&uevent);
+    bool const is_added = strcmp(uevent.action, "add") == 0;
+    bool const is_removed = strcmp(uevent.action, "remove") == 0;
+
+    if (strcmp(name, private->battery) == 0) {
+      if (is_removed) {
+        private_close_battery(private);
+        is_battery_added = false;
+      } else if (is_added) {
+        is_battery_added = true;
+      }
+
+      is_battery_changed = true;
+    } else if (private->adapter[0] != '\0' && strcmp(name, private->adapter) == 0) {
+      /* removed adapter that wasn't configured may be replaced by another one */
+      if (is_removed && private->is_adapter_configured) {
+        private_close_adapter(private);
+        is_adapter_added = false;
+      } else if (is_added || is_removed) {
+        is_adapter_added = true;
+      }
+
+      is_adapter_changed = true;
+    } else if (is_added && !private->is_adapter_configured && private->adapter[0] == '\0') {
+      is_adapter_added = true;
+    }
+  }
+
+  if (is_battery_added) {
+    private_open_battery(private);
+  }
+
+  if (is_adapter_added) {
+    private_open_adapter(private);
+  }
+
+  if (is_battery_added || is_battery_changed) {
+    private_read_battery(private);
+  }
+
+  if (is_adapter_added || is_adapter_changed) {
+    private_read_adapter(private);
+  }
+
+  return true;
+}
+
+static void record_state(module_t *module, battery_state_t const *state) {
+  u8 payload[RECORD_LENGTH];
+  trace_put_u8(trace_put_u8(trace_put_u8(payload, (u8)state->capacity), state->status), state->is_online);
+
+  module_record(module, payload, sizeof(payload));
+}
+
+static inline bool update_module(module_t *module, module_battery_config_t const *config,
+                                 battery_state_t const *state) {
+  char capacity_buffer[8] = "-";
+
+  if (state->capacity >= 0) {
+    snprintf(capacity_buffer, sizeof(capacity_buffer), "%d", state->capacity);
+  }
+
+  char const *formatters[][2] = {
+    {"%capacity%", capacity_buffer},
+    {"%status%", statuses[state->status < STATUSES_COUNT ? state->status : STATUS_UNKNOWN][1]},
+    {"%ac%", state->is_online ? "on" : "off"},
+    {NULL, NULL},
+  };
+
+  return module_update(module, config->format, formatters);
+}
+
+int module_battery_run(module_t *module) {
+  int status = EXIT_FAILURE;
+
+  module_battery_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    goto done;
+  }
+
+  private_t private;
+
+  if (!private_construct(&private, config)) {
+    log_error("Failed to initialize private struct");
+    goto free_config;
+  }
+
+  /* subscribed before reading, so a change between reading and polling isn't lost */
+  int uevent_file_descriptor = utils_uevent_source_open(module_get_uevent_source(module));
+
+  if (uevent_file_descriptor == -1) {
+    log_error("Failed to open uevent socket");
+    goto free_private;
+  }
+
+  private_open_battery(&private);
+  private_open_adapter(&private);
+
+  if (private.capacity_reader.file_descriptor == -1) {
+    log_warn("Battery %s is missing, waiting for it to be added", private.battery);
+  }
+
+  private_read_battery(&private);
+  private_read_adapter(&private);
+
+  struct pollfd pfds[] = {
+    {.fd = module_get_abort_file_descriptor(module), .events = POLLIN},
+    {.fd = uevent_file_descriptor, .events = POLLIN},
+  };
+
+  int const interval = (int)(config->interval / 1000000);
+
+  while (true) {
+    record_state(module, &private.state);
+
+    if (!update_module(module, config, &private.state)) {
+      log_error("Failed to update module");
+      goto close_uevent;
+    }
+
+    /* capacity of missing battery can't drift */
+    int const poll_status = poll(pfds, countof(pfds), private.state.capacity >= 0 ? interval : -1);
+
+    if (poll_status < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      log_error("Failed to poll");
+      goto close_uevent;
+    }
+
+    module_wakeup(module);
+
+    if (pfds[0].revents & POLLIN) {
+      break;
+    }
+
+    module_mark_event(module);
+
+    if (poll_status == 0) {
+      private_read_battery(&private);
+      continue;
+    }
+
+    if (!handle_events(uevent_file_descriptor, &private)) {
+      log_error("Failed to handle events");
+      goto close_uevent;
+    }
+  }
+
+  status = EXIT_SUCCESS;
+
+close_uevent:
+  close(uevent_file_descriptor);
+
+free_private:
+  private_destruct(&private);
+
+free_config:
+  config_free(config);
+
+done:
+  return status;
+}
+
+int module_battery_replay(module_t *module) {
+  module_battery_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_SUCCESS;
+  battery_state_t state;
+  void const *payload = NULL;
+  usize length = 0;
+
+  while (module_replay_next(module, &payload, &length)) {
+    if (length != RECORD_LENGTH) {
+      log_error("Invalid battery trace event");
+      status = EXIT_FAILURE;
+      break;
+    }
+
+    u8 capacity = 0;
+    trace_get_u8(trace_get_u8(trace_get_u8(payload, &capacity), &state.status), &state.is_online);
+    state.capacity = (i8)capacity;
+    module_mark_event(module);
+
+    if (!update_module(module, config, &state)) {
+      log_error("Failed to update module");
+      status = EXIT_FAILURE;
+      break;
+    }
+  }
+
+  config_free(config);
+
+  return status;
+}
@@ -1,13 +1,12 @@
 #include "modules/brightness.h"
 
-#include <alloca.h>
 #include <errno.h>
+#include <limits.h>
 #include <math.h>
 #include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/inotify.h>
 #include <unistd.h>
 
 #define LOG_MODULE "brightness"
@@ -16,75 +15,127 @@
 #include "macros.h"
 #include "module.h"
 #include "toml.h"
+#include "trace.h"
 #include "utils/fs.h"
+#include "utils/uevent.h"
 
-#define BACKLIGHT_PATH "/sys/class/backlight"
-#define MAX_BRIGHTNESS_LENGTH 5
+#define DEFAULT_SYSFS_ROOT "/sys"
+#define BACKLIGHT_SUBSYSTEM "backlight"
+#define MAX_BRIGHTNESS_LENGTH 32
+
+/* trace records, first byte of payload */
+typedef enum record_type {
+  RECORD_BRIGHTNESS = 0, /* i64 brightness, i64 max_brightness as read from sysfs */
+  RECORD_REMOVE,         /* device removed or its attributes failed to open */
+  RECORD_UPDATE,         /* brightness read so far is rendered */
+} record_type_t;
 
 typedef struct private {
-  char *brightness_file_path;
-  char *max_brightness_file_path;
-  i8 brightness;
+  module_t *module;
+  char *device_path;        /* <sysfs_root>/class/backlight/<card> */
+  utils_fs_reader_t reader; /* actual_brightness, or brightness if driver lacks it, reread on every uevent */
+  char buffer[MAX_BRIGHTNESS_LENGTH];
+  i64 max_brightness; /* read once when device appears */
+  i8 brightness;      /* percent, -1 - not read yet or device removed */
 }
 private_t;
 
+static void private_close(private_t *private) {
+  utils_fs_reader_close(&private->reader);
+}
+
 static void private_destruct(private_t *private) {
-  free(private->brightness_file_path);
-  free(private->max_brightness_file_path);
+  private_close(private);
+  free(private->device_path);
 }
 
-static bool private_construct(private_t *private, char const *card) {
-  static char *file_format = "%s/%s/%s";
-  static char *files[] = {"brightness", "max_brightness"};
+static bool private_construct(private_t *private, module_t *module, char const *sysfs_root, char const *card) {
+  static char const *path_format = "%s/class/" BACKLIGHT_SUBSYSTEM "/%s";
 
-  char *paths[countof(files)] = {0};
+  *private = (private_t){.module = module, .reader = {.file_descriptor = -1}, .brightness = -1};
 
-  for (usize path_index = 0; path_index < countof(paths); path_index += 1) {
-    usize path_size = (usize)strfsize(file_format, BACKLIGHT_PATH, card, files[path_index]);
-    char *path = malloc(path_size + 1);
+  usize const path_size = (usize)strfsize(path_format, sysfs_root, card);
+  private->device_path = malloc(path_size + 1);
 
-    if (path == NULL) {
-      goto error;
-    }
+  if (private->device_path == NULL) {
+    return false;
+  }
+
+  snprintf(private->device_path, path_size + 1, path_format, sysfs_root, card);
+
+  return true;
+}
+
+/* opens brightness reader and reads max_brightness, which is fixed for the lifetime of device */
+static bool private_open(private_t *private) {
+  char path[PATH_MAX];
+  utils_fs_reader_t max_brightness_reader;
+  char max_brightness_buffer[MAX_BRIGHTNESS_LENGTH];
+
+  private_close(private);
 
-    snprintf(path, path_size + 1, file_format, BACKLIGHT_PATH, card, files[path_index]);
+  snprintf(path, sizeof(path), "%s/max_brightness", private->device_path);
 
-    paths[path_index] = path;
+  if (!utils_fs_reader_open(&max_brightness_reader, path, max_brightness_buffer, sizeof(max_brightness_buffer))) {
+    return false;
   }
 
-  private->brightness_file_path = paths[0];
-  private->max_brightness_file_path = paths[1];
-  private->brightness = 0;
+  bool const has_max_brightness = utils_fs_reader_refresh(&max_brightness_reader) &&
+                                  utils_fs_reader_get_i64(&max_brightness_reader, &private->max_brightness) &&
+                                  private->max_brightness > 0;
 
-  return private;
+  utils_fs_reader_close(&max_brightness_reader);
 
-error:
-  private_destruct(private);
+  if (!has_max_brightness) {
+    return false;
+  }
 
-  return NULL;
+  snprintf(path, sizeof(path), "%s/actual_brightness", private->device_path);
+
+  if (utils_fs_reader_open(&private->reader, path, private->buffer, sizeof(private->buffer))) {
+    return true;
+  }
+
+  snprintf(path, sizeof(path), "%s/brightness", private->device_path);
+
+  return utils_fs_reader_open(&private->reader, path, private->buffer, sizeof(private->buffer));
+}
+
+static i8 convert_percentage(i64 brightness, i64 max_brightness) {
+  return (i8)round((double)brightness / (double)max_brightness * 100);
+}
+
+static void private_remove(private_t *private) {
+  u8 const record_type = RECORD_REMOVE;
+  module_record(private->module, &record_type, sizeof(record_type));
+
+  private_close(private);
+  private->brightness = -1;
 }
 
 static bool private_get_brightness(private_t *private) {
-  char *brightness_str = utils_fs_read_file(private->brightness_file_path, MAX_BRIGHTNESS_LENGTH);
-  char *max_brightness_str = utils_fs_read_file(private->max_brightness_file_path, MAX_BRIGHTNESS_LENGTH);
+  i64 brightness = 0;
 
-  if (brightness_str == NULL || max_brightness_str == NULL) {
+  if (!utils_fs_reader_refresh(&private->reader) || !utils_fs_reader_get_i64(&private->reader, &brightness)) {
     log_error("Failed to get brightness");
     return false;
   }
 
-  long brightness = atol(brightness_str);
-  long max_brightness = atol(max_brightness_str);
+  u8 payload[1 + 8 + 8];
+  trace_put_u64(trace_put_u64(trace_put_u8(payload, RECORD_BRIGHTNESS), (u64)brightness), (u64)private->max_brightness);
+  module_record(private->module, payload, sizeof(payload));
 
-  free(brightness_str);
-  free(max_brightness_str);
-
-  private->brightness = (i8)round((double)brightness / (double)max_brightness * 100);
+  private->brightness = convert_percentage(brightness, private->max_brightness);
 
   return true;
 }
 
 static void config_free(module_brightness_config_t *config) {
+  if (config == NULL) {
+    return;
+  }
+
+  free(config->sysfs_root);
   free(config->card);
   free(config->format);
   free(config);
@@ -93,6 +144,11 @@ static void config_free(module_brightness_config_t *config) {
 static module_brightness_config_t *config_get(toml_table_t *table) {
   module_brightness_config_t *config = calloc(1, sizeof(*config));
 
+  if (config == NULL) {
+    log_error("Failed to allocate config");
+    return NULL;
+  }
+
   toml_value_t format = toml_table_string(table, "format");
 
   if (!format.ok) {
@@ -100,6 +156,8 @@ static module_brightness_config_t *config_get(toml_table_t *table) {
     goto error;
   }
 
+  config->format = format.u.s;
+
   toml_value_t card = toml_table_string(table, "card");
 
   if (!card.ok) {
@@ -107,9 +165,16 @@ static module_brightness_config_t *config_get(toml_table_t *table) {
     goto error;
   }
 
-  config->format = format.u.s;
   config->card = card.u.s;
 
+  toml_value_t sysfs_root = toml_table_string(table, "sysfs_root");
+  config->sysfs_root = sysfs_root.ok ? sysfs_root.u.s : strdup(DEFAULT_SYSFS_ROOT);
+
+  if (config->sysfs_root == NULL) {
+    log_error("Failed to allocate sysfs root");
+    goto error;
+  }
+
   return config;
 
 error:
@@ -117,41 +182,63 @@ error:
   return NULL;
 }
 
-static bool handle_events(int inotifyfd, private_t *private) {
-  char buffer[sizeof(struct inotify_event)] = {0};
-  isize length = 0, n = 0;
-  struct inotify_event const *event = NULL;
+/* handles pending uevents of card, returns false on error */
+static bool handle_events(int uevent_file_descriptor, private_t *private, char const *card) {
+  char buffer[UTILS_UEVENT_BUFFER_SIZE];
+  utils_uevent_t uevent;
+  utils_uevent_status_t status;
+  bool is_changed = false, is_added = false;
+
+  while ((status = utils_uevent_receive(uevent_file_descriptor, BACKLIGHT_SUBSYSTEM, buffer, sizeof(buffer),
+                                        &uevent)) != UTILS_UEVENT_NONE) {
+    if (status == UTILS_UEVENT_FAILED) {
+      log_error("Failed to receive uevent");
+      return false;
+    }
 
-  length = read(inotifyfd, buffer, sizeof(buffer));
+    /* dropped uevents may have been for card */
+    if (status == UTILS_UEVENT_OVERFLOW) {
+      log_warn("Uevent socket overflowed, rereading brightness");
+      is_added = true;
+      continue;
+    }
 
-  if (length < 0 && errno == EINTR) {
-    return true;
-  }
+    if (strcmp(utils_uevent_get_name(&uevent), card) != 0) {
+      continue;
+    }
 
-  if (length <= 0) {
-    return false;
+    if (strcmp(uevent.action, "remove") == 0) {
+      private_remove(private);
+      is_changed = is_added = false;
+    } else if (strcmp(uevent.action, "add") == 0) {
+      is_added = true;
+    } else {
+      is_changed = true;
+    }
   }
 
-  while (n < length) {
-    event = (struct inotify_event const *)&buffer[n];
-
-    if (event->mask & (IN_CLOSE_WRITE | IN_CREATE)) {
-      if (!private_get_brightness(private)) {
-        return false;
-      }
-    } else if (event->mask & IN_DELETE) {
-      private->brightness = -1;
-    }
+  /* sysfs attributes of re-added device are new files */
+  if (is_added && !private_open(private)) {
+    private_remove(private);
+    return true;
+  }
 
-    n += sizeof(struct inotify_event) + event->len;
+  if ((is_added || is_changed) && private->reader.file_descriptor != -1) {
+    return private_get_brightness(private);
   }
 
   return true;
 }
 
 static inline bool update_module(module_t *module, module_brightness_config_t const *config, private_t const *private) {
-  char brightness_buffer[4] = {0};
-  snprintf(brightness_buffer, sizeof(brightness_buffer), "%d", (u8) private->brightness);
+  u8 const record_type = RECORD_UPDATE;
+  module_record(module, &record_type, sizeof(record_type));
+
+  char brightness_buffer[4] = "-";
+
+  if (private->brightness >= 0) {
+    snprintf(brightness_buffer, sizeof(brightness_buffer), "%d", private->brightness);
+  }
 
   char const *formatters[][2] = {
     {"%value%", brightness_buffer},
@@ -172,45 +259,39 @@ int module_brightness_run(module_t *module) {
 
   private_t private;
 
-  if (!private_construct(&private, config->card)) {
+  if (!private_construct(&private, module, config->sysfs_root, config->card)) {
     log_error("Failed to initialize private struct");
     goto free_config;
   }
 
   update_module(module, config, &private);
 
-  if (!utils_fs_has_file(private.brightness_file_path) || !utils_fs_has_file(private.max_brightness_file_path)) {
-    log_error("Failed to get brightness files");
-    goto free_private;
-  }
-
-  int inotifyfd = inotify_init1(0);
+  /* subscribed before reading, so a change between reading and polling isn't lost */
+  int uevent_file_descriptor = utils_uevent_source_open(module_get_uevent_source(module));
 
-  if (inotifyfd == -1) {
-    log_error("Failed to initialize inotify");
+  if (uevent_file_descriptor == -1) {
+    log_error("Failed to open uevent socket");
     goto free_private;
   }
 
-  if (!private_get_brightness(&private)) {
-    return false;
+  if (!private_open(&private)) {
+    log_error("Failed to open brightness files of %s", private.device_path);
+    goto close_uevent;
   }
 
-  int wd = inotify_add_watch(inotifyfd, private.brightness_file_path, IN_CLOSE_WRITE | IN_DELETE_SELF | IN_CREATE);
-
-  if (wd == -1) {
-    log_error("Failed to add inotify watch");
-    goto close_inotify;
+  if (!private_get_brightness(&private)) {
+    goto close_uevent;
   }
 
   struct pollfd pfds[] = {
     {.fd = module_get_abort_file_descriptor(module), .events = POLLIN},
-    {.fd = inotifyfd, .events = POLLIN},
+    {.fd = uevent_file_descriptor, .events = POLLIN},
   };
 
   while (true) {
     if (!update_module(module, config, &private)) {
       log_error("Failed to update module");
-      goto close_wd;
+      goto close_uevent;
     }
 
     if (poll(pfds, countof(pfds), -1) < 0) {
@@ -219,26 +300,27 @@ int module_brightness_run(module_t *module) {
       }
 
       log_error("Failed to poll");
-      goto close_wd;
+      goto close_uevent;
     }
 
+    module_wakeup(module);
+
     if (pfds[0].revents & POLLIN) {
       break;
     }
 
-    if (!handle_events(inotifyfd, &private)) {
+    module_mark_event(module);
+
+    if (!handle_events(uevent_file_descriptor, &private, config->card)) {
       log_error("Failed to handle events");
-      goto close_wd;
+      goto close_uevent;
     }
   }
 
   status = EXIT_SUCCESS;
 
-close_wd:
-  close(wd);
-
-close_inotify:
-  close(inotifyfd);
+close_uevent:
+  close(uevent_file_descriptor);
 
 free_private:
   private_destruct(&private);
@@ -249,3 +331,58 @@ free_config:
 done:
   return status;
 }
+
+int module_brightness_replay(module_t *module) {
+  module_brightness_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_SUCCESS;
+  private_t private = {.brightness = -1};
+  void const *payload = NULL;
+  usize length = 0;
+
+  while (module_replay_next(module, &payload, &length)) {
+    u8 const *record = payload;
+    u64 brightness = 0;
+    u64 max_brightness = 0;
+
+    if (length == 1 + 8 + 8 && record[0] == RECORD_BRIGHTNESS) {
+      trace_get_u64(trace_get_u64(record + 1, &brightness), &max_brightness);
+
+      if ((i64)max_brightness <= 0) {
+        log_error("Invalid brightness trace event");
+        status = EXIT_FAILURE;
+        break;
+      }
+
+      private.brightness = convert_percentage((i64)brightness, (i64)max_brightness);
+      module_mark_event(module);
+      continue;
+    }
+
+    if (length == 1 && record[0] == RECORD_REMOVE) {
+      private.brightness = -1;
+      module_mark_event(module);
+      continue;
+    }
+
+    if (length != 1 || record[0] != RECORD_UPDATE) {
+      log_error("Invalid brightness trace event");
+      status = EXIT_FAILURE;
+      break;
+    }
+
+    if (!update_module(module, config, &private)) {
+      log_error("Failed to update module");
+      status = EXIT_FAILURE;
+      break;
+    }
+  }
+
+  config_free(config);
+
+  return status;
+}
@@ -1,27 +1,108 @@
+#define _GNU_SOURCE
+
 #include "modules/clock.h"
 
 #include <errno.h>
-#include <limits.h>
 #include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
 
 #define LOG_MODULE "clock"
 
 #include "log.h"
 #include "module.h"
 #include "toml.h"
+#include "trace.h"
 #include "utils/time.h"
+#include "utils/tz.h"
 
 #define MAX_DATE_LENGTH 256
+#define MAX_TEXT_LENGTH 1024
+#define DEFAULT_ZONE "local"
+#define DEFAULT_SEPARATOR " "
+#define MAX_SEGMENTS_COUNT 8
+#define MAX_EPOCH_LENGTH 24 /* i64 seconds, e.g "-9223372036854775808" */
+
+/* seconds until output of a strftime conversion can change */
+typedef enum unit {
+  UNIT_SECOND = 1,
+  UNIT_MINUTE = 60,
+  UNIT_HOUR = 60 * 60,
+  UNIT_DAY = 24 * 60 * 60,
+} unit_t;
+
+/* run of format with conversions of the same granularity, day-level runs are formatted once a day */
+typedef struct segment {
+  char *format;
+  bool is_daily;
+  bool is_epoch; /* %s, rendered from timer as strftime converts it back through mktime in time zone of process */
+} segment_t;
+
+/* zone rendered with the whole format, keeps day-level segments formatted for its local day */
+typedef struct zone {
+  utils_tz_t tz;
+  i32 days[MAX_SEGMENTS_COUNT]; /* local day of cached text, -1 - nothing cached */
+  usize lengths[MAX_SEGMENTS_COUNT];
+  char caches[MAX_SEGMENTS_COUNT][MAX_DATE_LENGTH];
+} zone_t;
+
+typedef struct private {
+  segment_t segments[MAX_SEGMENTS_COUNT];
+  usize segments_count;
+  zone_t *zones; /* all zones share one timer */
+  usize zones_count;
+  u64 interval; /* nanoseconds between wakeups, aligned to local time of every zone */
+}
+private_t;
 
 static void config_free(module_clock_config_t *config) {
+  if (config == NULL) {
+    return;
+  }
+
+  for (usize zone_index = 0; zone_index < config->zones_count; zone_index++) {
+    free(config->zones[zone_index]);
+  }
+
+  free(config->zones);
+  free(config->separator);
   free(config->format);
   free(config);
 }
 
+static bool config_get_zones(module_clock_config_t *config, toml_table_t *table) {
+  toml_array_t *zones = toml_table_array(table, "zones");
+  usize const zones_count = zones != NULL ? (usize)toml_array_len(zones) : 0;
+
+  config->zones = calloc(zones_count != 0 ? zones_count : 1, sizeof(*config->zones));
+
+  if (config->zones == NULL) {
+    log_error("Failed to allocate clock zones");
+    return false;
+  }
+
+  if (zones_count == 0) {
+    config->zones[0] = strdup(DEFAULT_ZONE);
+    config->zones_count = config->zones[0] != NULL ? 1 : 0;
+
+    return config->zones_count == 1;
+  }
+
+  for (usize zone_index = 0; zone_index < zones_count; zone_index++) {
+    toml_value_t zone = toml_array_string(zones, (int)zone_index);
+
+    if (!zone.ok) {
+      log_error("Clock zones must be strings");
+      return false;
+    }
+
+    config->zones[config->zones_count++] = zone.u.s;
+  }
+
+  return true;
+}
+
 static module_clock_config_t *config_get(toml_table_t *table) {
   module_clock_config_t *config = calloc(1, sizeof(*config));
 
@@ -34,7 +115,7 @@ static module_clock_config_t *config_get(toml_table_t *table) {
 
   if (!format.ok) {
     log_error("Failed to get lock format");
-    return NULL;
+    goto error;
   }
 
   config->format = format.u.s;
@@ -53,6 +134,18 @@ static module_clock_config_t *config_get(toml_table_t *table) {
 
   config->interval = (u16)interval.u.i;
 
+  if (!config_get_zones(config, table)) {
+    goto error;
+  }
+
+  toml_value_t separator = toml_table_string(table, "separator");
+  config->separator = separator.ok ? separator.u.s : strdup(DEFAULT_SEPARATOR);
+
+  if (config->separator == NULL) {
+    log_error("Failed to allocate clock separator");
+    goto error;
+  }
+
   return config;
 
 error:
@@ -60,38 +153,322 @@ error:
   return NULL;
 }
 
-static inline struct timeval calculate_time_until_next_interval(long interval) {
-  long const current_time_ms = utils_time_get_milliseconds_since_epoch();
-  long const remaining_time_ms = interval - (current_time_ms % interval);
-  long const remaining_time_us = (remaining_time_ms % 1000) * 1000;
-
-  return (struct timeval){.tv_sec = remaining_time_ms / 1000, .tv_usec = remaining_time_us};
+static unit_t get_conversion_unit(char conversion) {
+  switch (conversion) {
+  case 'M':
+  case 'R':
+    return UNIT_MINUTE;
+  case 'H':
+  case 'I':
+  case 'k':
+  case 'l':
+  case 'p':
+  case 'P':
+  /* utc offset and zone name change at daylight saving time transitions within a day */
+  case 'z':
+  case 'Z':
+    return UNIT_HOUR;
+  case 'a':
+  case 'A':
+  case 'b':
+  case 'B':
+  case 'h':
+  case 'C':
+  case 'd':
+  case 'e':
+  case 'D':
+  case 'F':
+  case 'g':
+  case 'G':
+  case 'j':
+  case 'm':
+  case 'u':
+  case 'U':
+  case 'V':
+  case 'w':
+  case 'W':
+  case 'x':
+  case 'y':
+  case 'Y':
+  case 'n':
+  case 't':
+  case '%':
+    return UNIT_DAY;
+  default:
+    /* seconds (%S, %T, %r, %c, %X), %s and conversions unknown to us */
+    return UNIT_SECOND;
+  }
 }
 
-static inline bool get_time_and_date(char *buffer, usize length, char const *format) {
-  struct timespec current_time = {0};
-  clock_gettime(CLOCK_REALTIME, &current_time);
+/* skips glibc flags, field width and E/O modifiers after '%', returns conversion character */
+static char const *skip_conversion_modifiers(char const *conversion) {
+  while (*conversion != '\0' && strchr("_-0^#", *conversion) != NULL) {
+    conversion += 1;
+  }
 
-  time_t timer = current_time.tv_sec;
+  while (*conversion >= '0' && *conversion <= '9') {
+    conversion += 1;
+  }
 
-  struct tm local_time;
+  if (*conversion == 'E' || *conversion == 'O') {
+    conversion += 1;
+  }
+
+  return conversion;
+}
 
-  if (localtime_r(&timer, &local_time) == NULL) {
+static bool private_add_segment(private_t *private, char const *format, usize length, bool is_daily,
+                                bool is_epoch) {
+  if (private->segments_count == MAX_SEGMENTS_COUNT) {
+    log_error("Clock format has more than %d alternating date and time parts", MAX_SEGMENTS_COUNT);
     return false;
   }
 
-  strftime(buffer, length, format, &local_time);
+  char *segment_format = strndup(format, length);
+
+  if (segment_format == NULL) {
+    log_error("Failed to allocate clock format segment");
+    return false;
+  }
+
+  private->segments[private->segments_count++] =
+    (segment_t){.format = segment_format, .is_daily = is_daily, .is_epoch = is_epoch};
 
   return true;
 }
 
-static inline bool update_module(module_t *module, module_clock_config_t const *config) {
-  char buffer[MAX_DATE_LENGTH] = {0};
+static void private_destruct(private_t *private) {
+  for (usize segment_index = 0; segment_index < private->segments_count; segment_index++) {
+    free(private->segments[segment_index].format);
+  }
+
+  for (usize zone_index = 0; zone_index < private->zones_count; zone_index++) {
+    utils_tz_destruct(&private->zones[zone_index].tz);
+  }
+
+  free(private->zones);
+}
+
+/* zone rules are loaded once, conversions don't depend on TZ of process */
+static bool private_load_zones(private_t *private, module_clock_config_t const *config) {
+  private->zones = calloc(config->zones_count, sizeof(*private->zones));
 
-  if (!get_time_and_date(buffer, sizeof(buffer), config->format)) {
+  if (private->zones == NULL) {
+    log_error("Failed to allocate clock zones");
     return false;
   }
 
+  for (; private->zones_count < config->zones_count; private->zones_count++) {
+    zone_t *zone = &private->zones[private->zones_count];
+
+    if (!utils_tz_construct(&zone->tz, config->zones[private->zones_count])) {
+      log_error("Failed to load time zone %s", config->zones[private->zones_count]);
+      return false;
+    }
+
+    for (usize segment_index = 0; segment_index < MAX_SEGMENTS_COUNT; segment_index++) {
+      zone->days[segment_index] = -1;
+    }
+  }
+
+  return true;
+}
+
+/* splits format into day-level and finer segments and derives wakeup interval from the finest unit shown */
+static bool private_construct(private_t *private, module_clock_config_t const *config) {
+  *private = (private_t){0};
+
+  unit_t finest_unit = UNIT_DAY;
+  char const *segment_start = config->format;
+  bool is_daily = true;
+
+  for (char const *character = config->format; *character != '\0'; character++) {
+    if (*character != '%') {
+      continue;
+    }
+
+    char const *conversion = skip_conversion_modifiers(character + 1);
+
+    if (*conversion == '\0') {
+      break;
+    }
+
+    unit_t const unit = get_conversion_unit(*conversion);
+
+    if (unit < finest_unit) {
+      finest_unit = unit;
+    }
+
+    bool const is_conversion_daily = unit == UNIT_DAY;
+    bool const is_epoch = *conversion == 's';
+
+    /* text between conversions stays with the preceding segment */
+    if ((is_conversion_daily != is_daily || is_epoch) && character != segment_start) {
+      if (!private_add_segment(private, segment_start, (usize)(character - segment_start), is_daily, false)) {
+        goto error;
+      }
+
+      segment_start = character;
+    }
+
+    /* seconds since epoch are the same in every zone, flags and width of %s are not applied */
+    if (is_epoch) {
+      if (!private_add_segment(private, segment_start, (usize)(conversion + 1 - segment_start), false, true)) {
+        goto error;
+      }
+
+      segment_start = conversion + 1;
+    }
+
+    is_daily = is_conversion_daily;
+    character = conversion;
+  }
+
+  if (*segment_start != '\0' &&
+      !private_add_segment(private, segment_start, strlen(segment_start), is_daily, false)) {
+    goto error;
+  }
+
+  if (!private_load_zones(private, config)) {
+    goto error;
+  }
+
+  /* waking up more often than the format changes only repeats the same text */
+  u64 const interval = config->interval > finest_unit ? config->interval : finest_unit;
+
+  private->interval = interval * 1000000000;
+
+  return true;
+
+error:
+  private_destruct(private);
+  return false;
+}
+
+/* returns utc offset of zone at realtime in nanoseconds */
+static i64 get_offset(utils_tz_t const *tz, u64 realtime) {
+  struct tm local_time;
+
+  return utils_tz_get_local_time(tz, (i64)(realtime / 1000000000), &local_time)
+           ? (i64)local_time.tm_gmtoff * 1000000000
+           : 0;
+}
+
+/* boundaries are aligned to local time, so hourly and daily wakeups follow zones with non-hour offsets, the
+   earliest boundary of all zones wins */
+static u64 calculate_next_interval_boundary(private_t const *private, utils_time_clock_t *clock) {
+  u64 const realtime = utils_time_clock_get_realtime(clock);
+  u64 next_boundary = UTILS_TIME_INFINITE;
+
+  for (usize zone_index = 0; zone_index < private->zones_count; zone_index++) {
+    utils_tz_t const *tz = &private->zones[zone_index].tz;
+    i64 const offset = get_offset(tz, realtime);
+    u64 const local_realtime = (u64)((i64)realtime + offset);
+    u64 const local_boundary = local_realtime - local_realtime % private->interval + private->interval;
+    u64 boundary = (u64)((i64)local_boundary - offset);
+
+    /* offset changes before boundary (e.g midnight after daylight saving time starts is an hour earlier in utc),
+       local boundary is taken at offset after transition unless it doesn't exist in it, below a day the transition
+       itself is a boundary too as rendered hour or zone changes there */
+    i64 const boundary_offset = get_offset(tz, boundary);
+
+    if (boundary_offset != offset) {
+      u64 const shifted_boundary = (u64)((i64)local_boundary - boundary_offset);
+
+      if (shifted_boundary > realtime && get_offset(tz, shifted_boundary) == boundary_offset &&
+          (shifted_boundary < boundary || private->interval >= UNIT_DAY * 1000000000UL)) {
+        boundary = shifted_boundary;
+      }
+    }
+
+    if (boundary < next_boundary) {
+      next_boundary = boundary;
+    }
+  }
+
+  return next_boundary;
+}
+
+static usize render_zone(private_t const *private, zone_t *zone, char *buffer, usize length, time_t timer) {
+  struct tm local_time;
+
+  if (!utils_tz_get_local_time(&zone->tz, (i64)timer, &local_time)) {
+    return 0;
+  }
+
+  i32 const day = local_time.tm_year * 366 + local_time.tm_yday;
+  usize offset = 0;
+
+  for (usize segment_index = 0; segment_index < private->segments_count; segment_index++) {
+    segment_t const *segment = &private->segments[segment_index];
+
+    if (segment->is_epoch) {
+      char epoch[MAX_EPOCH_LENGTH];
+      int const epoch_length = snprintf(epoch, sizeof(epoch), "%lld", (long long)timer);
+
+      if (epoch_length > 0 && (usize)epoch_length < length - offset) {
+        memcpy(buffer + offset, epoch, (usize)epoch_length);
+        offset += (usize)epoch_length;
+      }
+
+      continue;
+    }
+
+    if (!segment->is_daily) {
+      offset += strftime(buffer + offset, length - offset, segment->format, &local_time);
+      continue;
+    }
+
+    if (zone->days[segment_index] != day) {
+      zone->lengths[segment_index] =
+        strftime(zone->caches[segment_index], sizeof(zone->caches[segment_index]), segment->format, &local_time);
+      zone->days[segment_index] = day;
+    }
+
+    if (zone->lengths[segment_index] < length - offset) {
+      memcpy(buffer + offset, zone->caches[segment_index], zone->lengths[segment_index]);
+      offset += zone->lengths[segment_index];
+    }
+  }
+
+  return offset;
+}
+
+static void render(private_t *private, char const *separator, char *buffer, usize length, time_t timer) {
+  usize const separator_length = strlen(separator);
+  usize offset = 0;
+
+  buffer[0] = '\0';
+
+  for (usize zone_index = 0; zone_index < private->zones_count; zone_index++) {
+    if (zone_index != 0) {
+      if (separator_length >= length - offset) {
+        break;
+      }
+
+      memcpy(buffer + offset, separator, separator_length);
+      offset += separator_length;
+    }
+
+    offset += render_zone(private, &private->zones[zone_index], buffer + offset, length - offset, timer);
+    buffer[offset] = '\0';
+  }
+}
+
+static inline time_t get_current_time(utils_time_clock_t *clock) {
+  return (time_t)(utils_time_clock_get_realtime(clock) / 1000000000);
+}
+
+static inline bool update_module(module_t *module, module_clock_config_t const *config, private_t *private,
+                                 time_t timer) {
+  /* time read from clock is the event source, recorded as i64 */
+  u8 payload[sizeof(u64)];
+  trace_put_u64(payload, (u64)timer);
+  module_record(module, payload, sizeof(payload));
+
+  char buffer[MAX_TEXT_LENGTH];
+  render(private, config->separator, buffer, sizeof(buffer), timer);
+
   return module_update(module, buffer, NULL);
 }
 
@@ -104,13 +481,17 @@ int module_clock_run(module_t *module) {
     goto done;
   }
 
-  tzset();
+  private_t private;
+
+  if (!private_construct(&private, config)) {
+    goto free_config;
+  }
 
   locale_t locale = newlocale(LC_TIME_MASK, "", NULL);
 
   if (locale == NULL) {
     log_error("Failed to create locale");
-    goto free_config;
+    goto destruct_private;
   }
 
   if (uselocale(locale) == NULL) {
@@ -118,46 +499,114 @@ int module_clock_run(module_t *module) {
     goto free_locale;
   }
 
-  update_module(module, config);
+  utils_time_clock_t *clock = module_get_clock(module);
+  utils_time_timer_t timer;
 
-  long const config_interval_ms = config->interval * 1000;
-
-  if (config_interval_ms > LONG_MAX) {
-    log_error("interval int overflow");
+  if (!utils_time_clock_timer_construct(clock, &timer)) {
+    log_error("Failed to create timer");
     goto free_locale;
   }
 
+  update_module(module, config, &private, get_current_time(clock));
+
   int abort_file_descriptor = module_get_abort_file_descriptor(module);
 
   if (abort_file_descriptor == -1) {
     log_error("Failed to get abort file descriptor");
-    goto free_locale;
+    goto destruct_timer;
   }
 
   while (true) {
-    fd_set fds;
+    u64 const deadline = calculate_next_interval_boundary(&private, clock);
+    utils_time_wait_status_t wait_status = utils_time_clock_wait_until(clock, &timer, abort_file_descriptor, deadline);
 
-    FD_ZERO(&fds);
-    FD_SET(abort_file_descriptor, &fds);
-
-    struct timeval timeout = calculate_time_until_next_interval(config_interval_ms);
-
-    int select_status = select(abort_file_descriptor + 1, &fds, NULL, NULL, &timeout);
-
-    if (select_status < 0) {
+    if (wait_status == UTILS_TIME_WAIT_FAILED) {
       if (errno == EINTR) {
         continue;
       }
 
-      log_error("select()");
-      goto free_locale;
+      log_error("Failed to wait for timer");
+      goto destruct_timer;
     }
 
-    if (select_status > 0) {
+    module_wakeup(module);
+
+    if (wait_status == UTILS_TIME_WAIT_READABLE) {
       break;
     }
 
-    if (!update_module(module, config)) {
+    /* on UTILS_TIME_WAIT_CLOCK_SET time is rendered right away and next boundary follows new time */
+    module_mark_event(module);
+
+    if (!update_module(module, config, &private, get_current_time(clock))) {
+      log_error("Failed to update lock module");
+      goto destruct_timer;
+    }
+  }
+
+  status = EXIT_SUCCESS;
+
+destruct_timer:
+  utils_time_clock_timer_destruct(clock, &timer);
+
+free_locale:
+  /* locale is still in use by calling thread */
+  uselocale(LC_GLOBAL_LOCALE);
+  freelocale(locale);
+
+destruct_private:
+  private_destruct(&private);
+
+free_config:
+  config_free(config);
+
+done:
+
+  return status;
+}
+
+int module_clock_replay(module_t *module) {
+  int status = EXIT_FAILURE;
+
+  module_clock_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    goto done;
+  }
+
+  private_t private;
+
+  if (!private_construct(&private, config)) {
+    goto free_config;
+  }
+
+  locale_t locale = newlocale(LC_TIME_MASK, "", NULL);
+
+  if (locale == NULL) {
+    log_error("Failed to create locale");
+    goto destruct_private;
+  }
+
+  if (uselocale(locale) == NULL) {
+    log_error("Failed to use locale");
+    goto free_locale;
+  }
+
+  void const *payload = NULL;
+  usize length = 0;
+
+  while (module_replay_next(module, &payload, &length)) {
+    u64 timer = 0;
+
+    if (length != sizeof(timer)) {
+      log_error("Invalid clock trace event");
+      goto free_locale;
+    }
+
+    trace_get_u64(payload, &timer);
+    module_mark_event(module);
+
+    if (!update_module(module, config, &private, (time_t)(i64)timer)) {
       log_error("Failed to update lock module");
       goto free_locale;
     }
@@ -166,12 +615,15 @@ int module_clock_run(module_t *module) {
   status = EXIT_SUCCESS;
 
 free_locale:
+  uselocale(LC_GLOBAL_LOCALE);
   freelocale(locale);
 
+destruct_private:
+  private_destruct(&private);
+
 free_config:
   config_free(config);
 
 done:
-
   return status;
 }
@@ -0,0 +1,663 @@
+#include "modules/cpu.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_MODULE "cpu"
+
+#include "log.h"
+#include "macros.h"
+#include "module.h"
+#include "toml.h"
+#include "trace.h"
+#include "utils/fs.h"
+#include "utils/time.h"
+
+#define DEFAULT_PROCFS_ROOT "/proc"
+#define DEFAULT_INTERVAL 1000000000UL /* nanoseconds */
+#define DEFAULT_TOP_COUNT 3
+#define MAX_TOP_COUNT 64
+#define LINE_SIZE 128           /* initial buffer per "cpuN" line, buffer grows if file doesn't fit */
+#define MAX_TOP_ENTRY_LENGTH 10 /* "65535:100 " */
+#define COUNTERS_COUNT 8        /* user nice system idle iowait irq softirq steal, guest is part of user */
+
+static char const heat_levels[] = "_.:-=+*#%@";
+
+/* per-core counters as structure of arrays, delta loop is branch-free over contiguous arrays, gcc vectorises it at
+   -O3 but not under cheap cost model of -O2 as loop needs an epilogue for count */
+typedef struct cores {
+  u16 *ids;       /* N of "cpuN" lines, offline cores have no line */
+  u64 *busy;      /* jiffies of previous sample */
+  u64 *total;
+  u64 *next_busy; /* jiffies of current sample, swapped with previous ones after deltas */
+  u64 *next_total;
+  u8 *usages; /* percent over last interval */
+  char *heat; /* heat string of capacity + 1 bytes */
+  usize count;
+  usize capacity;
+} cores_t;
+
+typedef struct private {
+  utils_fs_reader_t reader; /* <procfs_root>/stat, kept open and reread from offset 0 */
+  char *buffer;
+  cores_t cores;
+  u64 busy; /* aggregate "cpu" line of previous sample */
+  u64 total;
+  u64 next_busy;
+  u64 next_total;
+  u8 usage;
+  bool has_previous; /* first sample and samples after core set changed only prime counters */
+  u8 *record_buffer; /* trace payload, allocated once recording */
+}
+private_t;
+
+/* sample rendered by module and replayed from trace */
+typedef struct sample {
+  u8 usage;
+  u16 const *ids;
+  u8 const *usages;
+  char *heat; /* count + 1 bytes */
+  usize count;
+} sample_t;
+
+typedef enum scan_status {
+  SCAN_DONE,
+  SCAN_TRUNCATED,       /* buffer ended inside "cpuN" lines */
+  SCAN_CAPACITY_EXCEED, /* more cores than arrays hold */
+  SCAN_FAILED,
+} scan_status_t;
+
+static void config_free(module_cpu_config_t *config) {
+  if (config == NULL) {
+    return;
+  }
+
+  free(config->procfs_root);
+  free(config->format);
+  free(config);
+}
+
+static module_cpu_config_t *config_get(toml_table_t *table) {
+  module_cpu_config_t *config = calloc(1, sizeof(*config));
+
+  if (config == NULL) {
+    log_error("Failed to allocate cpu config");
+    goto error;
+  }
+
+  toml_value_t format = toml_table_string(table, "format");
+
+  if (!format.ok) {
+    log_error("Failed to get format");
+    goto error;
+  }
+
+  config->format = format.u.s;
+  config->interval = DEFAULT_INTERVAL;
+
+  toml_value_t interval = toml_table_string(table, "interval");
+
+  if (interval.ok) {
+    bool const is_parsed = utils_time_parse_interval(interval.u.s, &config->interval);
+
+    free(interval.u.s);
+
+    if (!is_parsed) {
+      log_error("Invalid cpu interval");
+      goto error;
+    }
+  }
+
+  toml_value_t top_count = toml_table_int(table, "top");
+
+  if (top_count.ok && (top_count.u.i < 0 || top_count.u.i > MAX_TOP_COUNT)) {
+    log_error("Cpu top must be between 0 and %d", MAX_TOP_COUNT);
+    goto error;
+  }
+
+  config->top_count = top_count.ok ? (u16)top_count.u.i : DEFAULT_TOP_COUNT;
+
+  toml_value_t procfs_root = toml_table_string(table, "procfs_root");
+  config->procfs_root = procfs_root.ok ? procfs_root.u.s : strdup(DEFAULT_PROCFS_ROOT);
+
+  if (config->procfs_root == NULL) {
+    log_error("Failed to allocate procfs root");
+    goto error;
+  }
+
+  return config;
+
+error:
+  config_free(config);
+  return NULL;
+}
+
+static void cores_destruct(cores_t *cores) {
+  free(cores->ids);
+  free(cores->busy);
+  free(cores->total);
+  free(cores->next_busy);
+  free(cores->next_total);
+  free(cores->usages);
+  free(cores->heat);
+}
+
+static bool reserve_array(void **array, usize capacity, usize element_size) {
+  void *reserved = realloc(*array, capacity * element_size);
+
+  if (reserved == NULL) {
+    return false;
+  }
+
+  *array = reserved;
+
+  return true;
+}
+
+/* grows arrays on first sample and core hotplug only, steady state samples don't allocate */
+static bool cores_reserve(cores_t *cores, usize capacity) {
+  if (!reserve_array((void **)&cores->ids, capacity, sizeof(*cores->ids)) ||
+      !reserve_array((void **)&cores->busy, capacity, sizeof(*cores->busy)) ||
+      !reserve_array((void **)&cores->total, capacity, sizeof(*cores->total)) ||
+      !reserve_array((void **)&cores->next_busy, capacity, sizeof(*cores->next_busy)) ||
+      !reserve_array((void **)&cores->next_total, capacity, sizeof(*cores->next_total)) ||
+      !reserve_array((void **)&cores->usages, capacity, sizeof(*cores->usages)) ||
+      !reserve_array((void **)&cores->heat, capacity + 1, sizeof(*cores->heat))) {
+    log_error("Failed to allocate %lu cores", (unsigned long)capacity);
+    return false;
+  }
+
+  cores->capacity = capacity;
+
+  return true;
+}
+
+static inline char const *scan_u64(char const *cursor, u64 *value) {
+  u64 result = 0;
+
+  for (; *cursor >= '0' && *cursor <= '9'; cursor++) {
+    result = result * 10 + (u64)(*cursor - '0');
+  }
+
+  *value = result;
+
+  return cursor;
+}
+
+/* scans counters after "cpu" or "cpuN", returns start of next line, null if line isn't complete */
+static char const *scan_counters(char const *cursor, u64 *busy, u64 *total) {
+  u64 counters[COUNTERS_COUNT] = {0};
+
+  for (usize counter_index = 0; counter_index < COUNTERS_COUNT && *cursor == ' '; counter_index++) {
+    while (*cursor == ' ') {
+      cursor++;
+    }
+
+    cursor = scan_u64(cursor, &counters[counter_index]);
+  }
+
+  cursor = strchr(cursor, '\n');
+
+  if (cursor == NULL) {
+    return NULL;
+  }
+
+  u64 const idle = counters[3] + counters[4];
+  *total = 0;
+
+  for (usize counter_index = 0; counter_index < COUNTERS_COUNT; counter_index++) {
+    *total += counters[counter_index];
+  }
+
+  *busy = *total - idle;
+
+  return cursor + 1;
+}
+
+static inline bool is_core_line(char const *cursor) {
+  return cursor[0] == 'c' && cursor[1] == 'p' && cursor[2] == 'u' && cursor[3] >= '0' && cursor[3] <= '9';
+}
+
+/* buffer ended at "", "c", "cp" or "cpu", which may be the start of a cut off "cpuN" line */
+static inline bool is_core_line_start(char const *cursor) {
+  usize const length = strnlen(cursor, 4);
+
+  return length < 4 && strncmp(cursor, "cpu", length) == 0;
+}
+
+/* hand-written scanner of "cpu" lines at the start of /proc/stat, the rest of the file is never looked at */
+static scan_status_t private_scan(private_t *private, bool *is_core_set_changed) {
+  cores_t *cores = &private->cores;
+  char const *cursor = private->reader.buffer;
+
+  if (strncmp(cursor, "cpu ", 4) != 0) {
+    return SCAN_FAILED;
+  }
+
+  cursor = scan_counters(cursor + 3, &private->next_busy, &private->next_total);
+
+  if (cursor == NULL) {
+    return SCAN_TRUNCATED;
+  }
+
+  usize count = 0;
+
+  while (is_core_line(cursor)) {
+    u64 id = 0;
+    u64 busy = 0;
+    u64 total = 0;
+
+    cursor = scan_counters(scan_u64(cursor + 3, &id), &busy, &total);
+
+    if (cursor == NULL) {
+      return SCAN_TRUNCATED;
+    }
+
+    if (count < cores->capacity) {
+      *is_core_set_changed |= cores->ids[count] != (u16)id;
+
+      cores->ids[count] = (u16)id;
+      cores->next_busy[count] = busy;
+      cores->next_total[count] = total;
+    }
+
+    count++;
+  }
+
+  /* buffer filled up right after a complete line or inside the first letters of the next one, which may be a core */
+  if (private->reader.length == private->reader.size - 1 && is_core_line_start(cursor)) {
+    return SCAN_TRUNCATED;
+  }
+
+  if (count > cores->capacity) {
+    cores->count = count;
+    return SCAN_CAPACITY_EXCEED;
+  }
+
+  *is_core_set_changed |= count != cores->count;
+  cores->count = count;
+
+  return SCAN_DONE;
+}
+
+static bool private_grow_buffer(private_t *private) {
+  usize const size = private->reader.size * 2;
+  char *buffer = realloc(private->buffer, size);
+
+  if (buffer == NULL) {
+    log_error("Failed to allocate stat buffer");
+    return false;
+  }
+
+  private->buffer = buffer;
+  private->reader.buffer = buffer;
+  private->reader.size = size;
+
+  return true;
+}
+
+static inline u8 calculate_usage(u64 busy, u64 total, u64 next_busy, u64 next_total) {
+  i32 busy_delta = (i32)(next_busy - busy);
+  i32 total_delta = (i32)(next_total - total);
+
+  /* iowait may go backwards on some kernels, clamped in integers so the loop stays branch-free */
+  busy_delta = busy_delta < 0 ? 0 : busy_delta;
+  busy_delta = busy_delta > total_delta ? total_delta : busy_delta;
+  total_delta = total_delta < 1 ? 1 : total_delta;
+
+  return (u8)((f32)busy_delta * 100.0F / (f32)total_delta + 0.5F);
+}
+
+/* deltas of one interval fit i32 jiffies, which keeps the loop free of 64-bit conversions and divisions */
+static void calculate_usages(u8 *restrict usages, u64 const *restrict busy, u64 const *restrict total,
+                             u64 const *restrict next_busy, u64 const *restrict next_total, usize count) {
+  for (usize core_index = 0; core_index < count; core_index++) {
+    usages[core_index] = calculate_usage(busy[core_index], total[core_index], next_busy[core_index],
+                                         next_total[core_index]);
+  }
+}
+
+static bool private_sample(private_t *private) {
+  cores_t *cores = &private->cores;
+  bool is_core_set_changed = false;
+  scan_status_t scan_status;
+
+  do {
+    if (!utils_fs_reader_refresh(&private->reader)) {
+      log_error("Failed to read stat");
+      return false;
+    }
+
+    scan_status = private_scan(private, &is_core_set_changed);
+
+    if ((scan_status == SCAN_TRUNCATED && !private_grow_buffer(private)) ||
+        (scan_status == SCAN_CAPACITY_EXCEED && !cores_reserve(cores, cores->count))) {
+      return false;
+    }
+
+    /* grown arrays are rescanned, previous counters of new cores are unknown */
+    is_core_set_changed |= scan_status == SCAN_CAPACITY_EXCEED;
+  } while (scan_status == SCAN_TRUNCATED || scan_status == SCAN_CAPACITY_EXCEED);
+
+  if (scan_status == SCAN_FAILED) {
+    log_error("Failed to parse stat");
+    return false;
+  }
+
+  if (private->has_previous && !is_core_set_changed) {
+    calculate_usages(cores->usages, cores->busy, cores->total, cores->next_busy, cores->next_total, cores->count);
+    private->usage = calculate_usage(private->busy, private->total, private->next_busy, private->next_total);
+  } else {
+    memset(cores->usages, 0, cores->count * sizeof(*cores->usages));
+    private->usage = 0;
+  }
+
+  u64 *busy = cores->busy;
+  u64 *total = cores->total;
+
+  cores->busy = cores->next_busy;
+  cores->total = cores->next_total;
+  cores->next_busy = busy;
+  cores->next_total = total;
+  private->busy = private->next_busy;
+  private->total = private->next_total;
+  private->has_previous = true;
+
+  return true;
+}
+
+static void private_destruct(private_t *private) {
+  utils_fs_reader_close(&private->reader);
+  cores_destruct(&private->cores);
+  free(private->buffer);
+  free(private->record_buffer);
+}
+
+static bool private_construct(private_t *private, char const *procfs_root) {
+  char path[PATH_MAX];
+  long const configured_cores_count = sysconf(_SC_NPROCESSORS_CONF);
+  usize const cores_count = configured_cores_count > 0 ? (usize)configured_cores_count : 1;
+  usize const buffer_size = (cores_count + 1) * LINE_SIZE;
+
+  *private = (private_t){.reader = {.file_descriptor = -1}};
+
+  snprintf(path, sizeof(path), "%s/stat", procfs_root);
+
+  private->buffer = malloc(buffer_size);
+
+  if (private->buffer == NULL || !cores_reserve(&private->cores, cores_count)) {
+    log_error("Failed to allocate cpu counters");
+    goto error;
+  }
+
+  if (!utils_fs_reader_open(&private->reader, path, private->buffer, buffer_size)) {
+    log_error("Failed to open %s", path);
+    goto error;
+  }
+
+  /* primes counters, first rendered sample covers first interval */
+  if (!private_sample(private)) {
+    goto error;
+  }
+
+  return true;
+
+error:
+  private_destruct(private);
+  return false;
+}
+
+static inline sample_t private_get_sample(private_t const *private) {
+  return (sample_t){
+    .usage = private->usage,
+    .ids = private->cores.ids,
+    .usages = private->cores.usages,
+    .heat = private->cores.heat,
+    .count = private->cores.count,
+  };
+}
+
+/* busiest cores first, ties keep core order, selection repeats top count times instead of sorting all cores */
+static void render_top(sample_t const *sample, u16 top_count, char *buffer, usize size) {
+  usize offset = 0;
+  isize previous_index = -1;
+
+  buffer[0] = '\0';
+
+  for (u16 top_index = 0; top_index < top_count && top_index < sample->count; top_index++) {
+    isize best_index = -1;
+
+    for (usize core_index = 0; core_index < sample->count; core_index++) {
+      u8 const usage = sample->usages[core_index];
+
+      /* only cores ordered after previous pick are left */
+      if (previous_index != -1) {
+        u8 const previous_usage = sample->usages[(usize)previous_index];
+
+        if (usage > previous_usage || (usage == previous_usage && (isize)core_index <= previous_index)) {
+          continue;
+        }
+      }
+
+      if (best_index == -1 || usage > sample->usages[(usize)best_index]) {
+        best_index = (isize)core_index;
+      }
+    }
+
+    if (best_index == -1) {
+      break;
+    }
+
+    offset += (usize)snprintf(buffer + offset, size - offset, "%s%u:%u", top_index != 0 ? " " : "",
+                              sample->ids[(usize)best_index], sample->usages[(usize)best_index]);
+    previous_index = best_index;
+  }
+}
+
+static void render_heat(sample_t const *sample) {
+  for (usize core_index = 0; core_index < sample->count; core_index++) {
+    sample->heat[core_index] = heat_levels[sample->usages[core_index] * lengthof(heat_levels) / 101];
+  }
+
+  sample->heat[sample->count] = '\0';
+}
+
+static bool update_module(module_t *module, module_cpu_config_t const *config, sample_t const *sample) {
+  char usage[8];
+  char top[MAX_TOP_COUNT * MAX_TOP_ENTRY_LENGTH + 1];
+
+  snprintf(usage, sizeof(usage), "%u", sample->usage);
+  render_top(sample, config->top_count, top, sizeof(top));
+  render_heat(sample);
+
+  char const *formatters[][2] = {
+    {"%usage%", usage},
+    {"%top%", top},
+    {"%heat%", sample->heat},
+    {NULL, NULL},
+  };
+
+  return module_update(module, config->format, formatters);
+}
+
+/* trace event payload: u8 aggregate usage, u16 ids and u8 usages of all cores */
+static void record_sample(module_t *module, private_t *private, sample_t const *sample) {
+  usize const length = 1 + sample->count * (sizeof(*sample->ids) + sizeof(*sample->usages));
+
+  if (length > TRACE_MAX_PAYLOAD_LENGTH) {
+    return;
+  }
+
+  /* sized for every core count up to trace payload limit, allocated once */
+  if (private->record_buffer == NULL) {
+    private->record_buffer = malloc(TRACE_MAX_PAYLOAD_LENGTH);
+
+    if (private->record_buffer == NULL) {
+      return;
+    }
+  }
+
+  u8 *payload = private->record_buffer;
+
+  u8 *cursor = trace_put_u8(payload, sample->usage);
+
+  for (usize core_index = 0; core_index < sample->count; core_index++) {
+    cursor = trace_put_u16(cursor, sample->ids[core_index]);
+  }
+
+  memcpy(cursor, sample->usages, sample->count);
+
+  module_record(module, payload, length);
+}
+
+int module_cpu_run(module_t *module) {
+  int status = EXIT_FAILURE;
+
+  module_cpu_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    goto done;
+  }
+
+  private_t private;
+
+  if (!private_construct(&private, config->procfs_root)) {
+    goto free_config;
+  }
+
+  utils_time_clock_t *clock = module_get_clock(module);
+  utils_time_timer_t timer;
+
+  if (!utils_time_clock_timer_construct(clock, &timer)) {
+    log_error("Failed to create timer");
+    goto destruct_private;
+  }
+
+  int abort_file_descriptor = module_get_abort_file_descriptor(module);
+
+  if (abort_file_descriptor == -1) {
+    log_error("Failed to get abort file descriptor");
+    goto destruct_timer;
+  }
+
+  while (true) {
+    u64 const deadline = (utils_time_clock_get_realtime(clock) / config->interval + 1) * config->interval;
+    utils_time_wait_status_t wait_status = utils_time_clock_wait_until(clock, &timer, abort_file_descriptor, deadline);
+
+    if (wait_status == UTILS_TIME_WAIT_FAILED) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      log_error("Failed to wait for timer");
+      goto destruct_timer;
+    }
+
+    module_wakeup(module);
+
+    if (wait_status == UTILS_TIME_WAIT_READABLE) {
+      break;
+    }
+
+    module_mark_event(module);
+
+    if (!private_sample(&private)) {
+      goto destruct_timer;
+    }
+
+    sample_t const sample = private_get_sample(&private);
+
+    if (module_is_recording(module)) {
+      record_sample(module, &private, &sample);
+    }
+
+    if (!update_module(module, config, &sample)) {
+      log_error("Failed to update module");
+      goto destruct_timer;
+    }
+  }
+
+  status = EXIT_SUCCESS;
+
+destruct_timer:
+  utils_time_clock_timer_destruct(clock, &timer);
+
+destruct_private:
+  private_destruct(&private);
+
+free_config:
+  config_free(config);
+
+done:
+  return status;
+}
+
+int module_cpu_replay(module_t *module) {
+  module_cpu_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_SUCCESS;
+  void const *payload = NULL;
+  usize length = 0;
+
+  while (module_replay_next(module, &payload, &length)) {
+    usize const core_size = sizeof(u16) + sizeof(u8);
+
+    if (length == 0 || (length - 1) % core_size != 0) {
+      log_error("Invalid cpu trace event");
+      status = EXIT_FAILURE;
+      break;
+    }
+
+    u8 const *bytes = payload;
+    usize const count = (length - 1) / core_size;
+    u16 *ids = malloc(count * sizeof(*ids) + 1);
+    char *heat = malloc(count + 1);
+
+    if (ids == NULL || heat == NULL) {
+      log_error("Failed to allocate cpu sample");
+      free(ids);
+      free(heat);
+      status = EXIT_FAILURE;
+      break;
+    }
+
+    u8 const *cursor = bytes + 1;
+
+    for (usize core_index = 0; core_index < count; core_index++) {
+      cursor = trace_get_u16(cursor, &ids[core_index]);
+    }
+
+    sample_t const sample = {
+      .usage = bytes[0],
+      .ids = ids,
+      .usages = cursor,
+      .heat = heat,
+      .count = count,
+    };
+
+    module_mark_event(module);
+
+    bool const is_updated = update_module(module, config, &sample);
+
+    free(ids);
+    free(heat);
+
+    if (!is_updated) {
+      log_error("Failed to update module");
+      status = EXIT_FAILURE;
+      break;
+    }
+  }
+
+  config_free(config);
+
+  return status;
+}
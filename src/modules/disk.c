@@ -0,0 +1,899 @@
+#define _GNU_SOURCE
+
+#include "modules/disk.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#define LOG_MODULE "disk"
+
+#include "log.h"
+#include "macros.h"
+#include "module.h"
+#include "toml.h"
+#include "trace.h"
+#include "utils/string.h"
+#include "utils/time.h"
+
+#define DEFAULT_MOUNT "/"
+#define DEFAULT_SEPARATOR " "
+#define DEFAULT_INTERVAL 30000000000UL /* nanoseconds */
+#define DEFAULT_TIMEOUT 1000000000UL   /* nanoseconds */
+#define DEFAULT_PROCFS_ROOT "/proc"
+#define MAX_TEXT_LENGTH 1024
+#define INITIAL_MOUNTINFO_SIZE 16384 /* grown while mount table doesn't fit */
+#define NEVER UINT64_MAX
+
+/* thread blocking in statvfs for one mount point, so a hung network filesystem blocks only its own worker. Shared
+   with module and freed by whichever of them lets go of it last, worker stuck in statvfs outlives module */
+typedef struct worker {
+  pthread_mutex_t lock;
+  pthread_cond_t condition; /* request posted or worker closed */
+  char *path;
+  int done_file_descriptor; /* duplicate of module eventfd, written after every statvfs */
+  bool has_request;
+  bool is_done;
+  bool is_closed;
+  int error; /* errno of statvfs, 0 on success */
+  struct statvfs stats;
+  u8 references;
+} worker_t;
+
+/* rendered and recorded state of configured mount point */
+typedef struct mount_state {
+  u64 total; /* bytes */
+  u64 used;
+  u64 available; /* to unprivileged users */
+  i32 is_present; /* mounted and sampled at least once, not rendered otherwise */
+} mount_state_t;
+
+#define RECORD_STATE_LENGTH (3 * 8 + 1) /* u64 total, u64 used, u64 available, u8 is present */
+
+typedef struct mount {
+  worker_t *worker;
+  bool is_mounted;
+  bool is_pending;  /* request posted and not collected yet */
+  bool is_hung;     /* request ran past timeout, logged once */
+  u64 next_time;    /* monotonic nanoseconds when mount is due */
+  u64 request_time; /* of pending request */
+} mount_t;
+
+typedef struct private {
+  int mountinfo_file_descriptor; /* polled for POLLPRI, read only when it changes */
+  int done_file_descriptor;      /* eventfd written by workers */
+  char *mountinfo;
+  usize mountinfo_size;
+  mount_t *mounts;
+  mount_state_t *states;
+  usize mounts_count;
+}
+private_t;
+
+/* frees worker once both module and worker thread released it */
+static void worker_release(worker_t *worker) {
+  pthread_mutex_lock(&worker->lock);
+
+  bool const is_last = --worker->references == 0;
+
+  pthread_mutex_unlock(&worker->lock);
+
+  if (is_last) {
+    close(worker->done_file_descriptor);
+    pthread_cond_destroy(&worker->condition);
+    pthread_mutex_destroy(&worker->lock);
+    free(worker->path);
+    free(worker);
+  }
+}
+
+static void *worker_thread(void *param) {
+  worker_t *worker = param;
+
+  pthread_mutex_lock(&worker->lock);
+
+  while (true) {
+    while (!worker->has_request && !worker->is_closed) {
+      pthread_cond_wait(&worker->condition, &worker->lock);
+    }
+
+    if (worker->is_closed) {
+      pthread_mutex_unlock(&worker->lock);
+      break;
+    }
+
+    worker->has_request = false;
+    pthread_mutex_unlock(&worker->lock);
+
+    struct statvfs stats = {0};
+    int const error = statvfs(worker->path, &stats) == 0 ? 0 : errno;
+
+    pthread_mutex_lock(&worker->lock);
+
+    worker->stats = stats;
+    worker->error = error;
+    worker->is_done = true;
+
+    u64 const done = 1;
+
+    if (write(worker->done_file_descriptor, &done, sizeof(done)) != sizeof(done)) {
+      log_error("Failed to notify module of statvfs result");
+    }
+  }
+
+  worker_release(worker);
+
+  return NULL;
+}
+
+static worker_t *worker_create(char const *path, int done_file_descriptor) {
+  worker_t *worker = calloc(1, sizeof(*worker));
+
+  if (worker == NULL) {
+    return NULL;
+  }
+
+  worker->path = strdup(path);
+  worker->done_file_descriptor = fcntl(done_file_descriptor, F_DUPFD_CLOEXEC, 0);
+  worker->references = 2;
+
+  if (worker->path == NULL || worker->done_file_descriptor == -1) {
+    goto free_worker;
+  }
+
+  if (pthread_mutex_init(&worker->lock, NULL) != 0) {
+    goto free_worker;
+  }
+
+  if (pthread_cond_init(&worker->condition, NULL) != 0) {
+    goto destroy_lock;
+  }
+
+  pthread_t thread;
+
+  if (pthread_create(&thread, NULL, worker_thread, worker) != 0) {
+    goto destroy_condition;
+  }
+
+  pthread_detach(thread);
+
+  return worker;
+
+destroy_condition:
+  pthread_cond_destroy(&worker->condition);
+
+destroy_lock:
+  pthread_mutex_destroy(&worker->lock);
+
+free_worker:
+  if (worker->done_file_descriptor != -1) {
+    close(worker->done_file_descriptor);
+  }
+
+  free(worker->path);
+  free(worker);
+
+  return NULL;
+}
+
+/* worker exits once it's done with statvfs it may be blocked in */
+static void worker_close(worker_t *worker) {
+  pthread_mutex_lock(&worker->lock);
+
+  worker->is_closed = true;
+  pthread_cond_signal(&worker->condition);
+
+  pthread_mutex_unlock(&worker->lock);
+
+  worker_release(worker);
+}
+
+static void worker_request(worker_t *worker) {
+  pthread_mutex_lock(&worker->lock);
+
+  worker->has_request = true;
+  worker->is_done = false;
+  pthread_cond_signal(&worker->condition);
+
+  pthread_mutex_unlock(&worker->lock);
+}
+
+/* returns whether statvfs is done and copies its result */
+static bool worker_collect(worker_t *worker, int *error, struct statvfs *stats) {
+  pthread_mutex_lock(&worker->lock);
+
+  bool const is_done = worker->is_done;
+
+  if (is_done) {
+    *error = worker->error;
+    *stats = worker->stats;
+    worker->is_done = false;
+  }
+
+  pthread_mutex_unlock(&worker->lock);
+
+  return is_done;
+}
+
+static void config_free(module_disk_config_t *config) {
+  if (config == NULL) {
+    return;
+  }
+
+  for (usize mount_index = 0; mount_index < config->mounts_count; mount_index++) {
+    free(config->mounts[mount_index]);
+  }
+
+  free(config->mounts);
+  free(config->procfs_root);
+  free(config->separator);
+  free(config->format);
+  free(config);
+}
+
+/* trailing slash is dropped, so mount point matches mountinfo */
+static bool get_mounts(module_disk_config_t *config, toml_table_t *table) {
+  toml_array_t *mounts = toml_table_array(table, "mounts");
+  usize const mounts_count = mounts != NULL ? (usize)toml_array_len(mounts) : 0;
+
+  config->mounts = calloc(mounts_count != 0 ? mounts_count : 1, sizeof(*config->mounts));
+
+  if (config->mounts == NULL) {
+    return false;
+  }
+
+  if (mounts_count == 0) {
+    config->mounts[0] = strdup(DEFAULT_MOUNT);
+    config->mounts_count = config->mounts[0] != NULL ? 1 : 0;
+
+    return config->mounts_count != 0;
+  }
+
+  for (usize mount_index = 0; mount_index < mounts_count; mount_index++) {
+    toml_value_t mount = toml_array_string(mounts, (int)mount_index);
+
+    if (!mount.ok) {
+      return false;
+    }
+
+    config->mounts[config->mounts_count++] = mount.u.s;
+
+    usize const length = strlen(mount.u.s);
+
+    if (length > 1 && mount.u.s[length - 1] == '/') {
+      mount.u.s[length - 1] = '\0';
+    }
+  }
+
+  return true;
+}
+
+static bool get_duration(toml_table_t *table, char const *key, u64 *value) {
+  toml_value_t duration = toml_table_string(table, key);
+
+  if (!duration.ok) {
+    return true;
+  }
+
+  bool const is_parsed = utils_time_parse_interval(duration.u.s, value);
+
+  free(duration.u.s);
+
+  return is_parsed;
+}
+
+static module_disk_config_t *config_get(toml_table_t *table) {
+  module_disk_config_t *config = calloc(1, sizeof(*config));
+
+  if (config == NULL) {
+    log_error("Failed to allocate disk config");
+    goto error;
+  }
+
+  toml_value_t format = toml_table_string(table, "format");
+
+  if (!format.ok) {
+    log_error("Failed to get format");
+    goto error;
+  }
+
+  config->format = format.u.s;
+
+  if (!get_mounts(config, table)) {
+    log_error("Failed to get mounts");
+    goto error;
+  }
+
+  toml_value_t separator = toml_table_string(table, "separator");
+  config->separator = separator.ok ? separator.u.s : strdup(DEFAULT_SEPARATOR);
+
+  if (config->separator == NULL) {
+    log_error("Failed to allocate separator");
+    goto error;
+  }
+
+  config->interval = DEFAULT_INTERVAL;
+  config->timeout = DEFAULT_TIMEOUT;
+
+  if (!get_duration(table, "interval", &config->interval)) {
+    log_error("Invalid disk interval");
+    goto error;
+  }
+
+  if (!get_duration(table, "timeout", &config->timeout)) {
+    log_error("Invalid disk timeout");
+    goto error;
+  }
+
+  toml_value_t procfs_root = toml_table_string(table, "procfs_root");
+  config->procfs_root = procfs_root.ok ? procfs_root.u.s : strdup(DEFAULT_PROCFS_ROOT);
+
+  if (config->procfs_root == NULL) {
+    log_error("Failed to allocate procfs root");
+    goto error;
+  }
+
+  return config;
+
+error:
+  config_free(config);
+  return NULL;
+}
+
+static void private_destruct(private_t *private) {
+  if (private->mounts != NULL) {
+    for (usize mount_index = 0; mount_index < private->mounts_count; mount_index++) {
+      if (private->mounts[mount_index].worker != NULL) {
+        worker_close(private->mounts[mount_index].worker);
+      }
+    }
+  }
+
+  if (private->mountinfo_file_descriptor != -1) {
+    close(private->mountinfo_file_descriptor);
+  }
+
+  if (private->done_file_descriptor != -1) {
+    close(private->done_file_descriptor);
+  }
+
+  free(private->mountinfo);
+  free(private->mounts);
+  free(private->states);
+}
+
+static bool private_construct(private_t *private, module_disk_config_t const *config) {
+  *private = (private_t){
+    .mountinfo_file_descriptor = -1,
+    .done_file_descriptor = -1,
+    .mountinfo_size = INITIAL_MOUNTINFO_SIZE,
+    .mounts_count = config->mounts_count,
+  };
+
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/self/mountinfo", config->procfs_root);
+
+  private->mountinfo_file_descriptor = open(path, O_RDONLY | O_CLOEXEC);
+
+  if (private->mountinfo_file_descriptor == -1) {
+    log_error("Failed to open %s: %s", path, strerror(errno));
+    goto error;
+  }
+
+  private->done_file_descriptor = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+  if (private->done_file_descriptor == -1) {
+    log_error("Failed to create eventfd");
+    goto error;
+  }
+
+  private->mountinfo = malloc(private->mountinfo_size);
+  private->mounts = calloc(private->mounts_count, sizeof(*private->mounts));
+  private->states = calloc(private->mounts_count, sizeof(*private->states));
+
+  if (private->mountinfo == NULL || private->mounts == NULL || private->states == NULL) {
+    log_error("Failed to allocate mounts");
+    goto error;
+  }
+
+  for (usize mount_index = 0; mount_index < private->mounts_count; mount_index++) {
+    private->mounts[mount_index].worker = worker_create(config->mounts[mount_index], private->done_file_descriptor);
+
+    if (private->mounts[mount_index].worker == NULL) {
+      log_error("Failed to start statvfs worker of %s", config->mounts[mount_index]);
+      goto error;
+    }
+  }
+
+  return true;
+
+error:
+  private_destruct(private);
+  return false;
+}
+
+/* reads whole mount table from offset 0, buffer grows only when mount table outgrows it */
+static bool private_read_mountinfo(private_t *private) {
+  usize length = 0;
+
+  while (true) {
+    if (private->mountinfo_size - length < 2) {
+      char *mountinfo = realloc(private->mountinfo, private->mountinfo_size * 2);
+
+      if (mountinfo == NULL) {
+        return false;
+      }
+
+      private->mountinfo = mountinfo;
+      private->mountinfo_size *= 2;
+    }
+
+    isize const read_length = pread(private->mountinfo_file_descriptor, private->mountinfo + length,
+                                    private->mountinfo_size - length - 1, (off_t)length);
+
+    if (read_length < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return false;
+    }
+
+    if (read_length == 0) {
+      break;
+    }
+
+    length += (usize)read_length;
+  }
+
+  private->mountinfo[length] = '\0';
+
+  return true;
+}
+
+/* compares mount point field of mountinfo line, which escapes space, tab, newline and backslash as octal */
+static bool is_mount_point(char const *field, char const *mount_point) {
+  for (; *field != ' ' && *field != '\0'; mount_point++) {
+    char character = *field++;
+
+    if (character == '\\' && field[0] >= '0' && field[0] <= '7' && field[1] >= '0' && field[1] <= '7' &&
+        field[2] >= '0' && field[2] <= '7') {
+      character = (char)((field[0] - '0') * 64 + (field[1] - '0') * 8 + (field[2] - '0'));
+      field += 3;
+    }
+
+    if (character != *mount_point) {
+      return false;
+    }
+  }
+
+  return *mount_point == '\0';
+}
+
+/* marks configured mount points found in mount table, mounted ones are due right away */
+static bool private_update_mounts(private_t *private, module_disk_config_t const *config, u64 now) {
+  if (!private_read_mountinfo(private)) {
+    log_error("Failed to read mountinfo: %s", strerror(errno));
+    return false;
+  }
+
+  for (usize mount_index = 0; mount_index < private->mounts_count; mount_index++) {
+    private->mounts[mount_index].is_mounted = false;
+  }
+
+  /* "36 35 98:0 /root /mnt/point rw,noatime ...", mount point is fifth field */
+  for (char const *line = private->mountinfo; *line != '\0';) {
+    char const *field = line;
+
+    for (usize field_index = 0; field_index < 4 && field != NULL; field_index++) {
+      field = strchr(field, ' ');
+      field = field != NULL ? field + 1 : NULL;
+    }
+
+    for (usize mount_index = 0; field != NULL && mount_index < private->mounts_count; mount_index++) {
+      if (is_mount_point(field, config->mounts[mount_index])) {
+        private->mounts[mount_index].is_mounted = true;
+      }
+    }
+
+    char const *line_end = strchr(line, '\n');
+    line = line_end != NULL ? line_end + 1 : line + strlen(line);
+  }
+
+  for (usize mount_index = 0; mount_index < private->mounts_count; mount_index++) {
+    mount_t *mount = &private->mounts[mount_index];
+
+    mount->next_time = now;
+
+    if (!mount->is_mounted) {
+      private->states[mount_index].is_present = 0;
+    }
+  }
+
+  return true;
+}
+
+/* posts requests of due mount points, returns whether any was posted */
+static bool private_request(private_t *private, module_disk_config_t const *config, u64 now) {
+  bool is_requested = false;
+
+  for (usize mount_index = 0; mount_index < private->mounts_count; mount_index++) {
+    mount_t *mount = &private->mounts[mount_index];
+
+    if (!mount->is_mounted || mount->is_pending || now < mount->next_time) {
+      continue;
+    }
+
+    worker_request(mount->worker);
+
+    mount->is_pending = true;
+    mount->request_time = now;
+    mount->next_time = now + config->interval;
+    is_requested = true;
+  }
+
+  return is_requested;
+}
+
+static void mount_state_set(mount_state_t *state, struct statvfs const *stats) {
+  u64 const block_size = stats->f_frsize != 0 ? stats->f_frsize : stats->f_bsize;
+
+  *state = (mount_state_t){
+    .total = (u64)stats->f_blocks * block_size,
+    .used = (u64)(stats->f_blocks - stats->f_bfree) * block_size,
+    .available = (u64)stats->f_bavail * block_size,
+    .is_present = 1,
+  };
+}
+
+/* collects finished statvfs, returns whether any was, mount points unmounted meanwhile keep their state cleared */
+static bool private_collect(private_t *private, module_disk_config_t const *config) {
+  bool is_collected = false;
+  u64 done = 0;
+
+  if (read(private->done_file_descriptor, &done, sizeof(done)) == -1 && errno != EAGAIN) {
+    log_warn("Failed to read eventfd: %s", strerror(errno));
+  }
+
+  for (usize mount_index = 0; mount_index < private->mounts_count; mount_index++) {
+    mount_t *mount = &private->mounts[mount_index];
+    struct statvfs stats;
+    int error = 0;
+
+    if (!mount->is_pending || !worker_collect(mount->worker, &error, &stats)) {
+      continue;
+    }
+
+    if (mount->is_hung) {
+      log_info("Statvfs of %s returned again", config->mounts[mount_index]);
+    }
+
+    mount->is_pending = false;
+    mount->is_hung = false;
+    is_collected = true;
+
+    if (error != 0) {
+      log_warn("Failed to statvfs %s: %s", config->mounts[mount_index], strerror(error));
+      private->states[mount_index].is_present = 0;
+    } else if (mount->is_mounted) {
+      mount_state_set(&private->states[mount_index], &stats);
+    }
+  }
+
+  return is_collected;
+}
+
+/* returns whether no request is pending within timeout, hung requests keep last state of their mount point */
+static bool private_is_settled(private_t *private, module_disk_config_t const *config, u64 now) {
+  bool is_settled = true;
+
+  for (usize mount_index = 0; mount_index < private->mounts_count; mount_index++) {
+    mount_t *mount = &private->mounts[mount_index];
+
+    if (!mount->is_pending || mount->is_hung) {
+      continue;
+    }
+
+    if (now - mount->request_time < config->timeout) {
+      is_settled = false;
+      continue;
+    }
+
+    log_warn("Statvfs of %s is blocked for longer than timeout, keeping its last sample", config->mounts[mount_index]);
+    mount->is_hung = true;
+  }
+
+  return is_settled;
+}
+
+/* milliseconds until next mount point is due or pending request times out, -1 if none */
+static int private_get_timeout(private_t const *private, module_disk_config_t const *config, u64 now) {
+  u64 next_time = NEVER;
+
+  for (usize mount_index = 0; mount_index < private->mounts_count; mount_index++) {
+    mount_t const *mount = &private->mounts[mount_index];
+    u64 mount_time = NEVER;
+
+    if (mount->is_pending) {
+      mount_time = mount->is_hung ? NEVER : mount->request_time + config->timeout;
+    } else if (mount->is_mounted) {
+      mount_time = mount->next_time;
+    }
+
+    next_time = mount_time < next_time ? mount_time : next_time;
+  }
+
+  if (next_time == NEVER) {
+    return -1;
+  }
+
+  /* rounded up, so module doesn't wake up just before deadline */
+  return next_time > now ? (int)((next_time - now + 999999) / 1000000) : 0;
+}
+
+static void format_size(u64 size, char *buffer, usize length) {
+  static char const units[] = "BKMGTP";
+  usize unit_index = 0;
+  u64 scale = 1;
+
+  while (unit_index + 1 < lengthof(units) && size >= scale * 1024) {
+    scale *= 1024;
+    unit_index++;
+  }
+
+  u64 const tenths = size * 10 / scale;
+
+  /* "840B", "12.5G", "310G" */
+  if (unit_index == 0 || tenths >= 100) {
+    snprintf(buffer, length, "%lu%c", (unsigned long)(size / scale), units[unit_index]);
+  } else {
+    snprintf(buffer, length, "%lu.%lu%c", (unsigned long)(tenths / 10), (unsigned long)(tenths % 10),
+             units[unit_index]);
+  }
+}
+
+static usize render_mount(char const *format, char const *mount_point, mount_state_t const *state, char *buffer,
+                          usize length) {
+  char used_string[16];
+  char free_string[16];
+  char total_string[16];
+  char percent_string[8];
+
+  format_size(state->used, used_string, sizeof(used_string));
+  format_size(state->available, free_string, sizeof(free_string));
+  format_size(state->total, total_string, sizeof(total_string));
+
+  /* like df, rounded up and relative to space unprivileged users can fill */
+  u64 const capacity = state->used + state->available;
+  snprintf(percent_string, sizeof(percent_string), "%lu",
+           (unsigned long)(capacity != 0 ? (state->used * 100 + capacity - 1) / capacity : 0));
+
+  char const *formatters[][2] = {
+    {"%used%", used_string},
+    {"%free%", free_string},
+    {"%total%", total_string},
+    {"%percent%", percent_string},
+    {"%mount%", mount_point},
+    {0},
+  };
+
+  usize const format_length = strlen(format);
+
+  if (format_length >= length) {
+    return 0;
+  }
+
+  memcpy(buffer, format, format_length + 1);
+
+  for (char const *(*formatter)[2] = formatters; (*formatter)[0] != NULL; formatter++) {
+    if (!utils_string_replace(buffer, length - 1, (*formatter)[0], (*formatter)[1])) {
+      buffer[0] = '\0';
+      return 0;
+    }
+  }
+
+  return strlen(buffer);
+}
+
+static void render(module_disk_config_t const *config, mount_state_t const *states, char *buffer, usize length) {
+  usize const separator_length = strlen(config->separator);
+  usize offset = 0;
+
+  buffer[0] = '\0';
+
+  for (usize mount_index = 0; mount_index < config->mounts_count; mount_index++) {
+    if (!states[mount_index].is_present) {
+      continue;
+    }
+
+    if (offset != 0) {
+      if (separator_length >= length - offset) {
+        break;
+      }
+
+      memcpy(buffer + offset, config->separator, separator_length);
+      offset += separator_length;
+    }
+
+    offset +=
+      render_mount(config->format, config->mounts[mount_index], &states[mount_index], buffer + offset, length - offset);
+    buffer[offset] = '\0';
+  }
+}
+
+static void record_states(module_t *module, mount_state_t const *states, usize states_count) {
+  usize const length = states_count * RECORD_STATE_LENGTH;
+  u8 *payload = malloc(length);
+
+  if (payload == NULL) {
+    log_error("Failed to allocate trace event");
+    return;
+  }
+
+  u8 *cursor = payload;
+
+  for (usize state_index = 0; state_index < states_count; state_index++) {
+    mount_state_t const *state = &states[state_index];
+    cursor = trace_put_u64(trace_put_u64(trace_put_u64(cursor, state->total), state->used), state->available);
+    cursor = trace_put_u8(cursor, state->is_present != 0);
+  }
+
+  module_record(module, payload, length);
+  free(payload);
+}
+
+static inline bool update(module_t *module, module_disk_config_t const *config, mount_state_t const *states) {
+  if (module_is_recording(module)) {
+    record_states(module, states, config->mounts_count);
+  }
+
+  char buffer[MAX_TEXT_LENGTH];
+  render(config, states, buffer, sizeof(buffer));
+
+  return module_update(module, buffer, NULL);
+}
+
+int module_disk_run(module_t *module) {
+  int status = EXIT_FAILURE;
+
+  module_disk_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    goto done;
+  }
+
+  private_t private;
+
+  if (!private_construct(&private, config)) {
+    goto free_config;
+  }
+
+  if (!private_update_mounts(&private, config, utils_time_get_monotonic_nanoseconds())) {
+    goto destruct_private;
+  }
+
+  /* kernel reports mount table changes as POLLPRI | POLLERR, statvfs results come through eventfd */
+  struct pollfd pfds[] = {
+    {.fd = module_get_abort_file_descriptor(module), .events = POLLIN},
+    {.fd = private.mountinfo_file_descriptor, .events = POLLPRI},
+    {.fd = private.done_file_descriptor, .events = POLLIN},
+  };
+
+  /* text is rendered once every due mount point is sampled or timed out, so a hung one doesn't hold up others */
+  bool is_changed = true;
+
+  while (true) {
+    u64 const now = utils_time_get_monotonic_nanoseconds();
+
+    is_changed |= private_request(&private, config, now);
+
+    if (is_changed && private_is_settled(&private, config, now)) {
+      is_changed = false;
+
+      if (!update(module, config, private.states)) {
+        log_error("Failed to update module");
+        goto destruct_private;
+      }
+    }
+
+    if (poll(pfds, countof(pfds), private_get_timeout(&private, config, now)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      log_error("Failed to poll");
+      goto destruct_private;
+    }
+
+    module_wakeup(module);
+
+    if (pfds[0].revents & POLLIN) {
+      break;
+    }
+
+    if (pfds[1].revents & (POLLPRI | POLLERR)) {
+      module_mark_event(module);
+
+      if (!private_update_mounts(&private, config, utils_time_get_monotonic_nanoseconds())) {
+        goto destruct_private;
+      }
+
+      is_changed = true;
+    }
+
+    if (pfds[2].revents & POLLIN) {
+      is_changed |= private_collect(&private, config);
+    }
+  }
+
+  status = EXIT_SUCCESS;
+
+destruct_private:
+  private_destruct(&private);
+
+free_config:
+  config_free(config);
+
+done:
+  return status;
+}
+
+int module_disk_replay(module_t *module) {
+  module_disk_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_SUCCESS;
+  mount_state_t *states = calloc(config->mounts_count, sizeof(*states));
+  void const *payload = NULL;
+  usize length = 0;
+
+  if (states == NULL) {
+    log_error("Failed to allocate mounts");
+    config_free(config);
+    return EXIT_FAILURE;
+  }
+
+  while (module_replay_next(module, &payload, &length)) {
+    if (length != config->mounts_count * RECORD_STATE_LENGTH) {
+      log_error("Invalid disk trace event");
+      status = EXIT_FAILURE;
+      break;
+    }
+
+    u8 const *cursor = payload;
+
+    for (usize mount_index = 0; mount_index < config->mounts_count; mount_index++) {
+      mount_state_t *state = &states[mount_index];
+      u8 is_present = 0;
+
+      cursor = trace_get_u64(trace_get_u64(trace_get_u64(cursor, &state->total), &state->used), &state->available);
+      cursor = trace_get_u8(cursor, &is_present);
+      state->is_present = is_present;
+    }
+
+    module_mark_event(module);
+
+    if (!update(module, config, states)) {
+      log_error("Failed to update module");
+      status = EXIT_FAILURE;
+      break;
+    }
+  }
+
+  free(states);
+  config_free(config);
+
+  return status;
+}
@@ -12,6 +12,8 @@
 #include "macros.h"
 #include "module.h"
 #include "toml.h"
+#include "trace.h"
+#include "utils/time.h"
 
 enum {
   INDICATOR_CAPSLOCK = 1,
@@ -19,9 +21,33 @@ enum {
   INDICATOR_SCROLLLOCK = 4,
 };
 
+#define MAX_NAME_LENGTH 63
+#define MAX_SYMBOL_LENGTH 2 /* symbols are cut to two letters (e.g "us" of "us(intl)") */
+#define MAX_SYMBOLS_LENGTH 255
+#define INDICATORS (INDICATOR_CAPSLOCK | INDICATOR_NUMLOCK | INDICATOR_SCROLLLOCK)
+
+/* trace records, first byte of payload */
+typedef enum record_type {
+  RECORD_KEYMAP = 0, /* u8 group, u32 indicators state, u8 layouts count, group names and symbols name as strings */
+  RECORD_INDICATOR,  /* u32 state changed, u32 state of indicator state notify */
+  RECORD_STATE,      /* u16 changed, u8 group of state notify */
+  RECORD_UPDATE,     /* state applied so far is rendered */
+} record_type_t;
+
+typedef struct layout {
+  char name[MAX_NAME_LENGTH + 1];
+  char symbol[MAX_SYMBOL_LENGTH + 1];
+} layout_t;
+
+/* layouts of current keymap by group, built on NEW_KEYBOARD_NOTIFY, group switches are served without requests */
+typedef struct keymap {
+  layout_t layouts[XCB_XKB_GROUP_4 + 1];
+  u8 layouts_count;
+} keymap_t;
+
 typedef struct private {
-  char *name;
-  char *symbol;
+  keymap_t keymap;
+  u8 group;
   bool is_capslock;
   bool is_numlock;
   bool is_scrolllock;
@@ -55,6 +81,7 @@ static bool enable_xkb(xcb_connection_t *connection) {
     status = true;
   }
 
+  free(error);
   free(reply);
 
   return status;
@@ -66,82 +93,121 @@ static bool register_events(xcb_connection_t *connection) {
 
   xcb_void_cookie_t cookie =
     xcb_xkb_select_events_checked(connection, XCB_XKB_ID_USE_CORE_KBD, events, 0, events, 0, 0, NULL);
+  xcb_generic_error_t *error = xcb_request_check(connection, cookie);
 
-  if (xcb_request_check(connection, cookie) != NULL) {
+  if (error != NULL) {
     log_error("Failed for register xkb events");
+    free(error);
     return false;
   }
 
   return true;
 }
 
-static u8 get_state_group(xcb_connection_t *connection, xcb_generic_error_t *error) {
-  u8 group = 0;
-
-  xcb_xkb_get_state_cookie_t cookie;
-  xcb_xkb_get_state_reply_t *reply;
+static void copy_atom_name(xcb_connection_t *connection, xcb_get_atom_name_cookie_t cookie, char *buffer,
+                           usize size) {
+  xcb_generic_error_t *error = NULL;
+  xcb_get_atom_name_reply_t *reply = xcb_get_atom_name_reply(connection, cookie, &error);
 
-  cookie = xcb_xkb_get_state(connection, XCB_XKB_ID_USE_CORE_KBD);
-  reply = xcb_xkb_get_state_reply(connection, cookie, &error);
+  buffer[0] = '\0';
 
   if (reply != NULL && error == NULL) {
-    group = reply->group;
+    usize name_length = (usize)xcb_get_atom_name_name_length(reply);
+
+    if (name_length >= size) {
+      name_length = size - 1;
+    }
+
+    memcpy(buffer, xcb_get_atom_name_name(reply), name_length);
+    buffer[name_length] = '\0';
   }
 
+  free(error);
   free(reply);
-
-  return group;
 }
 
-static u32 get_indicator_state(xcb_connection_t *connection, xcb_generic_error_t *error) {
-  u32 state = 0;
+/* symbols name is "pc+us+ru:2+inet(evdev)", layout of group n is token n + 1 */
+static void keymap_set_symbols(keymap_t *keymap, char const *symbols) {
+  char const *token = strchr(symbols, '+');
 
-  xcb_xkb_get_indicator_state_cookie_t cookie;
-  xcb_xkb_get_indicator_state_reply_t *reply;
+  for (u8 group = 0; group < keymap->layouts_count && token != NULL; group++) {
+    token++;
 
-  cookie = xcb_xkb_get_indicator_state(connection, XCB_XKB_ID_USE_CORE_KBD);
-  reply = xcb_xkb_get_indicator_state_reply(connection, cookie, &error);
+    usize symbol_length = strcspn(token, "+");
 
-  if (reply != NULL && error == NULL) {
-    state = reply->state;
-  }
+    if (symbol_length > MAX_SYMBOL_LENGTH) {
+      symbol_length = MAX_SYMBOL_LENGTH;
+    }
 
-  free(reply);
+    memcpy(keymap->layouts[group].symbol, token, symbol_length);
+    keymap->layouts[group].symbol[symbol_length] = '\0';
 
-  return state;
+    token = strchr(token, '+');
+  }
 }
 
-static char *get_xcb_atom(xcb_connection_t *connection, xcb_atom_t atom) {
-  char *buffer = NULL;
+/* takes names reply, then pipelines atom name requests of all groups and symbols, two round trips in total, symbols
+   name is kept for traces */
+static bool keymap_construct(keymap_t *keymap, char symbols[MAX_SYMBOLS_LENGTH + 1], xcb_connection_t *connection,
+                             xcb_xkb_get_names_cookie_t cookie) {
+  bool status = false;
 
-  xcb_generic_error_t *error;
-  xcb_get_atom_name_cookie_t cookie;
-  xcb_get_atom_name_reply_t *reply = NULL;
+  *keymap = (keymap_t){0};
 
-  cookie = xcb_get_atom_name(connection, atom);
-  reply = xcb_get_atom_name_reply(connection, cookie, &error);
+  xcb_generic_error_t *error = NULL;
+  xcb_xkb_get_names_reply_t *names_reply = xcb_xkb_get_names_reply(connection, cookie, &error);
+  xcb_xkb_get_names_value_list_t names_list;
 
-  if (reply == NULL || error != NULL) {
+  if (names_reply == NULL || error != NULL) {
+    log_error("Failed to get keyboard names");
     goto done;
   }
 
-  usize name_length = (usize)xcb_get_atom_name_name_length(reply);
-  char *name = xcb_get_atom_name_name(reply);
+  // clang-format off
+  xcb_xkb_get_names_value_list_unpack(xcb_xkb_get_names_value_list(names_reply),
+    names_reply->nTypes,
+    names_reply->indicators,
+    names_reply->virtualMods,
+    names_reply->groupNames,
+    names_reply->nKeys,
+    names_reply->nKeyAliases,
+    names_reply->nRadioGroups,
+    names_reply->which,
+    &names_list);
+  // clang-format on
 
-  buffer = malloc(name_length + 1);
+  /* group names are sent for groups set in the mask, at most four */
+  keymap->layouts_count = (u8)__builtin_popcount(names_reply->groupNames & ((1U << countof(keymap->layouts)) - 1));
 
-  if (buffer == NULL) {
-    log_error("Failed to allocate buffer for atom value");
-    goto done;
+  xcb_get_atom_name_cookie_t group_cookies[countof(keymap->layouts)];
+
+  for (u8 group = 0; group < keymap->layouts_count; group++) {
+    group_cookies[group] = xcb_get_atom_name(connection, names_list.groups[group]);
   }
 
-  memcpy(buffer, name, name_length);
-  buffer[name_length] = '\0';
+  xcb_get_atom_name_cookie_t const symbols_cookie = xcb_get_atom_name(connection, names_list.symbolsName);
+
+  for (u8 group = 0; group < keymap->layouts_count; group++) {
+    copy_atom_name(connection, group_cookies[group], keymap->layouts[group].name,
+                   sizeof(keymap->layouts[group].name));
+  }
+
+  copy_atom_name(connection, symbols_cookie, symbols, MAX_SYMBOLS_LENGTH + 1);
+  keymap_set_symbols(keymap, symbols);
+
+  status = true;
 
 done:
-  free(reply);
+  free(error);
+  free(names_reply);
 
-  return buffer;
+  return status;
+}
+
+static inline layout_t const *private_get_layout(private_t const *private) {
+  static layout_t const empty_layout = {0};
+
+  return private->group < private->keymap.layouts_count ? &private->keymap.layouts[private->group] : &empty_layout;
 }
 
 static inline void get_private_indicators(private_t *private, u32 state) {
@@ -150,113 +216,169 @@ static inline void get_private_indicators(private_t *private, u32 state) {
   private->is_scrolllock = (state & INDICATOR_SCROLLLOCK) != 0;
 }
 
-static bool get_private_layout(xcb_connection_t *connection, u8 group, private_t *private) {
-  bool status = false;
+/* applies indicator state notify, returns whether shown indicators changed */
+static bool private_apply_indicators(private_t *private, u32 state_changed, u32 state) {
+  if (!(state_changed & INDICATORS)) {
+    return false;
+  }
 
-  xcb_generic_error_t *error = NULL;
-  xcb_xkb_get_names_reply_t *names_reply = NULL;
-  xcb_xkb_get_names_cookie_t names_cookie;
-  xcb_xkb_get_names_value_list_t names_list;
-  void *names_list_buffer = NULL;
+  get_private_indicators(private, state);
+
+  return true;
+}
 
-  xcb_xkb_device_spec_t device_spec = XCB_XKB_ID_USE_CORE_KBD;
-  u32 names_cookie_which = XCB_XKB_NAME_DETAIL_SYMBOLS | XCB_XKB_NAME_DETAIL_GROUP_NAMES;
+/* applies state notify, returns whether group changed */
+static bool private_apply_state(private_t *private, u16 changed, u8 group) {
+  if (!(changed & XCB_XKB_STATE_PART_GROUP_STATE)) {
+    return false;
+  }
 
-  names_cookie = xcb_xkb_get_names(connection, device_spec, names_cookie_which);
-  names_reply = xcb_xkb_get_names_reply(connection, names_cookie, &error);
+  private->group = group;
 
-  if (error != NULL) {
-    log_error("Failed to get keyboard names");
-    goto done;
+  return true;
+}
+
+static u8 *put_string(u8 *cursor, char const *string) {
+  usize const size = strlen(string) + 1;
+  memcpy(cursor, string, size);
+
+  return cursor + size;
+}
+
+/* copies string at cursor to buffer of size, returns cursor past it or null if it isn't terminated before end */
+static u8 const *get_string(u8 const *cursor, u8 const *end, char *buffer, usize size) {
+  u8 const *string_end = cursor < end ? memchr(cursor, '\0', (usize)(end - cursor)) : NULL;
+
+  if (string_end == NULL) {
+    return NULL;
   }
 
-  names_list_buffer = xcb_xkb_get_names_value_list(names_reply);
+  snprintf(buffer, size, "%s", (char const *)cursor);
 
-  // clang-format off
-  xcb_xkb_get_names_value_list_unpack(names_list_buffer,
-    names_reply->nTypes,
-    names_reply->indicators,
-    names_reply->virtualMods,
-    names_reply->groupNames,
-    names_reply->nKeys,
-    names_reply->nKeyAliases,
-    names_reply->nRadioGroups,
-    names_reply->which,
-    &names_list);
-  // clang-format on
+  return string_end + 1;
+}
 
-  private->name = get_xcb_atom(connection, names_list.groups[group]);
+static void record_keymap(module_t *module, private_t const *private, u32 indicators_state, char const *symbols) {
+  if (!module_is_recording(module)) {
+    return;
+  }
 
-  {
-    char const *delimeter = "+";
-    char *symbols = get_xcb_atom(connection, names_list.symbolsName);
-    char *symbol_tok_save = NULL;
-    char *symbol_tok = strtok_r(symbols, delimeter, &symbol_tok_save);
+  u8 payload[1 + 1 + 4 + 1 + countof(private->keymap.layouts) * (MAX_NAME_LENGTH + 1) + MAX_SYMBOLS_LENGTH + 1];
+  u8 *cursor = trace_put_u8(payload, RECORD_KEYMAP);
+  cursor = trace_put_u8(cursor, private->group);
+  cursor = trace_put_u32(cursor, indicators_state);
+  cursor = trace_put_u8(cursor, private->keymap.layouts_count);
 
-    symbol_tok = strtok_r(NULL, delimeter, &symbol_tok_save);
+  for (u8 group = 0; group < private->keymap.layouts_count; group++) {
+    cursor = put_string(cursor, private->keymap.layouts[group].name);
+  }
 
-    for (int i = 0; symbol_tok != NULL && i < group; i++) {
-      symbol_tok = strtok_r(NULL, delimeter, &symbol_tok_save);
-    }
+  cursor = put_string(cursor, symbols);
 
-    if (symbol_tok != NULL) {
-      usize const symbol_size = 2;
-      char *symbol = malloc(symbol_size + 1);
+  module_record(module, payload, (usize)(cursor - payload));
+}
 
-      if (symbol == NULL) {
-        log_error("Failed to allocate keyboard symbols (e.q \"us\")");
-        goto done;
-      }
+static bool replay_keymap(private_t *private, u8 const *payload, usize length) {
+  u8 const *end = payload + length;
+  u8 group = 0;
+  u32 indicators_state = 0;
+  u8 layouts_count = 0;
+  char symbols[MAX_SYMBOLS_LENGTH + 1];
 
-      memcpy(symbol, symbol_tok, symbol_size);
-      symbol[symbol_size] = '\0';
+  if (length < 1 + 1 + 4 + 1) {
+    return false;
+  }
 
-      private->symbol = symbol;
+  u8 const *cursor = trace_get_u8(payload + 1, &group);
+  cursor = trace_get_u32(cursor, &indicators_state);
+  cursor = trace_get_u8(cursor, &layouts_count);
 
-      free(symbols);
-    }
+  if (layouts_count > countof(private->keymap.layouts)) {
+    return false;
   }
 
-  status = true;
+  *private = (private_t){.keymap = {.layouts_count = layouts_count}, .group = group};
 
-done:
-  free(names_reply);
+  for (u8 layout_index = 0; layout_index < layouts_count && cursor != NULL; layout_index++) {
+    layout_t *layout = &private->keymap.layouts[layout_index];
+    cursor = get_string(cursor, end, layout->name, sizeof(layout->name));
+  }
 
-  return status;
+  if (cursor == NULL || get_string(cursor, end, symbols, sizeof(symbols)) == NULL) {
+    return false;
+  }
+
+  keymap_set_symbols(&private->keymap, symbols);
+  get_private_indicators(private, indicators_state);
+
+  return true;
 }
 
-static inline void private_destruct(private_t *private) {
-  free(private->symbol);
-  free(private->name);
+/* indicator and state notifies are recorded as the server sent them, filtering is replayed */
+static void record_indicators(module_t *module, u32 state_changed, u32 state) {
+  u8 payload[1 + 4 + 4];
+  trace_put_u32(trace_put_u32(trace_put_u8(payload, RECORD_INDICATOR), state_changed), state);
+
+  module_record(module, payload, sizeof(payload));
 }
 
-static bool private_construct(xcb_connection_t *connection, private_t *private) {
-  xcb_generic_error_t *error = NULL;
+static void record_state(module_t *module, u16 changed, u8 group) {
+  u8 payload[1 + 2 + 1];
+  trace_put_u8(trace_put_u16(trace_put_u8(payload, RECORD_STATE), changed), group);
 
-  u8 state_group = get_state_group(connection, error);
+  module_record(module, payload, sizeof(payload));
+}
 
-  if (error != NULL) {
-    log_error("Failed to get current keyboard layout group");
-    return false;
-  }
+/* requests keymap names, group and indicators at once and collects replies afterwards */
+static bool private_construct(module_t *module, xcb_connection_t *connection, private_t *private) {
+  bool status = false;
+
+  xcb_xkb_device_spec_t const device_spec = XCB_XKB_ID_USE_CORE_KBD;
+  u32 const names_which = XCB_XKB_NAME_DETAIL_SYMBOLS | XCB_XKB_NAME_DETAIL_GROUP_NAMES;
 
-  private_destruct(private);
+  xcb_xkb_get_names_cookie_t const names_cookie = xcb_xkb_get_names(connection, device_spec, names_which);
+  xcb_xkb_get_state_cookie_t const state_cookie = xcb_xkb_get_state(connection, device_spec);
+  xcb_xkb_get_indicator_state_cookie_t const indicator_cookie = xcb_xkb_get_indicator_state(connection, device_spec);
 
-  if (!get_private_layout(connection, state_group, private)) {
+  xcb_generic_error_t *state_error = NULL;
+  xcb_generic_error_t *indicator_error = NULL;
+  xcb_xkb_get_state_reply_t *state_reply = NULL;
+  xcb_xkb_get_indicator_state_reply_t *indicator_reply = NULL;
+  char symbols[MAX_SYMBOLS_LENGTH + 1];
+
+  if (!keymap_construct(&private->keymap, symbols, connection, names_cookie)) {
     log_error("Failed to get keyboard layout");
-    return false;
+    xcb_discard_reply(connection, state_cookie.sequence);
+    xcb_discard_reply(connection, indicator_cookie.sequence);
+    goto done;
   }
 
-  u32 indicator_state = get_indicator_state(connection, error);
+  state_reply = xcb_xkb_get_state_reply(connection, state_cookie, &state_error);
+  indicator_reply = xcb_xkb_get_indicator_state_reply(connection, indicator_cookie, &indicator_error);
 
-  if (error != NULL) {
+  if (state_reply == NULL || state_error != NULL) {
+    log_error("Failed to get current keyboard layout group");
+    goto done;
+  }
+
+  if (indicator_reply == NULL || indicator_error != NULL) {
     log_error("Failed to get keyboard indicators");
-    return false;
+    goto done;
   }
 
-  get_private_indicators(private, indicator_state);
+  private->group = state_reply->group;
+  get_private_indicators(private, indicator_reply->state);
+  record_keymap(module, private, indicator_reply->state, symbols);
 
-  return true;
+  status = true;
+
+done:
+  free(state_error);
+  free(indicator_error);
+  free(state_reply);
+  free(indicator_reply);
+
+  return status;
 }
 
 static void config_free(module_keyboard_config_t *config) {
@@ -283,19 +405,16 @@ error:
   return NULL;
 }
 
-static handle_events_status_t handle_events(xcb_connection_t *connection, private_t *private) {
+static handle_events_status_t handle_events(module_t *module, xcb_connection_t *connection, private_t *private) {
   xcb_generic_event_t *xcb_event = NULL;
   handle_events_status_t status = NOEVENT;
+  bool is_keymap_changed = false;
 
   while ((xcb_event = xcb_poll_for_event(connection))) {
     switch (xcb_event->pad0) {
       case XCB_XKB_NEW_KEYBOARD_NOTIFY: {
-        if (!private_construct(connection, private)) {
-          log_error("Failed to get keyboard layout and indicators");
-          goto error;
-        }
-
-        status = EVENT;
+        /* keymap changes (e.g setxkbmap) come in bursts, table is rebuilt once after all of them */
+        is_keymap_changed = true;
 
         break;
       }
@@ -303,35 +422,24 @@ static handle_events_status_t handle_events(xcb_connection_t *connection, privat
         xcb_xkb_indicator_state_notify_event_t const *event = NULL;
         event = (xcb_xkb_indicator_state_notify_event_t const *)xcb_event;
 
-        static int const events = INDICATOR_CAPSLOCK | INDICATOR_NUMLOCK | INDICATOR_SCROLLLOCK;
+        record_indicators(module, event->stateChanged, event->state);
 
-        if (!(event->stateChanged & events)) {
-          break;
+        if (private_apply_indicators(private, event->stateChanged, event->state)) {
+          status = EVENT;
         }
 
-        get_private_indicators(private, event->state);
-
-        status = EVENT;
-
         break;
       }
       case XCB_XKB_STATE_NOTIFY: {
         xcb_xkb_state_notify_event_t const *event = NULL;
         event = (xcb_xkb_state_notify_event_t const *)xcb_event;
 
-        if (!(event->changed & XCB_XKB_STATE_PART_GROUP_STATE)) {
-          break;
-        }
-
-        private_destruct(private);
+        record_state(module, event->changed, event->group);
 
-        if (!get_private_layout(connection, event->group, private)) {
-          log_error("Failed to get keyboard layout");
-          goto error;
+        if (private_apply_state(private, event->changed, event->group)) {
+          status = EVENT;
         }
 
-        status = EVENT;
-
         break;
       }
       default:
@@ -341,21 +449,30 @@ static handle_events_status_t handle_events(xcb_connection_t *connection, privat
     free(xcb_event);
   }
 
-  return status;
+  if (is_keymap_changed) {
+    if (!private_construct(module, connection, private)) {
+      log_error("Failed to get keyboard layout and indicators");
+      return ERROR;
+    }
 
-error:
-  free(xcb_event);
+    status = EVENT;
+  }
 
-  return ERROR;
+  return status;
 }
 
 static inline bool update(module_t *module, module_keyboard_config_t const *config, private_t const *private) {
+  u8 const record_type = RECORD_UPDATE;
+  module_record(module, &record_type, sizeof(record_type));
+
+  layout_t const *layout = private_get_layout(private);
+
   char const *formatters[][2] = {
     {"%caps%", !private->is_capslock ? "c" : "C"},
     {"%num%", !private->is_numlock ? "n" : "N"},
     {"%scroll%", !private->is_scrolllock ? "s" : "S"},
-    {"%symbol%", private->symbol},
-    {"%name%", private->name},
+    {"%symbol%", layout->symbol},
+    {"%name%", layout->name},
     {NULL, NULL},
   };
 
@@ -388,7 +505,7 @@ int module_keyboard_run(module_t *module) {
 
   private_t private = {0};
 
-  if (!private_construct(connection, &private)) {
+  if (!private_construct(module, connection, &private)) {
     goto free_connection;
   }
 
@@ -400,7 +517,7 @@ int module_keyboard_run(module_t *module) {
   while (true) {
     if (!update(module, config, &private)) {
       log_error("Failed to update keyboard module");
-      goto free_private;
+      goto free_connection;
     }
 
   poll_start:
@@ -410,35 +527,37 @@ int module_keyboard_run(module_t *module) {
       }
 
       log_error("Failed to poll");
-      goto free_private;
+      goto free_connection;
     }
 
+    module_wakeup(module);
+
     if (fds[0].revents & POLLIN) {
       break;
     }
 
     if (fds[1].revents & POLLHUP) {
       log_error("x11 disconnected");
-      goto free_private;
+      goto free_connection;
     }
 
-    handle_events_status_t events_status = handle_events(connection, &private);
+    u64 const event_time = utils_time_get_monotonic_nanoseconds();
+    handle_events_status_t events_status = handle_events(module, connection, &private);
 
     if (events_status == NOEVENT) {
       goto poll_start;
     }
 
+    module_mark_event_at(module, event_time);
+
     if (events_status == ERROR) {
       log_error("Filed to handle events");
-      goto free_private;
+      goto free_connection;
     }
   }
 
   status = EXIT_SUCCESS;
 
-free_private:
-  private_destruct(&private);
-
 free_connection:
   xcb_disconnect(connection);
 
@@ -448,3 +567,58 @@ free_config:
 done:
   return status;
 }
+
+int module_keyboard_replay(module_t *module) {
+  module_keyboard_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_SUCCESS;
+  private_t private = {0};
+  void const *payload = NULL;
+  usize length = 0;
+
+  while (module_replay_next(module, &payload, &length)) {
+    u8 const *record = payload;
+    u32 state_changed = 0;
+    u32 state = 0;
+    u16 changed = 0;
+    u8 group = 0;
+    bool is_valid = length != 0;
+
+    if (is_valid && record[0] == RECORD_KEYMAP) {
+      is_valid = replay_keymap(&private, record, length);
+    } else if (is_valid && record[0] == RECORD_INDICATOR && length == 1 + 4 + 4) {
+      trace_get_u32(trace_get_u32(record + 1, &state_changed), &state);
+      private_apply_indicators(&private, state_changed, state);
+    } else if (is_valid && record[0] == RECORD_STATE && length == 1 + 2 + 1) {
+      trace_get_u8(trace_get_u16(record + 1, &changed), &group);
+      private_apply_state(&private, changed, group);
+    } else {
+      is_valid = is_valid && record[0] == RECORD_UPDATE && length == 1;
+    }
+
+    if (!is_valid) {
+      log_error("Invalid keyboard trace event");
+      status = EXIT_FAILURE;
+      break;
+    }
+
+    if (record[0] != RECORD_UPDATE) {
+      module_mark_event(module);
+      continue;
+    }
+
+    if (!update(module, config, &private)) {
+      log_error("Failed to update keyboard module");
+      status = EXIT_FAILURE;
+      break;
+    }
+  }
+
+  config_free(config);
+
+  return status;
+}
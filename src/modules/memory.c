@@ -0,0 +1,411 @@
+#include "modules/memory.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_MODULE "memory"
+
+#include "log.h"
+#include "macros.h"
+#include "module.h"
+#include "toml.h"
+#include "trace.h"
+#include "utils/fs.h"
+#include "utils/time.h"
+
+#define DEFAULT_PROCFS_ROOT "/proc"
+#define DEFAULT_INTERVAL 1000000000UL /* nanoseconds */
+#define MEMINFO_SIZE 8192             /* meminfo is about 1.5 KiB, lines past the buffer are never looked at */
+#define UNKNOWN_OFFSET SIZE_MAX
+
+typedef enum field {
+  FIELD_MEM_TOTAL,
+  FIELD_MEM_AVAILABLE,
+  FIELD_SWAP_TOTAL,
+  FIELD_SWAP_FREE,
+  FIELD_DIRTY,
+  FIELDS_COUNT,
+} field_t;
+
+#define FIELD_BIT(field) (1U << (field))
+
+/* meminfo keys including colon, so "SwapTotal:" never matches "SwapTotalFoo:" */
+static char const *const field_keys[FIELDS_COUNT] = {
+  [FIELD_MEM_TOTAL] = "MemTotal:",   [FIELD_MEM_AVAILABLE] = "MemAvailable:", [FIELD_SWAP_TOTAL] = "SwapTotal:",
+  [FIELD_SWAP_FREE] = "SwapFree:",   [FIELD_DIRTY] = "Dirty:",
+};
+
+typedef struct placeholder {
+  char const *name;
+  u32 fields; /* FIELD_BIT of fields used to render placeholder */
+} placeholder_t;
+
+static placeholder_t const placeholders[] = {
+  {"%used%", FIELD_BIT(FIELD_MEM_TOTAL) | FIELD_BIT(FIELD_MEM_AVAILABLE)},
+  {"%available%", FIELD_BIT(FIELD_MEM_AVAILABLE)},
+  {"%total%", FIELD_BIT(FIELD_MEM_TOTAL)},
+  {"%percent%", FIELD_BIT(FIELD_MEM_TOTAL) | FIELD_BIT(FIELD_MEM_AVAILABLE)},
+  {"%swap%", FIELD_BIT(FIELD_SWAP_TOTAL) | FIELD_BIT(FIELD_SWAP_FREE)},
+  {"%dirty%", FIELD_BIT(FIELD_DIRTY)},
+};
+
+typedef struct private {
+  utils_fs_reader_t reader; /* <procfs_root>/meminfo, kept open and reread from offset 0 */
+  char buffer[MEMINFO_SIZE];
+  u32 fields;                 /* FIELD_BIT of fields referenced by format */
+  usize offsets[FIELDS_COUNT]; /* line starts of fields in last read, kernel keeps them in place between reads */
+  u64 values[FIELDS_COUNT];    /* KiB, fields not referenced by format stay 0 */
+}
+private_t;
+
+static void config_free(module_memory_config_t *config) {
+  if (config == NULL) {
+    return;
+  }
+
+  free(config->procfs_root);
+  free(config->format);
+  free(config);
+}
+
+static module_memory_config_t *config_get(toml_table_t *table) {
+  module_memory_config_t *config = calloc(1, sizeof(*config));
+
+  if (config == NULL) {
+    log_error("Failed to allocate memory config");
+    goto error;
+  }
+
+  toml_value_t format = toml_table_string(table, "format");
+
+  if (!format.ok) {
+    log_error("Failed to get format");
+    goto error;
+  }
+
+  config->format = format.u.s;
+  config->interval = DEFAULT_INTERVAL;
+
+  toml_value_t interval = toml_table_string(table, "interval");
+
+  if (interval.ok) {
+    bool const is_parsed = utils_time_parse_interval(interval.u.s, &config->interval);
+
+    free(interval.u.s);
+
+    if (!is_parsed) {
+      log_error("Invalid memory interval");
+      goto error;
+    }
+  }
+
+  toml_value_t procfs_root = toml_table_string(table, "procfs_root");
+  config->procfs_root = procfs_root.ok ? procfs_root.u.s : strdup(DEFAULT_PROCFS_ROOT);
+
+  if (config->procfs_root == NULL) {
+    log_error("Failed to allocate procfs root");
+    goto error;
+  }
+
+  return config;
+
+error:
+  config_free(config);
+  return NULL;
+}
+
+static u32 get_referenced_fields(char const *format) {
+  u32 fields = 0;
+
+  for (usize placeholder_index = 0; placeholder_index < countof(placeholders); placeholder_index++) {
+    if (strstr(format, placeholders[placeholder_index].name) != NULL) {
+      fields |= placeholders[placeholder_index].fields;
+    }
+  }
+
+  return fields;
+}
+
+/* parses "<spaces><value> kB" after key at cached offset, false if key moved (e.g value got wider) */
+static bool private_parse_field(private_t *private, field_t field) {
+  char const *key = field_keys[field];
+  usize const key_length = strlen(key);
+  usize const offset = private->offsets[field];
+
+  if (offset == UNKNOWN_OFFSET || offset + key_length > private->reader.length ||
+      memcmp(private->buffer + offset, key, key_length) != 0) {
+    return false;
+  }
+
+  char const *cursor = private->buffer + offset + key_length;
+  i64 value = 0;
+
+  while (*cursor == ' ') {
+    cursor++;
+  }
+
+  if (!utils_fs_parse_i64(cursor, &value) || value < 0) {
+    return false;
+  }
+
+  private->values[field] = (u64)value;
+
+  return true;
+}
+
+/* walks all lines once to find referenced keys, only when cached offsets no longer match */
+static void private_index(private_t *private) {
+  for (usize field_index = 0; field_index < FIELDS_COUNT; field_index++) {
+    private->offsets[field_index] = UNKNOWN_OFFSET;
+  }
+
+  for (char const *line = private->buffer; *line != '\0';) {
+    for (usize field_index = 0; field_index < FIELDS_COUNT; field_index++) {
+      char const *key = field_keys[field_index];
+
+      if ((private->fields & FIELD_BIT(field_index)) != 0 && strncmp(line, key, strlen(key)) == 0) {
+        private->offsets[field_index] = (usize)(line - private->buffer);
+        break;
+      }
+    }
+
+    line = strchr(line, '\n');
+
+    if (line == NULL) {
+      break;
+    }
+
+    line++;
+  }
+}
+
+static bool private_parse(private_t *private) {
+  for (usize field_index = 0; field_index < FIELDS_COUNT; field_index++) {
+    if ((private->fields & FIELD_BIT(field_index)) != 0 && !private_parse_field(private, (field_t)field_index)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool private_sample(private_t *private) {
+  if (!utils_fs_reader_refresh(&private->reader)) {
+    log_error("Failed to read meminfo");
+    return false;
+  }
+
+  if (private_parse(private)) {
+    return true;
+  }
+
+  private_index(private);
+
+  if (!private_parse(private)) {
+    log_error("Failed to parse meminfo");
+    return false;
+  }
+
+  return true;
+}
+
+static bool private_construct(private_t *private, module_memory_config_t const *config) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/meminfo", config->procfs_root);
+
+  private->reader = (utils_fs_reader_t){.file_descriptor = -1};
+  private->fields = get_referenced_fields(config->format);
+  memset(private->values, 0, sizeof(private->values));
+
+  for (usize field_index = 0; field_index < FIELDS_COUNT; field_index++) {
+    private->offsets[field_index] = UNKNOWN_OFFSET;
+  }
+
+  if (!utils_fs_reader_open(&private->reader, path, private->buffer, sizeof(private->buffer))) {
+    log_error("Failed to open %s", path);
+    return false;
+  }
+
+  return true;
+}
+
+static void private_destruct(private_t *private) {
+  utils_fs_reader_close(&private->reader);
+}
+
+static inline u64 kibibytes_to_mebibytes(u64 kibibytes) {
+  return kibibytes / 1024;
+}
+
+static bool update_module(module_t *module, module_memory_config_t const *config, u64 const values[FIELDS_COUNT]) {
+  u64 const total = values[FIELD_MEM_TOTAL];
+  u64 const available = values[FIELD_MEM_AVAILABLE];
+  u64 const used = total > available ? total - available : 0;
+  u64 const swap = values[FIELD_SWAP_TOTAL] > values[FIELD_SWAP_FREE]
+                     ? values[FIELD_SWAP_TOTAL] - values[FIELD_SWAP_FREE]
+                     : 0;
+
+  char used_string[24];
+  char available_string[24];
+  char total_string[24];
+  char percent_string[8];
+  char swap_string[24];
+  char dirty_string[24];
+
+  snprintf(used_string, sizeof(used_string), "%lu", (unsigned long)kibibytes_to_mebibytes(used));
+  snprintf(available_string, sizeof(available_string), "%lu", (unsigned long)kibibytes_to_mebibytes(available));
+  snprintf(total_string, sizeof(total_string), "%lu", (unsigned long)kibibytes_to_mebibytes(total));
+  snprintf(percent_string, sizeof(percent_string), "%lu", (unsigned long)(total != 0 ? used * 100 / total : 0));
+  snprintf(swap_string, sizeof(swap_string), "%lu", (unsigned long)kibibytes_to_mebibytes(swap));
+  snprintf(dirty_string, sizeof(dirty_string), "%lu", (unsigned long)kibibytes_to_mebibytes(values[FIELD_DIRTY]));
+
+  char const *formatters[][2] = {
+    {"%used%", used_string},   {"%available%", available_string},
+    {"%total%", total_string}, {"%percent%", percent_string},
+    {"%swap%", swap_string},   {"%dirty%", dirty_string},
+    {NULL, NULL},
+  };
+
+  return module_update(module, config->format, formatters);
+}
+
+/* samples, records and renders meminfo, false on failure */
+static bool sample_and_update(module_t *module, module_memory_config_t const *config, private_t *private) {
+  module_mark_event(module);
+
+  if (!private_sample(private)) {
+    return false;
+  }
+
+  u8 payload[FIELDS_COUNT * sizeof(u64)];
+  u8 *cursor = payload;
+
+  for (usize field = 0; field < FIELDS_COUNT; field++) {
+    cursor = trace_put_u64(cursor, private->values[field]);
+  }
+
+  module_record(module, payload, sizeof(payload));
+
+  if (!update_module(module, config, private->values)) {
+    log_error("Failed to update module");
+    return false;
+  }
+
+  return true;
+}
+
+int module_memory_run(module_t *module) {
+  int status = EXIT_FAILURE;
+
+  module_memory_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    goto done;
+  }
+
+  private_t private;
+
+  if (!private_construct(&private, config)) {
+    goto free_config;
+  }
+
+  utils_time_clock_t *clock = module_get_clock(module);
+  utils_time_timer_t timer;
+
+  if (!utils_time_clock_timer_construct(clock, &timer)) {
+    log_error("Failed to create timer");
+    goto destruct_private;
+  }
+
+  int abort_file_descriptor = module_get_abort_file_descriptor(module);
+
+  if (abort_file_descriptor == -1) {
+    log_error("Failed to get abort file descriptor");
+    goto destruct_timer;
+  }
+
+  if (!sample_and_update(module, config, &private)) {
+    goto destruct_timer;
+  }
+
+  while (true) {
+    u64 const deadline = (utils_time_clock_get_realtime(clock) / config->interval + 1) * config->interval;
+    utils_time_wait_status_t wait_status = utils_time_clock_wait_until(clock, &timer, abort_file_descriptor, deadline);
+
+    if (wait_status == UTILS_TIME_WAIT_FAILED) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      log_error("Failed to wait for timer");
+      goto destruct_timer;
+    }
+
+    module_wakeup(module);
+
+    if (wait_status == UTILS_TIME_WAIT_READABLE) {
+      break;
+    }
+
+    if (!sample_and_update(module, config, &private)) {
+      goto destruct_timer;
+    }
+  }
+
+  status = EXIT_SUCCESS;
+
+destruct_timer:
+  utils_time_clock_timer_destruct(clock, &timer);
+
+destruct_private:
+  private_destruct(&private);
+
+free_config:
+  config_free(config);
+
+done:
+  return status;
+}
+
+int module_memory_replay(module_t *module) {
+  module_memory_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_SUCCESS;
+  u64 values[FIELDS_COUNT];
+  void const *payload = NULL;
+  usize length = 0;
+
+  while (module_replay_next(module, &payload, &length)) {
+    if (length != FIELDS_COUNT * sizeof(u64)) {
+      log_error("Invalid memory trace event");
+      status = EXIT_FAILURE;
+      break;
+    }
+
+    u8 const *cursor = payload;
+
+    for (usize field = 0; field < FIELDS_COUNT; field++) {
+      cursor = trace_get_u64(cursor, &values[field]);
+    }
+
+    module_mark_event(module);
+
+    if (!update_module(module, config, values)) {
+      log_error("Failed to update module");
+      status = EXIT_FAILURE;
+      break;
+    }
+  }
+
+  config_free(config);
+
+  return status;
+}
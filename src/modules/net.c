@@ -0,0 +1,913 @@
+#define _GNU_SOURCE
+
+#include "modules/net.h"
+
+#include <errno.h>
+#include <linux/if.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define LOG_MODULE "net"
+
+#include "log.h"
+#include "macros.h"
+#include "module.h"
+#include "toml.h"
+#include "trace.h"
+#include "utils/string.h"
+#include "utils/time.h"
+
+#define DEFAULT_INTERVAL 1000000000UL /* nanoseconds */
+#define DEFAULT_SEPARATOR " "
+#define AGGREGATE_NAME "total"
+#define MAX_TEXT_LENGTH 1024
+#define MAX_RATE_LENGTH 24 /* u64 byte rate with unit, e.g "18446744073709551615" */
+#define RECEIVE_BUFFER_SIZE 32768 /* kernel fills dump messages up to 32 KiB */
+#define INITIAL_LINKS_CAPACITY 16
+
+/* link from RTM_GETLINK dump, refreshed on start and link events only */
+typedef struct link_info {
+  i32 index;
+  u32 flags; /* IFF_* */
+} link_info_t;
+
+/* counters of one link from RTM_GETSTATS dump */
+typedef struct link {
+  i32 index;
+  u32 flags; /* IFF_* of link info with the same index */
+  u64 rx_bytes;
+  u64 tx_bytes;
+} link_t;
+
+typedef struct link_infos {
+  link_info_t *items;
+  usize count;
+  usize capacity;
+} link_infos_t;
+
+typedef struct links {
+  link_t *items;
+  usize count;
+  usize capacity;
+} links_t;
+
+/* rendered and recorded state of configured interface or aggregate */
+typedef struct interface_state {
+  u64 rx_rate; /* bytes per second over last interval */
+  u64 tx_rate;
+  i32 is_up;
+  i32 is_present; /* interface exists, not rendered otherwise */
+} interface_state_t;
+
+#define RECORD_STATE_LENGTH (8 + 8 + 1 + 1) /* u64 rx rate, u64 tx rate, u8 is up, u8 is present */
+
+typedef struct private {
+  int dump_socket;  /* RTM_GETLINK and RTM_GETSTATS requests and dumps */
+  int event_socket; /* RTNLGRP_LINK notifications */
+  u32 sequence;
+  char *buffer; /* RECEIVE_BUFFER_SIZE */
+  link_infos_t link_infos;
+  links_t links;
+  links_t previous_links; /* swapped with links after every sample */
+  u64 previous_time;      /* monotonic nanoseconds of previous dump, 0 - none yet */
+  char **names;           /* configured interfaces, none - aggregate */
+  usize names_count;
+  i32 *indexes; /* of configured interfaces, 0 - not in last RTM_GETLINK dump */
+  interface_state_t *states; /* names_count or single aggregate */
+  usize states_count;
+}
+private_t;
+
+typedef bool (*message_handler_t)(private_t *private, struct nlmsghdr const *header);
+
+static void config_free(module_net_config_t *config) {
+  if (config == NULL) {
+    return;
+  }
+
+  for (usize interface_index = 0; interface_index < config->interfaces_count; interface_index++) {
+    free(config->interfaces[interface_index]);
+  }
+
+  free(config->interfaces);
+  free(config->separator);
+  free(config->format);
+  free(config);
+}
+
+static bool get_interfaces(module_net_config_t *config, toml_table_t *table) {
+  toml_array_t *interfaces = toml_table_array(table, "interfaces");
+
+  if (interfaces == NULL) {
+    return true;
+  }
+
+  usize const interfaces_count = (usize)toml_array_len(interfaces);
+  config->interfaces = calloc(interfaces_count != 0 ? interfaces_count : 1, sizeof(*config->interfaces));
+
+  if (config->interfaces == NULL) {
+    return false;
+  }
+
+  for (usize interface_index = 0; interface_index < interfaces_count; interface_index++) {
+    toml_value_t interface = toml_array_string(interfaces, (int)interface_index);
+
+    if (!interface.ok) {
+      return false;
+    }
+
+    config->interfaces[config->interfaces_count++] = interface.u.s;
+  }
+
+  return true;
+}
+
+static module_net_config_t *config_get(toml_table_t *table) {
+  module_net_config_t *config = calloc(1, sizeof(*config));
+
+  if (config == NULL) {
+    log_error("Failed to allocate net config");
+    goto error;
+  }
+
+  toml_value_t format = toml_table_string(table, "format");
+
+  if (!format.ok) {
+    log_error("Failed to get format");
+    goto error;
+  }
+
+  config->format = format.u.s;
+
+  if (!get_interfaces(config, table)) {
+    log_error("Failed to get interfaces");
+    goto error;
+  }
+
+  toml_value_t separator = toml_table_string(table, "separator");
+  config->separator = separator.ok ? separator.u.s : strdup(DEFAULT_SEPARATOR);
+
+  if (config->separator == NULL) {
+    log_error("Failed to allocate separator");
+    goto error;
+  }
+
+  config->interval = DEFAULT_INTERVAL;
+
+  toml_value_t interval = toml_table_string(table, "interval");
+
+  if (interval.ok) {
+    bool const is_parsed = utils_time_parse_interval(interval.u.s, &config->interval);
+
+    free(interval.u.s);
+
+    if (!is_parsed) {
+      log_error("Invalid net interval");
+      goto error;
+    }
+  }
+
+  return config;
+
+error:
+  config_free(config);
+  return NULL;
+}
+
+static int open_socket(u32 groups) {
+  int const file_descriptor = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | (groups != 0 ? SOCK_NONBLOCK : 0),
+                                     NETLINK_ROUTE);
+
+  if (file_descriptor == -1) {
+    return -1;
+  }
+
+  struct sockaddr_nl const address = {
+    .nl_family = AF_NETLINK,
+    .nl_groups = groups,
+  };
+
+  if (bind(file_descriptor, (struct sockaddr const *)&address, sizeof(address)) == -1) {
+    close(file_descriptor);
+    return -1;
+  }
+
+  return file_descriptor;
+}
+
+/* grows items of link_infos_t or links_t on first dumps and when links are added, steady state doesn't allocate */
+static bool reserve_items(void **items, usize *capacity, usize count, usize item_size) {
+  if (count <= *capacity) {
+    return true;
+  }
+
+  usize new_capacity = *capacity != 0 ? *capacity : INITIAL_LINKS_CAPACITY;
+
+  while (new_capacity < count) {
+    new_capacity *= 2;
+  }
+
+  void *new_items = realloc(*items, new_capacity * item_size);
+
+  if (new_items == NULL) {
+    return false;
+  }
+
+  *items = new_items;
+  *capacity = new_capacity;
+
+  return true;
+}
+
+static void private_destruct(private_t *private) {
+  if (private->dump_socket != -1) {
+    close(private->dump_socket);
+  }
+
+  if (private->event_socket != -1) {
+    close(private->event_socket);
+  }
+
+  free(private->buffer);
+  free(private->link_infos.items);
+  free(private->links.items);
+  free(private->previous_links.items);
+  free(private->indexes);
+  free(private->states);
+}
+
+static bool private_construct(private_t *private, module_net_config_t const *config) {
+  *private = (private_t){
+    .dump_socket = -1,
+    .event_socket = -1,
+    .names = config->interfaces,
+    .names_count = config->interfaces_count,
+    .states_count = config->interfaces_count != 0 ? config->interfaces_count : 1,
+  };
+
+  private->buffer = malloc(RECEIVE_BUFFER_SIZE);
+  private->indexes = calloc(private->states_count, sizeof(*private->indexes));
+  private->states = calloc(private->states_count, sizeof(*private->states));
+
+  if (private->buffer == NULL || private->indexes == NULL || private->states == NULL) {
+    log_error("Failed to allocate links");
+    goto error;
+  }
+
+  /* subscribed before first dump, so a link change between dump and poll isn't lost */
+  private->event_socket = open_socket(RTMGRP_LINK);
+  private->dump_socket = open_socket(0);
+
+  if (private->event_socket == -1 || private->dump_socket == -1) {
+    log_error("Failed to open rtnetlink socket: %s", strerror(errno));
+    goto error;
+  }
+
+  return true;
+
+error:
+  private_destruct(private);
+  return false;
+}
+
+/* sends dump request with family header of message_length bytes */
+static bool private_request_dump(private_t *private, u16 type, void const *message, usize message_length) {
+  struct {
+    struct nlmsghdr header;
+    union {
+      struct ifinfomsg link;
+      struct if_stats_msg stats;
+    } message;
+  } request = {
+    .header =
+      {
+        .nlmsg_len = (u32)NLMSG_LENGTH(message_length),
+        .nlmsg_type = type,
+        .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+        .nlmsg_seq = ++private->sequence,
+      },
+  };
+
+  if (message_length > sizeof(request.message)) {
+    log_error("Dump request header is too large");
+    return false;
+  }
+
+  memcpy(&request.message, message, message_length);
+
+  return send(private->dump_socket, &request, request.header.nlmsg_len, 0) == (isize)request.header.nlmsg_len;
+}
+
+/* receives dump of current request, one recv per up to RECEIVE_BUFFER_SIZE bytes of messages */
+static bool private_receive_dump(private_t *private, u16 type, message_handler_t handle_message) {
+  while (true) {
+    isize const length = recv(private->dump_socket, private->buffer, RECEIVE_BUFFER_SIZE, 0);
+
+    if (length < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return false;
+    }
+
+    usize remaining_length = (usize)length;
+
+    for (struct nlmsghdr const *header = (struct nlmsghdr const *)private->buffer; NLMSG_OK(header, remaining_length);
+         header = NLMSG_NEXT(header, remaining_length)) {
+      if (header->nlmsg_seq != private->sequence) {
+        continue;
+      }
+
+      if (header->nlmsg_type == NLMSG_DONE) {
+        return true;
+      }
+
+      if (header->nlmsg_type == NLMSG_ERROR) {
+        struct nlmsgerr const *error = NLMSG_DATA(header);
+        errno = -error->error;
+        return false;
+      }
+
+      if (header->nlmsg_type == type && !handle_message(private, header)) {
+        errno = ENOMEM;
+        return false;
+      }
+    }
+  }
+}
+
+/* appends link info of RTM_NEWLINK message and resolves configured interface names to indexes */
+static bool handle_link_info(private_t *private, struct nlmsghdr const *header) {
+  if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg))) {
+    return true;
+  }
+
+  struct ifinfomsg const *message = NLMSG_DATA(header);
+  link_infos_t *link_infos = &private->link_infos;
+
+  if (!reserve_items((void **)&link_infos->items, &link_infos->capacity, link_infos->count + 1,
+                     sizeof(*link_infos->items))) {
+    return false;
+  }
+
+  link_infos->items[link_infos->count++] = (link_info_t){.index = message->ifi_index, .flags = message->ifi_flags};
+
+  if (private->names_count == 0) {
+    return true;
+  }
+
+  usize attributes_length = header->nlmsg_len - NLMSG_LENGTH(sizeof(*message));
+
+  for (struct rtattr const *attribute = IFLA_RTA(message); RTA_OK(attribute, attributes_length);
+       attribute = RTA_NEXT(attribute, attributes_length)) {
+    if (attribute->rta_type != IFLA_IFNAME || RTA_PAYLOAD(attribute) == 0) {
+      continue;
+    }
+
+    for (usize name_index = 0; name_index < private->names_count; name_index++) {
+      if (strcmp(private->names[name_index], RTA_DATA(attribute)) == 0) {
+        private->indexes[name_index] = message->ifi_index;
+      }
+    }
+  }
+
+  return true;
+}
+
+/* names and flags of links, dumped on start and link events only, RTM_GETLINK messages carry all link attributes */
+static bool private_dump_link_infos(private_t *private) {
+  struct ifinfomsg const message = {.ifi_family = AF_UNSPEC};
+
+  private->link_infos.count = 0;
+
+  for (usize name_index = 0; name_index < private->names_count; name_index++) {
+    private->indexes[name_index] = 0;
+  }
+
+  return private_request_dump(private, RTM_GETLINK, &message, sizeof(message)) &&
+         private_receive_dump(private, RTM_NEWLINK, handle_link_info);
+}
+
+/* link infos and stats are dumped in the same order unless links were added or removed, so position is tried first */
+static u32 find_link_flags(link_infos_t const *link_infos, usize position, i32 index) {
+  if (position < link_infos->count && link_infos->items[position].index == index) {
+    return link_infos->items[position].flags;
+  }
+
+  for (usize link_index = 0; link_index < link_infos->count; link_index++) {
+    if (link_infos->items[link_index].index == index) {
+      return link_infos->items[link_index].flags;
+    }
+  }
+
+  return 0;
+}
+
+/* appends counters of RTM_NEWSTATS message */
+static bool handle_link_stats(private_t *private, struct nlmsghdr const *header) {
+  if (header->nlmsg_len < NLMSG_LENGTH(sizeof(struct if_stats_msg))) {
+    return true;
+  }
+
+  struct if_stats_msg const *message = NLMSG_DATA(header);
+  usize attributes_length = header->nlmsg_len - NLMSG_LENGTH(sizeof(*message));
+  struct rtattr const *attribute =
+    (struct rtattr const *)((char const *)message + NLMSG_ALIGN(sizeof(struct if_stats_msg)));
+
+  for (; RTA_OK(attribute, attributes_length); attribute = RTA_NEXT(attribute, attributes_length)) {
+    if (attribute->rta_type == IFLA_STATS_LINK_64 && RTA_PAYLOAD(attribute) >= sizeof(struct rtnl_link_stats64)) {
+      break;
+    }
+  }
+
+  if (!RTA_OK(attribute, attributes_length)) {
+    return true;
+  }
+
+  links_t *links = &private->links;
+
+  if (!reserve_items((void **)&links->items, &links->capacity, links->count + 1, sizeof(*links->items))) {
+    return false;
+  }
+
+  i32 const index = (i32)message->ifindex;
+  link_t *link = &links->items[links->count];
+  /* attribute payload is 4-byte aligned only */
+  char const *stats = RTA_DATA(attribute);
+
+  *link = (link_t){.index = index, .flags = find_link_flags(&private->link_infos, links->count, index)};
+
+  memcpy(&link->rx_bytes, stats + offsetof(struct rtnl_link_stats64, rx_bytes), sizeof(link->rx_bytes));
+  memcpy(&link->tx_bytes, stats + offsetof(struct rtnl_link_stats64, tx_bytes), sizeof(link->tx_bytes));
+  links->count++;
+
+  return true;
+}
+
+/* RTM_GETSTATS filtered to 64-bit link stats, about a tenth of RTM_GETLINK dump size per link */
+static bool private_dump_links(private_t *private) {
+  struct if_stats_msg const message = {
+    .family = AF_UNSPEC,
+    .filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64),
+  };
+
+  private->links.count = 0;
+
+  return private_request_dump(private, RTM_GETSTATS, &message, sizeof(message)) &&
+         private_receive_dump(private, RTM_NEWSTATS, handle_link_stats);
+}
+
+/* previous links are in the same order unless links were added or removed, so position is tried first */
+static link_t const *find_link(links_t const *links, usize position, i32 index) {
+  if (position < links->count && links->items[position].index == index) {
+    return &links->items[position];
+  }
+
+  for (usize link_index = 0; link_index < links->count; link_index++) {
+    if (links->items[link_index].index == index) {
+      return &links->items[link_index];
+    }
+  }
+
+  return NULL;
+}
+
+static inline u64 calculate_delta(u64 previous, u64 current) {
+  return current >= previous ? current - previous : 0;
+}
+
+static inline u64 calculate_rate(u64 bytes, u64 elapsed) {
+  return elapsed != 0 ? (u64)((double)bytes * 1e9 / (double)elapsed) : 0;
+}
+
+/* new links count from their first dump, removed links drop out, so aggregate doesn't jump on link churn */
+static void private_calculate(private_t *private, u64 elapsed) {
+  links_t const *links = &private->links;
+  links_t const *previous_links = &private->previous_links;
+
+  if (private->names_count == 0) {
+    interface_state_t *state = &private->states[0];
+    u64 rx_bytes = 0;
+    u64 tx_bytes = 0;
+
+    *state = (interface_state_t){.is_present = 1};
+
+    for (usize link_index = 0; link_index < links->count; link_index++) {
+      link_t const *link = &links->items[link_index];
+
+      if (link->flags & IFF_LOOPBACK) {
+        continue;
+      }
+
+      state->is_up |= (link->flags & IFF_RUNNING) != 0;
+
+      link_t const *previous_link = find_link(previous_links, link_index, link->index);
+
+      if (previous_link != NULL) {
+        rx_bytes += calculate_delta(previous_link->rx_bytes, link->rx_bytes);
+        tx_bytes += calculate_delta(previous_link->tx_bytes, link->tx_bytes);
+      }
+    }
+
+    state->rx_rate = calculate_rate(rx_bytes, elapsed);
+    state->tx_rate = calculate_rate(tx_bytes, elapsed);
+
+    return;
+  }
+
+  for (usize name_index = 0; name_index < private->names_count; name_index++) {
+    interface_state_t *state = &private->states[name_index];
+    i32 const index = private->indexes[name_index];
+    link_t const *link = index != 0 ? find_link(links, 0, index) : NULL;
+
+    if (link == NULL) {
+      *state = (interface_state_t){0};
+      continue;
+    }
+
+    link_t const *previous_link = find_link(previous_links, (usize)(link - links->items), index);
+
+    *state = (interface_state_t){.is_up = (link->flags & IFF_RUNNING) != 0, .is_present = 1};
+
+    if (previous_link != NULL) {
+      state->rx_rate = calculate_rate(calculate_delta(previous_link->rx_bytes, link->rx_bytes), elapsed);
+      state->tx_rate = calculate_rate(calculate_delta(previous_link->tx_bytes, link->tx_bytes), elapsed);
+    }
+  }
+}
+
+static bool private_sample(private_t *private) {
+  if (!private_dump_links(private)) {
+    log_error("Failed to dump link stats: %s", strerror(errno));
+    return false;
+  }
+
+  u64 const time = utils_time_get_monotonic_nanoseconds();
+
+  private_calculate(private, private->previous_time != 0 ? time - private->previous_time : 0);
+
+  links_t const links = private->links;
+
+  private->links = private->previous_links;
+  private->previous_links = links;
+  private->previous_time = time;
+
+  return true;
+}
+
+/* drains link notifications, returns their count or -1 on error, overflow counts as a change */
+static isize private_receive_events(private_t *private) {
+  isize events_count = 0;
+
+  while (true) {
+    isize const length = recv(private->event_socket, private->buffer, RECEIVE_BUFFER_SIZE, 0);
+
+    if (length < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return events_count;
+      }
+
+      if (errno == ENOBUFS) {
+        log_warn("Rtnetlink socket overflowed, dumping links");
+        events_count++;
+        continue;
+      }
+
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    usize remaining_length = (usize)length;
+
+    for (struct nlmsghdr const *header = (struct nlmsghdr const *)private->buffer; NLMSG_OK(header, remaining_length);
+         header = NLMSG_NEXT(header, remaining_length)) {
+      if (header->nlmsg_type == RTM_NEWLINK || header->nlmsg_type == RTM_DELLINK) {
+        events_count++;
+      }
+    }
+  }
+}
+
+static void format_rate(u64 rate, char *buffer, usize size) {
+  static char const units[] = "BKMGT";
+  usize unit_index = 0;
+  u64 scale = 1;
+
+  while (unit_index + 1 < lengthof(units) && rate >= scale * 1024) {
+    scale *= 1024;
+    unit_index++;
+  }
+
+  u64 const tenths = rate * 10 / scale;
+
+  /* "840", "12.5K", "310M" */
+  if (unit_index == 0) {
+    snprintf(buffer, size, "%lu", (unsigned long)rate);
+  } else if (tenths < 100) {
+    snprintf(buffer, size, "%lu.%lu%c", (unsigned long)(tenths / 10), (unsigned long)(tenths % 10), units[unit_index]);
+  } else {
+    snprintf(buffer, size, "%lu%c", (unsigned long)(rate / scale), units[unit_index]);
+  }
+}
+
+static usize render_interface(char const *format, char const *name, interface_state_t const *state, char *buffer,
+                              usize length) {
+  char rx_string[MAX_RATE_LENGTH];
+  char tx_string[MAX_RATE_LENGTH];
+
+  format_rate(state->rx_rate, rx_string, sizeof(rx_string));
+  format_rate(state->tx_rate, tx_string, sizeof(tx_string));
+
+  char const *formatters[][2] = {
+    {"%rx%", rx_string},
+    {"%tx%", tx_string},
+    {"%state%", state->is_up ? "up" : "down"},
+    {"%interface%", name},
+    {0},
+  };
+
+  usize const format_length = strlen(format);
+
+  if (format_length >= length) {
+    return 0;
+  }
+
+  memcpy(buffer, format, format_length + 1);
+
+  for (char const *(*formatter)[2] = formatters; (*formatter)[0] != NULL; formatter++) {
+    if (!utils_string_replace(buffer, length - 1, (*formatter)[0], (*formatter)[1])) {
+      buffer[0] = '\0';
+      return 0;
+    }
+  }
+
+  return strlen(buffer);
+}
+
+static void render(module_net_config_t const *config, interface_state_t const *states, usize states_count,
+                   char *buffer, usize length) {
+  usize const separator_length = strlen(config->separator);
+  usize offset = 0;
+
+  buffer[0] = '\0';
+
+  for (usize state_index = 0; state_index < states_count; state_index++) {
+    if (!states[state_index].is_present) {
+      continue;
+    }
+
+    if (offset != 0) {
+      if (separator_length >= length - offset) {
+        break;
+      }
+
+      memcpy(buffer + offset, config->separator, separator_length);
+      offset += separator_length;
+    }
+
+    char const *name = config->interfaces_count != 0 ? config->interfaces[state_index] : AGGREGATE_NAME;
+
+    offset += render_interface(config->format, name, &states[state_index], buffer + offset, length - offset);
+    buffer[offset] = '\0';
+  }
+}
+
+static void record_states(module_t *module, interface_state_t const *states, usize states_count) {
+  usize const length = states_count * RECORD_STATE_LENGTH;
+  u8 *payload = malloc(length);
+
+  if (payload == NULL) {
+    log_error("Failed to allocate trace event");
+    return;
+  }
+
+  u8 *cursor = payload;
+
+  for (usize state_index = 0; state_index < states_count; state_index++) {
+    interface_state_t const *state = &states[state_index];
+    cursor = trace_put_u64(trace_put_u64(cursor, state->rx_rate), state->tx_rate);
+    cursor = trace_put_u8(trace_put_u8(cursor, state->is_up != 0), state->is_present != 0);
+  }
+
+  module_record(module, payload, length);
+  free(payload);
+}
+
+static inline bool update(module_t *module, module_net_config_t const *config, interface_state_t const *states,
+                          usize states_count) {
+  if (module_is_recording(module)) {
+    record_states(module, states, states_count);
+  }
+
+  char buffer[MAX_TEXT_LENGTH];
+  render(config, states, states_count, buffer, sizeof(buffer));
+
+  return module_update(module, buffer, NULL);
+}
+
+/* link infos are dumped again before sample after link events */
+static bool sample_and_update(module_t *module, module_net_config_t const *config, private_t *private,
+                              bool has_link_events) {
+  if (has_link_events && !private_dump_link_infos(private)) {
+    log_error("Failed to dump links: %s", strerror(errno));
+    return false;
+  }
+
+  if (!private_sample(private)) {
+    return false;
+  }
+
+  if (!update(module, config, private->states, private->states_count)) {
+    log_error("Failed to update module");
+    return false;
+  }
+
+  return true;
+}
+
+/* epoll of abort fd and event socket, so the module clock waits on both with one fd */
+static bool is_readable(int file_descriptor) {
+  struct pollfd pfd = {.fd = file_descriptor, .events = POLLIN};
+
+  return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN) != 0;
+}
+
+static int open_epoll(int abort_file_descriptor, int event_socket) {
+  int const epoll_file_descriptor = epoll_create1(EPOLL_CLOEXEC);
+
+  if (epoll_file_descriptor == -1) {
+    return -1;
+  }
+
+  struct epoll_event abort_event = {.events = EPOLLIN, .data.fd = abort_file_descriptor};
+  struct epoll_event socket_event = {.events = EPOLLIN, .data.fd = event_socket};
+
+  if (epoll_ctl(epoll_file_descriptor, EPOLL_CTL_ADD, abort_file_descriptor, &abort_event) == -1 ||
+      epoll_ctl(epoll_file_descriptor, EPOLL_CTL_ADD, event_socket, &socket_event) == -1) {
+    close(epoll_file_descriptor);
+    return -1;
+  }
+
+  return epoll_file_descriptor;
+}
+
+int module_net_run(module_t *module) {
+  int status = EXIT_FAILURE;
+
+  module_net_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    goto done;
+  }
+
+  private_t private;
+
+  if (!private_construct(&private, config)) {
+    goto free_config;
+  }
+
+  utils_time_clock_t *clock = module_get_clock(module);
+  utils_time_timer_t timer;
+
+  if (!utils_time_clock_timer_construct(clock, &timer)) {
+    log_error("Failed to create timer");
+    goto destruct_private;
+  }
+
+  int const abort_file_descriptor = module_get_abort_file_descriptor(module);
+  int const epoll_file_descriptor =
+    abort_file_descriptor != -1 ? open_epoll(abort_file_descriptor, private.event_socket) : -1;
+
+  if (epoll_file_descriptor == -1) {
+    log_error("Failed to wait for abort and link events");
+    goto destruct_timer;
+  }
+
+  module_mark_event(module);
+
+  if (!sample_and_update(module, config, &private, true)) {
+    goto close_epoll;
+  }
+
+  while (true) {
+    u64 const deadline = (utils_time_clock_get_realtime(clock) / config->interval + 1) * config->interval;
+    utils_time_wait_status_t wait_status = utils_time_clock_wait_until(clock, &timer, epoll_file_descriptor, deadline);
+
+    if (wait_status == UTILS_TIME_WAIT_FAILED) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      log_error("Failed to wait for timer");
+      goto close_epoll;
+    }
+
+    module_wakeup(module);
+
+    isize events_count = 0;
+
+    /* link going up or down is shown right away, epoll may be readable for messages which aren't link events */
+    if (wait_status == UTILS_TIME_WAIT_READABLE) {
+      if (is_readable(abort_file_descriptor)) {
+        break;
+      }
+
+      events_count = private_receive_events(&private);
+
+      if (events_count == -1) {
+        log_error("Failed to receive link events: %s", strerror(errno));
+        goto close_epoll;
+      }
+    }
+
+    module_mark_event(module);
+
+    if (!sample_and_update(module, config, &private, events_count != 0)) {
+      goto close_epoll;
+    }
+  }
+
+  status = EXIT_SUCCESS;
+
+close_epoll:
+  close(epoll_file_descriptor);
+
+destruct_timer:
+  utils_time_clock_timer_destruct(clock, &timer);
+
+destruct_private:
+  private_destruct(&private);
+
+free_config:
+  config_free(config);
+
+done:
+  return status;
+}
+
+int module_net_replay(module_t *module) {
+  module_net_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_SUCCESS;
+  usize const states_count = config->interfaces_count != 0 ? config->interfaces_count : 1;
+  interface_state_t *states = calloc(states_count, sizeof(*states));
+  void const *payload = NULL;
+  usize length = 0;
+
+  if (states == NULL) {
+    log_error("Failed to allocate interface states");
+    config_free(config);
+    return EXIT_FAILURE;
+  }
+
+  while (module_replay_next(module, &payload, &length)) {
+    if (length != states_count * RECORD_STATE_LENGTH) {
+      log_error("Invalid net trace event");
+      status = EXIT_FAILURE;
+      break;
+    }
+
+    u8 const *cursor = payload;
+
+    for (usize state_index = 0; state_index < states_count; state_index++) {
+      interface_state_t *state = &states[state_index];
+      u8 is_up = 0;
+      u8 is_present = 0;
+
+      cursor = trace_get_u64(trace_get_u64(cursor, &state->rx_rate), &state->tx_rate);
+      cursor = trace_get_u8(trace_get_u8(cursor, &is_up), &is_present);
+      state->is_up = is_up;
+      state->is_present = is_present;
+    }
+
+    module_mark_event(module);
+
+    if (!update(module, config, states, states_count)) {
+      log_error("Failed to update module");
+      status = EXIT_FAILURE;
+      break;
+    }
+  }
+
+  free(states);
+  config_free(config);
+
+  return status;
+}
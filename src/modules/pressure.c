@@ -0,0 +1,436 @@
+#include "modules/pressure.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_MODULE "pressure"
+
+#include "log.h"
+#include "macros.h"
+#include "module.h"
+#include "toml.h"
+#include "trace.h"
+#include "utils/fs.h"
+#include "utils/time.h"
+
+#define DEFAULT_PROCFS_ROOT "/proc"
+#define DEFAULT_TRIGGER "some 300000 2000000" /* window of 2s multiple is allowed to unprivileged users */
+#define DEFAULT_INTERVAL 2000000000UL         /* nanoseconds */
+#define PRESSURE_SIZE 256                     /* "some" and "full" lines of avg10, avg60, avg300 and total */
+
+typedef enum resource {
+  RESOURCE_CPU,
+  RESOURCE_MEMORY,
+  RESOURCE_IO,
+  RESOURCES_COUNT,
+} resource_t;
+
+static char const *const resource_names[RESOURCES_COUNT] = {
+  [RESOURCE_CPU] = "cpu",
+  [RESOURCE_MEMORY] = "memory",
+  [RESOURCE_IO] = "io",
+};
+
+/* avg10 of "some" and "full" lines in hundredths of percent, as kernel prints them (e.g 41.70) */
+typedef struct averages {
+  u16 some;
+  u16 full;
+} averages_t;
+
+#define RECORD_LENGTH (RESOURCES_COUNT * 2 * sizeof(u16)) /* some and full of every resource */
+
+typedef struct private {
+  utils_fs_reader_t readers[RESOURCES_COUNT]; /* <procfs_root>/pressure/<resource>, -1 if not referenced by format */
+  char buffers[RESOURCES_COUNT][PRESSURE_SIZE];
+  bool has_trigger[RESOURCES_COUNT]; /* trigger registered on reader, otherwise file is reread every interval */
+  averages_t averages[RESOURCES_COUNT];
+}
+private_t;
+
+static void config_free(module_pressure_config_t *config) {
+  if (config == NULL) {
+    return;
+  }
+
+  free(config->procfs_root);
+  free(config->trigger);
+  free(config->format);
+  free(config);
+}
+
+static module_pressure_config_t *config_get(toml_table_t *table) {
+  module_pressure_config_t *config = calloc(1, sizeof(*config));
+
+  if (config == NULL) {
+    log_error("Failed to allocate pressure config");
+    goto error;
+  }
+
+  toml_value_t format = toml_table_string(table, "format");
+
+  if (!format.ok) {
+    log_error("Failed to get format");
+    goto error;
+  }
+
+  config->format = format.u.s;
+
+  toml_value_t trigger = toml_table_string(table, "trigger");
+  config->trigger = trigger.ok ? trigger.u.s : strdup(DEFAULT_TRIGGER);
+
+  if (config->trigger == NULL) {
+    log_error("Failed to allocate trigger");
+    goto error;
+  }
+
+  config->interval = DEFAULT_INTERVAL;
+
+  toml_value_t interval = toml_table_string(table, "interval");
+
+  if (interval.ok) {
+    bool const is_parsed = utils_time_parse_interval(interval.u.s, &config->interval);
+
+    free(interval.u.s);
+
+    if (!is_parsed) {
+      log_error("Invalid pressure interval");
+      goto error;
+    }
+  }
+
+  toml_value_t procfs_root = toml_table_string(table, "procfs_root");
+  config->procfs_root = procfs_root.ok ? procfs_root.u.s : strdup(DEFAULT_PROCFS_ROOT);
+
+  if (config->procfs_root == NULL) {
+    log_error("Failed to allocate procfs root");
+    goto error;
+  }
+
+  return config;
+
+error:
+  config_free(config);
+  return NULL;
+}
+
+static inline bool is_referenced(private_t const *private, resource_t resource) {
+  return private->readers[resource].file_descriptor != -1;
+}
+
+static inline u16 round_average(u16 average) {
+  return (u16)((average + 50) / 100);
+}
+
+/* parses "<kind> avg10=<percent>.<hundredths>" at start of line, false if line is of other kind */
+static bool parse_avg10(char const *line, char const *kind, u16 *average) {
+  static char const avg10_prefix[] = " avg10=";
+  usize const kind_length = strlen(kind);
+
+  if (strncmp(line, kind, kind_length) != 0 || strncmp(line + kind_length, avg10_prefix, strlen(avg10_prefix)) != 0) {
+    return false;
+  }
+
+  char const *cursor = line + kind_length + strlen(avg10_prefix);
+  u32 value = 0;
+
+  for (; *cursor >= '0' && *cursor <= '9' && value <= UINT16_MAX; cursor++) {
+    value = value * 10 + (u32)(*cursor - '0');
+  }
+
+  value *= 100;
+
+  if (*cursor == '.') {
+    u32 scale = 10;
+
+    for (cursor++; *cursor >= '0' && *cursor <= '9' && scale != 0; cursor++, scale /= 10) {
+      value += (u32)(*cursor - '0') * scale;
+    }
+  }
+
+  *average = value > UINT16_MAX ? UINT16_MAX : (u16)value;
+
+  return true;
+}
+
+static bool private_read(private_t *private, resource_t resource) {
+  utils_fs_reader_t *reader = &private->readers[resource];
+  averages_t *averages = &private->averages[resource];
+
+  if (!utils_fs_reader_refresh(reader)) {
+    log_error("Failed to read %s pressure", resource_names[resource]);
+    return false;
+  }
+
+  /* "full" line is missing for cpu before Linux 5.13 */
+  *averages = (averages_t){0};
+
+  for (char const *line = reader->buffer; line != NULL && *line != '\0';) {
+    if (!parse_avg10(line, "some", &averages->some)) {
+      parse_avg10(line, "full", &averages->full);
+    }
+
+    line = strchr(line, '\n');
+    line = line != NULL ? line + 1 : NULL;
+  }
+
+  return true;
+}
+
+static bool private_read_all(private_t *private) {
+  for (usize resource_index = 0; resource_index < RESOURCES_COUNT; resource_index++) {
+    if (is_referenced(private, (resource_t)resource_index) && !private_read(private, (resource_t)resource_index)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* rereads are needed while shown averages decay, trigger doesn't fire when pressure goes away */
+static bool private_needs_reread(private_t const *private) {
+  for (usize resource_index = 0; resource_index < RESOURCES_COUNT; resource_index++) {
+    averages_t const *averages = &private->averages[resource_index];
+
+    if (is_referenced(private, (resource_t)resource_index) &&
+        (!private->has_trigger[resource_index] || round_average(averages->some) != 0 ||
+         round_average(averages->full) != 0)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void private_destruct(private_t *private) {
+  for (usize resource_index = 0; resource_index < RESOURCES_COUNT; resource_index++) {
+    utils_fs_reader_close(&private->readers[resource_index]);
+  }
+}
+
+/* trigger is written with its terminating null, kernel polls file with POLLPRI once stall exceeds it in window */
+static bool open_trigger(utils_fs_reader_t *reader, char const *path, char *buffer, char const *trigger) {
+  int const file_descriptor = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+  if (file_descriptor == -1) {
+    return false;
+  }
+
+  usize const trigger_size = strlen(trigger) + 1;
+
+  if (write(file_descriptor, trigger, trigger_size) != (isize)trigger_size) {
+    int const write_errno = errno;
+
+    close(file_descriptor);
+    errno = write_errno;
+
+    return false;
+  }
+
+  *reader = (utils_fs_reader_t){.file_descriptor = file_descriptor, .buffer = buffer, .size = PRESSURE_SIZE};
+
+  return true;
+}
+
+static bool private_construct(private_t *private, module_pressure_config_t const *config) {
+  *private = (private_t){0};
+
+  for (usize resource_index = 0; resource_index < RESOURCES_COUNT; resource_index++) {
+    private->readers[resource_index].file_descriptor = -1;
+  }
+
+  for (usize resource_index = 0; resource_index < RESOURCES_COUNT; resource_index++) {
+    char placeholder[16];
+    snprintf(placeholder, sizeof(placeholder), "%%%s", resource_names[resource_index]);
+
+    /* matches both "%cpu%" and "%cpu_full%" */
+    if (strstr(config->format, placeholder) == NULL) {
+      continue;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/pressure/%s", config->procfs_root, resource_names[resource_index]);
+
+    char *buffer = private->buffers[resource_index];
+    utils_fs_reader_t *reader = &private->readers[resource_index];
+
+    private->has_trigger[resource_index] = open_trigger(reader, path, buffer, config->trigger);
+
+    if (private->has_trigger[resource_index]) {
+      continue;
+    }
+
+    /* e.g unprivileged user on kernels before 6.5, or window not a multiple of 2s for unprivileged user */
+    log_warn("Failed to register %s pressure trigger (%s), rereading every interval", resource_names[resource_index],
+             strerror(errno));
+
+    if (!utils_fs_reader_open(reader, path, buffer, PRESSURE_SIZE)) {
+      log_error("Failed to open %s", path);
+      goto error;
+    }
+  }
+
+  if (!private_read_all(private)) {
+    goto error;
+  }
+
+  return true;
+
+error:
+  private_destruct(private);
+  return false;
+}
+
+static void record_averages(module_t *module, averages_t const averages[RESOURCES_COUNT]) {
+  u8 payload[RECORD_LENGTH];
+  u8 *cursor = payload;
+
+  for (usize resource_index = 0; resource_index < RESOURCES_COUNT; resource_index++) {
+    cursor = trace_put_u16(trace_put_u16(cursor, averages[resource_index].some), averages[resource_index].full);
+  }
+
+  module_record(module, payload, sizeof(payload));
+}
+
+static bool update_module(module_t *module, module_pressure_config_t const *config,
+                          averages_t const averages[RESOURCES_COUNT]) {
+  char strings[RESOURCES_COUNT][2][8];
+
+  for (usize resource_index = 0; resource_index < RESOURCES_COUNT; resource_index++) {
+    snprintf(strings[resource_index][0], sizeof(strings[resource_index][0]), "%u",
+             round_average(averages[resource_index].some));
+    snprintf(strings[resource_index][1], sizeof(strings[resource_index][1]), "%u",
+             round_average(averages[resource_index].full));
+  }
+
+  char const *formatters[][2] = {
+    {"%cpu%", strings[RESOURCE_CPU][0]},       {"%cpu_full%", strings[RESOURCE_CPU][1]},
+    {"%memory%", strings[RESOURCE_MEMORY][0]}, {"%memory_full%", strings[RESOURCE_MEMORY][1]},
+    {"%io%", strings[RESOURCE_IO][0]},         {"%io_full%", strings[RESOURCE_IO][1]},
+    {NULL, NULL},
+  };
+
+  return module_update(module, config->format, formatters);
+}
+
+int module_pressure_run(module_t *module) {
+  int status = EXIT_FAILURE;
+
+  module_pressure_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    goto done;
+  }
+
+  private_t private;
+
+  if (!private_construct(&private, config)) {
+    goto free_config;
+  }
+
+  /* abort and pressure files with trigger, files without trigger are reread on timeout */
+  struct pollfd pfds[1 + RESOURCES_COUNT] = {
+    {.fd = module_get_abort_file_descriptor(module), .events = POLLIN},
+  };
+  nfds_t pfds_count = 1;
+
+  for (usize resource_index = 0; resource_index < RESOURCES_COUNT; resource_index++) {
+    if (private.has_trigger[resource_index]) {
+      pfds[pfds_count++] = (struct pollfd){.fd = private.readers[resource_index].file_descriptor, .events = POLLPRI};
+    }
+  }
+
+  int const interval = (int)(config->interval / 1000000);
+
+  while (true) {
+    record_averages(module, private.averages);
+
+    if (!update_module(module, config, private.averages)) {
+      log_error("Failed to update module");
+      goto destruct_private;
+    }
+
+    if (poll(pfds, pfds_count, private_needs_reread(&private) ? interval : -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      log_error("Failed to poll");
+      goto destruct_private;
+    }
+
+    module_wakeup(module);
+
+    if (pfds[0].revents & POLLIN) {
+      break;
+    }
+
+    for (nfds_t pfd_index = 1; pfd_index < pfds_count; pfd_index++) {
+      if (pfds[pfd_index].revents & (POLLERR | POLLNVAL)) {
+        log_error("Pressure trigger was removed");
+        goto destruct_private;
+      }
+    }
+
+    module_mark_event(module);
+
+    if (!private_read_all(&private)) {
+      goto destruct_private;
+    }
+  }
+
+  status = EXIT_SUCCESS;
+
+destruct_private:
+  private_destruct(&private);
+
+free_config:
+  config_free(config);
+
+done:
+  return status;
+}
+
+int module_pressure_replay(module_t *module) {
+  module_pressure_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_SUCCESS;
+  averages_t averages[RESOURCES_COUNT];
+  void const *payload = NULL;
+  usize length = 0;
+
+  while (module_replay_next(module, &payload, &length)) {
+    if (length != RECORD_LENGTH) {
+      log_error("Invalid pressure trace event");
+      status = EXIT_FAILURE;
+      break;
+    }
+
+    u8 const *cursor = payload;
+
+    for (usize resource_index = 0; resource_index < RESOURCES_COUNT; resource_index++) {
+      cursor = trace_get_u16(trace_get_u16(cursor, &averages[resource_index].some), &averages[resource_index].full);
+    }
+
+    module_mark_event(module);
+
+    if (!update_module(module, config, averages)) {
+      log_error("Failed to update module");
+      status = EXIT_FAILURE;
+      break;
+    }
+  }
+
+  config_free(config);
+
+  return status;
+}
@@ -1,7 +1,5 @@
-
 #include "modules/sound.h"
 
-#include <alloca.h>
 #include <alsa/asoundlib.h>
 #include <math.h>
 
@@ -11,35 +9,210 @@
 #include "macros.h"
 #include "module.h"
 #include "toml.h"
+#include "trace.h"
+#include "utils/string.h"
 
-typedef struct private {
+#define MAX_TEXT_LENGTH 1024
+#define RECORD_ELEMENT_LENGTH (1 + 2 + 1 + 3 * 8 + 1)
+
+/* trace records, first byte of payload */
+typedef enum record_type {
+  RECORD_ELEMENT = 0, /* u16 control index, u8 is removed, i64 min, i64 max, i64 volume, u8 switch state */
+  RECORD_UPDATE,      /* states read so far are rendered */
+} record_type_t;
+
+/* state of one control as read from its alsa element */
+typedef struct control_state {
   long min;
   long max;
   long volume;
   int switch_state;
+  int is_removed; /* element went away (e.g USB card unplugged), control isn't rendered until it's added again */
+} control_state_t;
+
+typedef struct private {
+  module_t *module;
+  char **names;             /* names of controls from config */
+  snd_mixer_elem_t **elems; /* resolved once and on add events, null - not present */
+  control_state_t *states;
+  usize controls_count;
+  bool is_changed; /* element callback reread some state since last render */
 }
 private_t;
 
-static bool private_get(private_t *private, snd_mixer_selem_id_t const *id,
-                        snd_mixer_selem_channel_id_t const channel_id, snd_mixer_t *mixer) {
-  snd_mixer_elem_t *elem = snd_mixer_find_selem(mixer, id);
+static bool control_state_read(control_state_t *state, snd_mixer_elem_t *elem,
+                               snd_mixer_selem_channel_id_t const channel_id) {
+  state->is_removed = 0;
 
-  if (elem == NULL) {
+  if (snd_mixer_selem_has_playback_channel(elem, channel_id)) {
+    if (snd_mixer_selem_get_playback_volume(elem, channel_id, &state->volume) < 0 ||
+        snd_mixer_selem_get_playback_switch(elem, channel_id, &state->switch_state) < 0 ||
+        snd_mixer_selem_get_playback_volume_range(elem, &state->min, &state->max) < 0) {
+      return false;
+    }
+  } else if (snd_mixer_selem_has_capture_channel(elem, channel_id)) {
+    if (snd_mixer_selem_get_capture_volume(elem, channel_id, &state->volume) < 0 ||
+        snd_mixer_selem_get_capture_switch(elem, channel_id, &state->switch_state) < 0 ||
+        snd_mixer_selem_get_capture_volume_range(elem, &state->min, &state->max) < 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* records element as alsa reported it, replay renders it on the next update record */
+static void record_element(module_t *module, usize control_index, control_state_t const *state) {
+  if (!module_is_recording(module)) {
+    return;
+  }
+
+  u8 payload[RECORD_ELEMENT_LENGTH];
+  u8 *cursor = trace_put_u8(payload, RECORD_ELEMENT);
+  cursor = trace_put_u16(cursor, (u16)control_index);
+  cursor = trace_put_u8(cursor, state->is_removed != 0);
+  cursor = trace_put_u64(cursor, (u64)state->min);
+  cursor = trace_put_u64(cursor, (u64)state->max);
+  cursor = trace_put_u64(cursor, (u64)state->volume);
+  trace_put_u8(cursor, state->switch_state != 0);
+
+  module_record(module, payload, sizeof(payload));
+}
+
+static bool replay_element(control_state_t *states, usize controls_count, u8 const *payload, usize length) {
+  u16 control_index = 0;
+  u8 is_removed = 0;
+  u64 min = 0;
+  u64 max = 0;
+  u64 volume = 0;
+  u8 switch_state = 0;
+
+  if (length != RECORD_ELEMENT_LENGTH) {
     return false;
   }
 
-  if (snd_mixer_selem_has_playback_channel(elem, channel_id)) {
-    if (snd_mixer_selem_get_playback_volume(elem, channel_id, &private->volume) < 0 ||
-        snd_mixer_selem_get_playback_switch(elem, channel_id, &private->switch_state) < 0 ||
-        snd_mixer_selem_get_playback_volume_range(elem, &private->min, &private->max) < 0) {
+  u8 const *cursor = trace_get_u16(payload + 1, &control_index);
+  cursor = trace_get_u8(cursor, &is_removed);
+  cursor = trace_get_u64(cursor, &min);
+  cursor = trace_get_u64(cursor, &max);
+  cursor = trace_get_u64(cursor, &volume);
+  trace_get_u8(cursor, &switch_state);
+
+  if (control_index >= controls_count) {
+    return false;
+  }
+
+  states[control_index] = (control_state_t){
+    .min = (long)(i64)min,
+    .max = (long)(i64)max,
+    .volume = (long)(i64)volume,
+    .switch_state = switch_state,
+    .is_removed = is_removed,
+  };
+
+  return true;
+}
+
+static isize private_find_elem(private_t const *private, snd_mixer_elem_t const *elem) {
+  for (usize control_index = 0; control_index < private->controls_count; control_index++) {
+    if (private->elems[control_index] == elem) {
+      return (isize)control_index;
+    }
+  }
+
+  return -1;
+}
+
+/* called by snd_mixer_handle_events for changed element only */
+static int elem_callback(snd_mixer_elem_t *elem, unsigned int mask) {
+  private_t *private = snd_mixer_elem_get_callback_private(elem);
+  isize const control_index = private_find_elem(private, elem);
+
+  if (control_index == -1) {
+    return 0;
+  }
+
+  control_state_t *state = &private->states[control_index];
+
+  if (mask == SND_CTL_EVENT_MASK_REMOVE) {
+    private->elems[control_index] = NULL;
+    *state = (control_state_t){.is_removed = 1};
+  } else if (!control_state_read(state, elem, SND_MIXER_SCHN_MONO)) {
+    log_error("Failed to get channel info of %s", private->names[control_index]);
+    return -1;
+  }
+
+  record_element(private->module, (usize)control_index, state);
+  private->is_changed = true;
+
+  return 0;
+}
+
+/* binds elements of configured controls when mixer adds them, during load and on hotplug */
+static int mixer_callback(snd_mixer_t *mixer, unsigned int mask, snd_mixer_elem_t *elem) {
+  if ((mask & SND_CTL_EVENT_MASK_ADD) == 0 || snd_mixer_selem_get_index(elem) != 0) {
+    return 0;
+  }
+
+  private_t *private = snd_mixer_get_callback_private(mixer);
+  char const *name = snd_mixer_selem_get_name(elem);
+
+  for (usize control_index = 0; control_index < private->controls_count; control_index++) {
+    if (private->elems[control_index] != NULL || strcmp(private->names[control_index], name) != 0) {
+      continue;
+    }
+
+    private->elems[control_index] = elem;
+    snd_mixer_elem_set_callback(elem, elem_callback);
+    snd_mixer_elem_set_callback_private(elem, private);
+
+    /* volume and switch of a new element are filled later, they are reported by element callback */
+    control_state_read(&private->states[control_index], elem, SND_MIXER_SCHN_MONO);
+    record_element(private->module, control_index, &private->states[control_index]);
+    private->is_changed = true;
+  }
+
+  return 0;
+}
+
+static void private_destruct(private_t *private) {
+  free(private->elems);
+  free(private->states);
+}
+
+static bool private_construct(private_t *private, module_t *module, module_sound_config_t const *config) {
+  *private = (private_t){
+    .module = module,
+    .names = config->controls,
+    .controls_count = config->controls_count,
+  };
+
+  private->elems = calloc(config->controls_count, sizeof(*private->elems));
+  private->states = calloc(config->controls_count, sizeof(*private->states));
+
+  if (private->elems == NULL || private->states == NULL) {
+    log_error("Failed to allocate controls");
+    private_destruct(private);
+    return false;
+  }
+
+  return true;
+}
+
+/* initial read once mixer is loaded, afterwards states are only reread by element callback */
+static bool private_read(private_t *private) {
+  for (usize control_index = 0; control_index < private->controls_count; control_index++) {
+    if (private->elems[control_index] == NULL) {
+      log_error("Failed to find control %s", private->names[control_index]);
       return false;
     }
-  } else if (snd_mixer_selem_has_capture_channel(elem, channel_id)) {
-    if (snd_mixer_selem_get_capture_volume(elem, channel_id, &private->volume) < 0 ||
-        snd_mixer_selem_get_capture_switch(elem, channel_id, &private->switch_state) < 0 ||
-        snd_mixer_selem_get_capture_volume_range(elem, &private->min, &private->max) < 0) {
+
+    if (!control_state_read(&private->states[control_index], private->elems[control_index], SND_MIXER_SCHN_MONO)) {
+      log_error("Failed to get channel info of %s", private->names[control_index]);
       return false;
     }
+
+    record_element(private->module, control_index, &private->states[control_index]);
   }
 
   return true;
@@ -55,31 +228,127 @@ static u8 convert_percentage(long value, long min, long max) {
   return (u8)rintf((float)value / (float)range * 100);
 }
 
-static inline bool update(module_t *module, module_sound_config_t const *config, private_t const *private) {
-  u8 volume = convert_percentage(private->volume, private->min, private->max);
-  usize volume_string_size = (usize)strfsize("%d", volume);
-  char *volume_string = alloca(volume_string_size + 1);
-  snprintf(volume_string, volume_string_size + 1, "%d", volume);
+static usize render_control(char const *format, char const *name, control_state_t const *state, char *buffer,
+                            usize length) {
+  char volume_string[8];
+  snprintf(volume_string, sizeof(volume_string), "%d", convert_percentage(state->volume, state->min, state->max));
 
   char const *formatters[][2] = {
     {"%volume%", volume_string},
-    {"%state%", private->switch_state ? "m" : "M"},
+    {"%state%", state->switch_state ? "m" : "M"},
+    {"%control%", name},
     {0},
   };
 
-  return module_update(module, config->format, formatters);
+  usize const format_length = strlen(format);
+
+  if (format_length >= length) {
+    return 0;
+  }
+
+  memcpy(buffer, format, format_length + 1);
+
+  for (char const *(*formatter)[2] = formatters; (*formatter)[0] != NULL; formatter++) {
+    if (!utils_string_replace(buffer, length - 1, (*formatter)[0], (*formatter)[1])) {
+      buffer[0] = '\0';
+      return 0;
+    }
+  }
+
+  return strlen(buffer);
+}
+
+static void render(module_sound_config_t const *config, control_state_t const *states, char *buffer, usize length) {
+  usize const separator_length = strlen(config->separator);
+  usize offset = 0;
+
+  buffer[0] = '\0';
+
+  for (usize control_index = 0; control_index < config->controls_count; control_index++) {
+    if (states[control_index].is_removed) {
+      continue;
+    }
+
+    if (offset != 0) {
+      if (separator_length >= length - offset) {
+        break;
+      }
+
+      memcpy(buffer + offset, config->separator, separator_length);
+      offset += separator_length;
+    }
+
+    offset += render_control(config->format, config->controls[control_index], &states[control_index],
+                             buffer + offset, length - offset);
+    buffer[offset] = '\0';
+  }
+}
+
+static inline bool update(module_t *module, module_sound_config_t const *config, control_state_t const *states) {
+  u8 const record_type = RECORD_UPDATE;
+  module_record(module, &record_type, sizeof(record_type));
+
+  char buffer[MAX_TEXT_LENGTH];
+  render(config, states, buffer, sizeof(buffer));
+
+  return module_update(module, buffer, NULL);
 }
 
 static void free_config(module_sound_config_t *config) {
-  free(config->control);
+  for (usize control_index = 0; control_index < config->controls_count; control_index++) {
+    free(config->controls[control_index]);
+  }
+
+  free(config->controls);
+  free(config->separator);
   free(config->device);
   free(config->format);
   free(config);
 }
 
+/* "controls" array, single "control" string is kept for existing configs */
+static bool get_controls(module_sound_config_t *config, toml_table_t *table) {
+  toml_array_t *controls = toml_table_array(table, "controls");
+  usize const controls_count = controls != NULL ? (usize)toml_array_len(controls) : 1;
+
+  config->controls = calloc(controls_count, sizeof(*config->controls));
+
+  if (config->controls == NULL) {
+    return false;
+  }
+
+  if (controls == NULL) {
+    toml_value_t control = toml_table_string(table, "control");
+
+    if (!control.ok) {
+      return false;
+    }
+
+    config->controls[config->controls_count++] = control.u.s;
+
+    return true;
+  }
+
+  for (usize control_index = 0; control_index < controls_count; control_index++) {
+    toml_value_t control = toml_array_string(controls, (int)control_index);
+
+    if (!control.ok) {
+      return false;
+    }
+
+    config->controls[config->controls_count++] = control.u.s;
+  }
+
+  return controls_count != 0;
+}
+
 static module_sound_config_t *get_and_check_config(toml_table_t *table) {
   module_sound_config_t *config = calloc(1, sizeof(*config));
 
+  if (config == NULL) {
+    return NULL;
+  }
+
   toml_value_t format = toml_table_string(table, "format");
 
   if (!format.ok) {
@@ -96,13 +365,16 @@ static module_sound_config_t *get_and_check_config(toml_table_t *table) {
 
   config->device = device.u.s;
 
-  toml_value_t control = toml_table_string(table, "control");
-
-  if (!control.ok) {
+  if (!get_controls(config, table)) {
     goto error;
   }
 
-  config->control = control.u.s;
+  toml_value_t separator = toml_table_string(table, "separator");
+  config->separator = separator.ok ? separator.u.s : strdup(" ");
+
+  if (config->separator == NULL) {
+    goto error;
+  }
 
   return config;
 
@@ -121,8 +393,9 @@ int module_sound_run(module_t *module) {
     goto done;
   }
 
-  if (config == NULL) {
-    log_error("incorrect configuration of the audio module");
+  private_t private;
+
+  if (!private_construct(&private, module, config)) {
     goto free_config;
   }
 
@@ -130,9 +403,13 @@ int module_sound_run(module_t *module) {
 
   if (snd_mixer_open(&mixer, 0) < 0) {
     log_error("Failed to open mixer");
-    goto free_config;
+    goto free_private;
   }
 
+  /* elements are bound by mixer callback as load adds them, no lookup by name afterwards */
+  snd_mixer_set_callback(mixer, mixer_callback);
+  snd_mixer_set_callback_private(mixer, &private);
+
   if (snd_mixer_attach(mixer, config->device) < 0) {
     log_error("Failed to attach mixer");
     goto free_mixer;
@@ -148,12 +425,11 @@ int module_sound_run(module_t *module) {
     goto free_mixer;
   }
 
-  snd_mixer_selem_id_t *id = NULL;
-
-  snd_mixer_selem_id_alloca(&id);
-  snd_mixer_selem_id_set_name(id, config->control);
-  snd_mixer_selem_id_set_index(id, 0);
+  if (!private_read(&private)) {
+    goto free_mixer;
+  }
 
+  /* one poll set for all controls */
   int nfds = snd_mixer_poll_descriptors_count(mixer) + 1;
   struct pollfd *pfds = malloc((unsigned long)nfds * sizeof(*pfds));
 
@@ -170,17 +446,16 @@ int module_sound_run(module_t *module) {
     goto free_pfds;
   }
 
-  private_t private = {0};
+  private.is_changed = true;
 
   while (true) {
-    if (!private_get(&private, id, SND_MIXER_SCHN_MONO, mixer)) {
-      log_error("Failed to get channel info");
-      goto free_pfds;
-    }
+    if (private.is_changed) {
+      private.is_changed = false;
 
-    if (!update(module, config, &private)) {
-      log_error("Failed to update status line");
-      goto free_pfds;
+      if (!update(module, config, private.states)) {
+        log_error("Failed to update status line");
+        goto free_pfds;
+      }
     }
 
     int poll_status = poll(pfds, (nfds_t)nfds, -1);
@@ -194,6 +469,8 @@ int module_sound_run(module_t *module) {
       goto free_pfds;
     }
 
+    module_wakeup(module);
+
     if (pfds[0].revents & POLLIN) {
       break;
     }
@@ -206,7 +483,13 @@ int module_sound_run(module_t *module) {
     }
 
     if (revents & POLLIN) {
-      snd_mixer_handle_events(mixer);
+      module_mark_event(module);
+
+      /* rereads changed elements through elem_callback */
+      if (snd_mixer_handle_events(mixer) < 0) {
+        log_error("Failed to handle mixer events");
+        goto free_pfds;
+      }
     } else if (revents & (POLLERR | POLLNVAL)) {
       log_error("alsa I/O error");
       goto free_pfds;
@@ -221,9 +504,59 @@ free_pfds:
 free_mixer:
   snd_mixer_close(mixer);
 
+free_private:
+  private_destruct(&private);
+
 free_config:
   free_config(config);
 
 done:
   return status;
 }
+
+int module_sound_replay(module_t *module) {
+  module_sound_config_t *config = get_and_check_config(module->config);
+
+  if (config == NULL) {
+    log_error("Failed to get config");
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_SUCCESS;
+  control_state_t *states = calloc(config->controls_count, sizeof(*states));
+  void const *payload = NULL;
+  usize length = 0;
+
+  if (states == NULL) {
+    log_error("Failed to allocate controls");
+    free_config(config);
+    return EXIT_FAILURE;
+  }
+
+  while (module_replay_next(module, &payload, &length)) {
+    u8 const *record = payload;
+    bool const is_element = length != 0 && record[0] == RECORD_ELEMENT;
+
+    if (is_element && replay_element(states, config->controls_count, record, length)) {
+      module_mark_event(module);
+      continue;
+    }
+
+    if (is_element || length != 1 || record[0] != RECORD_UPDATE) {
+      log_error("Invalid sound trace event");
+      status = EXIT_FAILURE;
+      break;
+    }
+
+    if (!update(module, config, states)) {
+      log_error("Failed to update status line");
+      status = EXIT_FAILURE;
+      break;
+    }
+  }
+
+  free(states);
+  free_config(config);
+
+  return status;
+}
@@ -0,0 +1,661 @@
+#include "modules/temperature.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_MODULE "temperature"
+
+#include "log.h"
+#include "macros.h"
+#include "module.h"
+#include "toml.h"
+#include "trace.h"
+#include "utils/fs.h"
+#include "utils/time.h"
+
+#define DEFAULT_INTERVAL 2000000000UL /* nanoseconds */
+#define DEFAULT_SYSFS_ROOT "/sys"
+#define SENSOR_BUFFER_SIZE 16 /* millidegrees (e.g "45000\n") */
+#define MAX_LABEL_LENGTH 64
+#define MAX_VALUE_LENGTH 12 /* i32 millidegrees in whole degrees with sign, e.g "-2147484" */
+#define INITIAL_SENSORS_CAPACITY 16
+#define MISSING_VALUE INT32_MIN
+
+typedef enum value {
+  VALUE_MAX,
+  VALUE_AVG,
+  VALUES_COUNT, /* followed by one value per configured label */
+} value_t;
+
+/* input of sensor found while walking hwmon devices, opened once walk is done */
+typedef struct sensor_path {
+  char *path;
+  usize label_index; /* index of configured label, 0 if all sensors are shown */
+} sensor_path_t;
+
+typedef struct sensor_paths {
+  sensor_path_t *items;
+  usize count;
+  usize capacity;
+} sensor_paths_t;
+
+typedef struct private {
+  utils_fs_reader_t *readers; /* temp*_input of every shown sensor, open for module lifetime */
+  char (*buffers)[SENSOR_BUFFER_SIZE];
+  usize *label_indexes; /* per reader */
+  usize sensors_count;
+  utils_fs_batch_t batch;
+  i32 *values;         /* millidegrees, VALUES_COUNT and one per label, recorded */
+  usize values_count;
+  char **placeholders; /* "%<label>%" per label */
+  char (*value_strings)[MAX_VALUE_LENGTH];
+  char const *(*formatters)[2]; /* built once, point to value_strings */
+}
+private_t;
+
+static void config_free(module_temperature_config_t *config) {
+  if (config == NULL) {
+    return;
+  }
+
+  for (usize sensor_index = 0; sensor_index < config->sensors_count; sensor_index++) {
+    free(config->sensors[sensor_index]);
+  }
+
+  free(config->sensors);
+  free(config->sysfs_root);
+  free(config->format);
+  free(config);
+}
+
+static bool get_sensors(module_temperature_config_t *config, toml_table_t *table) {
+  toml_array_t *sensors = toml_table_array(table, "sensors");
+
+  if (sensors == NULL) {
+    return true;
+  }
+
+  usize const sensors_count = (usize)toml_array_len(sensors);
+  config->sensors = calloc(sensors_count != 0 ? sensors_count : 1, sizeof(*config->sensors));
+
+  if (config->sensors == NULL) {
+    return false;
+  }
+
+  for (usize sensor_index = 0; sensor_index < sensors_count; sensor_index++) {
+    toml_value_t sensor = toml_array_string(sensors, (int)sensor_index);
+
+    if (!sensor.ok) {
+      return false;
+    }
+
+    config->sensors[config->sensors_count++] = sensor.u.s;
+  }
+
+  return true;
+}
+
+static module_temperature_config_t *config_get(toml_table_t *table) {
+  module_temperature_config_t *config = calloc(1, sizeof(*config));
+
+  if (config == NULL) {
+    log_error("Failed to allocate config");
+    return NULL;
+  }
+
+  toml_value_t format = toml_table_string(table, "format");
+
+  if (!format.ok) {
+    log_error("Failed to get format");
+    goto error;
+  }
+
+  config->format = format.u.s;
+
+  if (!get_sensors(config, table)) {
+    log_error("Failed to get sensors");
+    goto error;
+  }
+
+  config->interval = DEFAULT_INTERVAL;
+
+  toml_value_t interval = toml_table_string(table, "interval");
+
+  if (interval.ok) {
+    bool const is_parsed = utils_time_parse_interval(interval.u.s, &config->interval);
+
+    free(interval.u.s);
+
+    if (!is_parsed) {
+      log_error("Invalid temperature interval");
+      goto error;
+    }
+  }
+
+  toml_value_t sysfs_root = toml_table_string(table, "sysfs_root");
+  config->sysfs_root = sysfs_root.ok ? sysfs_root.u.s : strdup(DEFAULT_SYSFS_ROOT);
+
+  if (config->sysfs_root == NULL) {
+    log_error("Failed to allocate sysfs root");
+    goto error;
+  }
+
+  return config;
+
+error:
+  config_free(config);
+  return NULL;
+}
+
+/* reads first line of small attribute (name, temp*_label) without newline, only while sensors are discovered */
+static bool read_line(char const *path, char *buffer, usize size) {
+  utils_fs_reader_t reader;
+
+  if (!utils_fs_reader_open(&reader, path, buffer, size)) {
+    return false;
+  }
+
+  bool const status = utils_fs_reader_refresh(&reader) && reader.length != 0;
+
+  utils_fs_reader_close(&reader);
+
+  buffer[strcspn(buffer, "\n")] = '\0';
+
+  return status;
+}
+
+static bool sensor_paths_add(sensor_paths_t *sensor_paths, char const *path, usize label_index) {
+  if (sensor_paths->count == sensor_paths->capacity) {
+    usize const capacity = sensor_paths->capacity != 0 ? sensor_paths->capacity * 2 : INITIAL_SENSORS_CAPACITY;
+    sensor_path_t *items = realloc(sensor_paths->items, capacity * sizeof(*items));
+
+    if (items == NULL) {
+      return false;
+    }
+
+    sensor_paths->items = items;
+    sensor_paths->capacity = capacity;
+  }
+
+  char *path_copy = strdup(path);
+
+  if (path_copy == NULL) {
+    return false;
+  }
+
+  sensor_paths->items[sensor_paths->count++] = (sensor_path_t){.path = path_copy, .label_index = label_index};
+
+  return true;
+}
+
+static void sensor_paths_free(sensor_paths_t *sensor_paths) {
+  for (usize path_index = 0; path_index < sensor_paths->count; path_index++) {
+    free(sensor_paths->items[path_index].path);
+  }
+
+  free(sensor_paths->items);
+}
+
+/* returns index of label in configured sensors, 0 if all sensors are shown, SIZE_MAX if sensor isn't shown */
+static usize find_label(module_temperature_config_t const *config, char const *label) {
+  if (config->sensors_count == 0) {
+    return 0;
+  }
+
+  for (usize sensor_index = 0; sensor_index < config->sensors_count; sensor_index++) {
+    if (strcmp(config->sensors[sensor_index], label) == 0) {
+      return sensor_index;
+    }
+  }
+
+  return SIZE_MAX;
+}
+
+/* returns true if snprintf output of length fit into size bytes */
+static inline bool is_path_formatted(int length, usize size) {
+  return length >= 0 && (usize)length < size;
+}
+
+/* adds temp*_input of one hwmon device whose label (or hwmon name if sensor has none) is shown */
+static bool discover_device(module_temperature_config_t const *config, char const *device_path,
+                            sensor_paths_t *sensor_paths) {
+  char path[PATH_MAX];
+  char name[MAX_LABEL_LENGTH] = "";
+  char label[MAX_LABEL_LENGTH];
+
+  if (!is_path_formatted(snprintf(path, sizeof(path), "%s/name", device_path), sizeof(path))) {
+    log_warn("Path of %s is too long", device_path);
+    return true;
+  }
+
+  read_line(path, name, sizeof(name));
+
+  DIR *directory = opendir(device_path);
+
+  if (directory == NULL) {
+    return true;
+  }
+
+  bool status = true;
+
+  for (struct dirent const *entry = readdir(directory); entry != NULL && status; entry = readdir(directory)) {
+    unsigned int channel = 0;
+    int length = 0;
+
+    /* "temp<channel>_input" */
+    if (sscanf(entry->d_name, "temp%u_input%n", &channel, &length) != 1 || entry->d_name[length] != '\0') {
+      continue;
+    }
+
+    if (!is_path_formatted(snprintf(path, sizeof(path), "%s/temp%u_label", device_path, channel), sizeof(path))) {
+      log_warn("Path of %s/%s is too long", device_path, entry->d_name);
+      continue;
+    }
+
+    usize const label_index = find_label(config, read_line(path, label, sizeof(label)) ? label : name);
+
+    if (label_index == SIZE_MAX) {
+      continue;
+    }
+
+    if (!is_path_formatted(snprintf(path, sizeof(path), "%s/%s", device_path, entry->d_name), sizeof(path))) {
+      log_warn("Path of %s/%s is too long", device_path, entry->d_name);
+      continue;
+    }
+
+    status = sensor_paths_add(sensor_paths, path, label_index);
+  }
+
+  closedir(directory);
+
+  return status;
+}
+
+/* walks <sysfs_root>/class/hwmon once, sensors appearing later aren't picked up */
+static bool discover_sensors(module_temperature_config_t const *config, sensor_paths_t *sensor_paths) {
+  char hwmon_path[PATH_MAX];
+  char device_path[PATH_MAX];
+
+  if (!is_path_formatted(snprintf(hwmon_path, sizeof(hwmon_path), "%s/class/hwmon", config->sysfs_root),
+                         sizeof(hwmon_path))) {
+    log_error("Path of sysfs root %s is too long", config->sysfs_root);
+    return false;
+  }
+
+  DIR *directory = opendir(hwmon_path);
+
+  if (directory == NULL) {
+    log_error("Failed to open %s: %s", hwmon_path, strerror(errno));
+    return false;
+  }
+
+  bool status = true;
+
+  for (struct dirent const *entry = readdir(directory); entry != NULL && status; entry = readdir(directory)) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+
+    if (!is_path_formatted(snprintf(device_path, sizeof(device_path), "%s/%s", hwmon_path, entry->d_name),
+                           sizeof(device_path))) {
+      log_warn("Path of %s/%s is too long", hwmon_path, entry->d_name);
+      continue;
+    }
+
+    status = discover_device(config, device_path, sensor_paths);
+  }
+
+  closedir(directory);
+
+  return status;
+}
+
+static void private_destruct(private_t *private) {
+  utils_fs_batch_destruct(&private->batch);
+
+  if (private->readers != NULL) {
+    for (usize sensor_index = 0; sensor_index < private->sensors_count; sensor_index++) {
+      utils_fs_reader_close(&private->readers[sensor_index]);
+    }
+  }
+
+  if (private->placeholders != NULL) {
+    for (usize value_index = VALUES_COUNT; value_index < private->values_count; value_index++) {
+      free(private->placeholders[value_index - VALUES_COUNT]);
+    }
+  }
+
+  free(private->readers);
+  free(private->buffers);
+  free(private->label_indexes);
+  free(private->values);
+  free(private->placeholders);
+  free(private->value_strings);
+  free(private->formatters);
+}
+
+static bool private_open_sensors(private_t *private, sensor_paths_t const *sensor_paths) {
+  usize const count = sensor_paths->count != 0 ? sensor_paths->count : 1;
+
+  private->readers = calloc(count, sizeof(*private->readers));
+  private->buffers = calloc(count, sizeof(*private->buffers));
+  private->label_indexes = calloc(count, sizeof(*private->label_indexes));
+
+  if (private->readers == NULL || private->buffers == NULL || private->label_indexes == NULL) {
+    log_error("Failed to allocate sensors");
+    return false;
+  }
+
+  for (usize path_index = 0; path_index < sensor_paths->count; path_index++) {
+    usize const sensor_index = private->sensors_count;
+
+    if (!utils_fs_reader_open(&private->readers[sensor_index], sensor_paths->items[path_index].path,
+                              private->buffers[sensor_index], sizeof(private->buffers[sensor_index]))) {
+      log_warn("Failed to open %s: %s", sensor_paths->items[path_index].path, strerror(errno));
+      continue;
+    }
+
+    private->label_indexes[sensor_index] = sensor_paths->items[path_index].label_index;
+    private->sensors_count++;
+  }
+
+  /* per-tick cost is one pass of preads over open fds */
+  return utils_fs_batch_construct(&private->batch, private->readers, private->sensors_count, false);
+}
+
+/* formatters point to value strings, which are rewritten on every render */
+static bool private_build_formatters(private_t *private, module_temperature_config_t const *config) {
+  private->values_count = VALUES_COUNT + config->sensors_count;
+  private->values = calloc(private->values_count, sizeof(*private->values));
+  private->value_strings = calloc(private->values_count, sizeof(*private->value_strings));
+  private->formatters = calloc(private->values_count + 1, sizeof(*private->formatters));
+  private->placeholders = calloc(config->sensors_count != 0 ? config->sensors_count : 1,
+                                 sizeof(*private->placeholders));
+
+  if (private->values == NULL || private->value_strings == NULL || private->formatters == NULL ||
+      private->placeholders == NULL) {
+    return false;
+  }
+
+  private->formatters[VALUE_MAX][0] = "%max%";
+  private->formatters[VALUE_AVG][0] = "%avg%";
+
+  for (usize sensor_index = 0; sensor_index < config->sensors_count; sensor_index++) {
+    static char const *placeholder_format = "%%%s%%";
+    usize const placeholder_size = (usize)strfsize(placeholder_format, config->sensors[sensor_index]);
+    char *placeholder = malloc(placeholder_size + 1);
+
+    if (placeholder == NULL) {
+      return false;
+    }
+
+    snprintf(placeholder, placeholder_size + 1, placeholder_format, config->sensors[sensor_index]);
+
+    private->placeholders[sensor_index] = placeholder;
+    private->formatters[VALUES_COUNT + sensor_index][0] = placeholder;
+  }
+
+  for (usize value_index = 0; value_index < private->values_count; value_index++) {
+    private->formatters[value_index][1] = private->value_strings[value_index];
+  }
+
+  return true;
+}
+
+static bool private_construct(private_t *private, module_temperature_config_t const *config) {
+  *private = (private_t){0};
+
+  sensor_paths_t sensor_paths = {0};
+  bool status = false;
+
+  if (!private_build_formatters(private, config)) {
+    log_error("Failed to allocate formatters");
+    goto free_paths;
+  }
+
+  if (!discover_sensors(config, &sensor_paths) || !private_open_sensors(private, &sensor_paths)) {
+    goto free_paths;
+  }
+
+  if (private->sensors_count == 0) {
+    log_warn("No temperature sensors found");
+  }
+
+  status = true;
+
+free_paths:
+  sensor_paths_free(&sensor_paths);
+
+  if (!status) {
+    private_destruct(private);
+  }
+
+  return status;
+}
+
+/* one batch of preads, no allocations, sensors failing to read (e.g powered down device) are skipped */
+static void private_sample(private_t *private) {
+  i32 *values = private->values;
+  i64 sum = 0;
+  i64 count = 0;
+
+  utils_fs_batch_refresh(&private->batch);
+
+  for (usize value_index = 0; value_index < private->values_count; value_index++) {
+    values[value_index] = MISSING_VALUE;
+  }
+
+  for (usize sensor_index = 0; sensor_index < private->sensors_count; sensor_index++) {
+    i64 value = 0;
+
+    if (!utils_fs_reader_get_i64(&private->readers[sensor_index], &value) || value < INT32_MIN + 1 ||
+        value > INT32_MAX) {
+      continue;
+    }
+
+    i32 const temperature = (i32)value;
+    usize const label_value_index = VALUES_COUNT + private->label_indexes[sensor_index];
+
+    sum += temperature;
+    count++;
+
+    if (temperature > values[VALUE_MAX]) {
+      values[VALUE_MAX] = temperature;
+    }
+
+    if (label_value_index < private->values_count && temperature > values[label_value_index]) {
+      values[label_value_index] = temperature;
+    }
+  }
+
+  if (count != 0) {
+    values[VALUE_AVG] = (i32)(sum / count);
+  }
+}
+
+/* millidegrees rounded to whole degrees, half away from zero */
+static void format_value(i32 value, char *buffer, usize size) {
+  if (value == MISSING_VALUE) {
+    snprintf(buffer, size, "-");
+    return;
+  }
+
+  i32 const degrees = value >= 0 ? (value + 500) / 1000 : (value - 500) / 1000;
+
+  snprintf(buffer, size, "%d", degrees);
+}
+
+static inline bool update_module(module_t *module, module_temperature_config_t const *config, private_t *private) {
+  for (usize value_index = 0; value_index < private->values_count; value_index++) {
+    format_value(private->values[value_index], private->value_strings[value_index],
+                 sizeof(private->value_strings[value_index]));
+  }
+
+  return module_update(module, config->format, private->formatters);
+}
+
+/* trace event payload: i32 per value, count of values depends on configured labels */
+static void record_values(module_t *module, private_t const *private) {
+  if (!module_is_recording(module)) {
+    return;
+  }
+
+  usize const length = private->values_count * sizeof(u32);
+  u8 *payload = malloc(length);
+
+  if (payload == NULL) {
+    log_error("Failed to allocate trace event");
+    return;
+  }
+
+  u8 *cursor = payload;
+
+  for (usize value_index = 0; value_index < private->values_count; value_index++) {
+    cursor = trace_put_u32(cursor, (u32)private->values[value_index]);
+  }
+
+  module_record(module, payload, length);
+  free(payload);
+}
+
+static bool sample_and_update(module_t *module, module_temperature_config_t const *config, private_t *private) {
+  module_mark_event(module);
+  private_sample(private);
+  record_values(module, private);
+
+  if (!update_module(module, config, private)) {
+    log_error("Failed to update module");
+    return false;
+  }
+
+  return true;
+}
+
+int module_temperature_run(module_t *module) {
+  int status = EXIT_FAILURE;
+
+  module_temperature_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    goto done;
+  }
+
+  private_t private;
+
+  if (!private_construct(&private, config)) {
+    goto free_config;
+  }
+
+  utils_time_clock_t *clock = module_get_clock(module);
+  utils_time_timer_t timer;
+
+  if (!utils_time_clock_timer_construct(clock, &timer)) {
+    log_error("Failed to create timer");
+    goto destruct_private;
+  }
+
+  int abort_file_descriptor = module_get_abort_file_descriptor(module);
+
+  if (abort_file_descriptor == -1) {
+    log_error("Failed to get abort file descriptor");
+    goto destruct_timer;
+  }
+
+  if (!sample_and_update(module, config, &private)) {
+    goto destruct_timer;
+  }
+
+  while (true) {
+    u64 const deadline = (utils_time_clock_get_realtime(clock) / config->interval + 1) * config->interval;
+    utils_time_wait_status_t wait_status = utils_time_clock_wait_until(clock, &timer, abort_file_descriptor, deadline);
+
+    if (wait_status == UTILS_TIME_WAIT_FAILED) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      log_error("Failed to wait for timer");
+      goto destruct_timer;
+    }
+
+    module_wakeup(module);
+
+    if (wait_status == UTILS_TIME_WAIT_READABLE) {
+      break;
+    }
+
+    if (!sample_and_update(module, config, &private)) {
+      goto destruct_timer;
+    }
+  }
+
+  status = EXIT_SUCCESS;
+
+destruct_timer:
+  utils_time_clock_timer_destruct(clock, &timer);
+
+destruct_private:
+  private_destruct(&private);
+
+free_config:
+  config_free(config);
+
+done:
+  return status;
+}
+
+int module_temperature_replay(module_t *module) {
+  module_temperature_config_t *config = config_get(module->config);
+
+  if (config == NULL) {
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_FAILURE;
+  private_t private = {0};
+
+  if (!private_build_formatters(&private, config)) {
+    log_error("Failed to allocate formatters");
+    goto destruct_private;
+  }
+
+  void const *payload = NULL;
+  usize length = 0;
+
+  status = EXIT_SUCCESS;
+
+  while (module_replay_next(module, &payload, &length)) {
+    if (length != private.values_count * sizeof(u32)) {
+      log_error("Invalid temperature trace event");
+      status = EXIT_FAILURE;
+      break;
+    }
+
+    u8 const *cursor = payload;
+
+    for (usize value_index = 0; value_index < private.values_count; value_index++) {
+      u32 value = 0;
+      cursor = trace_get_u32(cursor, &value);
+      private.values[value_index] = (i32)value;
+    }
+
+    module_mark_event(module);
+
+    if (!update_module(module, config, &private)) {
+      log_error("Failed to update module");
+      status = EXIT_FAILURE;
+      break;
+    }
+  }
+
+destruct_private:
+  private_destruct(&private);
+  config_free(config);
+
+  return status;
+}
@@ -0,0 +1,47 @@
+#include "profile.h"
+
+#include <sys/resource.h>
+
+#include "metrics.h"
+
+static inline double get_seconds(struct timeval time) {
+  return (double)time.tv_sec + (double)time.tv_usec / 1e6;
+}
+
+void profile_print(status_line_t const *status_line, u64 elapsed_ms, FILE *stream) {
+  metrics_t const *metrics = &status_line->metrics;
+
+  struct rusage usage = {0};
+  getrusage(RUSAGE_SELF, &usage);
+
+  double const user_time = get_seconds(usage.ru_utime);
+  double const system_time = get_seconds(usage.ru_stime);
+  double const elapsed = (double)elapsed_ms / 1000;
+
+  u64 wakeups = 0;
+
+  for (usize module_index = 0; module_index < metrics->modules_count; module_index++) {
+    wakeups += metrics_get(&metrics->modules[module_index].wakeups);
+  }
+
+  fprintf(stream, "duration:      %.3f s\n", elapsed);
+  fprintf(stream, "cpu time:      %.3f s (user %.3f s, system %.3f s, %.3f%% of one cpu)\n", user_time + system_time,
+          user_time, system_time, elapsed > 0 ? (user_time + system_time) / elapsed * 100 : 0);
+  fprintf(stream, "wakeups:       %lu (%.2f/s)\n", (unsigned long)wakeups,
+          elapsed > 0 ? (double)wakeups / elapsed : 0);
+  fprintf(stream, "frames:        %lu\n", (unsigned long)metrics_get(&metrics->global->frames));
+  fprintf(stream, "peak rss:      %ld KiB\n", usage.ru_maxrss);
+  fprintf(stream, "\n%-4s %-16s %10s %10s %10s %10s %10s %10s\n", "IDX", "MODULE", "UPDATES", "SUPPRESSED", "RENDERS",
+          "WAKEUPS", "ERRORS", "CPU(s)");
+
+  for (usize module_index = 0; module_index < metrics->modules_count; module_index++) {
+    metrics_module_t const *module = &metrics->modules[module_index];
+    char const *module_name = metrics->module_names[module_index];
+
+    fprintf(stream, "%-4lu %-16s %10lu %10lu %10lu %10lu %10lu %10.3f\n", (unsigned long)module_index,
+            module_name != NULL ? module_name : "", (unsigned long)metrics_get(&module->updates),
+            (unsigned long)metrics_get(&module->suppressed_updates), (unsigned long)metrics_get(&module->renders),
+            (unsigned long)metrics_get(&module->wakeups), (unsigned long)metrics_get(&module->errors),
+            (double)metrics_get(&module->cpu_time) / 1e9);
+  }
+}
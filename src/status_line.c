@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include "status_line.h"
 
 #include <errno.h>
@@ -8,6 +10,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/eventfd.h>
+#include <time.h>
 #include <unistd.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_aux.h>
@@ -16,22 +19,310 @@
 
 #include "log.h"
 #include "macros.h"
+#include "metrics.h"
 #include "module.h"
+#include "thread_profile.h"
+#include "utils/time.h"
 
-static volatile bool is_aborted = false;
+static volatile sig_atomic_t is_aborted = 0;
+static volatile sig_atomic_t is_metrics_dump_requested = 0;
 
 static void signal_handler(int sig) {
   is_aborted = sig;
 }
 
+static void metrics_signal_handler(int sig) {
+  (void)sig;
+  is_metrics_dump_requested = 1;
+}
+
+static void dump_requested_metrics(status_line_t const *status_line, char const *metrics_dump_path) {
+  if (!is_metrics_dump_requested) {
+    return;
+  }
+
+  is_metrics_dump_requested = 0;
+
+  if (metrics_dump_path == NULL) {
+    log_warn("Metrics dump requested without metrics dump path");
+  } else if (!metrics_dump(&status_line->metrics, metrics_dump_path)) {
+    log_error("Failed to dump metrics");
+  }
+}
+
 static void *module_thread(void *param) {
   module_t *const module = param;
 
+  /* module runs without its nice value rather than not at all */
+  if (!thread_profile_apply_current(&module->thread_profile)) {
+    log_warn("Module \"%s\" runs without its thread profile", module->status_line->metrics.module_names[module->index]);
+  }
+
   int status = module->run(module);
 
+  /* wakeups account thread at most every interval, last one may be missed */
+  metrics_account_thread(module->metrics);
+
+  if (status != EXIT_SUCCESS) {
+    metrics_add(&module->metrics->errors, 1);
+  }
+
+  /* release replay driver waiting for module which stopped before the end of trace */
+  if (module->status_line->trace_reader != NULL) {
+    module_replay_close(module);
+  }
+
+  /* notify supervisor */
+  write(module->supervisor.exit_file_descriptor, &(u64){1}, sizeof(u64));
+
   pthread_exit(&status);
 }
 
+typedef struct supervisor_options {
+  u64 restart_delay;     /* nanoseconds before first restart of exited module */
+  u64 max_restart_delay; /* nanoseconds, restart delay doubles with every consecutive exit up to it */
+  u64 stable_time;       /* nanoseconds of uptime after which exit counts as first one again */
+} supervisor_options_t;
+
+static bool parse_supervisor_duration(toml_table_t const *table, char const *key, u64 *duration) {
+  toml_value_t value = toml_table_string(table, key);
+
+  if (!value.ok) {
+    return true;
+  }
+
+  u64 milliseconds = 0;
+  bool status = utils_time_parse_duration(value.u.s, &milliseconds);
+
+  if (!status) {
+    log_error("Invalid supervisor %s \"%s\"", key, value.u.s);
+  }
+
+  *duration = milliseconds * 1000000;
+  free(value.u.s);
+
+  return status;
+}
+
+static bool parse_supervisor_options(supervisor_options_t *options, toml_table_t const *table) {
+  *options = (supervisor_options_t){
+    .restart_delay = 1000000000UL,
+    .max_restart_delay = 300 * 1000000000UL,
+    .stable_time = 60 * 1000000000UL,
+  };
+
+  if (table == NULL) {
+    return true;
+  }
+
+  if (!parse_supervisor_duration(table, "restart_delay", &options->restart_delay) ||
+      !parse_supervisor_duration(table, "max_restart_delay", &options->max_restart_delay) ||
+      !parse_supervisor_duration(table, "stable_time", &options->stable_time)) {
+    return false;
+  }
+
+  /* module exiting right after start would be restarted in a busy loop */
+  if (options->restart_delay == 0) {
+    log_error("Invalid supervisor restart_delay, must be greater than zero");
+    return false;
+  }
+
+  if (options->max_restart_delay < options->restart_delay) {
+    log_error("Invalid supervisor max_restart_delay, must not be less than restart_delay");
+    return false;
+  }
+
+  return true;
+}
+
+/* xorshift64, only spreads restarts of modules failing together (e.g on X server restart) */
+static u64 get_jitter(u64 range) {
+  static u64 state = 0;
+
+  if (state == 0) {
+    state = utils_time_get_monotonic_nanoseconds() | 1;
+  }
+
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+
+  return range != 0 ? state % range : 0;
+}
+
+static bool start_module(module_t *module) {
+  pthread_attr_t thread_attributes;
+
+  if (pthread_attr_init(&thread_attributes) != 0) {
+    log_error("Failed to initialize thread attributes");
+    return false;
+  }
+
+  if (!thread_profile_set_attributes(&module->thread_profile, &thread_attributes)) {
+    pthread_attr_destroy(&thread_attributes);
+    return false;
+  }
+
+  /* signals are handled by status line thread, module threads inherit blocked mask */
+  sigset_t signals, previous_signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGUSR2);
+
+  pthread_sigmask(SIG_BLOCK, &signals, &previous_signals);
+
+  int create_status = pthread_create(&module->supervisor.thread, &thread_attributes, module_thread, module);
+
+  pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+  pthread_attr_destroy(&thread_attributes);
+
+  if (create_status != 0) {
+    log_error("Failed to create module thread");
+    return false;
+  }
+
+  module->supervisor.is_running = true;
+  module->supervisor.start_time = utils_time_get_monotonic_nanoseconds();
+  module->supervisor.restart_time = 0;
+  metrics_set(&module->metrics->up, 1);
+
+  return true;
+}
+
+/* exponential backoff with equal jitter: half of delay is fixed, other half random */
+static void schedule_restart(module_t *module, supervisor_options_t const *options, u64 now) {
+  module_supervisor_t *supervisor = &module->supervisor;
+
+  u64 delay = options->restart_delay;
+
+  for (u32 failure = 0; failure < supervisor->failures && delay < options->max_restart_delay; failure++) {
+    delay *= 2;
+  }
+
+  if (delay > options->max_restart_delay) {
+    delay = options->max_restart_delay;
+  }
+
+  delay = delay / 2 + get_jitter(delay / 2 + 1);
+
+  supervisor->failures += 1;
+  supervisor->restart_time = now + delay;
+
+  log_warn("Module \"%s\" exited, restarting in %lu ms", module->status_line->metrics.module_names[module->index],
+           (unsigned long)(delay / 1000000));
+}
+
+static void handle_module_exit(status_line_t *status_line, module_t *module, supervisor_options_t const *options) {
+  module_supervisor_t *supervisor = &module->supervisor;
+  u64 value;
+
+  if (read(supervisor->exit_file_descriptor, &value, sizeof(value)) != sizeof(value) || !supervisor->is_running) {
+    return;
+  }
+
+  pthread_join(supervisor->thread, NULL);
+
+  u64 const now = utils_time_get_monotonic_nanoseconds();
+
+  supervisor->is_running = false;
+  supervisor->exit_time = now;
+  metrics_set(&module->metrics->up, 0);
+
+  if (now - supervisor->start_time >= options->stable_time) {
+    supervisor->failures = 0;
+  }
+
+  /* stale text of exited module would stay on status line until restart */
+  module_clear(module);
+  status_line_update(status_line);
+
+  schedule_restart(module, options, now);
+}
+
+static void restart_modules(status_line_t *status_line, supervisor_options_t const *options, u64 now) {
+  for (usize module_index = 0; module_index < status_line->modules_count; module_index++) {
+    module_t *module = &status_line->modules[module_index];
+    module_supervisor_t *supervisor = &module->supervisor;
+
+    if (supervisor->is_running || supervisor->restart_time == 0 || supervisor->restart_time > now) {
+      continue;
+    }
+
+    metrics_add(&module->metrics->downtime, now - supervisor->exit_time);
+    module->event_time = 0;
+
+    if (!start_module(module)) {
+      supervisor->exit_time = now;
+      schedule_restart(module, options, now);
+      continue;
+    }
+
+    metrics_add(&module->metrics->restarts, 1);
+  }
+}
+
+static u64 get_next_restart_time(status_line_t const *status_line) {
+  u64 restart_time = 0;
+
+  for (usize module_index = 0; module_index < status_line->modules_count; module_index++) {
+    module_supervisor_t const *supervisor = &status_line->modules[module_index].supervisor;
+
+    if (!supervisor->is_running && supervisor->restart_time != 0 &&
+        (restart_time == 0 || supervisor->restart_time < restart_time)) {
+      restart_time = supervisor->restart_time;
+    }
+  }
+
+  return restart_time;
+}
+
+static bool check_trace_modules(trace_reader_t const *trace_reader, config_t const *config) {
+  if (trace_reader->modules_count != config->modules_count) {
+    log_error("Trace has %u modules, config has %lu", trace_reader->modules_count, (unsigned long)config->modules_count);
+    return false;
+  }
+
+  for (usize module_index = 0; module_index < config->modules_count; module_index++) {
+    if (strcmp(trace_reader->keys[module_index], config->modules[module_index].key) != 0) {
+      log_error("Trace module %lu is \"%s\", config module is \"%s\"", (unsigned long)module_index,
+                trace_reader->keys[module_index], config->modules[module_index].key);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* hands trace events to module threads one at a time, so frames follow recorded event order */
+static void replay_trace(status_line_t *status_line) {
+  trace_reader_t *trace_reader = status_line->trace_reader;
+  u64 const start_time = utils_time_get_monotonic_nanoseconds();
+  trace_event_t event;
+
+  while (!is_aborted && trace_reader_next(trace_reader, &event)) {
+    if (!status_line->is_replay_fast) {
+      u64 const event_time = start_time + event.time_us * 1000;
+      struct timespec const event_timespec = {
+        .tv_sec = (time_t)(event_time / 1000000000),
+        .tv_nsec = (long)(event_time % 1000000000),
+      };
+
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &event_timespec, NULL) == EINTR && !is_aborted) {
+      }
+
+      if (is_aborted) {
+        break;
+      }
+    }
+
+    module_replay_deliver(&status_line->modules[event.module_index], event.payload, event.length);
+  }
+
+  for (usize module_index = 0; module_index < status_line->modules_count; module_index++) {
+    module_replay_close(&status_line->modules[module_index]);
+  }
+}
+
 static void update_wmname(xcb_connection_t *connection, char const *buffer, u32 length) {
   xcb_setup_t const *setup = xcb_get_setup(connection);
   xcb_window_t const root_window = xcb_setup_roots_iterator(setup).data->root;
@@ -97,12 +388,16 @@ static char *concatenate_buffers(status_line_t *status_line, usize buffer_length
   return buffer;
 }
 
-bool status_line_construct(status_line_t *status_line, usize modules_count) {
-  status_line->connection = xcb_connect(NULL, NULL);
+bool status_line_construct(status_line_t *status_line, usize modules_count, status_line_output_t output) {
+  status_line->output = output;
 
-  if (xcb_connection_has_error(status_line->connection)) {
-    log_error("Failed connect to X server");
-    goto error;
+  if (output == STATUS_LINE_OUTPUT_X11) {
+    status_line->connection = xcb_connect(NULL, NULL);
+
+    if (xcb_connection_has_error(status_line->connection)) {
+      log_error("Failed connect to X server");
+      goto error;
+    }
   }
 
   status_line->abort_file_descriptor = eventfd(0, 0);
@@ -112,7 +407,7 @@ bool status_line_construct(status_line_t *status_line, usize modules_count) {
     goto error;
   }
 
-  status_line->modules = malloc(modules_count * sizeof(module_t));
+  status_line->modules = calloc(modules_count, sizeof(module_t));
   status_line->modules_count = modules_count;
 
   if (status_line->modules == NULL) {
@@ -120,6 +415,10 @@ bool status_line_construct(status_line_t *status_line, usize modules_count) {
     goto error;
   }
 
+  if (!metrics_construct(&status_line->metrics, modules_count)) {
+    goto error;
+  }
+
   if (pthread_mutex_init(&status_line->lock, NULL) != 0) {
     log_error("Failed to create mutex");
     goto error;
@@ -136,24 +435,80 @@ error:
 bool status_line_run(status_line_t *status_line, config_t const *config) {
   bool status = false;
 
-  { /* handle sigint */
+  { /* handle sigint and sigusr2 (metrics dump) */
     struct sigaction act = {0};
     act.sa_handler = signal_handler;
     sigemptyset(&act.sa_mask);
 
-    if (sigaction(SIGINT, &act, NULL) == -1) {
+    struct sigaction metrics_act = {0};
+    metrics_act.sa_handler = metrics_signal_handler;
+    sigemptyset(&metrics_act.sa_mask);
+
+    if (sigaction(SIGINT, &act, NULL) == -1 || sigaction(SIGUSR2, &metrics_act, NULL) == -1) {
       log_error("Failed to setup signals");
       goto done;
     }
   }
 
-  pthread_t *thread_ids = malloc(status_line->modules_count * sizeof(*thread_ids));
+  if (status_line->trace_reader != NULL && !check_trace_modules(status_line->trace_reader, config)) {
+    goto done;
+  }
+
+  supervisor_options_t supervisor_options;
 
-  if (thread_ids == NULL) {
-    log_error("Failed to allocate threads");
+  if (!parse_supervisor_options(&supervisor_options, config->supervisor)) {
     goto done;
   }
 
+  char *metrics_socket_path = NULL;
+  char *metrics_dump_path = NULL;
+  int metrics_file_descriptor = -1;
+
+  if (config->metrics != NULL) {
+    toml_value_t socket_path = toml_table_string(config->metrics, "socket");
+    toml_value_t dump_path = toml_table_string(config->metrics, "dump");
+
+    metrics_socket_path = socket_path.ok ? socket_path.u.s : NULL;
+    metrics_dump_path = dump_path.ok ? dump_path.u.s : NULL;
+  }
+
+  if (metrics_socket_path != NULL) {
+    metrics_file_descriptor = metrics_listen(metrics_socket_path);
+
+    if (metrics_file_descriptor == -1) {
+      goto free_metrics;
+    }
+  }
+
+  thread_profile_t default_thread_profile = {0};
+
+  if (!thread_profile_parse(&default_thread_profile, config->thread)) {
+    log_error("Failed to parse default thread profile");
+    goto free_metrics;
+  }
+
+  /* pin status line thread itself to the default profile (e.g housekeeping cores) */
+  if (!thread_profile_apply_self(&default_thread_profile)) {
+    log_warn("Status line thread runs without default thread profile");
+  }
+
+  /* abort and metrics file descriptors followed by exit file descriptor of every module */
+  usize const poll_file_descriptors_count = 2 + status_line->modules_count;
+  struct pollfd *poll_file_descriptors = calloc(poll_file_descriptors_count, sizeof(*poll_file_descriptors));
+
+  if (poll_file_descriptors == NULL) {
+    log_error("Failed to allocate poll file descriptors");
+    goto free_metrics;
+  }
+
+  /* sigint and sigusr2 are only let in while poll waits, so a signal arriving anywhere else in the loop (e.g in
+     metrics_serve) interrupts the next poll instead of waiting for another one */
+  sigset_t loop_signals, poll_signals;
+  sigemptyset(&loop_signals);
+  sigaddset(&loop_signals, SIGINT);
+  sigaddset(&loop_signals, SIGUSR2);
+  pthread_sigmask(SIG_BLOCK, &loop_signals, &poll_signals);
+
   for (usize module_index = 0; module_index < status_line->modules_count; module_index++) {
     config_module_t const *const config_module = &config->modules[module_index];
 
@@ -161,51 +516,124 @@ bool status_line_run(status_line_t *status_line, config_t const *config) {
 
     if (!module_construct(module, status_line, config_module->key, config_module->config)) {
       log_error("Failed to initialize module");
-      goto free_threads;
+      goto stop_modules;
     }
 
-    if (pthread_create(&thread_ids[module_index], NULL, module_thread, module) != 0) {
-      log_error("Failed to create module thread");
-      goto free_threads;
+    module->thread_profile = default_thread_profile;
+
+    if (!thread_profile_parse(&module->thread_profile, config_module->thread)) {
+      log_error("Failed to parse module thread profile");
+      goto stop_modules;
     }
+
+    if (!start_module(module)) {
+      goto stop_modules;
+    }
+
+    poll_file_descriptors[2 + module_index] = (struct pollfd){
+      .fd = module->supervisor.exit_file_descriptor,
+      .events = POLLIN,
+    };
   }
 
-  struct pollfd poll_file_descriptors[] = {
-    {.fd = status_line->abort_file_descriptor, .events = POLLIN},
-  };
+  if (status_line->trace_reader != NULL) {
+    /* replay sleeps in clock_nanosleep and needs sigint delivered there */
+    pthread_sigmask(SIG_SETMASK, &poll_signals, NULL);
+    replay_trace(status_line);
+    status = true;
+    goto stop_modules;
+  }
+
+  poll_file_descriptors[0] = (struct pollfd){.fd = status_line->abort_file_descriptor, .events = POLLIN};
+  poll_file_descriptors[1] = (struct pollfd){.fd = metrics_file_descriptor, .events = POLLIN};
+
+  u64 const deadline = status_line->duration_ms != 0
+                         ? utils_time_get_monotonic_nanoseconds() + status_line->duration_ms * 1000000
+                         : 0;
 
   while (!is_aborted) {
-    int poll_status = poll(poll_file_descriptors, countof(poll_file_descriptors), -1);
+    dump_requested_metrics(status_line, metrics_dump_path);
+
+    u64 const now = utils_time_get_monotonic_nanoseconds();
+
+    if (deadline != 0 && now >= deadline) {
+      break;
+    }
+
+    restart_modules(status_line, &supervisor_options, now);
+
+    u64 wake_time = get_next_restart_time(status_line);
+
+    if (deadline != 0 && (wake_time == 0 || deadline < wake_time)) {
+      wake_time = deadline;
+    }
+
+    /* round up, so poll doesn't return just before wake time */
+    u64 const timeout = wake_time == 0 ? 0 : (wake_time - now + 999999) / 1000000 * 1000000;
+    struct timespec const timeout_timespec = {.tv_sec = (time_t)(timeout / 1000000000),
+                                              .tv_nsec = (long)(timeout % 1000000000)};
+
+    int poll_status = ppoll(poll_file_descriptors, poll_file_descriptors_count,
+                            wake_time == 0 ? NULL : &timeout_timespec, &poll_signals);
 
     if (poll_status < 0) {
-      if (errno == EINTR) {
-        continue;
+      if (errno != EINTR) {
+        log_error("poll()");
+        goto stop_modules;
       }
 
-      log_error("poll()");
-      goto free_threads;
+      continue;
+    }
+
+    if (poll_file_descriptors[1].revents & POLLIN) {
+      metrics_serve(&status_line->metrics, metrics_file_descriptor);
     }
 
-    log_error("close file descriptor writed from module");
-    break;
+    if (poll_file_descriptors[0].revents & POLLIN) {
+      log_error("close file descriptor writed from module");
+      break;
+    }
+
+    for (usize module_index = 0; module_index < status_line->modules_count; module_index++) {
+      if (poll_file_descriptors[2 + module_index].revents & POLLIN) {
+        handle_module_exit(status_line, &status_line->modules[module_index], &supervisor_options);
+      }
+    }
   }
 
+  status = true;
+
+stop_modules:
+  pthread_sigmask(SIG_SETMASK, &poll_signals, NULL);
+
   /* send a message to exit modules */
   write(status_line->abort_file_descriptor, &(u64){1}, sizeof(u64));
 
   for (usize module_index = 0; module_index < status_line->modules_count; module_index += 1) {
-    pthread_t thread = thread_ids[module_index];
+    module_t *module = &status_line->modules[module_index];
+
+    if (!module->supervisor.is_running) {
+      continue;
+    }
 
-    if (pthread_join(thread, NULL) != 0) {
+    if (pthread_join(module->supervisor.thread, NULL) != 0) {
       log_error("Failed to close module thread");
-      goto free_threads;
+      status = false;
     }
+
+    module->supervisor.is_running = false;
   }
 
-  status = true;
+  free(poll_file_descriptors);
+
+free_metrics:
+  if (metrics_file_descriptor != -1) {
+    close(metrics_file_descriptor);
+    unlink(metrics_socket_path);
+  }
 
-free_threads:
-  free(thread_ids);
+  free(metrics_socket_path);
+  free(metrics_dump_path);
 
 done:
   return status;
@@ -234,23 +662,29 @@ void status_line_destruct(status_line_t *status_line) {
     close(status_line->abort_file_descriptor);
   }
 
+  metrics_destruct(&status_line->metrics);
   pthread_mutex_destroy(&status_line->lock);
 }
 
-void status_line_update(status_line_t *status_line) {
+bool status_line_update(status_line_t *status_line) {
   u32 const buffer_length = (u32)calculate_new_length(status_line);
 
-  if (buffer_length == 0) {
-    return;
-  }
-
+  /* empty frame still replaces text of modules that were cleared */
   char *buffer = concatenate_buffers(status_line, buffer_length);
 
   if (buffer == NULL) {
-    return;
+    return false;
+  }
+
+  if (status_line->output == STATUS_LINE_OUTPUT_X11) {
+    update_wmname(status_line->connection, buffer, buffer_length);
+    metrics_add(&status_line->metrics.global->flushes, 1);
   }
 
-  update_wmname(status_line->connection, buffer, buffer_length);
+  metrics_add(&status_line->metrics.global->frames, 1);
+  metrics_set(&status_line->metrics.global->line_length, buffer_length);
 
   free(buffer);
+
+  return true;
 }
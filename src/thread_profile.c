@@ -0,0 +1,261 @@
+#define _GNU_SOURCE
+
+#include "thread_profile.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define LOG_MODULE "thread"
+
+#include "log.h"
+#include "macros.h"
+
+typedef struct scheduler_item {
+  char const *key;
+  thread_profile_scheduler_t scheduler;
+  int policy;
+} scheduler_item_t;
+
+static scheduler_item_t const schedulers[] = {
+  {"other", THREAD_PROFILE_SCHEDULER_OTHER, SCHED_OTHER},
+  {"batch", THREAD_PROFILE_SCHEDULER_BATCH, SCHED_BATCH},
+  {"idle", THREAD_PROFILE_SCHEDULER_IDLE, SCHED_IDLE},
+};
+
+static int get_scheduler_policy(thread_profile_scheduler_t scheduler) {
+  for (usize scheduler_index = 0; scheduler_index < countof(schedulers); scheduler_index++) {
+    if (schedulers[scheduler_index].scheduler == scheduler) {
+      return schedulers[scheduler_index].policy;
+    }
+  }
+
+  return -1;
+}
+
+static bool parse_scheduler(thread_profile_scheduler_t *scheduler, char const *key) {
+  for (usize scheduler_index = 0; scheduler_index < countof(schedulers); scheduler_index++) {
+    if (strcmp(schedulers[scheduler_index].key, key) == 0) {
+      *scheduler = schedulers[scheduler_index].scheduler;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static inline void set_affinity_cpu(thread_profile_t *profile, unsigned long cpu) {
+  profile->affinity[cpu / 64] |= (u64)1 << (cpu % 64);
+}
+
+/* parses decimal cpu number at cursor and moves cursor past it */
+static bool parse_cpu(char const **cursor, unsigned long *cpu) {
+  /* strtoul alone would skip whitespace and accept signs */
+  if (!isdigit((unsigned char)**cursor)) {
+    return false;
+  }
+
+  char *end = NULL;
+
+  errno = 0;
+  *cpu = strtoul(*cursor, &end, 10);
+  *cursor = end;
+
+  return errno == 0;
+}
+
+/* parses non-empty cpu list in taskset format (e.g "0-3,8,10-11") */
+static bool parse_affinity(thread_profile_t *profile, char const *list) {
+  memset(profile->affinity, 0, sizeof(profile->affinity));
+
+  char const *list_ptr = list;
+
+  while (true) {
+    unsigned long first = 0;
+
+    if (!parse_cpu(&list_ptr, &first)) {
+      return false;
+    }
+
+    unsigned long last = first;
+
+    if (*list_ptr == '-') {
+      list_ptr++;
+
+      if (!parse_cpu(&list_ptr, &last)) {
+        return false;
+      }
+    }
+
+    if (first > last || last >= THREAD_PROFILE_MAX_CPUS) {
+      return false;
+    }
+
+    for (unsigned long cpu = first; cpu <= last; cpu++) {
+      set_affinity_cpu(profile, cpu);
+    }
+
+    if (*list_ptr == '\0') {
+      break;
+    }
+
+    /* trailing comma is rejected by the next cpu */
+    if (*list_ptr != ',') {
+      return false;
+    }
+
+    list_ptr++;
+  }
+
+  profile->has_affinity = true;
+
+  return true;
+}
+
+static void fill_cpu_set(thread_profile_t const *profile, cpu_set_t *cpu_set) {
+  CPU_ZERO(cpu_set);
+
+  for (usize cpu = 0; cpu < THREAD_PROFILE_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+    if (profile->affinity[cpu / 64] & ((u64)1 << (cpu % 64))) {
+      CPU_SET(cpu, cpu_set);
+    }
+  }
+}
+
+bool thread_profile_parse(thread_profile_t *profile, toml_table_t const *table) {
+  if (table == NULL) {
+    return true;
+  }
+
+  toml_value_t stack_size = toml_table_int(table, "stack_size");
+
+  if (stack_size.ok) {
+    if (stack_size.u.i < PTHREAD_STACK_MIN) {
+      log_error("Thread stack size must be at least %ld bytes", (long)PTHREAD_STACK_MIN);
+      return false;
+    }
+
+    long const page_size = sysconf(_SC_PAGESIZE);
+    usize const alignment = page_size > 0 ? (usize)page_size : 4096;
+
+    profile->stack_size = ((usize)stack_size.u.i + alignment - 1) / alignment * alignment;
+  }
+
+  toml_value_t scheduler = toml_table_string(table, "scheduler");
+
+  if (scheduler.ok) {
+    bool is_parsed = parse_scheduler(&profile->scheduler, scheduler.u.s);
+
+    if (!is_parsed) {
+      log_error("Unknown thread scheduler \"%s\"", scheduler.u.s);
+    }
+
+    free(scheduler.u.s);
+
+    if (!is_parsed) {
+      return false;
+    }
+  }
+
+  toml_value_t nice = toml_table_int(table, "nice");
+
+  if (nice.ok) {
+    if (nice.u.i < -20 || nice.u.i > 19) {
+      log_error("Thread nice value must be in range [-20, 19]");
+      return false;
+    }
+
+    profile->nice = (int)nice.u.i;
+    profile->has_nice = true;
+  }
+
+  toml_value_t affinity = toml_table_string(table, "affinity");
+
+  if (affinity.ok) {
+    bool is_parsed = parse_affinity(profile, affinity.u.s);
+
+    if (!is_parsed) {
+      log_error("Invalid thread affinity \"%s\"", affinity.u.s);
+    }
+
+    free(affinity.u.s);
+
+    if (!is_parsed) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool thread_profile_set_attributes(thread_profile_t const *profile, pthread_attr_t *attributes) {
+  if (profile->stack_size != 0 && pthread_attr_setstacksize(attributes, profile->stack_size) != 0) {
+    log_error("Failed to set thread stack size");
+    return false;
+  }
+
+  if (profile->scheduler != THREAD_PROFILE_SCHEDULER_INHERIT) {
+    struct sched_param param = {.sched_priority = 0};
+
+    if (pthread_attr_setinheritsched(attributes, PTHREAD_EXPLICIT_SCHED) != 0 ||
+        pthread_attr_setschedpolicy(attributes, get_scheduler_policy(profile->scheduler)) != 0 ||
+        pthread_attr_setschedparam(attributes, &param) != 0) {
+      log_error("Failed to set thread scheduler");
+      return false;
+    }
+  }
+
+  if (profile->has_affinity) {
+    cpu_set_t cpu_set;
+    fill_cpu_set(profile, &cpu_set);
+
+    if (pthread_attr_setaffinity_np(attributes, sizeof(cpu_set), &cpu_set) != 0) {
+      log_error("Failed to set thread affinity");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool thread_profile_apply_current(thread_profile_t const *profile) {
+  /* on linux nice value is a per-thread attribute */
+  if (profile->has_nice && setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), profile->nice) == -1) {
+    log_warn("Failed to set thread nice value: %s", strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+bool thread_profile_apply_self(thread_profile_t const *profile) {
+  bool status = true;
+
+  if (profile->scheduler != THREAD_PROFILE_SCHEDULER_INHERIT) {
+    struct sched_param param = {.sched_priority = 0};
+
+    if (pthread_setschedparam(pthread_self(), get_scheduler_policy(profile->scheduler), &param) != 0) {
+      log_warn("Failed to set thread scheduler");
+      status = false;
+    }
+  }
+
+  if (profile->has_affinity) {
+    cpu_set_t cpu_set;
+    fill_cpu_set(profile, &cpu_set);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0) {
+      log_warn("Failed to set thread affinity");
+      status = false;
+    }
+  }
+
+  return thread_profile_apply_current(profile) && status;
+}
@@ -0,0 +1,327 @@
+#include "top.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_MODULE "top"
+
+#include "log.h"
+#include "macros.h"
+
+#define MAX_MODULE_NAME_LENGTH 32
+
+typedef struct top_sample {
+  double cpu_time;
+  double wakeups;
+  double voluntary_switches;
+  double involuntary_switches;
+  double updates;
+  double latency_p99;
+} top_sample_t;
+
+typedef struct top_entry {
+  char name[MAX_MODULE_NAME_LENGTH];
+  usize index;
+  bool is_present;
+  top_sample_t current;
+  top_sample_t previous;
+  double cpu_usage; /* cpu usage in percent during last interval, used for sorting */
+} top_entry_t;
+
+typedef struct top_field {
+  char const *name;
+  char const *quantile; /* required quantile label, NULL - none */
+  usize offset;
+} top_field_t;
+
+static top_field_t const fields[] = {
+  {"status_line_module_cpu_seconds_total", NULL, offsetof(top_sample_t, cpu_time)},
+  {"status_line_module_wakeups_total", NULL, offsetof(top_sample_t, wakeups)},
+  {"status_line_module_voluntary_context_switches_total", NULL, offsetof(top_sample_t, voluntary_switches)},
+  {"status_line_module_involuntary_context_switches_total", NULL, offsetof(top_sample_t, involuntary_switches)},
+  {"status_line_module_updates_total", NULL, offsetof(top_sample_t, updates)},
+  {"status_line_module_event_latency_seconds", "0.99", offsetof(top_sample_t, latency_p99)},
+};
+
+static char *fetch_metrics(char const *socket_path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    log_error("Metrics socket path is too long");
+    return NULL;
+  }
+
+  strcpy(address.sun_path, socket_path);
+
+  int file_descriptor = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (file_descriptor == -1) {
+    log_error("Failed to create socket");
+    return NULL;
+  }
+
+  char *buffer = NULL;
+  usize buffer_length = 0;
+  usize buffer_size = 0;
+
+  if (connect(file_descriptor, (struct sockaddr const *)&address, sizeof(address)) == -1) {
+    log_error("Failed to connect to \"%s\": %s", socket_path, strerror(errno));
+    goto error;
+  }
+
+  while (true) {
+    if (buffer_size - buffer_length < 4096 + 1) {
+      buffer_size = buffer_size == 0 ? 16384 : buffer_size * 2;
+      char *new_buffer = realloc(buffer, buffer_size);
+
+      if (new_buffer == NULL) {
+        log_error("Failed to allocate metrics buffer");
+        goto error;
+      }
+
+      buffer = new_buffer;
+    }
+
+    isize length = read(file_descriptor, buffer + buffer_length, buffer_size - buffer_length - 1);
+
+    if (length < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (length < 0) {
+      log_error("Failed to read metrics");
+      goto error;
+    }
+
+    if (length == 0) {
+      break;
+    }
+
+    buffer_length += (usize)length;
+  }
+
+  close(file_descriptor);
+  buffer[buffer_length] = '\0';
+
+  return buffer;
+
+error:
+  close(file_descriptor);
+  free(buffer);
+
+  return NULL;
+}
+
+/* copies value of label (e.g module="clock") into buffer, returns false if line has no such label */
+static bool get_label(char const *labels, char const *labels_end, char const *key, char *buffer, usize size) {
+  usize const key_length = strlen(key);
+
+  for (char const *label = labels; label < labels_end; label++) {
+    if (strncmp(label, key, key_length) != 0 || label[key_length] != '=' || label[key_length + 1] != '"') {
+      continue;
+    }
+
+    char const *value = label + key_length + 2;
+    char const *value_end = memchr(value, '"', (usize)(labels_end - value));
+
+    if (value_end == NULL || (usize)(value_end - value) >= size) {
+      return false;
+    }
+
+    memcpy(buffer, value, (usize)(value_end - value));
+    buffer[value_end - value] = '\0';
+
+    return true;
+  }
+
+  return false;
+}
+
+static top_entry_t *get_entry(top_entry_t **entries, usize *entries_count, usize index) {
+  if (index >= *entries_count) {
+    top_entry_t *new_entries = realloc(*entries, (index + 1) * sizeof(**entries));
+
+    if (new_entries == NULL) {
+      return NULL;
+    }
+
+    memset(new_entries + *entries_count, 0, (index + 1 - *entries_count) * sizeof(**entries));
+
+    *entries = new_entries;
+    *entries_count = index + 1;
+  }
+
+  return &(*entries)[index];
+}
+
+static bool parse_line(char const *line, char const *line_end, top_entry_t **entries, usize *entries_count) {
+  char const *labels = memchr(line, '{', (usize)(line_end - line));
+  char const *labels_end = labels != NULL ? memchr(labels, '}', (usize)(line_end - labels)) : NULL;
+
+  if (labels_end == NULL) {
+    return true;
+  }
+
+  for (usize field_index = 0; field_index < countof(fields); field_index++) {
+    top_field_t const *field = &fields[field_index];
+    usize const name_length = strlen(field->name);
+
+    if ((usize)(labels - line) != name_length || strncmp(line, field->name, name_length) != 0) {
+      continue;
+    }
+
+    char quantile[16];
+    bool has_quantile = get_label(labels, labels_end, "quantile", quantile, sizeof(quantile));
+
+    if (field->quantile != NULL ? !has_quantile || strcmp(quantile, field->quantile) != 0 : has_quantile) {
+      continue;
+    }
+
+    char index_string[32];
+    char name[MAX_MODULE_NAME_LENGTH];
+
+    if (!get_label(labels, labels_end, "index", index_string, sizeof(index_string)) ||
+        !get_label(labels, labels_end, "module", name, sizeof(name))) {
+      return true;
+    }
+
+    top_entry_t *entry = get_entry(entries, entries_count, strtoul(index_string, NULL, 10));
+
+    if (entry == NULL) {
+      log_error("Failed to allocate module entry");
+      return false;
+    }
+
+    memcpy(entry->name, name, sizeof(name));
+    entry->is_present = true;
+    *(double *)((char *)&entry->current + field->offset) = strtod(labels_end + 1, NULL);
+
+    return true;
+  }
+
+  return true;
+}
+
+static bool parse_metrics(char const *text, top_entry_t **entries, usize *entries_count) {
+  for (usize entry_index = 0; entry_index < *entries_count; entry_index++) {
+    (*entries)[entry_index].is_present = false;
+  }
+
+  for (char const *line = text; *line != '\0';) {
+    char const *line_end = strchr(line, '\n');
+
+    if (line_end == NULL) {
+      line_end = line + strlen(line);
+    }
+
+    if (*line != '#' && !parse_line(line, line_end, entries, entries_count)) {
+      return false;
+    }
+
+    line = *line_end == '\n' ? line_end + 1 : line_end;
+  }
+
+  return true;
+}
+
+static int compare_entries(void const *first, void const *second) {
+  top_entry_t const *const *first_entry = first;
+  top_entry_t const *const *second_entry = second;
+
+  if ((*first_entry)->cpu_usage != (*second_entry)->cpu_usage) {
+    return (*first_entry)->cpu_usage < (*second_entry)->cpu_usage ? 1 : -1;
+  }
+
+  return (*first_entry)->index < (*second_entry)->index ? -1 : 1;
+}
+
+static void print_entries(top_entry_t *entries, usize entries_count, double interval, bool has_previous) {
+  top_entry_t **sorted = malloc((entries_count + 1) * sizeof(*sorted));
+
+  if (sorted == NULL) {
+    return;
+  }
+
+  usize sorted_count = 0;
+
+  for (usize entry_index = 0; entry_index < entries_count; entry_index++) {
+    top_entry_t *entry = &entries[entry_index];
+
+    if (!entry->is_present) {
+      continue;
+    }
+
+    entry->index = entry_index;
+    entry->cpu_usage = has_previous ? (entry->current.cpu_time - entry->previous.cpu_time) / interval * 100 : 0;
+    sorted[sorted_count++] = entry;
+  }
+
+  qsort(sorted, sorted_count, sizeof(*sorted), compare_entries);
+
+  /* clear screen and move cursor home */
+  printf("\033[H\033[2J");
+  printf("%-4s %-20s %7s %10s %9s %9s %9s %9s %10s\n", "IDX", "MODULE", "CPU%", "CPU(s)", "WAKE/s", "VCSW/s", "ICSW/s",
+         "UPD/s", "P99(ms)");
+
+  for (usize sorted_index = 0; sorted_index < sorted_count; sorted_index++) {
+    top_entry_t const *entry = sorted[sorted_index];
+    top_sample_t const *current = &entry->current;
+    top_sample_t const *previous = has_previous ? &entry->previous : current;
+
+    printf("%-4lu %-20s %7.2f %10.3f %9.1f %9.1f %9.1f %9.1f %10.3f\n", (unsigned long)entry->index, entry->name,
+           entry->cpu_usage, current->cpu_time, (current->wakeups - previous->wakeups) / interval,
+           (current->voluntary_switches - previous->voluntary_switches) / interval,
+           (current->involuntary_switches - previous->involuntary_switches) / interval,
+           (current->updates - previous->updates) / interval, current->latency_p99 * 1000);
+  }
+
+  fflush(stdout);
+  free(sorted);
+}
+
+int top_run(char const *socket_path, u32 interval_ms) {
+  top_entry_t *entries = NULL;
+  usize entries_count = 0;
+  bool has_previous = false;
+
+  double const interval = (double)interval_ms / 1000;
+  struct timespec const sleep_time = {.tv_sec = interval_ms / 1000, .tv_nsec = (long)(interval_ms % 1000) * 1000000};
+
+  /* runs until interrupted, loop is left only when metrics can't be fetched or parsed */
+  while (true) {
+    char *text = fetch_metrics(socket_path);
+
+    if (text == NULL) {
+      goto done;
+    }
+
+    bool is_parsed = parse_metrics(text, &entries, &entries_count);
+    free(text);
+
+    if (!is_parsed) {
+      goto done;
+    }
+
+    print_entries(entries, entries_count, interval, has_previous);
+
+    for (usize entry_index = 0; entry_index < entries_count; entry_index++) {
+      entries[entry_index].previous = entries[entry_index].current;
+    }
+
+    has_previous = true;
+
+    nanosleep(&sleep_time, NULL);
+  }
+
+done:
+  free(entries);
+
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,245 @@
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_MODULE "trace"
+
+#include "log.h"
+#include "utils/time.h"
+
+bool trace_writer_construct(trace_writer_t *writer, char const *path, char const *const *keys, usize keys_count) {
+  if (keys_count > UINT16_MAX) {
+    log_error("Too many modules to trace");
+    return false;
+  }
+
+  writer->file = fopen(path, "wb");
+
+  if (writer->file == NULL) {
+    log_error("Failed to open trace file \"%s\"", path);
+    return false;
+  }
+
+  u8 modules_count[sizeof(u16)];
+  trace_put_u16(modules_count, (u16)keys_count);
+
+  fwrite(TRACE_MAGIC, sizeof(char), sizeof(TRACE_MAGIC) - 1, writer->file);
+  fwrite(modules_count, sizeof(modules_count), 1, writer->file);
+
+  for (usize key_index = 0; key_index < keys_count; key_index++) {
+    usize const key_length = strlen(keys[key_index]);
+
+    if (key_length > UINT8_MAX) {
+      log_error("Module key is too long to trace");
+      goto error;
+    }
+
+    fputc((int)key_length, writer->file);
+    fwrite(keys[key_index], sizeof(char), key_length, writer->file);
+  }
+
+  if (ferror(writer->file)) {
+    log_error("Failed to write trace header");
+    goto error;
+  }
+
+  if (pthread_mutex_init(&writer->lock, NULL) != 0) {
+    log_error("Failed to create mutex");
+    goto error;
+  }
+
+  writer->start_time = utils_time_get_monotonic_nanoseconds();
+  writer->last_time_us = 0;
+
+  return true;
+
+error:
+  fclose(writer->file);
+  writer->file = NULL;
+
+  return false;
+}
+
+void trace_writer_destruct(trace_writer_t *writer) {
+  if (writer->file == NULL) {
+    return;
+  }
+
+  fclose(writer->file);
+  writer->file = NULL;
+  pthread_mutex_destroy(&writer->lock);
+}
+
+bool trace_writer_write(trace_writer_t *writer, usize module_index, void const *payload, usize length) {
+  if (length > TRACE_MAX_PAYLOAD_LENGTH) {
+    return false;
+  }
+
+  pthread_mutex_lock(&writer->lock);
+
+  u64 const time_us = (utils_time_get_monotonic_nanoseconds() - writer->start_time) / 1000;
+  u64 const delta_us = time_us - writer->last_time_us;
+  u32 const clamped_delta_us = delta_us > UINT32_MAX ? UINT32_MAX : (u32)delta_us;
+  u8 header[TRACE_EVENT_HEADER_SIZE];
+
+  trace_put_u16(trace_put_u16(trace_put_u32(header, clamped_delta_us), (u16)module_index), (u16)length);
+
+  writer->last_time_us += clamped_delta_us;
+
+  bool const status =
+    fwrite(header, sizeof(header), 1, writer->file) == 1 && fwrite(payload, 1, length, writer->file) == length;
+
+  pthread_mutex_unlock(&writer->lock);
+
+  return status;
+}
+
+static bool read_file(trace_reader_t *reader, char const *path) {
+  FILE *file = fopen(path, "rb");
+
+  if (file == NULL) {
+    log_error("Failed to open trace file \"%s\"", path);
+    return false;
+  }
+
+  usize size = 0;
+  usize capacity = 0;
+  u8 *buffer = NULL;
+
+  while (true) {
+    if (size == capacity) {
+      capacity = capacity == 0 ? 65536 : capacity * 2;
+      u8 *new_buffer = realloc(buffer, capacity);
+
+      if (new_buffer == NULL) {
+        log_error("Failed to allocate trace buffer");
+        goto error;
+      }
+
+      buffer = new_buffer;
+    }
+
+    usize length = fread(buffer + size, 1, capacity - size, file);
+
+    if (length == 0) {
+      break;
+    }
+
+    size += length;
+  }
+
+  if (ferror(file)) {
+    log_error("Failed to read trace file");
+    goto error;
+  }
+
+  fclose(file);
+
+  reader->buffer = buffer;
+  reader->size = size;
+
+  return true;
+
+error:
+  fclose(file);
+  free(buffer);
+
+  return false;
+}
+
+bool trace_reader_construct(trace_reader_t *reader, char const *path) {
+  *reader = (trace_reader_t){0};
+
+  if (!read_file(reader, path)) {
+    return false;
+  }
+
+  usize const magic_length = sizeof(TRACE_MAGIC) - 1;
+
+  if (reader->size < magic_length + sizeof(u16) || memcmp(reader->buffer, TRACE_MAGIC, magic_length) != 0) {
+    log_error("Invalid trace file");
+    goto error;
+  }
+
+  trace_get_u16(reader->buffer + magic_length, &reader->modules_count);
+  reader->offset = magic_length + sizeof(u16);
+
+  reader->keys = calloc((usize)reader->modules_count + 1, sizeof(*reader->keys));
+
+  if (reader->keys == NULL) {
+    log_error("Failed to allocate trace keys");
+    goto error;
+  }
+
+  for (usize key_index = 0; key_index < reader->modules_count; key_index++) {
+    if (reader->offset >= reader->size || reader->offset + 1 + reader->buffer[reader->offset] > reader->size) {
+      log_error("Truncated trace header");
+      goto error;
+    }
+
+    usize const key_length = reader->buffer[reader->offset];
+    char *key = malloc(key_length + 1);
+
+    if (key == NULL) {
+      log_error("Failed to allocate trace key");
+      goto error;
+    }
+
+    memcpy(key, reader->buffer + reader->offset + 1, key_length);
+    key[key_length] = '\0';
+
+    reader->keys[key_index] = key;
+    reader->offset += 1 + key_length;
+  }
+
+  return true;
+
+error:
+  trace_reader_destruct(reader);
+
+  return false;
+}
+
+void trace_reader_destruct(trace_reader_t *reader) {
+  if (reader->keys != NULL) {
+    for (usize key_index = 0; key_index < reader->modules_count; key_index++) {
+      free(reader->keys[key_index]);
+    }
+  }
+
+  free(reader->keys);
+  free(reader->buffer);
+
+  *reader = (trace_reader_t){0};
+}
+
+bool trace_reader_next(trace_reader_t *reader, trace_event_t *event) {
+  if (reader->offset + TRACE_EVENT_HEADER_SIZE > reader->size) {
+    return false;
+  }
+
+  u32 delta_us = 0;
+  u16 module_index = 0;
+  u16 length = 0;
+
+  trace_get_u16(trace_get_u16(trace_get_u32(reader->buffer + reader->offset, &delta_us), &module_index), &length);
+
+  if (reader->offset + TRACE_EVENT_HEADER_SIZE + length > reader->size || module_index >= reader->modules_count) {
+    log_error("Truncated or invalid trace event");
+    return false;
+  }
+
+  reader->time_us += delta_us;
+
+  *event = (trace_event_t){
+    .time_us = reader->time_us,
+    .module_index = module_index,
+    .length = length,
+    .payload = reader->buffer + reader->offset + TRACE_EVENT_HEADER_SIZE,
+  };
+
+  reader->offset += TRACE_EVENT_HEADER_SIZE + length;
+
+  return true;
+}
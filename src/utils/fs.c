@@ -1,9 +1,43 @@
+#define _GNU_SOURCE
+
 #include "utils/fs.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define RING_MAX_ENTRIES 4096
+
+/* io_uring through raw syscalls, liburing isn't a dependency */
+typedef struct utils_fs_ring {
+  int file_descriptor;
+  u32 entries;
+  bool has_fixed_buffers; /* IORING_OP_READ_FIXED on registered buffers, IORING_OP_READ otherwise */
+  void *sq_map;
+  usize sq_map_size;
+  void *cq_map; /* same as sq_map with IORING_FEAT_SINGLE_MMAP */
+  usize cq_map_size;
+  struct io_uring_sqe *sqes;
+  usize sqes_size;
+  u32 const *sq_head;
+  u32 *sq_tail;
+  u32 const *sq_mask;
+  u32 *sq_array;
+  u32 *cq_head;
+  u32 const *cq_tail;
+  u32 const *cq_mask;
+  struct io_uring_cqe const *cqes;
+  bool is_broken; /* submitted reads couldn't be reaped, batch falls back to pread */
+} utils_fs_ring_t;
 
 inline bool utils_fs_has_dir(char const *path) {
   struct stat path_stat;
@@ -18,7 +52,7 @@ inline bool utils_fs_has_file(char const *path) {
 }
 
 inline char *utils_fs_read_file(char const *file_path, int n) {
-  FILE *file = fopen(file_path, "ro");
+  FILE *file = fopen(file_path, "r");
 
   if (file == NULL) {
     return NULL;
@@ -26,9 +60,378 @@ inline char *utils_fs_read_file(char const *file_path, int n) {
 
   char *buffer = calloc((unsigned long)n + 1, sizeof(*buffer));
 
-  if (buffer == NULL) {
+  if (buffer != NULL && fgets(buffer, n + 1, file) == NULL) {
+    free(buffer);
+    buffer = NULL;
+  }
+
+  fclose(file);
+
+  return buffer;
+}
+
+bool utils_fs_reader_open(utils_fs_reader_t *reader, char const *path, char *buffer, usize size) {
+  if (size == 0) {
+    return false;
+  }
+
+  reader->file_descriptor = open(path, O_RDONLY | O_CLOEXEC);
+  reader->buffer = buffer;
+  reader->size = size;
+  reader->length = 0;
+  reader->buffer[0] = '\0';
+
+  return reader->file_descriptor != -1;
+}
+
+void utils_fs_reader_close(utils_fs_reader_t *reader) {
+  if (reader->file_descriptor != -1) {
+    close(reader->file_descriptor);
+    reader->file_descriptor = -1;
+  }
+}
+
+bool utils_fs_reader_refresh(utils_fs_reader_t *reader) {
+  isize length;
+
+  do {
+    length = pread(reader->file_descriptor, reader->buffer, reader->size - 1, 0);
+  } while (length < 0 && errno == EINTR);
+
+  if (length < 0) {
+    reader->length = 0;
+    reader->buffer[0] = '\0';
+    return false;
+  }
+
+  reader->length = (usize)length;
+  reader->buffer[length] = '\0';
+
+  return true;
+}
+
+bool utils_fs_reader_refresh_all(utils_fs_reader_t *readers, usize readers_count) {
+  bool status = true;
+
+  for (usize reader_index = 0; reader_index < readers_count; reader_index++) {
+    if (!utils_fs_reader_refresh(&readers[reader_index])) {
+      status = false;
+    }
+  }
+
+  return status;
+}
+
+bool utils_fs_parse_i64(char const *buffer, i64 *value) {
+  char const *current = buffer;
+  bool const is_negative = *current == '-';
+
+  if (is_negative) {
+    current++;
+  }
+
+  if (*current < '0' || *current > '9') {
+    return false;
+  }
+
+  u64 result = 0;
+
+  for (; *current >= '0' && *current <= '9'; current++) {
+    u64 const digit = (u64)(*current - '0');
+
+    if (result > (INT64_MAX - digit) / 10) {
+      return false;
+    }
+
+    result = result * 10 + digit;
+  }
+
+  *value = is_negative ? -(i64)result : (i64)result;
+
+  return true;
+}
+
+static inline int ring_setup(u32 entries, struct io_uring_params *params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int ring_enter(int file_descriptor, u32 to_submit, u32 min_complete, u32 flags) {
+  return (int)syscall(__NR_io_uring_enter, file_descriptor, to_submit, min_complete, flags, NULL, 0);
+}
+
+static inline int ring_register(int file_descriptor, u32 opcode, void const *arguments, u32 arguments_count) {
+  return (int)syscall(__NR_io_uring_register, file_descriptor, opcode, arguments, arguments_count);
+}
+
+static void ring_destruct(utils_fs_ring_t *ring) {
+  if (ring->sqes != NULL) {
+    munmap(ring->sqes, ring->sqes_size);
+  }
+
+  if (ring->cq_map != NULL && ring->cq_map != ring->sq_map) {
+    munmap(ring->cq_map, ring->cq_map_size);
+  }
+
+  if (ring->sq_map != NULL) {
+    munmap(ring->sq_map, ring->sq_map_size);
+  }
+
+  if (ring->file_descriptor != -1) {
+    close(ring->file_descriptor);
+  }
+
+  free(ring);
+}
+
+static bool ring_map(utils_fs_ring_t *ring, struct io_uring_params const *params) {
+  ring->sq_map_size = params->sq_off.array + params->sq_entries * sizeof(u32);
+  ring->cq_map_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+
+  bool const is_single_map = (params->features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+  if (is_single_map && ring->cq_map_size > ring->sq_map_size) {
+    ring->sq_map_size = ring->cq_map_size;
+  }
+
+  ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->file_descriptor, IORING_OFF_SQ_RING);
+
+  if (ring->sq_map == MAP_FAILED) {
+    ring->sq_map = NULL;
+    return false;
+  }
+
+  ring->cq_map = is_single_map ? ring->sq_map
+                               : mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                      ring->file_descriptor, IORING_OFF_CQ_RING);
+
+  if (ring->cq_map == MAP_FAILED) {
+    ring->cq_map = NULL;
+    return false;
+  }
+
+  ring->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->file_descriptor,
+                    IORING_OFF_SQES);
+
+  if (ring->sqes == MAP_FAILED) {
+    ring->sqes = NULL;
+    return false;
+  }
+
+  char *sq_map = ring->sq_map;
+  char *cq_map = ring->cq_map;
+
+  ring->sq_head = (u32 const *)(sq_map + params->sq_off.head);
+  ring->sq_tail = (u32 *)(sq_map + params->sq_off.tail);
+  ring->sq_mask = (u32 const *)(sq_map + params->sq_off.ring_mask);
+  ring->sq_array = (u32 *)(sq_map + params->sq_off.array);
+  ring->cq_head = (u32 *)(cq_map + params->cq_off.head);
+  ring->cq_tail = (u32 const *)(cq_map + params->cq_off.tail);
+  ring->cq_mask = (u32 const *)(cq_map + params->cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe const *)(cq_map + params->cq_off.cqes);
+  ring->entries = params->sq_entries;
+
+  return true;
+}
+
+static bool ring_register_readers(utils_fs_ring_t *ring, utils_fs_reader_t const *readers, usize readers_count) {
+  int *file_descriptors = malloc(readers_count * sizeof(*file_descriptors));
+  struct iovec *buffers = malloc(readers_count * sizeof(*buffers));
+  bool status = false;
+
+  if (file_descriptors == NULL || buffers == NULL) {
+    goto done;
+  }
+
+  for (usize reader_index = 0; reader_index < readers_count; reader_index++) {
+    file_descriptors[reader_index] = readers[reader_index].file_descriptor;
+    buffers[reader_index] = (struct iovec){.iov_base = readers[reader_index].buffer, .iov_len = readers[reader_index].size};
+  }
+
+  if (ring_register(ring->file_descriptor, IORING_REGISTER_FILES, file_descriptors, (u32)readers_count) < 0) {
+    goto done;
+  }
+
+  /* pinned buffers count against RLIMIT_MEMLOCK, plain reads into unregistered buffers still batch */
+  ring->has_fixed_buffers = ring_register(ring->file_descriptor, IORING_REGISTER_BUFFERS, buffers, (u32)readers_count) == 0;
+  status = true;
+
+done:
+  free(file_descriptors);
+  free(buffers);
+
+  return status;
+}
+
+static utils_fs_ring_t *ring_construct(utils_fs_reader_t const *readers, usize readers_count) {
+  utils_fs_ring_t *ring = calloc(1, sizeof(*ring));
+
+  if (ring == NULL) {
+    return NULL;
+  }
+
+  ring->file_descriptor = -1;
+
+  struct io_uring_params params = {0};
+  u32 const entries = readers_count < RING_MAX_ENTRIES ? (u32)readers_count : RING_MAX_ENTRIES;
+
+  ring->file_descriptor = ring_setup(entries, &params);
+
+  if (ring->file_descriptor == -1 || !ring_map(ring, &params) || !ring_register_readers(ring, readers, readers_count)) {
+    ring_destruct(ring);
     return NULL;
   }
 
-  return fgets(buffer, n, file);
+  return ring;
+}
+
+static void ring_complete(utils_fs_reader_t *readers, struct io_uring_cqe const *cqe, bool *status) {
+  utils_fs_reader_t *reader = &readers[cqe->user_data];
+
+  if (cqe->res < 0) {
+    reader->length = 0;
+    reader->buffer[0] = '\0';
+    *status = false;
+    return;
+  }
+
+  reader->length = (usize)cqe->res;
+  reader->buffer[cqe->res] = '\0';
+}
+
+/* completes posted cqes into readers, returns their count */
+static u32 ring_reap(utils_fs_ring_t *ring, utils_fs_reader_t *readers, bool *status) {
+  u32 head = *ring->cq_head;
+  u32 const cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+  u32 const reaped = cq_tail - head;
+
+  for (; head != cq_tail; head++) {
+    ring_complete(readers, &ring->cqes[head & *ring->cq_mask], status);
+  }
+
+  __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+  return reaped;
+}
+
+/* withdraws entries kernel didn't take and waits for taken ones, which would otherwise write into reader buffers
+   later and be counted as completions of the next refresh, returns false if they couldn't be waited for */
+static bool ring_drain(utils_fs_ring_t *ring, utils_fs_reader_t *readers, u32 batch_head, u32 completed) {
+  u32 const sq_head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  u32 in_flight = sq_head - batch_head - completed;
+  bool status = true;
+
+  __atomic_store_n(ring->sq_tail, sq_head, __ATOMIC_RELEASE);
+
+  while (in_flight > 0) {
+    if (ring_enter(ring->file_descriptor, 0, in_flight, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+      return false;
+    }
+
+    in_flight -= ring_reap(ring, readers, &status);
+  }
+
+  return true;
+}
+
+static bool ring_refresh(utils_fs_ring_t *ring, utils_fs_reader_t *readers, usize readers_count) {
+  bool status = true;
+
+  for (usize offset = 0; offset < readers_count; offset += ring->entries) {
+    u32 const count = readers_count - offset < ring->entries ? (u32)(readers_count - offset) : ring->entries;
+    u32 const batch_head = *ring->sq_tail;
+    u32 tail = batch_head;
+
+    for (u32 entry_index = 0; entry_index < count; entry_index++, tail++) {
+      usize const reader_index = offset + entry_index;
+      u32 const sq_index = tail & *ring->sq_mask;
+      struct io_uring_sqe *sqe = &ring->sqes[sq_index];
+
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = ring->has_fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+      sqe->flags = IOSQE_FIXED_FILE;
+      sqe->fd = (i32)reader_index;
+      sqe->addr = (u64)(usize)readers[reader_index].buffer;
+      sqe->len = (u32)(readers[reader_index].size - 1);
+      sqe->off = 0;
+      sqe->buf_index = (u16)reader_index;
+      sqe->user_data = reader_index;
+
+      ring->sq_array[sq_index] = sq_index;
+    }
+
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+    u32 to_submit = count;
+    u32 completed = 0;
+
+    while (completed < count) {
+      int submitted = ring_enter(ring->file_descriptor, to_submit, count - completed, IORING_ENTER_GETEVENTS);
+
+      /* readers of batch are left partly refreshed, they are all reread with pread instead */
+      if (submitted < 0 && errno != EINTR) {
+        ring->is_broken = !ring_drain(ring, readers, batch_head, completed);
+
+        return utils_fs_reader_refresh_all(readers, readers_count);
+      }
+
+      if (submitted > 0) {
+        to_submit -= (u32)submitted;
+      }
+
+      completed += ring_reap(ring, readers, &status);
+    }
+  }
+
+  return status;
+}
+
+bool utils_fs_batch_construct(utils_fs_batch_t *batch, utils_fs_reader_t *readers, usize readers_count,
+                              bool is_io_uring_allowed) {
+  *batch = (utils_fs_batch_t){
+    .readers = readers,
+    .readers_count = readers_count,
+    .backend = UTILS_FS_BATCH_BACKEND_PREAD,
+  };
+
+  /* registered buffer index is 16 bits wide */
+  if (is_io_uring_allowed && readers_count > 0 && readers_count <= UINT16_MAX) {
+    batch->ring = ring_construct(readers, readers_count);
+
+    if (batch->ring != NULL) {
+      batch->backend = UTILS_FS_BATCH_BACKEND_IO_URING;
+    }
+  }
+
+  return true;
+}
+
+void utils_fs_batch_destruct(utils_fs_batch_t *batch) {
+  if (batch->ring != NULL) {
+    ring_destruct(batch->ring);
+  }
+
+  *batch = (utils_fs_batch_t){0};
+}
+
+bool utils_fs_batch_refresh(utils_fs_batch_t *batch) {
+  if (batch->ring != NULL) {
+    bool const status = ring_refresh(batch->ring, batch->readers, batch->readers_count);
+
+    /* reported through backend name */
+    if (batch->ring->is_broken) {
+      ring_destruct(batch->ring);
+      batch->ring = NULL;
+      batch->backend = UTILS_FS_BATCH_BACKEND_PREAD;
+    }
+
+    return status;
+  }
+
+  return utils_fs_reader_refresh_all(batch->readers, batch->readers_count);
+}
+
+char const *utils_fs_batch_get_backend_name(utils_fs_batch_t const *batch) {
+  return batch->backend == UTILS_FS_BATCH_BACKEND_IO_URING ? "io_uring" : "pread";
 }
@@ -0,0 +1,75 @@
+#include "utils/histogram.h"
+
+#include <stdbool.h>
+
+static inline usize get_bucket_index(u64 value) {
+  if (value < UTILS_HISTOGRAM_SUB_COUNT) {
+    return (usize)value;
+  }
+
+  usize exponent = (usize)(63 - __builtin_clzll(value));
+
+  if (exponent > UTILS_HISTOGRAM_MAX_EXPONENT) {
+    return UTILS_HISTOGRAM_BUCKETS_COUNT - 1;
+  }
+
+  usize const mantissa = (usize)(value >> (exponent - UTILS_HISTOGRAM_SUB_BITS));
+
+  return (exponent - UTILS_HISTOGRAM_SUB_BITS + 1) * UTILS_HISTOGRAM_SUB_COUNT + mantissa - UTILS_HISTOGRAM_SUB_COUNT;
+}
+
+static inline u64 get_bucket_upper_bound(usize index) {
+  if (index < UTILS_HISTOGRAM_SUB_COUNT) {
+    return index;
+  }
+
+  usize const exponent = index / UTILS_HISTOGRAM_SUB_COUNT + UTILS_HISTOGRAM_SUB_BITS - 1;
+  u64 const mantissa = index % UTILS_HISTOGRAM_SUB_COUNT + UTILS_HISTOGRAM_SUB_COUNT;
+  usize const shift = exponent - UTILS_HISTOGRAM_SUB_BITS;
+
+  return (mantissa << shift) + ((u64)1 << shift) - 1;
+}
+
+void utils_histogram_record(utils_histogram_t *histogram, u64 value) {
+  __atomic_fetch_add(&histogram->buckets[get_bucket_index(value)], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+
+  u64 max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+
+  while (value > max &&
+         !__atomic_compare_exchange_n(&histogram->max, &max, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+u64 utils_histogram_get_percentile(utils_histogram_t const *histogram, double quantile) {
+  u64 const count = utils_histogram_get_count(histogram);
+
+  if (count == 0) {
+    return 0;
+  }
+
+  u64 rank = (u64)(quantile * (double)count + 0.5);
+
+  if (rank == 0) {
+    rank = 1;
+  }
+
+  u64 cumulative = 0;
+
+  for (usize bucket_index = 0; bucket_index < UTILS_HISTOGRAM_BUCKETS_COUNT; bucket_index++) {
+    cumulative += __atomic_load_n(&histogram->buckets[bucket_index], __ATOMIC_RELAXED);
+
+    if (cumulative >= rank) {
+      u64 const upper_bound = get_bucket_upper_bound(bucket_index);
+      u64 const max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+
+      return upper_bound < max ? upper_bound : max;
+    }
+  }
+
+  return __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+}
+
+u64 utils_histogram_get_count(utils_histogram_t const *histogram) {
+  return __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+}
@@ -1,10 +1,211 @@
 #include "utils/time.h"
 
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
 #include <time.h>
+#include <unistd.h>
+
+#include "macros.h"
+
+u64 utils_time_get_monotonic_nanoseconds(void) {
+  struct timespec current_time;
+  clock_gettime(CLOCK_MONOTONIC, &current_time);
+
+  return (u64)current_time.tv_sec * 1000000000UL + (u64)current_time.tv_nsec;
+}
+
+static u64 system_clock_get_realtime(utils_time_clock_t *clock) {
+  (void)clock;
 
-inline long utils_time_get_milliseconds_since_epoch(void) {
   struct timespec current_time;
   clock_gettime(CLOCK_REALTIME, &current_time);
 
-  return current_time.tv_sec * 1000L + current_time.tv_nsec / 1000000L;
+  return (u64)current_time.tv_sec * 1000000000UL + (u64)current_time.tv_nsec;
+}
+
+static bool system_clock_timer_construct(utils_time_clock_t *clock, utils_time_timer_t *timer) {
+  (void)clock;
+
+  timer->file_descriptor = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+
+  return timer->file_descriptor != -1;
+}
+
+static void system_clock_timer_destruct(utils_time_clock_t *clock, utils_time_timer_t *timer) {
+  (void)clock;
+
+  if (timer->file_descriptor != -1) {
+    close(timer->file_descriptor);
+    timer->file_descriptor = -1;
+  }
+}
+
+/* absolute CLOCK_REALTIME deadline does not drift with scheduling delays and expires right after resume,
+   TFD_TIMER_CANCEL_ON_SET cancels it when wall-clock time is set */
+static utils_time_wait_status_t system_clock_wait_until(utils_time_clock_t *clock, utils_time_timer_t *timer,
+                                                        int file_descriptor, u64 deadline) {
+  (void)clock;
+
+  struct itimerspec const timer_value = {
+    .it_value = {.tv_sec = (time_t)(deadline / 1000000000), .tv_nsec = (long)(deadline % 1000000000)},
+  };
+
+  if (timerfd_settime(timer->file_descriptor, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &timer_value, NULL) ==
+      -1) {
+    return UTILS_TIME_WAIT_FAILED;
+  }
+
+  struct pollfd file_descriptors[] = {
+    {.fd = file_descriptor, .events = POLLIN},
+    {.fd = timer->file_descriptor, .events = POLLIN},
+  };
+
+  if (poll(file_descriptors, countof(file_descriptors), -1) == -1) {
+    return UTILS_TIME_WAIT_FAILED;
+  }
+
+  if (file_descriptors[0].revents != 0) {
+    return UTILS_TIME_WAIT_READABLE;
+  }
+
+  u64 expirations;
+
+  if (read(timer->file_descriptor, &expirations, sizeof(expirations)) == -1) {
+    return errno == ECANCELED ? UTILS_TIME_WAIT_CLOCK_SET : UTILS_TIME_WAIT_FAILED;
+  }
+
+  return UTILS_TIME_WAIT_EXPIRED;
+}
+
+utils_time_clock_t *utils_time_get_system_clock(void) {
+  static utils_time_clock_t system_clock = {
+    .get_realtime = system_clock_get_realtime,
+    .timer_construct = system_clock_timer_construct,
+    .timer_destruct = system_clock_timer_destruct,
+    .wait_until = system_clock_wait_until,
+  };
+
+  return &system_clock;
+}
+
+static u64 virtual_clock_get_realtime(utils_time_clock_t *clock) {
+  return ((utils_time_virtual_clock_t *)clock)->realtime;
+}
+
+static bool virtual_clock_timer_construct(utils_time_clock_t *clock, utils_time_timer_t *timer) {
+  (void)clock;
+
+  timer->file_descriptor = -1;
+
+  return true;
+}
+
+static void virtual_clock_timer_destruct(utils_time_clock_t *clock, utils_time_timer_t *timer) {
+  (void)clock;
+  (void)timer;
+}
+
+static utils_time_wait_status_t virtual_clock_wait_until(utils_time_clock_t *clock, utils_time_timer_t *timer,
+                                                         int file_descriptor, u64 deadline) {
+  (void)timer;
+  (void)file_descriptor;
+
+  utils_time_virtual_clock_t *virtual_clock = (utils_time_virtual_clock_t *)clock;
+
+  if (virtual_clock->step_time != 0 && virtual_clock->step_time <= deadline &&
+      virtual_clock->step_time < virtual_clock->end_time) {
+    u64 const step_time = virtual_clock->step_time > virtual_clock->realtime ? virtual_clock->step_time
+                                                                               : virtual_clock->realtime;
+
+    virtual_clock->realtime = (u64)((i64)step_time + virtual_clock->step_offset);
+    virtual_clock->end_time = (u64)((i64)virtual_clock->end_time + virtual_clock->step_offset);
+    virtual_clock->step_time = 0;
+
+    return UTILS_TIME_WAIT_CLOCK_SET;
+  }
+
+  if (deadline >= virtual_clock->end_time) {
+    virtual_clock->realtime = virtual_clock->end_time;
+    return UTILS_TIME_WAIT_READABLE;
+  }
+
+  if (deadline > virtual_clock->realtime) {
+    virtual_clock->realtime = deadline;
+  }
+
+  virtual_clock->wait_count += 1;
+
+  return UTILS_TIME_WAIT_EXPIRED;
+}
+
+void utils_time_virtual_clock_construct(utils_time_virtual_clock_t *clock, u64 start_time, u64 end_time) {
+  *clock = (utils_time_virtual_clock_t){
+    .clock =
+      {
+        .get_realtime = virtual_clock_get_realtime,
+        .timer_construct = virtual_clock_timer_construct,
+        .timer_destruct = virtual_clock_timer_destruct,
+        .wait_until = virtual_clock_wait_until,
+      },
+    .realtime = start_time,
+    .end_time = end_time,
+  };
+}
+
+void utils_time_virtual_clock_step(utils_time_virtual_clock_t *clock, u64 step_time, i64 offset) {
+  clock->step_time = step_time;
+  clock->step_offset = offset;
+}
+
+bool utils_time_parse_duration(char const *duration, u64 *milliseconds) {
+  static struct {
+    char const *suffix;
+    u64 multiplier;
+  } const units[] = {
+    {"ms", 1}, {"s", 1000}, {"m", 60 * 1000}, {"h", 60 * 60 * 1000}, {"", 1000},
+  };
+
+  /* strtoull accepts leading spaces and signs, "-1" would wrap around */
+  if (duration[0] < '0' || duration[0] > '9') {
+    return false;
+  }
+
+  char *end = NULL;
+  errno = 0;
+  unsigned long long const value = strtoull(duration, &end, 10);
+
+  if (errno == ERANGE) {
+    return false;
+  }
+
+  for (usize unit_index = 0; unit_index < countof(units); unit_index++) {
+    if (strcmp(end, units[unit_index].suffix) == 0) {
+      u64 const multiplier = units[unit_index].multiplier;
+
+      /* callers convert to nanoseconds, so result has to fit u64 in nanoseconds */
+      if (value > UINT64_MAX / 1000000 / multiplier) {
+        return false;
+      }
+
+      *milliseconds = (u64)value * multiplier;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool utils_time_parse_interval(char const *interval, u64 *nanoseconds) {
+  u64 milliseconds = 0;
+
+  if (!utils_time_parse_duration(interval, &milliseconds) || milliseconds == 0 ||
+      milliseconds > UTILS_TIME_MAX_INTERVAL_MS) {
+    return false;
+  }
+
+  *nanoseconds = milliseconds * 1000000;
+  return true;
 }
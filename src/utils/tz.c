@@ -0,0 +1,616 @@
+#define _GNU_SOURCE
+
+#include "utils/tz.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "macros.h"
+
+#define ZONEINFO_PATH "/usr/share/zoneinfo"
+#define LOCALTIME_PATH "/etc/localtime"
+#define MAX_FILE_SIZE (1L << 20)
+#define HEADER_SIZE 44
+#define TYPE_SIZE 6
+#define MAX_TYPES_COUNT 256
+#define SECONDS_PER_MINUTE 60
+#define SECONDS_PER_HOUR (60 * SECONDS_PER_MINUTE)
+#define SECONDS_PER_DAY (24 * SECONDS_PER_HOUR)
+#define MAX_RULE_TIME (167 * SECONDS_PER_HOUR)
+
+/* counts of TZif header (RFC 8536) */
+typedef struct header {
+  u8 version;
+  u32 utc_indicators_count;
+  u32 standard_indicators_count;
+  u32 leap_seconds_count;
+  u32 transitions_count;
+  u32 types_count;
+  u32 abbreviations_size;
+} header_t;
+
+static inline u32 read_u32(u8 const *data) {
+  return (u32)data[0] << 24 | (u32)data[1] << 16 | (u32)data[2] << 8 | (u32)data[3];
+}
+
+static inline i64 read_i64(u8 const *data) {
+  return (i64)((u64)read_u32(data) << 32 | (u64)read_u32(data + 4));
+}
+
+static inline i64 floor_divide(i64 dividend, i64 divisor) {
+  return dividend / divisor - (dividend % divisor < 0 ? 1 : 0);
+}
+
+static inline bool is_leap_year(i64 year) {
+  return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+}
+
+/* days since epoch of proleptic gregorian date, see http://howardhinnant.github.io/date_algorithms.html */
+static i64 days_from_civil(i64 year, u32 month, u32 day) {
+  year -= month <= 2 ? 1 : 0;
+
+  i64 const era = floor_divide(year, 400);
+  i64 const year_of_era = year - era * 400;
+  i64 const day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  i64 const day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+
+  return era * 146097 + day_of_era - 719468;
+}
+
+static void civil_from_days(i64 days, i64 *year, u32 *month, u32 *day) {
+  days += 719468;
+
+  i64 const era = floor_divide(days, 146097);
+  i64 const day_of_era = days - era * 146097;
+  i64 const year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+  i64 const day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  i64 const month_index = (5 * day_of_year + 2) / 153;
+
+  *day = (u32)(day_of_year - (153 * month_index + 2) / 5 + 1);
+  *month = (u32)(month_index < 10 ? month_index + 3 : month_index - 9);
+  *year = year_of_era + era * 400 + (*month <= 2 ? 1 : 0);
+}
+
+/* 0 - Sunday, epoch was Thursday */
+static inline i32 get_weekday(i64 days) {
+  return (i32)((days % 7 + 11) % 7);
+}
+
+static bool read_file(char const *path, u8 **data, usize *size) {
+  FILE *file = fopen(path, "rb");
+
+  if (file == NULL) {
+    return false;
+  }
+
+  bool status = false;
+
+  if (fseek(file, 0, SEEK_END) != 0) {
+    goto close_file;
+  }
+
+  long const file_size = ftell(file);
+
+  if (file_size <= 0 || file_size > MAX_FILE_SIZE || fseek(file, 0, SEEK_SET) != 0) {
+    goto close_file;
+  }
+
+  *data = malloc((usize)file_size);
+
+  if (*data == NULL) {
+    goto close_file;
+  }
+
+  if (fread(*data, 1, (usize)file_size, file) != (usize)file_size) {
+    free(*data);
+    goto close_file;
+  }
+
+  *size = (usize)file_size;
+  status = true;
+
+close_file:
+  fclose(file);
+
+  return status;
+}
+
+static bool parse_header(u8 const *data, usize size, header_t *header) {
+  if (size < HEADER_SIZE || memcmp(data, "TZif", 4) != 0) {
+    return false;
+  }
+
+  *header = (header_t){
+    .version = data[4],
+    .utc_indicators_count = read_u32(data + 20),
+    .standard_indicators_count = read_u32(data + 24),
+    .leap_seconds_count = read_u32(data + 28),
+    .transitions_count = read_u32(data + 32),
+    .types_count = read_u32(data + 36),
+    .abbreviations_size = read_u32(data + 40),
+  };
+
+  return header->types_count != 0 && header->types_count <= MAX_TYPES_COUNT && header->abbreviations_size != 0;
+}
+
+static inline usize get_data_size(header_t const *header, usize time_size) {
+  return header->transitions_count * (time_size + 1) + header->types_count * TYPE_SIZE + header->abbreviations_size +
+         header->leap_seconds_count * (time_size + 4) + header->standard_indicators_count +
+         header->utc_indicators_count;
+}
+
+/* parses abbreviation, alphabetic or quoted in angle brackets (e.g "<+0530>") */
+static char const *parse_rule_abbreviation(char const *string, char *abbreviation) {
+  char const *start = string;
+  char const *end = NULL;
+
+  if (*string == '<') {
+    start = string + 1;
+    end = strchr(start, '>');
+
+    if (end == NULL) {
+      return NULL;
+    }
+
+    string = end + 1;
+  } else {
+    while ((*string >= 'a' && *string <= 'z') || (*string >= 'A' && *string <= 'Z')) {
+      string += 1;
+    }
+
+    end = string;
+  }
+
+  usize length = (usize)(end - start);
+
+  if (length == 0) {
+    return NULL;
+  }
+
+  if (length > UTILS_TZ_MAX_ABBREVIATION_LENGTH) {
+    length = UTILS_TZ_MAX_ABBREVIATION_LENGTH;
+  }
+
+  memcpy(abbreviation, start, length);
+  abbreviation[length] = '\0';
+
+  return string;
+}
+
+static char const *parse_rule_number(char const *string, i32 *number, i32 max) {
+  if (*string < '0' || *string > '9') {
+    return NULL;
+  }
+
+  i32 value = 0;
+
+  while (*string >= '0' && *string <= '9') {
+    value = value * 10 + (*string - '0');
+
+    if (value > max) {
+      return NULL;
+    }
+
+    string += 1;
+  }
+
+  *number = value;
+
+  return string;
+}
+
+/* parses [+-]hh[:mm[:ss]] */
+static char const *parse_rule_time(char const *string, i32 *seconds) {
+  i32 sign = 1;
+
+  if (*string == '+' || *string == '-') {
+    sign = *string == '-' ? -1 : 1;
+    string += 1;
+  }
+
+  i32 hours = 0, minutes = 0, remaining_seconds = 0;
+
+  if ((string = parse_rule_number(string, &hours, MAX_RULE_TIME / SECONDS_PER_HOUR)) == NULL) {
+    return NULL;
+  }
+
+  if (*string == ':' && (string = parse_rule_number(string + 1, &minutes, 59)) == NULL) {
+    return NULL;
+  }
+
+  if (*string == ':' && (string = parse_rule_number(string + 1, &remaining_seconds, 59)) == NULL) {
+    return NULL;
+  }
+
+  *seconds = sign * (hours * SECONDS_PER_HOUR + minutes * SECONDS_PER_MINUTE + remaining_seconds);
+
+  return string;
+}
+
+static char const *parse_rule_date(char const *string, utils_tz_rule_date_t *date) {
+  i32 day = 0, month = 0, week = 0;
+
+  if (*string == 'J') {
+    if ((string = parse_rule_number(string + 1, &day, 365)) == NULL || day == 0) {
+      return NULL;
+    }
+
+    *date = (utils_tz_rule_date_t){.kind = UTILS_TZ_RULE_DATE_JULIAN, .day = (u16)day};
+  } else if (*string == 'M') {
+    if ((string = parse_rule_number(string + 1, &month, 12)) == NULL || month == 0 || *string != '.' ||
+        (string = parse_rule_number(string + 1, &week, 5)) == NULL || week == 0 || *string != '.' ||
+        (string = parse_rule_number(string + 1, &day, 6)) == NULL) {
+      return NULL;
+    }
+
+    *date = (utils_tz_rule_date_t){
+      .kind = UTILS_TZ_RULE_DATE_MONTH_WEEK_DAY,
+      .day = (u16)day,
+      .month = (u8)month,
+      .week = (u8)week,
+    };
+  } else {
+    if ((string = parse_rule_number(string, &day, 365)) == NULL) {
+      return NULL;
+    }
+
+    *date = (utils_tz_rule_date_t){.kind = UTILS_TZ_RULE_DATE_DAY, .day = (u16)day};
+  }
+
+  date->time = 2 * SECONDS_PER_HOUR;
+
+  if (*string == '/' && (string = parse_rule_time(string + 1, &date->time)) == NULL) {
+    return NULL;
+  }
+
+  return string;
+}
+
+/* parses POSIX TZ string, offsets in it are west of UTC */
+static bool parse_rule(utils_tz_rule_t *rule, char const *string) {
+  i32 offset = 0;
+
+  *rule = (utils_tz_rule_t){0};
+
+  if ((string = parse_rule_abbreviation(string, rule->standard.abbreviation)) == NULL ||
+      (string = parse_rule_time(string, &offset)) == NULL) {
+    return false;
+  }
+
+  rule->standard.offset = -offset;
+
+  if (*string == '\0') {
+    return true;
+  }
+
+  if ((string = parse_rule_abbreviation(string, rule->daylight.abbreviation)) == NULL) {
+    return false;
+  }
+
+  rule->has_daylight = true;
+  rule->daylight.is_dst = true;
+  rule->daylight.offset = rule->standard.offset + SECONDS_PER_HOUR;
+
+  if (*string != ',' && *string != '\0') {
+    if ((string = parse_rule_time(string, &offset)) == NULL) {
+      return false;
+    }
+
+    rule->daylight.offset = -offset;
+  }
+
+  /* rules of the United States when omitted, as glibc does */
+  if (*string == '\0') {
+    string = ",M3.2.0,M11.1.0";
+  }
+
+  if (*string != ',' || (string = parse_rule_date(string + 1, &rule->start)) == NULL || *string != ',' ||
+      (string = parse_rule_date(string + 1, &rule->end)) == NULL) {
+    return false;
+  }
+
+  return *string == '\0';
+}
+
+static bool parse_tzif(utils_tz_t *tz, u8 const *data, usize size) {
+  header_t header;
+
+  if (!parse_header(data, size, &header)) {
+    return false;
+  }
+
+  usize offset = HEADER_SIZE;
+  usize time_size = 4;
+
+  /* version 2 and later repeat data with 64-bit times after version 1 data, followed by TZ string footer */
+  if (header.version >= '2') {
+    offset += get_data_size(&header, time_size);
+
+    if (offset > size || !parse_header(data + offset, size - offset, &header)) {
+      return false;
+    }
+
+    offset += HEADER_SIZE;
+    time_size = 8;
+  }
+
+  usize const data_size = get_data_size(&header, time_size);
+
+  if (data_size > size - offset) {
+    return false;
+  }
+
+  tz->transitions = calloc(header.transitions_count + 1, sizeof(*tz->transitions));
+  tz->transition_types = calloc(header.transitions_count + 1, sizeof(*tz->transition_types));
+  tz->types = calloc(header.types_count, sizeof(*tz->types));
+
+  if (tz->transitions == NULL || tz->transition_types == NULL || tz->types == NULL) {
+    return false;
+  }
+
+  u8 const *transitions = data + offset;
+  u8 const *transition_types = transitions + header.transitions_count * time_size;
+  u8 const *types = transition_types + header.transitions_count;
+  char const *abbreviations = (char const *)(types + header.types_count * TYPE_SIZE);
+
+  for (usize transition_index = 0; transition_index < header.transitions_count; transition_index++) {
+    u8 const *transition = transitions + transition_index * time_size;
+
+    tz->transitions[transition_index] = time_size == 8 ? read_i64(transition) : (i64)(i32)read_u32(transition);
+    tz->transition_types[transition_index] = transition_types[transition_index];
+
+    if (transition_types[transition_index] >= header.types_count ||
+        (transition_index > 0 && tz->transitions[transition_index] <= tz->transitions[transition_index - 1])) {
+      return false;
+    }
+  }
+
+  for (usize type_index = 0; type_index < header.types_count; type_index++) {
+    u8 const *type = types + type_index * TYPE_SIZE;
+    u8 const abbreviation_index = type[5];
+
+    if (abbreviation_index >= header.abbreviations_size) {
+      return false;
+    }
+
+    usize length = strnlen(abbreviations + abbreviation_index, header.abbreviations_size - abbreviation_index);
+
+    if (length > UTILS_TZ_MAX_ABBREVIATION_LENGTH) {
+      length = UTILS_TZ_MAX_ABBREVIATION_LENGTH;
+    }
+
+    tz->types[type_index].offset = (i32)read_u32(type);
+    tz->types[type_index].is_dst = type[4] != 0;
+    memcpy(tz->types[type_index].abbreviation, abbreviations + abbreviation_index, length);
+  }
+
+  tz->transitions_count = header.transitions_count;
+  tz->types_count = header.types_count;
+
+  offset += data_size;
+
+  /* footer is "\n<TZ string>\n", empty string means no rule past last transition */
+  if (time_size == 8 && offset < size && data[offset] == '\n') {
+    char const *footer = (char const *)data + offset + 1;
+    char const *footer_end = memchr(footer, '\n', size - offset - 1);
+
+    if (footer_end != NULL && footer_end != footer) {
+      char *rule = strndup(footer, (usize)(footer_end - footer));
+
+      if (rule == NULL) {
+        return false;
+      }
+
+      tz->has_rule = parse_rule(&tz->rule, rule);
+      free(rule);
+    }
+  }
+
+  return true;
+}
+
+static bool load_file(utils_tz_t *tz, char const *path) {
+  u8 *data = NULL;
+  usize size = 0;
+
+  if (!read_file(path, &data, &size)) {
+    return false;
+  }
+
+  bool status = parse_tzif(tz, data, size);
+  free(data);
+
+  if (!status) {
+    utils_tz_destruct(tz);
+  }
+
+  return status;
+}
+
+static bool load_name(utils_tz_t *tz, char const *name) {
+  if (*name == ':') {
+    name += 1;
+  }
+
+  if (*name == '/') {
+    return load_file(tz, name);
+  }
+
+  char const *directory = getenv("TZDIR");
+
+  if (directory == NULL || *directory == '\0') {
+    directory = ZONEINFO_PATH;
+  }
+
+  /* names escaping tzdata directory are only accepted as POSIX TZ strings */
+  if (strstr(name, "..") == NULL) {
+    usize const path_size = (usize)strfsize("%s/%s", directory, name);
+    char *path = malloc(path_size + 1);
+
+    if (path == NULL) {
+      return false;
+    }
+
+    snprintf(path, path_size + 1, "%s/%s", directory, name);
+
+    bool const is_loaded = load_file(tz, path);
+    free(path);
+
+    if (is_loaded) {
+      return true;
+    }
+  }
+
+  tz->has_rule = parse_rule(&tz->rule, name);
+
+  return tz->has_rule;
+}
+
+bool utils_tz_construct(utils_tz_t *tz, char const *name) {
+  *tz = (utils_tz_t){0};
+
+  if (strcmp(name, "local") != 0) {
+    return load_name(tz, name);
+  }
+
+  char const *environment_name = getenv("TZ");
+
+  if (environment_name != NULL && *environment_name != '\0') {
+    return load_name(tz, environment_name);
+  }
+
+  if (load_file(tz, LOCALTIME_PATH)) {
+    return true;
+  }
+
+  /* same fallback as libc without TZ and /etc/localtime */
+  tz->has_rule = true;
+  strcpy(tz->rule.standard.abbreviation, "UTC");
+
+  return true;
+}
+
+void utils_tz_destruct(utils_tz_t *tz) {
+  free(tz->transitions);
+  free(tz->transition_types);
+  free(tz->types);
+
+  *tz = (utils_tz_t){0};
+}
+
+static i64 get_rule_date_time(utils_tz_rule_date_t const *date, i64 year) {
+  i64 const year_start = days_from_civil(year, 1, 1);
+  i64 day = 0;
+
+  switch (date->kind) {
+  case UTILS_TZ_RULE_DATE_JULIAN:
+    day = year_start + date->day - 1 + (is_leap_year(year) && date->day >= 60 ? 1 : 0);
+    break;
+  case UTILS_TZ_RULE_DATE_DAY:
+    day = year_start + date->day;
+    break;
+  case UTILS_TZ_RULE_DATE_MONTH_WEEK_DAY: {
+    i64 const month_start = days_from_civil(year, date->month, 1);
+    i64 const next_month_start =
+      date->month == 12 ? days_from_civil(year + 1, 1, 1) : days_from_civil(year, date->month + 1U, 1);
+
+    day = month_start + (date->day - get_weekday(month_start) + 7) % 7 + (date->week - 1) * 7;
+
+    /* week 5 is the last such weekday of month */
+    while (day >= next_month_start) {
+      day -= 7;
+    }
+
+    break;
+  }
+  }
+
+  return day * SECONDS_PER_DAY + date->time;
+}
+
+static utils_tz_type_t const *get_rule_type(utils_tz_rule_t const *rule, i64 time) {
+  if (!rule->has_daylight) {
+    return &rule->standard;
+  }
+
+  i64 year = 0;
+  u32 month = 0, day = 0;
+
+  civil_from_days(floor_divide(time + rule->standard.offset, SECONDS_PER_DAY), &year, &month, &day);
+
+  i64 const start = get_rule_date_time(&rule->start, year) - rule->standard.offset;
+  i64 const end = get_rule_date_time(&rule->end, year) - rule->daylight.offset;
+
+  /* southern hemisphere zones start daylight saving time late in year and end it early in next one */
+  bool const is_daylight = start < end ? time >= start && time < end : time < end || time >= start;
+
+  return is_daylight ? &rule->daylight : &rule->standard;
+}
+
+static utils_tz_type_t const *get_type(utils_tz_t const *tz, i64 time) {
+  if (tz->transitions_count == 0) {
+    return tz->has_rule ? get_rule_type(&tz->rule, time) : &tz->types[0];
+  }
+
+  /* time type 0 applies before first transition */
+  if (time < tz->transitions[0]) {
+    return &tz->types[0];
+  }
+
+  usize low = 0;
+  usize high = tz->transitions_count;
+
+  while (high - low > 1) {
+    usize const middle = low + (high - low) / 2;
+
+    if (tz->transitions[middle] <= time) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+
+  if (low == tz->transitions_count - 1 && tz->has_rule) {
+    return get_rule_type(&tz->rule, time);
+  }
+
+  return &tz->types[tz->transition_types[low]];
+}
+
+bool utils_tz_get_local_time(utils_tz_t const *tz, i64 time, struct tm *local_time) {
+  if (tz->types == NULL && !tz->has_rule) {
+    return false;
+  }
+
+  utils_tz_type_t const *type = get_type(tz, time);
+
+  i64 const local_seconds = time + type->offset;
+  i64 const days = floor_divide(local_seconds, SECONDS_PER_DAY);
+  i64 const seconds_of_day = local_seconds - days * SECONDS_PER_DAY;
+
+  i64 year = 0;
+  u32 month = 0, day = 0;
+
+  civil_from_days(days, &year, &month, &day);
+
+  if (year - 1900 < INT32_MIN || year - 1900 > INT32_MAX) {
+    return false;
+  }
+
+  *local_time = (struct tm){
+    .tm_sec = (int)(seconds_of_day % SECONDS_PER_MINUTE),
+    .tm_min = (int)(seconds_of_day / SECONDS_PER_MINUTE % 60),
+    .tm_hour = (int)(seconds_of_day / SECONDS_PER_HOUR),
+    .tm_mday = (int)day,
+    .tm_mon = (int)month - 1,
+    .tm_year = (int)(year - 1900),
+    .tm_wday = get_weekday(days),
+    .tm_yday = (int)(days - days_from_civil(year, 1, 1)),
+    .tm_isdst = type->is_dst ? 1 : 0,
+    .tm_gmtoff = type->offset,
+    .tm_zone = type->abbreviation,
+  };
+
+  return true;
+}
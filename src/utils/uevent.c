@@ -0,0 +1,135 @@
+#define _GNU_SOURCE
+
+#include "utils/uevent.h"
+
+#include <errno.h>
+#include <linux/netlink.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define KERNEL_GROUP 1 /* multicast group of kernel uevents, udev rebroadcasts on group 2 */
+#define RECEIVE_BUFFER_SIZE (1 << 20)
+
+/* unwanted subsystems aren't dropped by SO_ATTACH_FILTER: SUBSYSTEM= of kernel uevents is one of the variables at an
+   offset varying with action and devpath, which classic BPF can't search as it has no backward jumps (udev filters
+   only its own messages, by subsystem hash in their binary header), so they're skipped in utils_uevent_receive */
+static int kernel_source_open(utils_uevent_source_t *source) {
+  (void)source;
+
+  int file_descriptor = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+
+  if (file_descriptor == -1) {
+    return -1;
+  }
+
+  struct sockaddr_nl const address = {
+    .nl_family = AF_NETLINK,
+    .nl_groups = KERNEL_GROUP,
+  };
+
+  if (bind(file_descriptor, (struct sockaddr const *)&address, sizeof(address)) == -1) {
+    close(file_descriptor);
+    return -1;
+  }
+
+  /* bursts (e.g docking, resume) come in faster than a module thread drains them, overflow is still handled */
+  int const receive_buffer_size = RECEIVE_BUFFER_SIZE;
+  setsockopt(file_descriptor, SOL_SOCKET, SO_RCVBUF, &receive_buffer_size, sizeof(receive_buffer_size));
+
+  return file_descriptor;
+}
+
+utils_uevent_source_t *utils_uevent_get_kernel_source(void) {
+  static utils_uevent_source_t kernel_source = {.open = kernel_source_open};
+
+  return &kernel_source;
+}
+
+bool utils_uevent_parse(char const *message, usize length, utils_uevent_t *uevent) {
+  *uevent = (utils_uevent_t){0};
+
+  /* header is "action@devpath", libudev messages start with "libudev" and carry binary header */
+  usize const header_length = strnlen(message, length);
+
+  if (header_length == length || memchr(message, '@', header_length) == NULL) {
+    return false;
+  }
+
+  uevent->variables = message + header_length + 1;
+  uevent->variables_length = length - header_length - 1;
+
+  uevent->action = utils_uevent_get(uevent, "ACTION");
+  uevent->devpath = utils_uevent_get(uevent, "DEVPATH");
+  uevent->subsystem = utils_uevent_get(uevent, "SUBSYSTEM");
+
+  return uevent->action != NULL && uevent->devpath != NULL && uevent->subsystem != NULL;
+}
+
+char const *utils_uevent_get(utils_uevent_t const *uevent, char const *key) {
+  usize const key_length = strlen(key);
+  char const *variable = uevent->variables;
+  char const *end = uevent->variables + uevent->variables_length;
+
+  while (variable < end) {
+    usize const variable_length = strnlen(variable, (usize)(end - variable));
+
+    if (variable_length > key_length && variable[key_length] == '=' && memcmp(variable, key, key_length) == 0) {
+      return variable + key_length + 1;
+    }
+
+    variable += variable_length + 1;
+  }
+
+  return NULL;
+}
+
+char const *utils_uevent_get_name(utils_uevent_t const *uevent) {
+  char const *name = strrchr(uevent->devpath, '/');
+
+  return name != NULL ? name + 1 : uevent->devpath;
+}
+
+utils_uevent_status_t utils_uevent_receive(int file_descriptor, char const *subsystem, char *buffer, usize size,
+                                           utils_uevent_t *uevent) {
+  while (true) {
+    struct sockaddr_nl sender = {0};
+    struct iovec vector = {.iov_base = buffer, .iov_len = size - 1};
+    struct msghdr message = {
+      .msg_name = &sender,
+      .msg_namelen = sizeof(sender),
+      .msg_iov = &vector,
+      .msg_iovlen = 1,
+    };
+
+    isize const length = recvmsg(file_descriptor, &message, MSG_DONTWAIT);
+
+    if (length == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return UTILS_UEVENT_NONE;
+      }
+
+      if (errno == ENOBUFS) {
+        return UTILS_UEVENT_OVERFLOW;
+      }
+
+      return errno == EINTR ? UTILS_UEVENT_NONE : UTILS_UEVENT_FAILED;
+    }
+
+    /* only the kernel (port 0) may send on netlink, injected sockets have no netlink sender */
+    if ((message.msg_flags & MSG_TRUNC) != 0 ||
+        (message.msg_namelen == sizeof(sender) && sender.nl_family == AF_NETLINK && sender.nl_pid != 0)) {
+      continue;
+    }
+
+    buffer[length] = '\0';
+
+    if (!utils_uevent_parse(buffer, (usize)length + 1, uevent)) {
+      continue;
+    }
+
+    if (subsystem == NULL || strcmp(uevent->subsystem, subsystem) == 0) {
+      return UTILS_UEVENT_RECEIVED;
+    }
+  }
+}
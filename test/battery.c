@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+
+#include "modules/battery.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "harness.h"
+#include "macros.h"
+#include "module.h"
+#include "test.h"
+#include "utils/time.h"
+
+/* runs battery module against fake sysfs tree with uevents injected through a socket pair, fails when a uevent of
+   battery or adapter isn't rendered, when uevents of other power supplies or subsystems make module reread battery,
+   when capacity drift isn't picked up by fallback timer or when removed battery isn't reopened after it's added
+   again */
+
+#define BATTERY "BAT0"
+#define ADAPTER "AC"
+#define OTHER_BATTERY "hidpp_battery_0" /* e.g wireless mouse, its uevents are skipped */
+#define DEVPATH_PREFIX "/devices/platform/fake/power_supply/"
+#define BATTERY_PATH "class/power_supply/" BATTERY
+#define ADAPTER_PATH "class/power_supply/" ADAPTER
+#define OTHER_BATTERY_PATH "class/power_supply/" OTHER_BATTERY
+#define CONFIG "format = \"%capacity% %status% %ac%\"\nbattery = \"" BATTERY "\"\ninterval = "
+#define UEVENTS_CONFIG CONFIG "\"1h\"" /* fallback timer doesn't reread battery while uevents are checked */
+#define DRIFT_CONFIG CONFIG "\"50ms\""
+
+static harness_attribute_t const attributes[] = {
+  {BATTERY_PATH, "type", "Battery"},
+  {BATTERY_PATH, "capacity", "80"},
+  {BATTERY_PATH, "status", "Discharging"},
+  {ADAPTER_PATH, "type", "Mains"},
+  {ADAPTER_PATH, "online", "0"},
+  {OTHER_BATTERY_PATH, "type", "Battery"},
+  {OTHER_BATTERY_PATH, "capacity", "5"},
+};
+
+/* adapter isn't configured, it's discovered by its type */
+static harness_fixture_options_t const uevents_options = {
+  .key = "battery",
+  .run = module_battery_run,
+  .config = UEVENTS_CONFIG,
+  .root_key = "sysfs_root",
+  .attributes = attributes,
+  .attributes_count = countof(attributes),
+  .initial_text = "80 discharging off",
+};
+
+static bool run_change(void const *context) {
+  harness_fixture_t *fixture = (harness_fixture_t *)context;
+
+  if (!harness_write_attribute(fixture->root, BATTERY_PATH, "capacity", "37") ||
+      !harness_send_uevent(&fixture->uevent_source, "change", DEVPATH_PREFIX BATTERY, "power_supply")) {
+    fprintf(stderr, "failed to inject uevent\n");
+    return false;
+  }
+
+  if (!harness_fixture_wait_for_text(fixture, "37 discharging off")) {
+    fprintf(stderr, "capacity wasn't rendered after uevent\n");
+    return false;
+  }
+
+  return true;
+}
+
+/* capacity written without uevent of battery stays unrendered until one comes */
+static bool run_other_devices(void const *context) {
+  harness_fixture_t *fixture = (harness_fixture_t *)context;
+  u64 const *updates = &fixture->module->metrics->updates;
+  u64 const updates_count = metrics_get(updates);
+
+  if (!harness_write_attribute(fixture->root, BATTERY_PATH, "capacity", "36") ||
+      !harness_send_uevent(&fixture->uevent_source, "change", DEVPATH_PREFIX OTHER_BATTERY, "power_supply") ||
+      !harness_send_uevent(&fixture->uevent_source, "change", DEVPATH_PREFIX BATTERY, "backlight")) {
+    fprintf(stderr, "failed to inject uevent\n");
+    return false;
+  }
+
+  /* module updates after it handled every uevent it woke up for */
+  u64 const start_time = utils_time_get_monotonic_nanoseconds();
+
+  while (metrics_get(updates) == updates_count || !harness_wait_for_uevents_received(&fixture->uevent_source)) {
+    if (utils_time_get_monotonic_nanoseconds() - start_time > HARNESS_RENDER_TIMEOUT) {
+      fprintf(stderr, "module didn't handle uevents of other devices\n");
+      return false;
+    }
+
+    sched_yield();
+  }
+
+  if (!harness_has_text(fixture->module, "37 discharging off")) {
+    fprintf(stderr, "battery was reread after uevent of other device\n");
+    return false;
+  }
+
+  if (!harness_send_uevent(&fixture->uevent_source, "change", DEVPATH_PREFIX BATTERY, "power_supply") ||
+      !harness_fixture_wait_for_text(fixture, "36 discharging off")) {
+    fprintf(stderr, "capacity wasn't rendered after uevent\n");
+    return false;
+  }
+
+  return true;
+}
+
+/* adapter plugged in, kernel sends uevents for adapter and battery */
+static bool run_plug(void const *context) {
+  harness_fixture_t *fixture = (harness_fixture_t *)context;
+
+  if (!harness_write_attribute(fixture->root, ADAPTER_PATH, "online", "1") ||
+      !harness_write_attribute(fixture->root, BATTERY_PATH, "capacity", "50") ||
+      !harness_write_attribute(fixture->root, BATTERY_PATH, "status", "Charging") ||
+      !harness_send_uevent(&fixture->uevent_source, "change", DEVPATH_PREFIX ADAPTER, "power_supply") ||
+      !harness_send_uevent(&fixture->uevent_source, "change", DEVPATH_PREFIX BATTERY, "power_supply")) {
+    fprintf(stderr, "failed to inject uevent\n");
+    return false;
+  }
+
+  if (!harness_fixture_wait_for_text(fixture, "50 charging on")) {
+    fprintf(stderr, "adapter plug wasn't rendered\n");
+    return false;
+  }
+
+  return true;
+}
+
+/* battery removed and added again, its attributes are reopened */
+static bool run_readd(void const *context) {
+  harness_fixture_t *fixture = (harness_fixture_t *)context;
+
+  if (!harness_send_uevent(&fixture->uevent_source, "remove", DEVPATH_PREFIX BATTERY, "power_supply")) {
+    fprintf(stderr, "failed to inject uevent\n");
+    return false;
+  }
+
+  if (!harness_fixture_wait_for_text(fixture, "- missing on")) {
+    fprintf(stderr, "battery removal wasn't rendered\n");
+    return false;
+  }
+
+  char path[HARNESS_MAX_PATH_LENGTH];
+  int const length = snprintf(path, sizeof(path), "%s/" BATTERY_PATH "/capacity", fixture->root);
+
+  /* new file, an fd kept open across removal would still read old one */
+  if (length < 0 || (usize)length >= sizeof(path) || unlink(path) != 0 ||
+      !harness_write_attribute(fixture->root, BATTERY_PATH, "capacity", "97") ||
+      !harness_write_attribute(fixture->root, BATTERY_PATH, "status", "Full") ||
+      !harness_send_uevent(&fixture->uevent_source, "add", DEVPATH_PREFIX BATTERY, "power_supply")) {
+    fprintf(stderr, "failed to inject uevent\n");
+    return false;
+  }
+
+  if (!harness_fixture_wait_for_text(fixture, "97 full on")) {
+    fprintf(stderr, "battery wasn't reopened after it was added\n");
+    return false;
+  }
+
+  return true;
+}
+
+/* capacity changes without uevent, picked up by fallback timer */
+static bool run_drift(void const *context) {
+  (void)context;
+
+  harness_fixture_options_t options = uevents_options;
+  options.config = DRIFT_CONFIG;
+
+  harness_fixture_t fixture;
+
+  if (!harness_fixture_construct(&fixture, &options)) {
+    return false;
+  }
+
+  bool const is_passed = harness_write_attribute(fixture.root, BATTERY_PATH, "capacity", "79") &&
+                         harness_fixture_wait_for_text(&fixture, "79 discharging off");
+
+  if (!is_passed) {
+    fprintf(stderr, "capacity drift wasn't rendered\n");
+  }
+
+  return harness_fixture_destruct(&fixture) && is_passed;
+}
+
+int main(void) {
+  harness_fixture_t fixture;
+
+  if (!harness_fixture_construct(&fixture, &uevents_options)) {
+    return EXIT_FAILURE;
+  }
+
+  test_run("battery/change", run_change, &fixture);
+  test_run("battery/other_devices", run_other_devices, &fixture);
+  test_run("battery/plug", run_plug, &fixture);
+  test_run("battery/readd", run_readd, &fixture);
+
+  if (!harness_fixture_destruct(&fixture)) {
+    fprintf(stderr, "battery module failed\n");
+    return EXIT_FAILURE;
+  }
+
+  test_run("battery/drift", run_drift, NULL);
+
+  return test_finish();
+}
@@ -0,0 +1,141 @@
+#define _GNU_SOURCE
+
+#include "modules/brightness.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "harness.h"
+#include "macros.h"
+#include "module.h"
+#include "test.h"
+#include "utils/time.h"
+
+/* runs brightness module against fake sysfs tree with uevents injected through a socket pair, fails when a uevent
+   of the card isn't rendered, when uevents of other devices or subsystems make module reread brightness, when
+   removed card isn't rendered as placeholder or when max_brightness isn't reread after the card is added again */
+
+#define CARD "fake_backlight"
+#define DEVPATH "/devices/platform/fake/backlight/" CARD
+#define DEVICE_PATH "class/backlight/" CARD
+
+static harness_attribute_t const attributes[] = {
+  {DEVICE_PATH, "max_brightness", "1000"},
+  {DEVICE_PATH, "brightness", "500"},
+  {DEVICE_PATH, "actual_brightness", "500"},
+};
+
+static harness_fixture_options_t const options = {
+  .key = "brightness",
+  .run = module_brightness_run,
+  .config = "format = \"%value%\"\ncard = \"" CARD "\"",
+  .root_key = "sysfs_root",
+  .attributes = attributes,
+  .attributes_count = countof(attributes),
+  .initial_text = "50",
+};
+
+static bool run_change(void const *context) {
+  harness_fixture_t const *fixture = context;
+
+  if (!harness_write_attribute(fixture->root, DEVICE_PATH, "actual_brightness", "370") ||
+      !harness_send_uevent(&fixture->uevent_source, "change", DEVPATH, "backlight")) {
+    fprintf(stderr, "failed to inject uevent\n");
+    return false;
+  }
+
+  if (!harness_fixture_wait_for_text(fixture, "37")) {
+    fprintf(stderr, "brightness wasn't rendered after uevent\n");
+    return false;
+  }
+
+  return true;
+}
+
+/* brightness written without uevent of the card stays unrendered until one comes */
+static bool run_other_devices(void const *context) {
+  harness_fixture_t const *fixture = context;
+  u64 const *updates = &fixture->module->metrics->updates;
+  u64 const updates_count = metrics_get(updates);
+
+  if (!harness_write_attribute(fixture->root, DEVICE_PATH, "actual_brightness", "820") ||
+      !harness_send_uevent(&fixture->uevent_source, "change", "/devices/platform/other/backlight/other", "backlight") ||
+      !harness_send_uevent(&fixture->uevent_source, "change", "/devices/platform/other/power_supply/" CARD,
+                           "power_supply")) {
+    fprintf(stderr, "failed to inject uevent\n");
+    return false;
+  }
+
+  /* module updates after it handled every uevent it woke up for */
+  u64 const start_time = utils_time_get_monotonic_nanoseconds();
+
+  while (metrics_get(updates) == updates_count || !harness_wait_for_uevents_received(&fixture->uevent_source)) {
+    if (utils_time_get_monotonic_nanoseconds() - start_time > HARNESS_RENDER_TIMEOUT) {
+      fprintf(stderr, "module didn't handle uevents of other devices\n");
+      return false;
+    }
+
+    sched_yield();
+  }
+
+  if (!harness_has_text(fixture->module, "37")) {
+    fprintf(stderr, "brightness was reread after uevent of other device\n");
+    return false;
+  }
+
+  if (!harness_send_uevent(&fixture->uevent_source, "change", DEVPATH, "backlight") ||
+      !harness_fixture_wait_for_text(fixture, "82")) {
+    fprintf(stderr, "brightness wasn't rendered after uevent\n");
+    return false;
+  }
+
+  return true;
+}
+
+/* device re-added with different max_brightness, which is read again */
+static bool run_readd(void const *context) {
+  harness_fixture_t const *fixture = context;
+
+  if (!harness_send_uevent(&fixture->uevent_source, "remove", DEVPATH, "backlight")) {
+    fprintf(stderr, "failed to inject uevent\n");
+    return false;
+  }
+
+  if (!harness_fixture_wait_for_text(fixture, "-")) {
+    fprintf(stderr, "removed device wasn't rendered as placeholder\n");
+    return false;
+  }
+
+  if (!harness_write_attribute(fixture->root, DEVICE_PATH, "max_brightness", "2000") ||
+      !harness_write_attribute(fixture->root, DEVICE_PATH, "actual_brightness", "500") ||
+      !harness_send_uevent(&fixture->uevent_source, "add", DEVPATH, "backlight")) {
+    fprintf(stderr, "failed to inject uevent\n");
+    return false;
+  }
+
+  if (!harness_fixture_wait_for_text(fixture, "25")) {
+    fprintf(stderr, "max_brightness wasn't reread after device was added\n");
+    return false;
+  }
+
+  return true;
+}
+
+int main(void) {
+  harness_fixture_t fixture;
+
+  if (!harness_fixture_construct(&fixture, &options)) {
+    return EXIT_FAILURE;
+  }
+
+  test_run("brightness/change", run_change, &fixture);
+  test_run("brightness/other_devices", run_other_devices, &fixture);
+  test_run("brightness/readd", run_readd, &fixture);
+
+  if (!harness_fixture_destruct(&fixture)) {
+    fprintf(stderr, "brightness module failed\n");
+    return EXIT_FAILURE;
+  }
+
+  return test_finish();
+}
@@ -0,0 +1,360 @@
+#define _GNU_SOURCE
+
+#include "modules/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "harness.h"
+#include "macros.h"
+#include "module.h"
+#include "status_line.h"
+#include "test.h"
+#include "toml.h"
+#include "utils/time.h"
+
+/* runs clock module against virtual clock over simulated hours, fails when it wakes up other than exactly once per
+   local interval boundary, wakes up off a boundary, misses re-render after clock step or renders text other than
+   current local time formatted with format of scenario */
+
+#define NANOSECONDS 1000000000UL
+#define HOUR 3600UL
+#define DEFAULT_FORMAT "%Y-%m-%d %H:%M:%S"
+#define START_OFFSET 300000000UL /* start 300 ms past a second, so first wait is shorter than interval */
+#define MAX_TEXT_LENGTH 256
+
+typedef struct scenario {
+  char const *name;
+  char const *timezone;
+  char const *format; /* null - DEFAULT_FORMAT */
+  char const *zones;  /* toml array of zones, null - local zone only, text of other zones isn't checked */
+  bool is_zone_free;  /* format renders the same in every zone, text of other zones is checked too */
+  u16 interval;       /* seconds */
+  u32 boundary;       /* expected seconds between wakeups, 0 - interval */
+  u64 start_time;     /* seconds since epoch */
+  u64 duration;       /* seconds */
+  u64 step_time;      /* seconds since start when clock is stepped, 0 - never */
+  i64 step_offset;    /* seconds */
+} scenario_t;
+
+typedef struct scenario_clock {
+  utils_time_clock_t clock; /* checks wakeup times and rendered text of wrapped virtual clock */
+  utils_time_virtual_clock_t virtual_clock;
+  module_t *module;
+  char const *format; /* null - text isn't checked */
+  u64 interval;       /* nanoseconds */
+  u64 max_deviation;  /* nanoseconds between wakeup and nearest local interval boundary */
+  u64 wait_count;
+  u64 clock_set_count;
+  u64 mismatches_count;
+  char mismatched_text[MAX_TEXT_LENGTH]; /* first text which didn't match */
+  char expected_text[MAX_TEXT_LENGTH];
+} scenario_clock_t;
+
+static u64 scenario_clock_get_realtime(utils_time_clock_t *clock) {
+  scenario_clock_t *scenario_clock = (scenario_clock_t *)clock;
+
+  return utils_time_clock_get_realtime(&scenario_clock->virtual_clock.clock);
+}
+
+static bool scenario_clock_timer_construct(utils_time_clock_t *clock, utils_time_timer_t *timer) {
+  scenario_clock_t *scenario_clock = (scenario_clock_t *)clock;
+
+  return utils_time_clock_timer_construct(&scenario_clock->virtual_clock.clock, timer);
+}
+
+static void scenario_clock_timer_destruct(utils_time_clock_t *clock, utils_time_timer_t *timer) {
+  scenario_clock_t *scenario_clock = (scenario_clock_t *)clock;
+
+  utils_time_clock_timer_destruct(&scenario_clock->virtual_clock.clock, timer);
+}
+
+static void measure_deviation(scenario_clock_t *scenario_clock, u64 realtime, struct tm const *local_time) {
+  u64 const local_seconds = (u64)local_time->tm_hour * HOUR + (u64)local_time->tm_min * 60 + (u64)local_time->tm_sec;
+  u64 const offset = local_seconds * NANOSECONDS % scenario_clock->interval + realtime % NANOSECONDS;
+  u64 const deviation = offset < scenario_clock->interval - offset ? offset : scenario_clock->interval - offset;
+
+  if (deviation > scenario_clock->max_deviation) {
+    scenario_clock->max_deviation = deviation;
+  }
+}
+
+/* module rendered current time before it waits again */
+static void check_text(scenario_clock_t *scenario_clock, struct tm const *local_time) {
+  char expected_text[MAX_TEXT_LENGTH];
+
+  if (scenario_clock->format == NULL ||
+      strftime(expected_text, sizeof(expected_text), scenario_clock->format, local_time) == 0 ||
+      harness_has_text(scenario_clock->module, expected_text)) {
+    return;
+  }
+
+  if (scenario_clock->mismatches_count++ == 0) {
+    pthread_mutex_lock(&scenario_clock->module->lock);
+    snprintf(scenario_clock->mismatched_text, sizeof(scenario_clock->mismatched_text), "%s",
+             scenario_clock->module->buffer != NULL ? scenario_clock->module->buffer : "");
+    pthread_mutex_unlock(&scenario_clock->module->lock);
+    memcpy(scenario_clock->expected_text, expected_text, sizeof(expected_text));
+  }
+}
+
+static utils_time_wait_status_t scenario_clock_wait_until(utils_time_clock_t *clock, utils_time_timer_t *timer,
+                                                          int file_descriptor, u64 deadline) {
+  scenario_clock_t *scenario_clock = (scenario_clock_t *)clock;
+  u64 realtime = utils_time_clock_get_realtime(&scenario_clock->virtual_clock.clock);
+  time_t timer_seconds = (time_t)(realtime / NANOSECONDS);
+  struct tm local_time;
+
+  if (localtime_r(&timer_seconds, &local_time) == NULL) {
+    return UTILS_TIME_WAIT_FAILED;
+  }
+
+  check_text(scenario_clock, &local_time);
+
+  utils_time_wait_status_t status =
+    utils_time_clock_wait_until(&scenario_clock->virtual_clock.clock, timer, file_descriptor, deadline);
+
+  if (status == UTILS_TIME_WAIT_CLOCK_SET) {
+    scenario_clock->clock_set_count += 1;
+  }
+
+  if (status != UTILS_TIME_WAIT_EXPIRED) {
+    return status;
+  }
+
+  realtime = utils_time_clock_get_realtime(&scenario_clock->virtual_clock.clock);
+  timer_seconds = (time_t)(realtime / NANOSECONDS);
+
+  if (localtime_r(&timer_seconds, &local_time) == NULL) {
+    return UTILS_TIME_WAIT_FAILED;
+  }
+
+  scenario_clock->wait_count += 1;
+  measure_deviation(scenario_clock, realtime, &local_time);
+
+  return status;
+}
+
+/* local interval boundaries strictly inside [start, end), the wait for the last one ends on abort at end time */
+static u64 count_boundaries(u64 start_time, u64 end_time, u64 interval) {
+  time_t const timer = (time_t)(start_time / NANOSECONDS);
+  struct tm local_time;
+
+  u64 const offset = localtime_r(&timer, &local_time) != NULL ? (u64)local_time.tm_gmtoff * NANOSECONDS : 0;
+
+  return (end_time + offset - 1) / interval - (start_time + offset) / interval;
+}
+
+static bool run_scenario(void const *context) {
+  scenario_t const *scenario = context;
+  bool status = false;
+
+  setenv("TZ", scenario->timezone, 1);
+  tzset();
+
+  char const *format = scenario->format != NULL ? scenario->format : DEFAULT_FORMAT;
+  char config_string[256];
+  snprintf(config_string, sizeof(config_string), "format = \"%s\"\ninterval = %u\nzones = [%s]\nseparator = \" | \"\n",
+           format, scenario->interval, scenario->zones != NULL ? scenario->zones : "");
+
+  toml_table_t *config = toml_parse(config_string, NULL, 0);
+
+  if (config == NULL) {
+    fprintf(stderr, "%s: failed to parse config\n", scenario->name);
+    return false;
+  }
+
+  status_line_t status_line = {0};
+
+  if (!status_line_construct(&status_line, 1, STATUS_LINE_OUTPUT_NULL)) {
+    goto free_config;
+  }
+
+  u64 const interval = (scenario->boundary != 0 ? scenario->boundary : scenario->interval) * NANOSECONDS;
+  module_t *module = &status_line.modules[0];
+
+  scenario_clock_t clock = {
+    .clock =
+      {
+        .get_realtime = scenario_clock_get_realtime,
+        .timer_construct = scenario_clock_timer_construct,
+        .timer_destruct = scenario_clock_timer_destruct,
+        .wait_until = scenario_clock_wait_until,
+      },
+    .module = module,
+    .format = scenario->zones == NULL || scenario->is_zone_free ? format : NULL,
+    .interval = interval,
+  };
+
+  u64 const start_time = scenario->start_time * NANOSECONDS + START_OFFSET;
+  u64 const end_time = start_time + scenario->duration * NANOSECONDS;
+  u64 expected_waits = count_boundaries(start_time, end_time, interval);
+
+  utils_time_virtual_clock_construct(&clock.virtual_clock, start_time, end_time);
+
+  if (scenario->step_time != 0) {
+    u64 const step_time = start_time + scenario->step_time * NANOSECONDS;
+    i64 const step_offset = scenario->step_offset * (i64)NANOSECONDS;
+
+    utils_time_virtual_clock_step(&clock.virtual_clock, step_time, step_offset);
+    expected_waits = count_boundaries(start_time, step_time, interval) +
+                     count_boundaries((u64)((i64)step_time + step_offset), (u64)((i64)end_time + step_offset),
+                                      interval);
+  }
+
+  status_line.clock = &clock.clock;
+
+  if (!module_construct(module, &status_line, "clock", config)) {
+    goto free_status_line;
+  }
+
+  if (module_clock_run(module) != EXIT_SUCCESS) {
+    fprintf(stderr, "%s: clock module failed\n", scenario->name);
+    goto free_status_line;
+  }
+
+  /* every wakeup formats time, renders skip unchanged text (e.g repeated hour at daylight saving time end) */
+  u64 const updates = metrics_get(&status_line.metrics.modules[0].updates);
+  u64 const expected_updates = 1 + clock.wait_count + clock.clock_set_count;
+
+  if (clock.wait_count != expected_waits) {
+    fprintf(stderr, "%s: %lu wakeups, expected %lu\n", scenario->name, (unsigned long)clock.wait_count,
+            (unsigned long)expected_waits);
+    goto free_status_line;
+  }
+
+  if (clock.max_deviation != 0) {
+    fprintf(stderr, "%s: woke up %.3f s off local interval boundary\n", scenario->name,
+            (double)clock.max_deviation / 1e9);
+    goto free_status_line;
+  }
+
+  if (scenario->step_time != 0 && clock.clock_set_count != 1) {
+    fprintf(stderr, "%s: clock step was not noticed\n", scenario->name);
+    goto free_status_line;
+  }
+
+  if (updates != expected_updates) {
+    fprintf(stderr, "%s: %lu updates, expected %lu\n", scenario->name, (unsigned long)updates,
+            (unsigned long)expected_updates);
+    goto free_status_line;
+  }
+
+  if (clock.mismatches_count != 0) {
+    fprintf(stderr, "%s: %lu renders of other than current time, first \"%s\", expected \"%s\"\n", scenario->name,
+            (unsigned long)clock.mismatches_count, clock.mismatched_text, clock.expected_text);
+    goto free_status_line;
+  }
+
+  status = true;
+
+free_status_line:
+  status_line_destruct(&status_line);
+
+free_config:
+  toml_free(config);
+
+  return status;
+}
+
+int main(void) {
+  static scenario_t const scenarios[] = {
+    /* 2026-01-01 00:00:00 UTC */
+    {.name = "clock/1s/utc/1h", .timezone = "UTC", .interval = 1, .start_time = 1767225600, .duration = HOUR},
+    /* 2026-03-28 00:00:00 UTC, daylight saving time starts 2026-03-29 01:00 UTC */
+    {.name = "clock/60s/berlin_dst_start/48h",
+     .timezone = "Europe/Berlin",
+     .interval = 60,
+     .start_time = 1774656000,
+     .duration = 48 * HOUR},
+    /* 2026-10-24 00:00:00 UTC, daylight saving time ends 2026-10-25 01:00 UTC */
+    {.name = "clock/3600s/berlin_dst_end/48h",
+     .timezone = "Europe/Berlin",
+     .interval = 3600,
+     .start_time = 1792800000,
+     .duration = 48 * HOUR},
+    /* UTC+05:30, hourly boundaries in local time are half past UTC hour */
+    {.name = "clock/3600s/kolkata/24h",
+     .timezone = "Asia/Kolkata",
+     .interval = 3600,
+     .start_time = 1767225600,
+     .duration = 24 * HOUR},
+    /* format decides wakeups, interval of a second is raised to a minute and a day */
+    {.name = "clock/1s/minutes_format/utc/1h",
+     .timezone = "UTC",
+     .format = "%a %d %b %H:%M",
+     .interval = 1,
+     .boundary = 60,
+     .start_time = 1767225600,
+     .duration = HOUR},
+    {.name = "clock/1s/date_format/kolkata/7d",
+     .timezone = "Asia/Kolkata",
+     .format = "%A %d %B",
+     .interval = 1,
+     .boundary = 24 * HOUR,
+     .start_time = 1767225600,
+     .duration = 7 * 24 * HOUR},
+    /* day boundaries follow utc offset of the coming midnight, not the current one */
+    {.name = "clock/1s/date_format/berlin_dst_start/72h",
+     .timezone = "Europe/Berlin",
+     .format = "%a %Y-%m-%d",
+     .interval = 1,
+     .boundary = 24 * HOUR,
+     .start_time = 1774656000,
+     .duration = 72 * HOUR},
+    {.name = "clock/1s/date_format/berlin_dst_end/72h",
+     .timezone = "Europe/Berlin",
+     .format = "%a %Y-%m-%d",
+     .interval = 1,
+     .boundary = 24 * HOUR,
+     .start_time = 1792800000,
+     .duration = 72 * HOUR},
+    /* hour from 02:00 to 03:00 doesn't exist, hourly boundary falls on transition */
+    {.name = "clock/3600s/berlin_dst_start/48h",
+     .timezone = "Europe/Berlin",
+     .interval = 3600,
+     .start_time = 1774656000,
+     .duration = 48 * HOUR},
+    /* seconds since epoch don't depend on zone, neither on time zone of process */
+    {.name = "clock/1s/epoch_format/new_york_in_berlin/1h",
+     .timezone = "Europe/Berlin",
+     .format = "%s",
+     .zones = "\"America/New_York\"",
+     .is_zone_free = true,
+     .interval = 1,
+     .start_time = 1767225600,
+     .duration = HOUR},
+    /* one shared timer for all zones, hourly boundaries of UTC and half-hour offset zones interleave */
+    {.name = "clock/3600s/3_zones/24h",
+     .timezone = "UTC",
+     .format = "%H %Z",
+     .zones = "\"UTC\", \"Asia/Kolkata\", \"America/St_Johns\"",
+     .interval = 3600,
+     .boundary = 1800,
+     .start_time = 1767225600,
+     .duration = 24 * HOUR},
+    /* wall clock set back by an hour half an hour in, e.g by NTP step or settimeofday */
+    {.name = "clock/60s/utc/step_back/2h",
+     .timezone = "UTC",
+     .interval = 60,
+     .start_time = 1767225600,
+     .duration = 2 * HOUR,
+     .step_time = HOUR / 2,
+     .step_offset = -(i64)HOUR},
+    {.name = "clock/60s/utc/step_forward/2h",
+     .timezone = "UTC",
+     .interval = 60,
+     .start_time = 1767225600,
+     .duration = 2 * HOUR,
+     .step_time = HOUR / 2,
+     .step_offset = (i64)HOUR},
+  };
+
+  for (usize scenario_index = 0; scenario_index < countof(scenarios); scenario_index++) {
+    test_run(scenarios[scenario_index].name, run_scenario, &scenarios[scenario_index]);
+  }
+
+  return test_finish();
+}
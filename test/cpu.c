@@ -0,0 +1,156 @@
+#include "modules/cpu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "harness.h"
+#include "macros.h"
+#include "module.h"
+#include "status_line.h"
+#include "test.h"
+#include "toml.h"
+#include "utils/time.h"
+
+/* runs cpu module against fake /proc/stat whose "cpuN" lines don't fit initial stat buffer, which holds a line per
+   configured core. Buffer is cut right after a line or inside the first letters of the next one, fails when heat
+   string doesn't have one character per core line, i.e when module missed that stat was truncated */
+
+#define LINE_SIZE 128 /* initial stat buffer per line of src/modules/cpu.c */
+#define MAX_LINE_LENGTH 64
+#define CORE_COUNTERS " 0 0 0 0 0 0 0 0\n"
+#define AGGREGATE_LINE_START "cpu  0 0 0 0 0 0 0 0"
+
+typedef struct scenario {
+  char const *name;
+  char const *cut; /* start of next line left in full buffer */
+} scenario_t;
+
+/* writes "cpu" line padded with spaces after its counters so core lines before cut fill buffer of size up to its last
+   byte, returns count of core lines */
+static usize write_stat(char const *path, usize buffer_size, char const *cut) {
+  usize const cores_count = buffer_size / 16; /* core lines are over 16 bytes, all of them don't fit */
+  usize const cut_offset = buffer_size - 1 - strlen(cut);
+  usize lines_length = strlen(AGGREGATE_LINE_START "\n");
+  char line[MAX_LINE_LENGTH];
+
+  /* cores before cut fit next to shortest "cpu" line */
+  for (usize core_index = 0; core_index < cores_count; core_index++) {
+    usize const line_length = (usize)snprintf(line, sizeof(line), "cpu%lu" CORE_COUNTERS, (unsigned long)core_index);
+
+    if (lines_length + line_length > cut_offset) {
+      break;
+    }
+
+    lines_length += line_length;
+  }
+
+  FILE *file = fopen(path, "w");
+
+  if (file == NULL) {
+    return 0;
+  }
+
+  fprintf(file, AGGREGATE_LINE_START "%*s\n", (int)(cut_offset - lines_length), "");
+
+  for (usize core_index = 0; core_index < cores_count; core_index++) {
+    fprintf(file, "cpu%lu" CORE_COUNTERS, (unsigned long)core_index);
+  }
+
+  fputs("intr 123456 0 0 0\nctxt 654321\n", file);
+
+  return fclose(file) == 0 ? cores_count : 0;
+}
+
+static bool run_scenario(void const *context) {
+  scenario_t const *scenario = context;
+  bool status = false;
+  char root[] = "/tmp/status_line_cpu_XXXXXX";
+
+  if (mkdtemp(root) == NULL) {
+    fprintf(stderr, "%s: failed to create fake procfs\n", scenario->name);
+    return false;
+  }
+
+  char stat_path[sizeof(root) + sizeof("/stat")];
+  snprintf(stat_path, sizeof(stat_path), "%s/stat", root);
+
+  long const configured_cores_count = sysconf(_SC_NPROCESSORS_CONF);
+  usize const buffer_size = ((configured_cores_count > 0 ? (usize)configured_cores_count : 1) + 1) * LINE_SIZE;
+  usize const cores_count = write_stat(stat_path, buffer_size, scenario->cut);
+  char *expected_text = malloc(cores_count + 1);
+
+  if (cores_count == 0 || expected_text == NULL) {
+    fprintf(stderr, "%s: failed to write fake stat\n", scenario->name);
+    goto free_expected_text;
+  }
+
+  /* counters never advance, every core is idle */
+  memset(expected_text, '_', cores_count);
+  expected_text[cores_count] = '\0';
+
+  char config_string[256];
+  snprintf(config_string, sizeof(config_string), "format = \"%%heat%%\"\ninterval = \"10ms\"\nprocfs_root = \"%s\"\n",
+           root);
+
+  toml_table_t *config = toml_parse(config_string, NULL, 0);
+
+  if (config == NULL) {
+    fprintf(stderr, "%s: failed to parse config\n", scenario->name);
+    goto free_expected_text;
+  }
+
+  status_line_t status_line = {0};
+
+  if (!status_line_construct(&status_line, 1, STATUS_LINE_OUTPUT_NULL)) {
+    goto free_config;
+  }
+
+  module_t *module = &status_line.modules[0];
+  harness_module_thread_t module_thread;
+
+  if (!module_construct(module, &status_line, "cpu", config) ||
+      !harness_module_thread_start(&module_thread, module, module_cpu_run)) {
+    goto free_status_line;
+  }
+
+  bool const is_rendered =
+    harness_wait_for_text(module, expected_text, utils_time_get_monotonic_nanoseconds()) != 0;
+
+  if (harness_module_thread_stop(&module_thread) != EXIT_SUCCESS) {
+    fprintf(stderr, "%s: cpu module failed\n", scenario->name);
+  } else if (!is_rendered) {
+    fprintf(stderr, "%s: heat string of %lu cores wasn't rendered\n", scenario->name, (unsigned long)cores_count);
+  } else {
+    status = true;
+  }
+
+free_status_line:
+  status_line_destruct(&status_line);
+
+free_config:
+  toml_free(config);
+
+free_expected_text:
+  free(expected_text);
+  unlink(stat_path);
+  rmdir(root);
+
+  return status;
+}
+
+int main(void) {
+  static scenario_t const scenarios[] = {
+    {.name = "cpu/stat_cut/after_line", .cut = ""},
+    {.name = "cpu/stat_cut/c", .cut = "c"},
+    {.name = "cpu/stat_cut/cp", .cut = "cp"},
+    {.name = "cpu/stat_cut/cpu", .cut = "cpu"},
+  };
+
+  for (usize scenario_index = 0; scenario_index < countof(scenarios); scenario_index++) {
+    test_run(scenarios[scenario_index].name, run_scenario, &scenarios[scenario_index]);
+  }
+
+  return test_finish();
+}
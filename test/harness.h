@@ -0,0 +1,327 @@
+#pragma once
+
+/* drives a module the way status line does, included by benchmarks and tests: module runs on its own thread until
+   abort file descriptor is written, its text is polled, uevents are injected through a socket pair instead of
+   kernel socket and fake sysfs or procfs trees are written under a temporary root. harness_fixture_t does all of it
+   for a module, leaving only scenarios to tests and benchmarks */
+
+#include <errno.h>
+#include <ftw.h>
+#include <linux/sockios.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "module.h"
+#include "status_line.h"
+#include "toml.h"
+#include "typedefs.h"
+#include "utils/time.h"
+#include "utils/uevent.h"
+
+#define HARNESS_RENDER_TIMEOUT 1000000000UL /* nanoseconds */
+#define HARNESS_MAX_PATH_LENGTH 512
+#define HARNESS_MAX_CONFIG_LENGTH 1024
+#define HARNESS_ROOT_TEMPLATE "/tmp/status_line_tree.XXXXXX"
+
+typedef int (*harness_run_t)(module_t *module);
+
+typedef struct harness_module_thread {
+  pthread_t thread;
+  module_t *module;
+  harness_run_t run;
+  int status;
+} harness_module_thread_t;
+
+/* hands module one end of a datagram socket pair, uevents are sent to the other end */
+typedef struct harness_uevent_source {
+  utils_uevent_source_t source;
+  int file_descriptors[2]; /* module end, injecting end */
+} harness_uevent_source_t;
+
+/* file of fake tree, value is written with newline to <root>/<directory>/<name> */
+typedef struct harness_attribute {
+  char const *directory;
+  char const *name;
+  char const *value;
+} harness_attribute_t;
+
+typedef struct harness_fixture_options {
+  char const *key; /* module key, e.g "battery" */
+  harness_run_t run;
+  char const *config;   /* module config, "<root_key> = <root>" is appended */
+  char const *root_key; /* e.g "sysfs_root" */
+  harness_attribute_t const *attributes;
+  usize attributes_count;
+  char const *initial_text; /* rendered once module read fake tree */
+} harness_fixture_options_t;
+
+/* module running on its own thread against its own fake tree, fed by injected uevents */
+typedef struct harness_fixture {
+  char root[sizeof(HARNESS_ROOT_TEMPLATE)];
+  toml_table_t *config;
+  harness_uevent_source_t uevent_source;
+  status_line_t status_line;
+  harness_module_thread_t module_thread;
+  module_t *module;
+} harness_fixture_t;
+
+static inline bool harness_has_text(module_t *module, char const *text) {
+  pthread_mutex_lock(&module->lock);
+  bool const is_equal = module->buffer != NULL && strcmp(module->buffer, text) == 0;
+  pthread_mutex_unlock(&module->lock);
+
+  return is_equal;
+}
+
+/* returns nanoseconds since start time until module renders text, 0 on timeout */
+static inline u64 harness_wait_for_text(module_t *module, char const *text, u64 start_time) {
+  while (!harness_has_text(module, text)) {
+    if (utils_time_get_monotonic_nanoseconds() - start_time > HARNESS_RENDER_TIMEOUT) {
+      return 0;
+    }
+
+    sched_yield();
+  }
+
+  return utils_time_get_monotonic_nanoseconds() - start_time;
+}
+
+static inline void *harness_module_thread_main(void *param) {
+  harness_module_thread_t *module_thread = param;
+  module_thread->status = module_thread->run(module_thread->module);
+
+  return NULL;
+}
+
+static inline bool harness_module_thread_start(harness_module_thread_t *module_thread, module_t *module,
+                                               harness_run_t run) {
+  *module_thread = (harness_module_thread_t){.module = module, .run = run, .status = EXIT_FAILURE};
+
+  return pthread_create(&module_thread->thread, NULL, harness_module_thread_main, module_thread) == 0;
+}
+
+/* aborts module like status line does on exit, returns exit status of module */
+static inline int harness_module_thread_stop(harness_module_thread_t *module_thread) {
+  u64 const abort = 1;
+
+  if (write(module_thread->module->status_line->abort_file_descriptor, &abort, sizeof(abort)) != sizeof(abort)) {
+    fprintf(stderr, "failed to abort module: %s\n", strerror(errno));
+  }
+
+  pthread_join(module_thread->thread, NULL);
+
+  return module_thread->status;
+}
+
+static inline int harness_uevent_source_open(utils_uevent_source_t *source) {
+  harness_uevent_source_t *uevent_source = (harness_uevent_source_t *)source;
+  int const file_descriptor = uevent_source->file_descriptors[0];
+
+  /* module owns and closes its end */
+  uevent_source->file_descriptors[0] = -1;
+
+  return file_descriptor;
+}
+
+static inline bool harness_uevent_source_construct(harness_uevent_source_t *uevent_source) {
+  *uevent_source =
+    (harness_uevent_source_t){.source = {.open = harness_uevent_source_open}, .file_descriptors = {-1, -1}};
+
+  return socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, uevent_source->file_descriptors) == 0;
+}
+
+static inline void harness_uevent_source_destruct(harness_uevent_source_t *uevent_source) {
+  for (usize end_index = 0; end_index < 2; end_index++) {
+    if (uevent_source->file_descriptors[end_index] != -1) {
+      close(uevent_source->file_descriptors[end_index]);
+    }
+  }
+}
+
+/* sends uevent in kernel wire format, "<action>@<devpath>" header followed by properties */
+static inline bool harness_send_uevent(harness_uevent_source_t const *uevent_source, char const *action,
+                                       char const *devpath, char const *subsystem) {
+  char message[HARNESS_MAX_PATH_LENGTH * 2 + 128];
+  int const length = snprintf(message, sizeof(message), "%s@%s%cACTION=%s%cDEVPATH=%s%cSUBSYSTEM=%s%cSEQNUM=1",
+                              action, devpath, '\0', action, '\0', devpath, '\0', subsystem, '\0');
+
+  if (length < 0 || (usize)length >= sizeof(message)) {
+    return false;
+  }
+
+  return send(uevent_source->file_descriptors[1], message, (usize)length + 1, 0) == length + 1;
+}
+
+/* returns true once module received every injected uevent, a datagram is charged to injecting end until it's read */
+static inline bool harness_wait_for_uevents_received(harness_uevent_source_t const *uevent_source) {
+  u64 const start_time = utils_time_get_monotonic_nanoseconds();
+  int pending_size = 0;
+
+  while (ioctl(uevent_source->file_descriptors[1], SIOCOUTQ, &pending_size) == 0 && pending_size != 0) {
+    if (utils_time_get_monotonic_nanoseconds() - start_time > HARNESS_RENDER_TIMEOUT) {
+      return false;
+    }
+
+    sched_yield();
+  }
+
+  return pending_size == 0;
+}
+
+/* writes text to path relative to root, creating missing directories */
+static inline bool harness_write_file(char const *root, char const *path, char const *text) {
+  char full_path[HARNESS_MAX_PATH_LENGTH];
+  int const length = snprintf(full_path, sizeof(full_path), "%s/%s", root, path);
+
+  if (length < 0 || (usize)length >= sizeof(full_path)) {
+    return false;
+  }
+
+  for (char *separator = strchr(full_path + strlen(root) + 1, '/'); separator != NULL;
+       separator = strchr(separator + 1, '/')) {
+    *separator = '\0';
+
+    int const status = mkdir(full_path, 0755);
+    *separator = '/';
+
+    if (status != 0 && errno != EEXIST) {
+      return false;
+    }
+  }
+
+  FILE *file = fopen(full_path, "w");
+
+  if (file == NULL) {
+    return false;
+  }
+
+  fputs(text, file);
+
+  return fclose(file) == 0;
+}
+
+static inline int harness_remove_entry(char const *path, struct stat const *entry_stat, int type,
+                                       struct FTW *entry_ftw) {
+  (void)entry_stat;
+  (void)type;
+  (void)entry_ftw;
+
+  return remove(path);
+}
+
+/* removes root and everything written under it */
+static inline bool harness_remove_tree(char const *root) {
+  return nftw(root, harness_remove_entry, 16, FTW_DEPTH | FTW_PHYS) == 0;
+}
+
+static inline bool harness_write_attribute(char const *root, char const *directory, char const *name,
+                                           char const *value) {
+  char path[HARNESS_MAX_PATH_LENGTH];
+  char text[HARNESS_MAX_PATH_LENGTH];
+  int const path_length = snprintf(path, sizeof(path), "%s/%s", directory, name);
+  int const text_length = snprintf(text, sizeof(text), "%s\n", value);
+
+  if (path_length < 0 || (usize)path_length >= sizeof(path) || text_length < 0 || (usize)text_length >= sizeof(text)) {
+    return false;
+  }
+
+  return harness_write_file(root, path, text);
+}
+
+/* writes fake tree under a fresh root, starts module on its thread and waits for its initial text */
+static inline bool harness_fixture_construct(harness_fixture_t *fixture, harness_fixture_options_t const *options) {
+  *fixture = (harness_fixture_t){.root = HARNESS_ROOT_TEMPLATE};
+
+  if (mkdtemp(fixture->root) == NULL) {
+    fprintf(stderr, "failed to create fake tree\n");
+    return false;
+  }
+
+  for (usize attribute_index = 0; attribute_index < options->attributes_count; attribute_index++) {
+    harness_attribute_t const *attribute = &options->attributes[attribute_index];
+
+    if (!harness_write_attribute(fixture->root, attribute->directory, attribute->name, attribute->value)) {
+      fprintf(stderr, "failed to create fake tree\n");
+      goto remove_tree;
+    }
+  }
+
+  char config_string[HARNESS_MAX_CONFIG_LENGTH];
+  int const config_length = snprintf(config_string, sizeof(config_string), "%s\n%s = \"%s\"\n", options->config,
+                                     options->root_key, fixture->root);
+
+  if (config_length < 0 || (usize)config_length >= sizeof(config_string)) {
+    fprintf(stderr, "config is too long\n");
+    goto remove_tree;
+  }
+
+  fixture->config = toml_parse(config_string, NULL, 0);
+
+  if (fixture->config == NULL) {
+    fprintf(stderr, "failed to parse config\n");
+    goto remove_tree;
+  }
+
+  if (!harness_uevent_source_construct(&fixture->uevent_source)) {
+    fprintf(stderr, "failed to create socket pair\n");
+    goto free_config;
+  }
+
+  if (!status_line_construct(&fixture->status_line, 1, STATUS_LINE_OUTPUT_NULL)) {
+    goto destruct_uevent_source;
+  }
+
+  fixture->status_line.uevent_source = &fixture->uevent_source.source;
+  fixture->module = &fixture->status_line.modules[0];
+
+  if (!module_construct(fixture->module, &fixture->status_line, options->key, fixture->config) ||
+      !harness_module_thread_start(&fixture->module_thread, fixture->module, options->run)) {
+    goto free_status_line;
+  }
+
+  if (harness_wait_for_text(fixture->module, options->initial_text, utils_time_get_monotonic_nanoseconds()) == 0) {
+    fprintf(stderr, "initial text \"%s\" wasn't rendered\n", options->initial_text);
+    harness_module_thread_stop(&fixture->module_thread);
+    goto free_status_line;
+  }
+
+  return true;
+
+free_status_line:
+  status_line_destruct(&fixture->status_line);
+
+destruct_uevent_source:
+  harness_uevent_source_destruct(&fixture->uevent_source);
+
+free_config:
+  toml_free(fixture->config);
+
+remove_tree:
+  harness_remove_tree(fixture->root);
+
+  return false;
+}
+
+/* stops module and removes its tree, returns false if module failed */
+static inline bool harness_fixture_destruct(harness_fixture_t *fixture) {
+  bool const is_stopped = harness_module_thread_stop(&fixture->module_thread) == EXIT_SUCCESS;
+
+  status_line_destruct(&fixture->status_line);
+  harness_uevent_source_destruct(&fixture->uevent_source);
+  toml_free(fixture->config);
+  harness_remove_tree(fixture->root);
+
+  return is_stopped;
+}
+
+/* waits for module to render text, starting now */
+static inline bool harness_fixture_wait_for_text(harness_fixture_t const *fixture, char const *text) {
+  return harness_wait_for_text(fixture->module, text, utils_time_get_monotonic_nanoseconds()) != 0;
+}
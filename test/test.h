@@ -0,0 +1,29 @@
+#pragma once
+
+/* test harness, included once by every test executable: test_run runs a test case and reports it as ok or FAIL,
+   failing case prints why to stderr, test_finish returns exit status of executable */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "typedefs.h"
+
+typedef bool (*test_function_t)(void const *context);
+
+static usize test_failures_count = 0;
+
+static inline void test_run(char const *name, test_function_t function, void const *context) {
+  bool const is_passed = function(context);
+
+  if (!is_passed) {
+    test_failures_count += 1;
+  }
+
+  printf("%-4s %s\n", is_passed ? "ok" : "FAIL", name);
+  fflush(stdout);
+}
+
+static inline int test_finish(void) {
+  return test_failures_count == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}